@@ -0,0 +1,514 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tim_defs.h"
+
+static R8G8B8A8 TIMPixToRGBA8(const TIM_PIX* psPix)
+{
+	R8G8B8A8 sPix = {
+		.uRed = CONV_U5_TO_U8(psPix->r),
+		.uGreen = CONV_U5_TO_U8(psPix->g),
+		.uBlue = CONV_U5_TO_U8(psPix->b),
+		.uAlpha = ((psPix->stp == 0x1) ? 0xff : 0x00)
+	};
+
+	return sPix;
+}
+
+uint32_t GetTIMPixelWidth(const TIM_FILE* psFile)
+{
+	uint32_t ui32Width = psFile->sPixelHeader.ui16Width;
+
+	switch (psFile->sFileHeader.sFlags.uMode)
+	{
+		case TIM_PIX_FMT_4BIT_CLUT:
+		{
+			ui32Width *= 4;
+			break;
+
+		}
+		case TIM_PIX_FMT_8BIT_CLUT:
+		{
+			ui32Width *= 2;
+			break;
+		}
+		default: break;
+	}
+
+	return ui32Width;
+}
+
+int ValidateTIM(const TIM_FILE* psFile)
+{
+	const uint32_t ui32PixelDataInBytes = (
+		psFile->sPixelHeader.ui16Width * psFile->sPixelHeader.ui16Height * sizeof(uint16_t)
+	);
+
+	if (!TIM_PIX_FMT_HAS_CLUT(psFile->sFileHeader.sFlags.uMode) ||
+		!psFile->sFileHeader.sFlags.uClut)
+	{
+		printf("15/24 bit direct colour formats unsupported\n");
+		return 1;
+	}
+
+	if ((psFile->sCLUTHeader.ui16Width == 0) ||
+		(psFile->sCLUTHeader.ui16Height == 0) ||
+		((psFile->sCLUTHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER)) <
+			(psFile->sCLUTHeader.ui16Width * psFile->sCLUTHeader.ui16Height * sizeof(TIM_PIX))))
+	{
+		printf("CLUT block is smaller than its dimensions\n");
+		return 1;
+	}
+
+	if ((psFile->sPixelHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER)) < ui32PixelDataInBytes)
+	{
+		printf("Pixel block is smaller than its dimensions\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+	The 4bpp decoders look up 16 pixels at a time. The palette is split into
+	a plane per channel, so one byte shuffle per channel finds that channel
+	for all 16 pixels, which are then interleaved back into RGBA
+*/
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define DECODE_4BIT_SSSE3
+
+__attribute__((target("ssse3")))
+static uint32_t Decode4BitPixelsSSSE3(
+	const uint8_t* pui8Src,
+	const R8G8B8A8* psTable,
+	const uint32_t ui32NumPixels,
+	R8G8B8A8* psDst)
+{
+	uint8_t aui8Planes[4][16];
+	uint32_t i = 0;
+
+	for (uint32_t j = 0; j < 16; ++j)
+	{
+		aui8Planes[0][j] = psTable[j].uRed;
+		aui8Planes[1][j] = psTable[j].uGreen;
+		aui8Planes[2][j] = psTable[j].uBlue;
+		aui8Planes[3][j] = psTable[j].uAlpha;
+	}
+
+	{
+		const __m128i sRed = _mm_loadu_si128((const __m128i*)aui8Planes[0]);
+		const __m128i sGreen = _mm_loadu_si128((const __m128i*)aui8Planes[1]);
+		const __m128i sBlue = _mm_loadu_si128((const __m128i*)aui8Planes[2]);
+		const __m128i sAlpha = _mm_loadu_si128((const __m128i*)aui8Planes[3]);
+		const __m128i sLowNibbles = _mm_set1_epi8(0x0F);
+
+		for (; (i + 16) <= ui32NumPixels; i += 16)
+		{
+			// The left pixel of each pair is in the low nibble
+			const __m128i sPacked = _mm_loadl_epi64((const __m128i*)&pui8Src[i / 2]);
+			const __m128i sIndices = _mm_unpacklo_epi8(
+				_mm_and_si128(sPacked, sLowNibbles),
+				_mm_and_si128(_mm_srli_epi16(sPacked, 4), sLowNibbles)
+			);
+
+			const __m128i sR = _mm_shuffle_epi8(sRed, sIndices);
+			const __m128i sG = _mm_shuffle_epi8(sGreen, sIndices);
+			const __m128i sB = _mm_shuffle_epi8(sBlue, sIndices);
+			const __m128i sA = _mm_shuffle_epi8(sAlpha, sIndices);
+
+			const __m128i sRGLow = _mm_unpacklo_epi8(sR, sG);
+			const __m128i sRGHigh = _mm_unpackhi_epi8(sR, sG);
+			const __m128i sBALow = _mm_unpacklo_epi8(sB, sA);
+			const __m128i sBAHigh = _mm_unpackhi_epi8(sB, sA);
+
+			_mm_storeu_si128((__m128i*)&psDst[i], _mm_unpacklo_epi16(sRGLow, sBALow));
+			_mm_storeu_si128((__m128i*)&psDst[i + 4], _mm_unpackhi_epi16(sRGLow, sBALow));
+			_mm_storeu_si128((__m128i*)&psDst[i + 8], _mm_unpacklo_epi16(sRGHigh, sBAHigh));
+			_mm_storeu_si128((__m128i*)&psDst[i + 12], _mm_unpackhi_epi16(sRGHigh, sBAHigh));
+		}
+	}
+
+	return i;
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define DECODE_4BIT_NEON
+
+static uint32_t Decode4BitPixelsNEON(
+	const uint8_t* pui8Src,
+	const R8G8B8A8* psTable,
+	const uint32_t ui32NumPixels,
+	R8G8B8A8* psDst)
+{
+	uint8_t aui8Planes[4][16];
+	uint32_t i = 0;
+
+	for (uint32_t j = 0; j < 16; ++j)
+	{
+		aui8Planes[0][j] = psTable[j].uRed;
+		aui8Planes[1][j] = psTable[j].uGreen;
+		aui8Planes[2][j] = psTable[j].uBlue;
+		aui8Planes[3][j] = psTable[j].uAlpha;
+	}
+
+	{
+		const uint8x16_t sRed = vld1q_u8(aui8Planes[0]);
+		const uint8x16_t sGreen = vld1q_u8(aui8Planes[1]);
+		const uint8x16_t sBlue = vld1q_u8(aui8Planes[2]);
+		const uint8x16_t sAlpha = vld1q_u8(aui8Planes[3]);
+
+		for (; (i + 16) <= ui32NumPixels; i += 16)
+		{
+			// The left pixel of each pair is in the low nibble
+			const uint8x8_t sPacked = vld1_u8(&pui8Src[i / 2]);
+			const uint8x8x2_t sPairs = vzip_u8(vand_u8(sPacked, vdup_n_u8(0x0F)), vshr_n_u8(sPacked, 4));
+			const uint8x16_t sIndices = vcombine_u8(sPairs.val[0], sPairs.val[1]);
+
+			// The store interleaves the planes back into RGBA
+			uint8x16x4_t sPixels;
+			sPixels.val[0] = vqtbl1q_u8(sRed, sIndices);
+			sPixels.val[1] = vqtbl1q_u8(sGreen, sIndices);
+			sPixels.val[2] = vqtbl1q_u8(sBlue, sIndices);
+			sPixels.val[3] = vqtbl1q_u8(sAlpha, sIndices);
+			vst4q_u8((uint8_t*)&psDst[i], sPixels);
+		}
+	}
+
+	return i;
+}
+#endif
+
+static void Decode4BitPixels(
+	const uint8_t* pui8Src,
+	const R8G8B8A8* psTable,
+	const uint32_t ui32NumPixels,
+	R8G8B8A8* psDst)
+{
+	uint32_t i = 0;
+
+#if defined(DECODE_4BIT_SSSE3)
+	if (__builtin_cpu_supports("ssse3"))
+	{
+		i = Decode4BitPixelsSSSE3(pui8Src, psTable, ui32NumPixels, psDst);
+	}
+#elif defined(DECODE_4BIT_NEON)
+	i = Decode4BitPixelsNEON(pui8Src, psTable, ui32NumPixels, psDst);
+#endif
+
+	// Whatever's left over, or everything without a vector unit
+	for (; (i + 2) <= ui32NumPixels; i += 2)
+	{
+		psDst[i] = psTable[pui8Src[i / 2] & 0x0F];
+		psDst[i + 1] = psTable[pui8Src[i / 2] >> 4];
+	}
+
+	// A rect can end halfway through a byte
+	if (i < ui32NumPixels)
+	{
+		psDst[i] = psTable[pui8Src[i / 2] & 0x0F];
+	}
+}
+
+static void Decode8BitPixels(
+	const uint8_t* pui8Src,
+	const R8G8B8A8* psTable,
+	const uint32_t ui32NumPixels,
+	R8G8B8A8* psDst)
+{
+	uint32_t i = 0;
+
+	for (; (i + 4) <= ui32NumPixels; i += 4)
+	{
+		psDst[i] = psTable[pui8Src[i]];
+		psDst[i + 1] = psTable[pui8Src[i + 1]];
+		psDst[i + 2] = psTable[pui8Src[i + 2]];
+		psDst[i + 3] = psTable[pui8Src[i + 3]];
+	}
+
+	for (; i < ui32NumPixels; ++i)
+	{
+		psDst[i] = psTable[pui8Src[i]];
+	}
+}
+
+// Converts the CLUT row once rather than every pixel. Indices past the end of
+// a narrow CLUT decode as transparent black, rather than reading the next row
+// (or past the end of the block)
+static void BuildCLUTTable(
+	const TIM_FILE* psFile,
+	const uint32_t ui32PaletteIndex,
+	R8G8B8A8* psTable)
+{
+	const uint32_t ui32TableSize = (psFile->sFileHeader.sFlags.uMode == TIM_PIX_FMT_4BIT_CLUT) ? 16 : 256;
+	const TIM_PIX* psCLUTRow = &psFile->psCLUTData[ui32PaletteIndex * psFile->sCLUTHeader.ui16Width];
+
+	memset(psTable, 0, 256 * sizeof(R8G8B8A8));
+
+	for (uint32_t i = 0; (i < ui32TableSize) && (i < psFile->sCLUTHeader.ui16Width); ++i)
+	{
+		psTable[i] = TIMPixToRGBA8(&psCLUTRow[i]);
+	}
+}
+
+int DecodeTIMPixelDataWithPalette(
+	const TIM_FILE* psFile,
+	const uint32_t ui32PaletteIndex,
+	R8G8B8A8* pui32PixelData)
+{
+	assert(psFile != NULL);
+	assert(ui32PaletteIndex < psFile->sCLUTHeader.ui16Height);
+	assert(pui32PixelData != NULL);
+
+	const uint32_t ui32NumPixels = (
+		GetTIMPixelWidth(psFile) * psFile->sPixelHeader.ui16Height
+	);
+
+	R8G8B8A8 asTable[256];
+	BuildCLUTTable(psFile, ui32PaletteIndex, asTable);
+
+	if (psFile->sFileHeader.sFlags.uMode == TIM_PIX_FMT_4BIT_CLUT)
+	{
+		Decode4BitPixels(psFile->pui8PixelData, asTable, ui32NumPixels, pui32PixelData);
+	}
+	else
+	{
+		Decode8BitPixels(psFile->pui8PixelData, asTable, ui32NumPixels, pui32PixelData);
+	}
+
+	return 0;
+}
+
+int DecodeTIMPixelRectWithPalette(
+	const TIM_FILE* psFile,
+	const uint32_t ui32PaletteIndex,
+	const uint32_t ui32X,
+	const uint32_t ui32Y,
+	const uint32_t ui32Width,
+	const uint32_t ui32Height,
+	R8G8B8A8* psPixels,
+	const uint32_t ui32Pitch)
+{
+	assert(psFile != NULL);
+	assert(ui32PaletteIndex < psFile->sCLUTHeader.ui16Height);
+	assert(psPixels != NULL);
+
+	const uint32_t ui32RowInBytes = psFile->sPixelHeader.ui16Width * sizeof(uint16_t);
+
+	if (((ui32X + ui32Width) > GetTIMPixelWidth(psFile)) ||
+		((ui32Y + ui32Height) > psFile->sPixelHeader.ui16Height))
+	{
+		printf(
+			"rect %u, %u, %u * %u is outside the %u * %hu texture\n",
+			ui32X,
+			ui32Y,
+			ui32Width,
+			ui32Height,
+			GetTIMPixelWidth(psFile),
+			psFile->sPixelHeader.ui16Height
+		);
+		return 1;
+	}
+
+	R8G8B8A8 asTable[256];
+	BuildCLUTTable(psFile, ui32PaletteIndex, asTable);
+
+	for (uint32_t y = 0; y < ui32Height; ++y)
+	{
+		const uint8_t* pui8Src = &psFile->pui8PixelData[(ui32Y + y) * ui32RowInBytes];
+		R8G8B8A8* psDst = &psPixels[y * ui32Pitch];
+
+		if (psFile->sFileHeader.sFlags.uMode == TIM_PIX_FMT_4BIT_CLUT)
+		{
+			uint32_t x = ui32X;
+			uint32_t ui32NumPixels = ui32Width;
+
+			// A rect starting at an odd X starts on the high nibble, after
+			// which the rest of the row is byte aligned
+			if ((x % 2) && (ui32NumPixels > 0))
+			{
+				*psDst++ = asTable[pui8Src[x / 2] >> 4];
+				++x;
+				--ui32NumPixels;
+			}
+
+			Decode4BitPixels(&pui8Src[x / 2], asTable, ui32NumPixels, psDst);
+		}
+		else
+		{
+			Decode8BitPixels(&pui8Src[ui32X], asTable, ui32Width, psDst);
+		}
+	}
+
+	return 0;
+}
+
+// Below this many pixels a rect is decoded on one thread, waking the pool
+// would cost more than it saves. Bands are kept at least this big too
+#define TIM_DECODE_MIN_BAND_PIXELS (32 * 1024)
+
+typedef struct _TIM_DECODE_BANDS
+{
+	const TIM_FILE* psFile;
+	uint32_t ui32PaletteIndex;
+	uint32_t ui32X;
+	uint32_t ui32Y;
+	uint32_t ui32Width;
+	uint32_t ui32Height;
+	R8G8B8A8* psPixels;
+	uint32_t ui32Pitch;
+	uint32_t ui32RowsPerBand;
+} TIM_DECODE_BANDS;
+
+static void DecodeTIMBandJob(void* pvUserData, const uint32_t ui32JobIndex)
+{
+	const TIM_DECODE_BANDS* psBands = pvUserData;
+	const uint32_t ui32FirstRow = ui32JobIndex * psBands->ui32RowsPerBand;
+	const uint32_t ui32NumRows = (
+		((ui32FirstRow + psBands->ui32RowsPerBand) < psBands->ui32Height) ?
+		psBands->ui32RowsPerBand :
+		(psBands->ui32Height - ui32FirstRow)
+	);
+
+	DecodeTIMPixelRectWithPalette(
+		psBands->psFile,
+		psBands->ui32PaletteIndex,
+		psBands->ui32X,
+		psBands->ui32Y + ui32FirstRow,
+		psBands->ui32Width,
+		ui32NumRows,
+		&psBands->psPixels[ui32FirstRow * psBands->ui32Pitch],
+		psBands->ui32Pitch
+	);
+}
+
+int DecodeTIMPixelRectInBands(
+	TIM_THREAD_POOL* psPool,
+	const TIM_FILE* psFile,
+	const uint32_t ui32PaletteIndex,
+	const uint32_t ui32X,
+	const uint32_t ui32Y,
+	const uint32_t ui32Width,
+	const uint32_t ui32Height,
+	R8G8B8A8* psPixels,
+	const uint32_t ui32Pitch)
+{
+	const uint32_t ui32NumPixels = ui32Width * ui32Height;
+	TIM_DECODE_BANDS sBands = {
+		.psFile = psFile,
+		.ui32PaletteIndex = ui32PaletteIndex,
+		.ui32X = ui32X,
+		.ui32Y = ui32Y,
+		.ui32Width = ui32Width,
+		.ui32Height = ui32Height,
+		.psPixels = psPixels,
+		.ui32Pitch = ui32Pitch
+	};
+	uint32_t ui32NumBands;
+
+	// Rects outside the texture are left to report their own error
+	if ((psPool == NULL) ||
+		(ui32NumPixels < (2 * TIM_DECODE_MIN_BAND_PIXELS)) ||
+		((ui32X + ui32Width) > GetTIMPixelWidth(psFile)) ||
+		((ui32Y + ui32Height) > psFile->sPixelHeader.ui16Height))
+	{
+		return DecodeTIMPixelRectWithPalette(
+			psFile,
+			ui32PaletteIndex,
+			ui32X,
+			ui32Y,
+			ui32Width,
+			ui32Height,
+			psPixels,
+			ui32Pitch
+		);
+	}
+
+	// One band per thread, as long as each has enough pixels to be worth it
+	ui32NumBands = GetThreadPoolSize(psPool) + 1;
+	if (ui32NumBands > (ui32NumPixels / TIM_DECODE_MIN_BAND_PIXELS))
+	{
+		ui32NumBands = ui32NumPixels / TIM_DECODE_MIN_BAND_PIXELS;
+	}
+
+	sBands.ui32RowsPerBand = (ui32Height + ui32NumBands - 1) / ui32NumBands;
+	ui32NumBands = (ui32Height + sBands.ui32RowsPerBand - 1) / sBands.ui32RowsPerBand;
+
+	RunThreadPoolJobs(psPool, DecodeTIMBandJob, &sBands, ui32NumBands);
+
+	return 0;
+}
+
+int DecodeTIMPalette(
+	const TIM_FILE* psFile,
+	const uint32_t ui32PaletteIndex,
+	R8G8B8A8* psColours)
+{
+	assert(psFile != NULL);
+	assert(ui32PaletteIndex < psFile->sCLUTHeader.ui16Height);
+	assert(psColours != NULL);
+
+	const TIM_PIX* psCLUTRow = &psFile->psCLUTData[ui32PaletteIndex * psFile->sCLUTHeader.ui16Width];
+
+	for (uint32_t i = 0; i < psFile->sCLUTHeader.ui16Width; ++i)
+	{
+		psColours[i] = TIMPixToRGBA8(&psCLUTRow[i]);
+	}
+
+	return 0;
+}
+
+int ExpandTIMPixelRectIndices(
+	const TIM_FILE* psFile,
+	const uint32_t ui32X,
+	const uint32_t ui32Y,
+	const uint32_t ui32Width,
+	const uint32_t ui32Height,
+	uint8_t* pui8Indices,
+	const uint32_t ui32Pitch)
+{
+	assert(psFile != NULL);
+	assert(pui8Indices != NULL);
+
+	const uint32_t ui32RowInBytes = psFile->sPixelHeader.ui16Width * sizeof(uint16_t);
+
+	if (((ui32X + ui32Width) > GetTIMPixelWidth(psFile)) ||
+		((ui32Y + ui32Height) > psFile->sPixelHeader.ui16Height))
+	{
+		printf(
+			"rect %u, %u, %u * %u is outside the %u * %hu texture\n",
+			ui32X,
+			ui32Y,
+			ui32Width,
+			ui32Height,
+			GetTIMPixelWidth(psFile),
+			psFile->sPixelHeader.ui16Height
+		);
+		return 1;
+	}
+
+	for (uint32_t y = 0; y < ui32Height; ++y)
+	{
+		const uint8_t* pui8Src = &psFile->pui8PixelData[(ui32Y + y) * ui32RowInBytes];
+		uint8_t* pui8Dst = &pui8Indices[y * ui32Pitch];
+
+		if (psFile->sFileHeader.sFlags.uMode == TIM_PIX_FMT_4BIT_CLUT)
+		{
+			// The left pixel of each pair is in the low nibble
+			for (uint32_t x = 0; x < ui32Width; ++x)
+			{
+				const uint8_t ui8Byte = pui8Src[(ui32X + x) / 2];
+
+				pui8Dst[x] = ((ui32X + x) % 2) ? (ui8Byte >> 4) : (ui8Byte & 0x0F);
+			}
+		}
+		else
+		{
+			memcpy(pui8Dst, &pui8Src[ui32X], ui32Width);
+		}
+	}
+
+	return 0;
+}
@@ -1,13 +1,21 @@
 #ifndef TIMDEFS_H
 #define TIMDEFS_H
 
+#include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "tim_thread_defs.h"
 
 #define PSX_VRAM_WIDTH (1024)
 #define PSX_VRAM_HEIGHT (512)
 
 #define TIM_FILE_HEADER_ID (0x10)
 
+#define ALIGN_UP(x, y) (((x % y) != 0) ? (x + y - (x % y)) : x)
+
 typedef enum _TIM_PIX_FMT
 {
 	TIM_PIX_FMT_4BIT_CLUT = 0x0,
@@ -67,6 +75,30 @@ typedef struct _TIM_FILE
 	uint8_t* pui8PixelData;
 } TIM_FILE;
 
+// Animation deltas, as written by timpack --sequence. The file header is
+// followed by a frame header for every frame after the first, each followed
+// by its changed rects as pixel blocks: a TIM_BLOCK_HEADER then the data
+#define TIM_DELTA_FILE_ID (0x444D4954) // "TIMD"
+
+typedef struct _TIM_DELTA_HEADER
+{
+	uint32_t ui32ID;
+
+	// Including the base frame, which has no delta
+	uint16_t ui16NumFrames;
+	uint16_t ui16NumDeltas;
+} TIM_DELTA_HEADER;
+
+typedef struct _TIM_DELTA_FRAME_HEADER
+{
+	// The size of the frame's header and blocks, to skip to the next frame
+	uint32_t ui32SizeInBytes;
+
+	// The frame the blocks turn the previous frame into
+	uint16_t ui16Frame;
+	uint16_t ui16NumBlocks;
+} TIM_DELTA_FRAME_HEADER;
+
 void PrintTIM(const char* pszName, TIM_FILE* psFile);
 
 int WriteTIM(const char* pszOutputFileName, const TIM_FILE* psFile);
@@ -75,4 +107,134 @@ int ReadTIM(const char* pszInputFileName, TIM_FILE* psFile);
 
 void DestroyTIM(TIM_FILE* psFile);
 
+// Reads only the file and block headers, seeking over the data blocks. The
+// data pointers are left NULL, so there is nothing to destroy
+int ReadTIMHeaders(const char* pszInputFileName, TIM_FILE* psFile);
+
+// Whether the name ends in .tim, in any case
+bool HasTIMExtension(const char* pszFileName);
+
+// Milliseconds of CLOCK_MONOTONIC since psStart
+double GetElapsedMS(const struct timespec* psStart);
+
+// Nanoseconds of CLOCK_MONOTONIC since psStart, for summing short intervals
+uint64_t GetElapsedNS(const struct timespec* psStart);
+
+typedef struct _TIM_MAPPING
+{
+	void* pvData;
+	size_t uSizeInBytes;
+	bool bWritable;
+
+	// A writable mapping keeps the file open until it's unmapped. Stores
+	// through MAP_SHARED raise no inotify event, so closing it after the
+	// flush is what tells a watcher the edits have landed
+	int iFD;
+
+	// The block headers within the mapping, for editing a file in place
+	TIM_BLOCK_HEADER* psCLUTHeader;
+	TIM_BLOCK_HEADER* psPixelHeader;
+} TIM_MAPPING;
+
+// Maps a TIM file into memory, the data pointers within psFile point into the
+// mapping, so psFile must not be passed to DestroyTIM
+int MapTIM(
+	const char* pszInputFileName,
+	const bool bWritable,
+	TIM_MAPPING* psMapping,
+	TIM_FILE* psFile);
+
+// Flushes any edits made through a writable mapping, then unmaps it and
+// closes the file
+int UnmapTIM(TIM_MAPPING* psMapping);
+
+// Maps a TIM file just long enough to copy its blocks out, checking they fit
+// in the file as MapTIM does. Unlike a mapping, the copy can't change or be
+// truncated when the file is rewritten. psFile must be passed to DestroyTIM
+int CopyTIM(const char* pszInputFileName, TIM_FILE* psFile);
+
+// FNV-1a hash, used to identify duplicate CLUT and pixel data blocks
+#define TIM_HASH_SEED (0x811C9DC5)
+
+uint32_t HashTIMData(
+	const void* pvData,
+	const uint32_t ui32SizeInBytes,
+	const uint32_t ui32Seed);
+
+typedef struct _R8G8B8A8
+{
+	uint32_t uRed: 8, uGreen: 8, uBlue: 8, uAlpha: 8;
+} R8G8B8A8;
+
+// The width of the pixel block in pixels, rather than VRAM halfwords
+uint32_t GetTIMPixelWidth(const TIM_FILE* psFile);
+
+// Checks the blocks of a (possibly mapped) file are large enough to decode
+int ValidateTIM(const TIM_FILE* psFile);
+
+int DecodeTIMPixelDataWithPalette(
+	const TIM_FILE* psFile,
+	const uint32_t ui32PaletteIndex,
+	R8G8B8A8* pui32PixelData);
+
+// Decodes a rect of the texture, in pixels, into rows ui32Pitch pixels apart.
+// Only the bytes the rect covers are read, and 4bpp rects may start or end
+// halfway through a byte
+int DecodeTIMPixelRectWithPalette(
+	const TIM_FILE* psFile,
+	const uint32_t ui32PaletteIndex,
+	const uint32_t ui32X,
+	const uint32_t ui32Y,
+	const uint32_t ui32Width,
+	const uint32_t ui32Height,
+	R8G8B8A8* psPixels,
+	const uint32_t ui32Pitch);
+
+// As DecodeTIMPixelRectWithPalette, split into bands of rows decoded across
+// the pool. Rects too small to be worth waking the pool for are decoded on
+// the calling thread, as is everything when psPool is NULL. Must not be
+// called from a job running on the same pool
+int DecodeTIMPixelRectInBands(
+	TIM_THREAD_POOL* psPool,
+	const TIM_FILE* psFile,
+	const uint32_t ui32PaletteIndex,
+	const uint32_t ui32X,
+	const uint32_t ui32Y,
+	const uint32_t ui32Width,
+	const uint32_t ui32Height,
+	R8G8B8A8* psPixels,
+	const uint32_t ui32Pitch);
+
+// Converts one row of the CLUT, writing sCLUTHeader.ui16Width colours
+int DecodeTIMPalette(
+	const TIM_FILE* psFile,
+	const uint32_t ui32PaletteIndex,
+	R8G8B8A8* psColours);
+
+// Expands a rect of the pixel block to one CLUT index per byte, with rows
+// ui32Pitch bytes apart, so that a palette can be applied without decoding
+// again. As with decoding, 4bpp rects may start halfway through a byte
+int ExpandTIMPixelRectIndices(
+	const TIM_FILE* psFile,
+	const uint32_t ui32X,
+	const uint32_t ui32Y,
+	const uint32_t ui32Width,
+	const uint32_t ui32Height,
+	uint8_t* pui8Indices,
+	const uint32_t ui32Pitch);
+
+// Writes an RGBA image as an uncompressed (stored) PNG, trading file size for
+// encoding speed
+int WritePNG(
+	const char* pszOutputFileName,
+	const R8G8B8A8* psPixels,
+	const uint32_t ui32Width,
+	const uint32_t ui32Height);
+
+int WritePNGToStream(
+	FILE* fFilePtr,
+	const R8G8B8A8* psPixels,
+	const uint32_t ui32Width,
+	const uint32_t ui32Height);
+
 #endif // TIMDEFS_H
@@ -1,6 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "tim_defs.h"
 
@@ -35,18 +44,70 @@ void PrintTIM(const char* pszName, TIM_FILE* psFile)
 	);
 }
 
+// The file is written under a temporary name beside the output then renamed
+// over it, so anything reading or mapping the old file keeps seeing it whole,
+// and a failed write leaves it untouched. A symlinked output has its target
+// replaced rather than the link, and an existing file keeps its mode
 int WriteTIM(
 	const char* pszOutputFileName,
 	const TIM_FILE* psFile)
 {
-	FILE *fFilePtr = fopen(pszOutputFileName, "wb");
-	if (fFilePtr == NULL)
+	char szTargetFileName[PATH_MAX];
+	char szTempFileName[PATH_MAX];
+	struct stat sStat;
+	mode_t uMode;
+	FILE *fFilePtr;
+	int iFD;
+	bool bFailed;
+
+	assert(psFile != NULL);
+
+	if (realpath(pszOutputFileName, szTargetFileName) == NULL)
+	{
+		// A new file is written where it's named
+		if ((errno != ENOENT) ||
+			(snprintf(szTargetFileName, sizeof(szTargetFileName), "%s", pszOutputFileName) >= (int)sizeof(szTargetFileName)))
+		{
+			printf("could not resolve %s\n", pszOutputFileName);
+			return 1;
+		}
+	}
+
+	if (snprintf(szTempFileName, sizeof(szTempFileName), "%s.XXXXXX", szTargetFileName) >= (int)sizeof(szTempFileName))
 	{
-		printf("could not open %s for writing\n", pszOutputFileName);
+		printf("%s is too long a file name\n", szTargetFileName);
 		return 1;
 	}
 
-	assert(psFile != NULL);
+	if (stat(szTargetFileName, &sStat) == 0)
+	{
+		uMode = sStat.st_mode & 07777;
+	}
+	else
+	{
+		// mkstemp creates the file 0600, so give a new one the mode fopen
+		// would have. Nothing writes TIMs from more than one thread, so
+		// reading the umask by setting it is safe
+		const mode_t uUMask = umask(0);
+		umask(uUMask);
+		uMode = 0666 & ~uUMask;
+	}
+
+	iFD = mkstemp(szTempFileName);
+	if (iFD < 0)
+	{
+		printf("could not create a temporary file for %s\n", szTargetFileName);
+		return 1;
+	}
+
+	fFilePtr = (fchmod(iFD, uMode) == 0) ? fdopen(iFD, "wb") : NULL;
+	if (fFilePtr == NULL)
+	{
+		printf("could not open %s for writing\n", szTempFileName);
+		close(iFD);
+		remove(szTempFileName);
+		return 1;
+	}
 
 	// Write header
 	fwrite(&psFile->sFileHeader, sizeof(TIM_FILE_HEADER), 1, fFilePtr);
@@ -69,7 +130,15 @@ int WriteTIM(
 		fFilePtr
 	);
 
-	fclose(fFilePtr);
+	bFailed = (ferror(fFilePtr) != 0);
+	bFailed = (fclose(fFilePtr) != 0) || bFailed;
+
+	if (bFailed || (rename(szTempFileName, szTargetFileName) != 0))
+	{
+		printf("could not write %s\n", pszOutputFileName);
+		remove(szTempFileName);
+		return 1;
+	}
 
 	return 0;
 }
@@ -139,8 +208,318 @@ FAILED_ReadTIM:
 	return 1;
 }
 
+int ReadTIMHeaders(
+	const char* pszInputFileName,
+	TIM_FILE* psFile)
+{
+	FILE *fFilePtr = fopen(pszInputFileName, "r");
+	if (fFilePtr == NULL)
+	{
+		printf("could not open %s for reading\n", pszInputFileName);
+		return 1;
+	}
+
+	assert(psFile != NULL);
+
+	memset(psFile, 0, sizeof(TIM_FILE));
+
+	if ((fread(&psFile->sFileHeader, sizeof(TIM_FILE_HEADER), 1, fFilePtr) != 1) ||
+		(psFile->sFileHeader.ui32ID != TIM_FILE_HEADER_ID))
+	{
+		printf("%s: file header does not match that of a TIM file\n", pszInputFileName);
+		goto FAILED_ReadTIMHeaders;
+	}
+
+	if (psFile->sFileHeader.sFlags.uClut)
+	{
+		if ((fread(&psFile->sCLUTHeader, sizeof(TIM_BLOCK_HEADER), 1, fFilePtr) != 1) ||
+			(psFile->sCLUTHeader.ui32SizeInBytes < sizeof(TIM_BLOCK_HEADER)) ||
+			(fseek(fFilePtr, psFile->sCLUTHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER), SEEK_CUR) != 0))
+		{
+			printf("%s: truncated CLUT block\n", pszInputFileName);
+			goto FAILED_ReadTIMHeaders;
+		}
+	}
+
+	if (fread(&psFile->sPixelHeader, sizeof(TIM_BLOCK_HEADER), 1, fFilePtr) != 1)
+	{
+		printf("%s: truncated pixel block\n", pszInputFileName);
+		goto FAILED_ReadTIMHeaders;
+	}
+
+	fclose(fFilePtr);
+
+	return 0;
+
+FAILED_ReadTIMHeaders:
+	fclose(fFilePtr);
+
+	return 1;
+}
+
 void DestroyTIM(TIM_FILE* psFile)
 {
 	if (psFile->psCLUTData) { free(psFile->psCLUTData); }
 	if (psFile->pui8PixelData) { free(psFile->pui8PixelData); }
 }
+
+bool HasTIMExtension(const char* pszFileName)
+{
+	const size_t uLength = strlen(pszFileName);
+
+	return (uLength > 4) && (strcasecmp(&pszFileName[uLength - 4], ".tim") == 0);
+}
+
+double GetElapsedMS(const struct timespec* psStart)
+{
+	struct timespec sEnd;
+	clock_gettime(CLOCK_MONOTONIC, &sEnd);
+
+	return ((sEnd.tv_sec - psStart->tv_sec) * 1000.0) + ((sEnd.tv_nsec - psStart->tv_nsec) / 1000000.0);
+}
+
+uint64_t GetElapsedNS(const struct timespec* psStart)
+{
+	struct timespec sEnd;
+	clock_gettime(CLOCK_MONOTONIC, &sEnd);
+
+	return ((uint64_t)(sEnd.tv_sec - psStart->tv_sec) * 1000000000ull) + (sEnd.tv_nsec - psStart->tv_nsec);
+}
+
+// Reads a block header from the mapping, checking the block fits in the file
+static TIM_BLOCK_HEADER* MapTIMBlock(
+	uint8_t* pui8Data,
+	const size_t uSizeInBytes,
+	size_t* puOffset,
+	void** ppvBlockData)
+{
+	TIM_BLOCK_HEADER* psHeader;
+
+	if ((*puOffset + sizeof(TIM_BLOCK_HEADER)) > uSizeInBytes)
+	{
+		return NULL;
+	}
+
+	psHeader = (TIM_BLOCK_HEADER*)(pui8Data + *puOffset);
+	if ((psHeader->ui32SizeInBytes < sizeof(TIM_BLOCK_HEADER)) ||
+		(psHeader->ui32SizeInBytes > (uSizeInBytes - *puOffset)))
+	{
+		return NULL;
+	}
+
+	*ppvBlockData = pui8Data + *puOffset + sizeof(TIM_BLOCK_HEADER);
+	*puOffset += psHeader->ui32SizeInBytes;
+
+	return psHeader;
+}
+
+int MapTIM(
+	const char* pszInputFileName,
+	const bool bWritable,
+	TIM_MAPPING* psMapping,
+	TIM_FILE* psFile)
+{
+	struct stat sStat;
+	size_t uOffset = sizeof(TIM_FILE_HEADER);
+	void* pvBlockData = NULL;
+
+	assert(psMapping != NULL);
+	assert(psFile != NULL);
+
+	memset(psMapping, 0, sizeof(TIM_MAPPING));
+	memset(psFile, 0, sizeof(TIM_FILE));
+
+	int iFD = open(pszInputFileName, bWritable ? O_RDWR : O_RDONLY);
+	if (iFD < 0)
+	{
+		printf("could not open %s for %s\n", pszInputFileName, bWritable ? "writing" : "reading");
+		return 1;
+	}
+
+	if ((fstat(iFD, &sStat) != 0) || (sStat.st_size < (off_t)sizeof(TIM_FILE_HEADER)))
+	{
+		printf("%s is too small to be a TIM file\n", pszInputFileName);
+		close(iFD);
+		return 1;
+	}
+
+	psMapping->uSizeInBytes = sStat.st_size;
+	psMapping->bWritable = bWritable;
+	psMapping->iFD = -1;
+	psMapping->pvData = mmap(
+		NULL,
+		psMapping->uSizeInBytes,
+		bWritable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+		MAP_SHARED,
+		iFD,
+		0
+	);
+
+	if (psMapping->pvData == MAP_FAILED)
+	{
+		printf("could not map %s\n", pszInputFileName);
+		psMapping->pvData = NULL;
+		close(iFD);
+		return 1;
+	}
+
+	// The mapping holds its own reference to the file, but a writable one
+	// is closed by UnmapTIM so the edits raise IN_CLOSE_WRITE
+	if (bWritable)
+	{
+		psMapping->iFD = iFD;
+	}
+	else
+	{
+		close(iFD);
+	}
+
+	memcpy(&psFile->sFileHeader, psMapping->pvData, sizeof(TIM_FILE_HEADER));
+	if (psFile->sFileHeader.ui32ID != TIM_FILE_HEADER_ID)
+	{
+		printf("File header does not match that of a TIM file\n");
+		goto FAILED_MapTIM;
+	}
+
+	// Direct colour files have no CLUT block
+	if (psFile->sFileHeader.sFlags.uClut)
+	{
+		psMapping->psCLUTHeader = MapTIMBlock(
+			psMapping->pvData,
+			psMapping->uSizeInBytes,
+			&uOffset,
+			&pvBlockData
+		);
+
+		if (psMapping->psCLUTHeader == NULL)
+		{
+			printf("CLUT block of %s is truncated\n", pszInputFileName);
+			goto FAILED_MapTIM;
+		}
+
+		psFile->sCLUTHeader = *psMapping->psCLUTHeader;
+		psFile->psCLUTData = pvBlockData;
+	}
+
+	psMapping->psPixelHeader = MapTIMBlock(
+		psMapping->pvData,
+		psMapping->uSizeInBytes,
+		&uOffset,
+		&pvBlockData
+	);
+
+	if (psMapping->psPixelHeader == NULL)
+	{
+		printf("Pixel block of %s is truncated\n", pszInputFileName);
+		goto FAILED_MapTIM;
+	}
+
+	psFile->sPixelHeader = *psMapping->psPixelHeader;
+	psFile->pui8PixelData = pvBlockData;
+
+	return 0;
+
+FAILED_MapTIM:
+	UnmapTIM(psMapping);
+
+	return 1;
+}
+
+int UnmapTIM(TIM_MAPPING* psMapping)
+{
+	int iResult = 0;
+
+	if (psMapping->pvData == NULL)
+	{
+		return 0;
+	}
+
+	if (psMapping->bWritable &&
+		(msync(psMapping->pvData, psMapping->uSizeInBytes, MS_SYNC) != 0))
+	{
+		printf("failed to flush TIM mapping\n");
+		iResult = 1;
+	}
+
+	munmap(psMapping->pvData, psMapping->uSizeInBytes);
+
+	if (psMapping->bWritable && (close(psMapping->iFD) != 0))
+	{
+		printf("failed to close TIM mapping\n");
+		iResult = 1;
+	}
+
+	memset(psMapping, 0, sizeof(TIM_MAPPING));
+
+	return iResult;
+}
+
+int CopyTIM(
+	const char* pszInputFileName,
+	TIM_FILE* psFile)
+{
+	TIM_MAPPING sMapping;
+	TIM_FILE sMappedFile;
+	uint32_t ui32CLUTDataInBytes = 0;
+	uint32_t ui32PixelDataInBytes;
+
+	assert(psFile != NULL);
+
+	memset(psFile, 0, sizeof(TIM_FILE));
+
+	if (MapTIM(pszInputFileName, false, &sMapping, &sMappedFile) != 0)
+	{
+		return 1;
+	}
+
+	*psFile = sMappedFile;
+	psFile->psCLUTData = NULL;
+	psFile->pui8PixelData = NULL;
+
+	// One byte over, so an empty block still gets a buffer of its own
+	if (sMappedFile.psCLUTData != NULL)
+	{
+		ui32CLUTDataInBytes = sMappedFile.sCLUTHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER);
+		psFile->psCLUTData = malloc(ui32CLUTDataInBytes + 1);
+	}
+
+	ui32PixelDataInBytes = sMappedFile.sPixelHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER);
+	psFile->pui8PixelData = malloc(ui32PixelDataInBytes + 1);
+
+	if (((sMappedFile.psCLUTData != NULL) && (psFile->psCLUTData == NULL)) || (psFile->pui8PixelData == NULL))
+	{
+		printf("failed to allocate a copy of %s\n", pszInputFileName);
+		DestroyTIM(psFile);
+		memset(psFile, 0, sizeof(TIM_FILE));
+		UnmapTIM(&sMapping);
+		return 1;
+	}
+
+	if (ui32CLUTDataInBytes != 0)
+	{
+		memcpy(psFile->psCLUTData, sMappedFile.psCLUTData, ui32CLUTDataInBytes);
+	}
+
+	memcpy(psFile->pui8PixelData, sMappedFile.pui8PixelData, ui32PixelDataInBytes);
+
+	UnmapTIM(&sMapping);
+
+	return 0;
+}
+
+uint32_t HashTIMData(
+	const void* pvData,
+	const uint32_t ui32SizeInBytes,
+	const uint32_t ui32Seed)
+{
+	const uint8_t* pui8Data = pvData;
+	uint32_t ui32Hash = ui32Seed;
+
+	for (uint32_t i = 0; i < ui32SizeInBytes; ++i)
+	{
+		ui32Hash ^= pui8Data[i];
+		ui32Hash *= 0x01000193;
+	}
+
+	return ui32Hash;
+}
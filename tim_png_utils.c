@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include <pthread.h>
+
+#include "tim_defs.h"
+
+// The largest block deflate allows without compression
+#define PNG_STORED_BLOCK_MAX (0xFFFF)
+#define PNG_ADLER_MOD (65521)
+
+static uint32_t aui32CRCTable[256];
+static pthread_once_t sCRCTableOnce = PTHREAD_ONCE_INIT;
+
+static void InitCRCTable(void)
+{
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		uint32_t ui32CRC = i;
+		for (uint32_t j = 0; j < 8; ++j)
+		{
+			ui32CRC = (ui32CRC & 1) ? (0xEDB88320 ^ (ui32CRC >> 1)) : (ui32CRC >> 1);
+		}
+		aui32CRCTable[i] = ui32CRC;
+	}
+}
+
+// State for streaming a single IDAT chunk made of stored deflate blocks
+typedef struct _PNG_STREAM
+{
+	FILE* fFilePtr;
+	uint32_t ui32CRC;
+	uint32_t ui32AdlerA;
+	uint32_t ui32AdlerB;
+
+	// Uncompressed bytes left in the image, and in the current block
+	uint32_t ui32RawRemaining;
+	uint32_t ui32BlockRemaining;
+} PNG_STREAM;
+
+static void PNGWriteChunkBytes(PNG_STREAM* psStream, const uint8_t* pui8Data, const uint32_t ui32Size)
+{
+	uint32_t ui32CRC = psStream->ui32CRC;
+
+	for (uint32_t i = 0; i < ui32Size; ++i)
+	{
+		ui32CRC = aui32CRCTable[(ui32CRC ^ pui8Data[i]) & 0xFF] ^ (ui32CRC >> 8);
+	}
+
+	psStream->ui32CRC = ui32CRC;
+	fwrite(pui8Data, ui32Size, 1, psStream->fFilePtr);
+}
+
+static void PNGWriteU32(FILE* fFilePtr, const uint32_t ui32Value)
+{
+	const uint8_t aui8Bytes[4] = {
+		(ui32Value >> 24) & 0xFF,
+		(ui32Value >> 16) & 0xFF,
+		(ui32Value >> 8) & 0xFF,
+		ui32Value & 0xFF
+	};
+
+	fwrite(aui8Bytes, sizeof(aui8Bytes), 1, fFilePtr);
+}
+
+static void PNGBeginChunk(PNG_STREAM* psStream, const char* pszType, const uint32_t ui32Size)
+{
+	PNGWriteU32(psStream->fFilePtr, ui32Size);
+	psStream->ui32CRC = 0xFFFFFFFF;
+	PNGWriteChunkBytes(psStream, (const uint8_t*)pszType, 4);
+}
+
+static void PNGEndChunk(PNG_STREAM* psStream)
+{
+	PNGWriteU32(psStream->fFilePtr, psStream->ui32CRC ^ 0xFFFFFFFF);
+}
+
+// Writes image data into the deflate stream, starting stored blocks as needed
+static void PNGWriteDeflateBytes(PNG_STREAM* psStream, const uint8_t* pui8Data, uint32_t ui32Size)
+{
+	while (ui32Size > 0)
+	{
+		uint32_t ui32Chunk;
+
+		if (psStream->ui32BlockRemaining == 0)
+		{
+			const uint16_t ui16BlockSize = (
+				(psStream->ui32RawRemaining > PNG_STORED_BLOCK_MAX) ?
+				PNG_STORED_BLOCK_MAX :
+				psStream->ui32RawRemaining
+			);
+			const uint8_t aui8BlockHeader[5] = {
+				(ui16BlockSize == psStream->ui32RawRemaining) ? 0x01 : 0x00, // BFINAL, BTYPE = stored
+				ui16BlockSize & 0xFF,
+				ui16BlockSize >> 8,
+				~ui16BlockSize & 0xFF,
+				(~ui16BlockSize >> 8) & 0xFF
+			};
+
+			PNGWriteChunkBytes(psStream, aui8BlockHeader, sizeof(aui8BlockHeader));
+			psStream->ui32BlockRemaining = ui16BlockSize;
+		}
+
+		ui32Chunk = (ui32Size < psStream->ui32BlockRemaining) ? ui32Size : psStream->ui32BlockRemaining;
+
+		PNGWriteChunkBytes(psStream, pui8Data, ui32Chunk);
+
+		// Adler-32, deferring the modulo for as long as the sums can't overflow
+		for (uint32_t i = 0; i < ui32Chunk; )
+		{
+			const uint32_t ui32End = ((ui32Chunk - i) > 5552) ? (i + 5552) : ui32Chunk;
+			for (; i < ui32End; ++i)
+			{
+				psStream->ui32AdlerA += pui8Data[i];
+				psStream->ui32AdlerB += psStream->ui32AdlerA;
+			}
+			psStream->ui32AdlerA %= PNG_ADLER_MOD;
+			psStream->ui32AdlerB %= PNG_ADLER_MOD;
+		}
+
+		psStream->ui32BlockRemaining -= ui32Chunk;
+		psStream->ui32RawRemaining -= ui32Chunk;
+		pui8Data += ui32Chunk;
+		ui32Size -= ui32Chunk;
+	}
+}
+
+int WritePNGToStream(
+	FILE* fFilePtr,
+	const R8G8B8A8* psPixels,
+	const uint32_t ui32Width,
+	const uint32_t ui32Height)
+{
+	static const uint8_t aui8Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	// Each row is prefixed with its filter type, which is always none
+	const uint32_t ui32RowInBytes = 1 + (ui32Width * sizeof(R8G8B8A8));
+	const uint64_t ui64RawInBytes = (uint64_t)ui32RowInBytes * ui32Height;
+	const uint64_t ui64NumBlocks = (ui64RawInBytes + PNG_STORED_BLOCK_MAX - 1) / PNG_STORED_BLOCK_MAX;
+	const uint64_t ui64IDATInBytes = 2 + (ui64NumBlocks * 5) + ui64RawInBytes + 4;
+
+	PNG_STREAM sStream = { .fFilePtr = fFilePtr, .ui32AdlerA = 1 };
+
+	assert(fFilePtr != NULL);
+	assert(psPixels != NULL);
+
+	if ((ui32Width == 0) || (ui32Height == 0) || (ui64IDATInBytes > 0x7FFFFFFF))
+	{
+		printf("cannot write a %u * %u PNG\n", ui32Width, ui32Height);
+		return 1;
+	}
+
+	pthread_once(&sCRCTableOnce, InitCRCTable);
+
+	fwrite(aui8Signature, sizeof(aui8Signature), 1, fFilePtr);
+
+	{
+		const uint8_t aui8IHDR[13] = {
+			(ui32Width >> 24) & 0xFF, (ui32Width >> 16) & 0xFF, (ui32Width >> 8) & 0xFF, ui32Width & 0xFF,
+			(ui32Height >> 24) & 0xFF, (ui32Height >> 16) & 0xFF, (ui32Height >> 8) & 0xFF, ui32Height & 0xFF,
+			8, // Bit depth
+			6, // Colour type, RGBA
+			0, // Compression method, deflate
+			0, // Filter method
+			0 // Interlace method, none
+		};
+
+		PNGBeginChunk(&sStream, "IHDR", sizeof(aui8IHDR));
+		PNGWriteChunkBytes(&sStream, aui8IHDR, sizeof(aui8IHDR));
+		PNGEndChunk(&sStream);
+	}
+
+	{
+		// zlib header for deflate with a 32K window and no preset dictionary
+		static const uint8_t aui8ZlibHeader[2] = { 0x78, 0x01 };
+		static const uint8_t ui8FilterType = 0;
+
+		PNGBeginChunk(&sStream, "IDAT", (uint32_t)ui64IDATInBytes);
+		PNGWriteChunkBytes(&sStream, aui8ZlibHeader, sizeof(aui8ZlibHeader));
+
+		sStream.ui32RawRemaining = (uint32_t)ui64RawInBytes;
+		for (uint32_t y = 0; y < ui32Height; ++y)
+		{
+			PNGWriteDeflateBytes(&sStream, &ui8FilterType, 1);
+			PNGWriteDeflateBytes(
+				&sStream,
+				(const uint8_t*)&psPixels[y * ui32Width],
+				ui32Width * sizeof(R8G8B8A8)
+			);
+		}
+
+		{
+			const uint32_t ui32Adler = (sStream.ui32AdlerB << 16) | sStream.ui32AdlerA;
+			const uint8_t aui8Adler[4] = {
+				(ui32Adler >> 24) & 0xFF,
+				(ui32Adler >> 16) & 0xFF,
+				(ui32Adler >> 8) & 0xFF,
+				ui32Adler & 0xFF
+			};
+
+			PNGWriteChunkBytes(&sStream, aui8Adler, sizeof(aui8Adler));
+		}
+
+		PNGEndChunk(&sStream);
+	}
+
+	PNGBeginChunk(&sStream, "IEND", 0);
+	PNGEndChunk(&sStream);
+
+	return ferror(fFilePtr) ? 1 : 0;
+}
+
+int WritePNG(
+	const char* pszOutputFileName,
+	const R8G8B8A8* psPixels,
+	const uint32_t ui32Width,
+	const uint32_t ui32Height)
+{
+	int iResult;
+
+	FILE *fFilePtr = fopen(pszOutputFileName, "wb");
+	if (fFilePtr == NULL)
+	{
+		printf("could not open %s for writing\n", pszOutputFileName);
+		return 1;
+	}
+
+	iResult = WritePNGToStream(fFilePtr, psPixels, ui32Width, ui32Height);
+
+	if (fclose(fFilePtr) != 0)
+	{
+		iResult = 1;
+	}
+
+	if (iResult != 0)
+	{
+		printf("failed to write %s\n", pszOutputFileName);
+	}
+
+	return iResult;
+}
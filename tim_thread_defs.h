@@ -0,0 +1,25 @@
+#ifndef TIM_THREAD_DEFS_H
+#define TIM_THREAD_DEFS_H
+
+#include <stdint.h>
+
+typedef void (*TIM_JOB_FUNC)(void* pvUserData, const uint32_t ui32JobIndex);
+
+typedef struct _TIM_THREAD_POOL TIM_THREAD_POOL;
+
+// Creates a pool of worker threads, one per online CPU if ui32NumThreads is 0
+TIM_THREAD_POOL* CreateThreadPool(const uint32_t ui32NumThreads);
+
+uint32_t GetThreadPoolSize(const TIM_THREAD_POOL* psPool);
+
+// Calls pfnJob for every index in [0, ui32NumJobs) across the pool and the
+// calling thread, returning once all jobs have completed
+void RunThreadPoolJobs(
+	TIM_THREAD_POOL* psPool,
+	TIM_JOB_FUNC pfnJob,
+	void* pvUserData,
+	const uint32_t ui32NumJobs);
+
+void DestroyThreadPool(TIM_THREAD_POOL* psPool);
+
+#endif // TIM_THREAD_DEFS_H
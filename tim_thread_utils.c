@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "tim_thread_defs.h"
+
+struct _TIM_THREAD_POOL
+{
+	pthread_t* psThreads;
+	uint32_t ui32NumThreads;
+
+	pthread_mutex_t sMutex;
+	pthread_cond_t sWorkCond;
+	pthread_cond_t sDoneCond;
+
+	// Serialises callers of RunThreadPoolJobs
+	pthread_mutex_t sRunMutex;
+
+	// The current set of jobs, workers pick up a new set when the generation
+	// changes
+	TIM_JOB_FUNC pfnJob;
+	void* pvUserData;
+	uint32_t ui32NumJobs;
+	atomic_uint ui32NextJob;
+	uint32_t ui32Generation;
+
+	// Workers yet to finish the current generation
+	uint32_t ui32NumActive;
+	bool bQuit;
+};
+
+static void RunJobs(TIM_THREAD_POOL* psPool)
+{
+	uint32_t ui32Job;
+
+	while ((ui32Job = atomic_fetch_add(&psPool->ui32NextJob, 1)) < psPool->ui32NumJobs)
+	{
+		psPool->pfnJob(psPool->pvUserData, ui32Job);
+	}
+}
+
+static void* WorkerThread(void* pvPool)
+{
+	TIM_THREAD_POOL* psPool = pvPool;
+	uint32_t ui32Generation = 0;
+
+	pthread_mutex_lock(&psPool->sMutex);
+
+	for (;;)
+	{
+		while (!psPool->bQuit && (psPool->ui32Generation == ui32Generation))
+		{
+			pthread_cond_wait(&psPool->sWorkCond, &psPool->sMutex);
+		}
+
+		if (psPool->bQuit)
+		{
+			break;
+		}
+
+		ui32Generation = psPool->ui32Generation;
+		pthread_mutex_unlock(&psPool->sMutex);
+
+		RunJobs(psPool);
+
+		pthread_mutex_lock(&psPool->sMutex);
+		if (--psPool->ui32NumActive == 0)
+		{
+			pthread_cond_signal(&psPool->sDoneCond);
+		}
+	}
+
+	pthread_mutex_unlock(&psPool->sMutex);
+
+	return NULL;
+}
+
+TIM_THREAD_POOL* CreateThreadPool(const uint32_t ui32NumThreads)
+{
+	TIM_THREAD_POOL* psPool = calloc(1, sizeof(TIM_THREAD_POOL));
+	if (psPool == NULL)
+	{
+		printf("failed to allocate thread pool\n");
+		return NULL;
+	}
+
+	psPool->ui32NumThreads = ui32NumThreads;
+	if (psPool->ui32NumThreads == 0)
+	{
+		const long lNumCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+		psPool->ui32NumThreads = (lNumCPUs > 0) ? (uint32_t)lNumCPUs : 1;
+	}
+
+	psPool->psThreads = calloc(psPool->ui32NumThreads, sizeof(pthread_t));
+	if (psPool->psThreads == NULL)
+	{
+		printf("failed to allocate thread pool\n");
+		free(psPool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&psPool->sMutex, NULL);
+	pthread_mutex_init(&psPool->sRunMutex, NULL);
+	pthread_cond_init(&psPool->sWorkCond, NULL);
+	pthread_cond_init(&psPool->sDoneCond, NULL);
+	atomic_init(&psPool->ui32NextJob, 0);
+
+	for (uint32_t i = 0; i < psPool->ui32NumThreads; ++i)
+	{
+		if (pthread_create(&psPool->psThreads[i], NULL, WorkerThread, psPool) != 0)
+		{
+			printf("failed to create worker thread %u\n", i);
+
+			// Run with however many threads were created
+			psPool->ui32NumThreads = i;
+			break;
+		}
+	}
+
+	return psPool;
+}
+
+uint32_t GetThreadPoolSize(const TIM_THREAD_POOL* psPool)
+{
+	return psPool->ui32NumThreads;
+}
+
+void RunThreadPoolJobs(
+	TIM_THREAD_POOL* psPool,
+	TIM_JOB_FUNC pfnJob,
+	void* pvUserData,
+	const uint32_t ui32NumJobs)
+{
+	assert(psPool != NULL);
+	assert(pfnJob != NULL);
+
+	pthread_mutex_lock(&psPool->sRunMutex);
+
+	pthread_mutex_lock(&psPool->sMutex);
+	psPool->pfnJob = pfnJob;
+	psPool->pvUserData = pvUserData;
+	psPool->ui32NumJobs = ui32NumJobs;
+	atomic_store(&psPool->ui32NextJob, 0);
+	psPool->ui32NumActive = psPool->ui32NumThreads;
+	++psPool->ui32Generation;
+	pthread_cond_broadcast(&psPool->sWorkCond);
+	pthread_mutex_unlock(&psPool->sMutex);
+
+	RunJobs(psPool);
+
+	pthread_mutex_lock(&psPool->sMutex);
+	while (psPool->ui32NumActive > 0)
+	{
+		pthread_cond_wait(&psPool->sDoneCond, &psPool->sMutex);
+	}
+	pthread_mutex_unlock(&psPool->sMutex);
+
+	pthread_mutex_unlock(&psPool->sRunMutex);
+}
+
+void DestroyThreadPool(TIM_THREAD_POOL* psPool)
+{
+	if (psPool == NULL)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&psPool->sMutex);
+	psPool->bQuit = true;
+	pthread_cond_broadcast(&psPool->sWorkCond);
+	pthread_mutex_unlock(&psPool->sMutex);
+
+	for (uint32_t i = 0; i < psPool->ui32NumThreads; ++i)
+	{
+		pthread_join(psPool->psThreads[i], NULL);
+	}
+
+	pthread_cond_destroy(&psPool->sDoneCond);
+	pthread_cond_destroy(&psPool->sWorkCond);
+	pthread_mutex_destroy(&psPool->sRunMutex);
+	pthread_mutex_destroy(&psPool->sMutex);
+
+	free(psPool->psThreads);
+	free(psPool);
+}
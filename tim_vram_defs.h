@@ -0,0 +1,199 @@
+#ifndef TIM_VRAM_DEFS_H
+#define TIM_VRAM_DEFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tim_defs.h"
+
+// Raw VRAM dumps are the full 1024x512 halfword framebuffer, row by row
+#define PSX_VRAM_SIZE_IN_BYTES (PSX_VRAM_WIDTH * PSX_VRAM_HEIGHT * sizeof(uint16_t))
+
+// A rectangle within VRAM, in halfwords
+typedef struct _VRAM_RECT
+{
+	uint16_t ui16X;
+	uint16_t ui16Y;
+	uint16_t ui16Width;
+	uint16_t ui16Height;
+} VRAM_RECT;
+
+typedef struct _VRAM_MAPPING
+{
+	uint16_t* pui16Data;
+	bool bWritable;
+} VRAM_MAPPING;
+
+// Maps a raw VRAM dump, a writable mapping creates the file if needed
+int MapVRAMDump(
+	const char* pszFileName,
+	const bool bWritable,
+	VRAM_MAPPING* psMapping);
+
+int UnmapVRAMDump(VRAM_MAPPING* psMapping);
+
+VRAM_RECT GetVRAMRect(const TIM_BLOCK_HEADER* psHeader);
+
+bool IsVRAMRectValid(const VRAM_RECT* psRect);
+
+// Row by row copies between a VRAM image and a block's data
+void WriteVRAMRect(uint16_t* pui16VRAM, const VRAM_RECT* psRect, const void* pvData);
+void ReadVRAMRect(const uint16_t* pui16VRAM, const VRAM_RECT* psRect, void* pvData);
+
+// Copies the CLUT and pixel blocks of a TIM to their FB coordinates
+int BlitTIMToVRAM(uint16_t* pui16VRAM, const TIM_FILE* psFile);
+
+// Converts a rect of a VRAM image to RGBA as if every halfword were a 15 bit
+// colour, which is how VRAM viewers show it. ui32Pitch is in pixels, and the
+// rect's top left is written to psPixels[0]
+void DecodeVRAMRect(
+	const uint16_t* pui16VRAM,
+	const VRAM_RECT* psRect,
+	R8G8B8A8* psPixels,
+	const uint32_t ui32Pitch);
+
+// Builds a TIM from a CLUT and pixel rect of a VRAM image, the pixel rect is
+// in halfwords, as in the pixel block header
+int ExtractTIMFromVRAM(
+	const uint16_t* pui16VRAM,
+	const TIM_PIX_FMT ePixFmt,
+	const VRAM_RECT* psPixelRect,
+	const VRAM_RECT* psCLUTRect,
+	TIM_FILE* psFile);
+
+// Texture pages are 64 halfwords wide and 256 lines tall
+#define PSX_TPAGE_WIDTH (64)
+#define PSX_TPAGE_HEIGHT (256)
+
+// CLUT X coordinates must be a multiple of 16 halfwords
+#define PSX_CLUT_ALIGN_X (16)
+
+// The GP0 texpage attribute of a texture at a VRAM coordinate, with semi
+// transparency mode 0
+uint16_t GetVRAMTPageID(const TIM_PIX_FMT ePixFmt, const uint16_t ui16X, const uint16_t ui16Y);
+
+// The attribute used by textured primitives to sample from a CLUT
+uint16_t GetVRAMCLUTID(const uint16_t ui16X, const uint16_t ui16Y);
+
+// Everything a sprite needs to sample a texture, as written to the attribute
+// tables of timpack --emit-attrs
+typedef struct _VRAM_TEXTURE_ATTRS
+{
+	uint16_t ui16TPage;
+	uint16_t ui16CLUT;
+
+	// The texture's top left corner within its texture page, in pixels
+	uint8_t ui8U;
+	uint8_t ui8V;
+
+	// The texture's size in pixels
+	uint16_t ui16Width;
+	uint16_t ui16Height;
+
+	uint16_t ui16Reserved;
+} VRAM_TEXTURE_ATTRS;
+
+void GetVRAMTextureAttrs(const TIM_FILE* psFile, VRAM_TEXTURE_ATTRS* psAttrs);
+
+typedef enum _VRAM_PLACEMENT
+{
+	// Kept within one texture page, or started at a page origin if too large
+	VRAM_PLACEMENT_TEXTURE,
+	// X aligned for use as a CLUT
+	VRAM_PLACEMENT_CLUT,
+} VRAM_PLACEMENT;
+
+// MaxRects bin packer over the free space of VRAM
+typedef struct _VRAM_PACKER
+{
+	VRAM_RECT* psFreeRects;
+	uint32_t ui32NumFreeRects;
+	uint32_t ui32Capacity;
+} VRAM_PACKER;
+
+int InitVRAMPacker(VRAM_PACKER* psPacker);
+
+// Marks a rect as occupied, so nothing is packed over it
+int ReserveVRAMRect(VRAM_PACKER* psPacker, const VRAM_RECT* psRect);
+
+// Finds space for a ui16Width * ui16Height rect, and reserves it
+int PackVRAMRect(
+	VRAM_PACKER* psPacker,
+	const uint16_t ui16Width,
+	const uint16_t ui16Height,
+	const VRAM_PLACEMENT ePlacement,
+	VRAM_RECT* psRect);
+
+void DestroyVRAMPacker(VRAM_PACKER* psPacker);
+
+bool DoVRAMRectsOverlap(const VRAM_RECT* psA, const VRAM_RECT* psB);
+
+// Parses a rect given on the command line as "x,y,w,h"
+int ParseVRAMRect(const char* pszRect, VRAM_RECT* psRect);
+
+// One bit per VRAM halfword, 64 halfwords to a word
+#define VRAM_BITMAP_WORDS_PER_ROW (PSX_VRAM_WIDTH / 64)
+
+typedef struct _VRAM_BITMAP
+{
+	uint64_t aui64Rows[PSX_VRAM_HEIGHT][VRAM_BITMAP_WORDS_PER_ROW];
+} VRAM_BITMAP;
+
+void ClearVRAMBitmap(VRAM_BITMAP* psBitmap);
+
+void SetVRAMBitmapRect(VRAM_BITMAP* psBitmap, const VRAM_RECT* psRect);
+
+// Sets the rect as SetVRAMBitmapRect does, also setting every bit which was
+// already set in psOverlapBitmap
+void SetVRAMBitmapRectOverlaps(
+	VRAM_BITMAP* psBitmap,
+	VRAM_BITMAP* psOverlapBitmap,
+	const VRAM_RECT* psRect);
+
+bool IsVRAMBitmapRectFree(const VRAM_BITMAP* psBitmap, const VRAM_RECT* psRect);
+
+// The number of halfwords left free in the bitmap
+uint32_t CountVRAMBitmapFree(const VRAM_BITMAP* psBitmap);
+
+// Finds the top left most free ui16Width * ui16Height rect with X aligned for
+// a CLUT, without marking it
+bool FindVRAMBitmapCLUTSpace(
+	const VRAM_BITMAP* psBitmap,
+	const uint16_t ui16Width,
+	const uint16_t ui16Height,
+	VRAM_RECT* psRect);
+
+typedef struct _VRAM_LAYOUT_ENTRY
+{
+	char* pszFileName;
+	VRAM_RECT sPixelRect;
+	VRAM_RECT sCLUTRect;
+
+	// Hash of the CLUT and pixel data, to find which textures have changed
+	uint32_t ui32Hash;
+} VRAM_LAYOUT_ENTRY;
+
+// The placement of a set of TIM files, as written to a layout manifest
+typedef struct _VRAM_LAYOUT
+{
+	VRAM_LAYOUT_ENTRY* psEntries;
+	uint32_t ui32NumEntries;
+
+	VRAM_RECT* psReservedRects;
+	uint32_t ui32NumReservedRects;
+} VRAM_LAYOUT;
+
+uint32_t HashTIM(const TIM_FILE* psFile);
+
+int AddVRAMLayoutEntry(
+	VRAM_LAYOUT* psLayout,
+	const char* pszFileName,
+	const TIM_FILE* psFile);
+
+int WriteVRAMLayout(const char* pszOutputFileName, const VRAM_LAYOUT* psLayout);
+
+int ReadVRAMLayout(const char* pszInputFileName, VRAM_LAYOUT* psLayout);
+
+void DestroyVRAMLayout(VRAM_LAYOUT* psLayout);
+
+#endif // TIM_VRAM_DEFS_H
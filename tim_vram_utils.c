@@ -0,0 +1,1029 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tim_defs.h"
+#include "tim_vram_defs.h"
+
+int MapVRAMDump(
+	const char* pszFileName,
+	const bool bWritable,
+	VRAM_MAPPING* psMapping)
+{
+	struct stat sStat;
+	void* pvData;
+
+	assert(psMapping != NULL);
+
+	memset(psMapping, 0, sizeof(VRAM_MAPPING));
+
+	int iFD = open(pszFileName, bWritable ? (O_RDWR | O_CREAT) : O_RDONLY, 0666);
+	if (iFD < 0)
+	{
+		printf("could not open %s for %s\n", pszFileName, bWritable ? "writing" : "reading");
+		return 1;
+	}
+
+	if (fstat(iFD, &sStat) != 0)
+	{
+		printf("could not stat %s\n", pszFileName);
+		close(iFD);
+		return 1;
+	}
+
+	// New dumps are grown to the size of VRAM, which reads back as zeroes
+	if (sStat.st_size < (off_t)PSX_VRAM_SIZE_IN_BYTES)
+	{
+		if (!bWritable || (sStat.st_size != 0) || (ftruncate(iFD, PSX_VRAM_SIZE_IN_BYTES) != 0))
+		{
+			printf(
+				"%s is %lld bytes, expected a %u byte VRAM dump\n",
+				pszFileName,
+				(long long)sStat.st_size,
+				(uint32_t)PSX_VRAM_SIZE_IN_BYTES
+			);
+			close(iFD);
+			return 1;
+		}
+	}
+
+	pvData = mmap(
+		NULL,
+		PSX_VRAM_SIZE_IN_BYTES,
+		bWritable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+		MAP_SHARED,
+		iFD,
+		0
+	);
+
+	close(iFD);
+
+	if (pvData == MAP_FAILED)
+	{
+		printf("could not map %s\n", pszFileName);
+		return 1;
+	}
+
+	psMapping->pui16Data = pvData;
+	psMapping->bWritable = bWritable;
+
+	return 0;
+}
+
+int UnmapVRAMDump(VRAM_MAPPING* psMapping)
+{
+	int iResult = 0;
+
+	if (psMapping->pui16Data == NULL)
+	{
+		return 0;
+	}
+
+	if (psMapping->bWritable &&
+		(msync(psMapping->pui16Data, PSX_VRAM_SIZE_IN_BYTES, MS_SYNC) != 0))
+	{
+		printf("failed to flush VRAM dump\n");
+		iResult = 1;
+	}
+
+	munmap(psMapping->pui16Data, PSX_VRAM_SIZE_IN_BYTES);
+	memset(psMapping, 0, sizeof(VRAM_MAPPING));
+
+	return iResult;
+}
+
+VRAM_RECT GetVRAMRect(const TIM_BLOCK_HEADER* psHeader)
+{
+	VRAM_RECT sRect = {
+		.ui16X = psHeader->ui16FBCoordX,
+		.ui16Y = psHeader->ui16FBCoordY,
+		.ui16Width = psHeader->ui16Width,
+		.ui16Height = psHeader->ui16Height
+	};
+
+	return sRect;
+}
+
+bool IsVRAMRectValid(const VRAM_RECT* psRect)
+{
+	return (
+		((psRect->ui16X + psRect->ui16Width) <= PSX_VRAM_WIDTH) &&
+		((psRect->ui16Y + psRect->ui16Height) <= PSX_VRAM_HEIGHT)
+	);
+}
+
+void WriteVRAMRect(uint16_t* pui16VRAM, const VRAM_RECT* psRect, const void* pvData)
+{
+	const uint16_t* pui16Src = pvData;
+	uint16_t* pui16Dst = &pui16VRAM[(psRect->ui16Y * PSX_VRAM_WIDTH) + psRect->ui16X];
+
+	assert(IsVRAMRectValid(psRect));
+
+	for (uint32_t y = 0; y < psRect->ui16Height; ++y)
+	{
+		memcpy(pui16Dst, pui16Src, psRect->ui16Width * sizeof(uint16_t));
+		pui16Dst += PSX_VRAM_WIDTH;
+		pui16Src += psRect->ui16Width;
+	}
+}
+
+void ReadVRAMRect(const uint16_t* pui16VRAM, const VRAM_RECT* psRect, void* pvData)
+{
+	const uint16_t* pui16Src = &pui16VRAM[(psRect->ui16Y * PSX_VRAM_WIDTH) + psRect->ui16X];
+	uint16_t* pui16Dst = pvData;
+
+	assert(IsVRAMRectValid(psRect));
+
+	for (uint32_t y = 0; y < psRect->ui16Height; ++y)
+	{
+		memcpy(pui16Dst, pui16Src, psRect->ui16Width * sizeof(uint16_t));
+		pui16Src += PSX_VRAM_WIDTH;
+		pui16Dst += psRect->ui16Width;
+	}
+}
+
+void DecodeVRAMRect(
+	const uint16_t* pui16VRAM,
+	const VRAM_RECT* psRect,
+	R8G8B8A8* psPixels,
+	const uint32_t ui32Pitch)
+{
+	assert(IsVRAMRectValid(psRect));
+
+	for (uint32_t y = 0; y < psRect->ui16Height; ++y)
+	{
+		const uint16_t* pui16Src = &pui16VRAM[((psRect->ui16Y + y) * PSX_VRAM_WIDTH) + psRect->ui16X];
+		R8G8B8A8* psDst = &psPixels[y * ui32Pitch];
+
+		for (uint32_t x = 0; x < psRect->ui16Width; ++x)
+		{
+			const uint16_t ui16Pix = pui16Src[x];
+
+			// Opaque regardless of STP, so black texels stay visible
+			psDst[x].uRed = CONV_U5_TO_U8(ui16Pix);
+			psDst[x].uGreen = CONV_U5_TO_U8(ui16Pix >> 5);
+			psDst[x].uBlue = CONV_U5_TO_U8(ui16Pix >> 10);
+			psDst[x].uAlpha = 0xff;
+		}
+	}
+}
+
+int BlitTIMToVRAM(uint16_t* pui16VRAM, const TIM_FILE* psFile)
+{
+	const VRAM_RECT sPixelRect = GetVRAMRect(&psFile->sPixelHeader);
+
+	if (psFile->sFileHeader.sFlags.uClut)
+	{
+		const VRAM_RECT sCLUTRect = GetVRAMRect(&psFile->sCLUTHeader);
+
+		if (!IsVRAMRectValid(&sCLUTRect) ||
+			((psFile->sCLUTHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER)) <
+				(sCLUTRect.ui16Width * sCLUTRect.ui16Height * sizeof(uint16_t))))
+		{
+			printf("CLUT block does not fit within PSX VRAM\n");
+			return 1;
+		}
+
+		WriteVRAMRect(pui16VRAM, &sCLUTRect, psFile->psCLUTData);
+	}
+
+	if (!IsVRAMRectValid(&sPixelRect) ||
+		((psFile->sPixelHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER)) <
+			(sPixelRect.ui16Width * sPixelRect.ui16Height * sizeof(uint16_t))))
+	{
+		printf("Pixel block does not fit within PSX VRAM\n");
+		return 1;
+	}
+
+	WriteVRAMRect(pui16VRAM, &sPixelRect, psFile->pui8PixelData);
+
+	return 0;
+}
+
+static int ExtractVRAMBlock(
+	const uint16_t* pui16VRAM,
+	const VRAM_RECT* psRect,
+	TIM_BLOCK_HEADER* psHeader,
+	void** ppvData)
+{
+	uint32_t ui32DataInBytes = psRect->ui16Width * psRect->ui16Height * sizeof(uint16_t);
+	ui32DataInBytes = ALIGN_UP(ui32DataInBytes, 4);
+
+	if ((psRect->ui16Width == 0) || (psRect->ui16Height == 0) || !IsVRAMRectValid(psRect))
+	{
+		printf(
+			"rect %hu, %hu, %hu * %hu does not fit within PSX VRAM\n",
+			psRect->ui16X,
+			psRect->ui16Y,
+			psRect->ui16Width,
+			psRect->ui16Height
+		);
+		return 1;
+	}
+
+	*ppvData = calloc(ui32DataInBytes, 1);
+	if (*ppvData == NULL)
+	{
+		printf("failed to allocate block data\n");
+		return 1;
+	}
+
+	ReadVRAMRect(pui16VRAM, psRect, *ppvData);
+
+	psHeader->ui32SizeInBytes = sizeof(TIM_BLOCK_HEADER) + ui32DataInBytes;
+	psHeader->ui16FBCoordX = psRect->ui16X;
+	psHeader->ui16FBCoordY = psRect->ui16Y;
+	psHeader->ui16Width = psRect->ui16Width;
+	psHeader->ui16Height = psRect->ui16Height;
+
+	return 0;
+}
+
+int ExtractTIMFromVRAM(
+	const uint16_t* pui16VRAM,
+	const TIM_PIX_FMT ePixFmt,
+	const VRAM_RECT* psPixelRect,
+	const VRAM_RECT* psCLUTRect,
+	TIM_FILE* psFile)
+{
+	memset(psFile, 0, sizeof(TIM_FILE));
+
+	psFile->sFileHeader.ui32ID = TIM_FILE_HEADER_ID;
+	psFile->sFileHeader.sFlags.uMode = ePixFmt;
+	psFile->sFileHeader.sFlags.uClut = TIM_PIX_FMT_HAS_CLUT(ePixFmt);
+
+	if (psFile->sFileHeader.sFlags.uClut &&
+		(ExtractVRAMBlock(
+			pui16VRAM,
+			psCLUTRect,
+			&psFile->sCLUTHeader,
+			(void**)&psFile->psCLUTData
+		) != 0))
+	{
+		return 1;
+	}
+
+	if (ExtractVRAMBlock(
+			pui16VRAM,
+			psPixelRect,
+			&psFile->sPixelHeader,
+			(void**)&psFile->pui8PixelData
+		) != 0)
+	{
+		DestroyTIM(psFile);
+		return 1;
+	}
+
+	return 0;
+}
+
+bool DoVRAMRectsOverlap(const VRAM_RECT* psA, const VRAM_RECT* psB)
+{
+	return (
+		(psA->ui16X < (psB->ui16X + psB->ui16Width)) &&
+		(psB->ui16X < (psA->ui16X + psA->ui16Width)) &&
+		(psA->ui16Y < (psB->ui16Y + psB->ui16Height)) &&
+		(psB->ui16Y < (psA->ui16Y + psA->ui16Height))
+	);
+}
+
+static bool IsVRAMRectContained(const VRAM_RECT* psInner, const VRAM_RECT* psOuter)
+{
+	return (
+		(psInner->ui16X >= psOuter->ui16X) &&
+		(psInner->ui16Y >= psOuter->ui16Y) &&
+		((psInner->ui16X + psInner->ui16Width) <= (psOuter->ui16X + psOuter->ui16Width)) &&
+		((psInner->ui16Y + psInner->ui16Height) <= (psOuter->ui16Y + psOuter->ui16Height))
+	);
+}
+
+int ParseVRAMRect(const char* pszRect, VRAM_RECT* psRect)
+{
+	if ((sscanf(
+			pszRect,
+			"%hu,%hu,%hu,%hu",
+			&psRect->ui16X,
+			&psRect->ui16Y,
+			&psRect->ui16Width,
+			&psRect->ui16Height
+		) != 4) ||
+		!IsVRAMRectValid(psRect))
+	{
+		printf("expected a rect within VRAM as x,y,w,h (%s provided)\n", pszRect);
+		return 1;
+	}
+
+	return 0;
+}
+
+uint16_t GetVRAMTPageID(const TIM_PIX_FMT ePixFmt, const uint16_t ui16X, const uint16_t ui16Y)
+{
+	return (
+		((ePixFmt & 0x3) << 7) |
+		((ui16Y / PSX_TPAGE_HEIGHT) << 4) |
+		((ui16X / PSX_TPAGE_WIDTH) & 0xF)
+	);
+}
+
+uint16_t GetVRAMCLUTID(const uint16_t ui16X, const uint16_t ui16Y)
+{
+	return (ui16Y << 6) | ((ui16X / PSX_CLUT_ALIGN_X) & 0x3F);
+}
+
+void GetVRAMTextureAttrs(const TIM_FILE* psFile, VRAM_TEXTURE_ATTRS* psAttrs)
+{
+	const TIM_BLOCK_HEADER* psPixelHeader = &psFile->sPixelHeader;
+	const uint32_t ui32PixelsPerHalfword = (
+		(psFile->sFileHeader.sFlags.uMode == TIM_PIX_FMT_4BIT_CLUT) ? 4 :
+		(psFile->sFileHeader.sFlags.uMode == TIM_PIX_FMT_8BIT_CLUT) ? 2 :
+		1
+	);
+
+	memset(psAttrs, 0, sizeof(VRAM_TEXTURE_ATTRS));
+
+	psAttrs->ui16TPage = GetVRAMTPageID(
+		psFile->sFileHeader.sFlags.uMode,
+		psPixelHeader->ui16FBCoordX,
+		psPixelHeader->ui16FBCoordY
+	);
+
+	if (psFile->sFileHeader.sFlags.uClut)
+	{
+		psAttrs->ui16CLUT = GetVRAMCLUTID(psFile->sCLUTHeader.ui16FBCoordX, psFile->sCLUTHeader.ui16FBCoordY);
+	}
+
+	psAttrs->ui8U = (psPixelHeader->ui16FBCoordX % PSX_TPAGE_WIDTH) * ui32PixelsPerHalfword;
+	psAttrs->ui8V = psPixelHeader->ui16FBCoordY % PSX_TPAGE_HEIGHT;
+	psAttrs->ui16Width = GetTIMPixelWidth(psFile);
+	psAttrs->ui16Height = psPixelHeader->ui16Height;
+}
+
+static int PushFreeRect(
+	VRAM_RECT** ppsRects,
+	uint32_t* pui32NumRects,
+	uint32_t* pui32Capacity,
+	const VRAM_RECT* psRect)
+{
+	if ((psRect->ui16Width == 0) || (psRect->ui16Height == 0))
+	{
+		return 0;
+	}
+
+	if (*pui32NumRects == *pui32Capacity)
+	{
+		const uint32_t ui32Capacity = (*pui32Capacity == 0) ? 64 : (*pui32Capacity * 2);
+		VRAM_RECT* psRects = realloc(*ppsRects, ui32Capacity * sizeof(VRAM_RECT));
+		if (psRects == NULL)
+		{
+			printf("failed to allocate free rects\n");
+			return 1;
+		}
+
+		*ppsRects = psRects;
+		*pui32Capacity = ui32Capacity;
+	}
+
+	(*ppsRects)[(*pui32NumRects)++] = *psRect;
+
+	return 0;
+}
+
+int InitVRAMPacker(VRAM_PACKER* psPacker)
+{
+	const VRAM_RECT sVRAMRect = { 0, 0, PSX_VRAM_WIDTH, PSX_VRAM_HEIGHT };
+
+	memset(psPacker, 0, sizeof(VRAM_PACKER));
+
+	return PushFreeRect(
+		&psPacker->psFreeRects,
+		&psPacker->ui32NumFreeRects,
+		&psPacker->ui32Capacity,
+		&sVRAMRect
+	);
+}
+
+void DestroyVRAMPacker(VRAM_PACKER* psPacker)
+{
+	free(psPacker->psFreeRects);
+	memset(psPacker, 0, sizeof(VRAM_PACKER));
+}
+
+int ReserveVRAMRect(VRAM_PACKER* psPacker, const VRAM_RECT* psRect)
+{
+	VRAM_RECT* psRects = NULL;
+	uint32_t ui32NumRects = 0;
+	uint32_t ui32Capacity = 0;
+
+	// Split every free rect overlapping the reserved one into the maximal
+	// rects left around it
+	for (uint32_t i = 0; i < psPacker->ui32NumFreeRects; ++i)
+	{
+		const VRAM_RECT* psFree = &psPacker->psFreeRects[i];
+		const uint16_t ui16FreeRight = psFree->ui16X + psFree->ui16Width;
+		const uint16_t ui16FreeBottom = psFree->ui16Y + psFree->ui16Height;
+		const uint16_t ui16Right = psRect->ui16X + psRect->ui16Width;
+		const uint16_t ui16Bottom = psRect->ui16Y + psRect->ui16Height;
+
+		if (!DoVRAMRectsOverlap(psFree, psRect))
+		{
+			if (PushFreeRect(&psRects, &ui32NumRects, &ui32Capacity, psFree) != 0)
+			{
+				goto FAILED_ReserveVRAMRect;
+			}
+			continue;
+		}
+
+		{
+			const VRAM_RECT asSplit[4] = {
+				// Left
+				{ psFree->ui16X, psFree->ui16Y, psRect->ui16X - psFree->ui16X, psFree->ui16Height },
+				// Right
+				{ ui16Right, psFree->ui16Y, ui16FreeRight - ui16Right, psFree->ui16Height },
+				// Top
+				{ psFree->ui16X, psFree->ui16Y, psFree->ui16Width, psRect->ui16Y - psFree->ui16Y },
+				// Bottom
+				{ psFree->ui16X, ui16Bottom, psFree->ui16Width, ui16FreeBottom - ui16Bottom },
+			};
+
+			if ((psRect->ui16X > psFree->ui16X) &&
+				(PushFreeRect(&psRects, &ui32NumRects, &ui32Capacity, &asSplit[0]) != 0))
+			{
+				goto FAILED_ReserveVRAMRect;
+			}
+
+			if ((ui16Right < ui16FreeRight) &&
+				(PushFreeRect(&psRects, &ui32NumRects, &ui32Capacity, &asSplit[1]) != 0))
+			{
+				goto FAILED_ReserveVRAMRect;
+			}
+
+			if ((psRect->ui16Y > psFree->ui16Y) &&
+				(PushFreeRect(&psRects, &ui32NumRects, &ui32Capacity, &asSplit[2]) != 0))
+			{
+				goto FAILED_ReserveVRAMRect;
+			}
+
+			if ((ui16Bottom < ui16FreeBottom) &&
+				(PushFreeRect(&psRects, &ui32NumRects, &ui32Capacity, &asSplit[3]) != 0))
+			{
+				goto FAILED_ReserveVRAMRect;
+			}
+		}
+	}
+
+	// Remove free rects which are contained by another
+	for (uint32_t i = 0; i < ui32NumRects; ++i)
+	{
+		for (uint32_t j = i + 1; j < ui32NumRects; ++j)
+		{
+			if (IsVRAMRectContained(&psRects[i], &psRects[j]))
+			{
+				psRects[i--] = psRects[--ui32NumRects];
+				break;
+			}
+
+			if (IsVRAMRectContained(&psRects[j], &psRects[i]))
+			{
+				psRects[j--] = psRects[--ui32NumRects];
+			}
+		}
+	}
+
+	free(psPacker->psFreeRects);
+	psPacker->psFreeRects = psRects;
+	psPacker->ui32NumFreeRects = ui32NumRects;
+	psPacker->ui32Capacity = ui32Capacity;
+
+	return 0;
+
+FAILED_ReserveVRAMRect:
+	free(psRects);
+
+	return 1;
+}
+
+// Finds the top left most position within a free rect that obeys the
+// placement rules, if there is one
+static bool FitVRAMRect(
+	const VRAM_RECT* psFree,
+	const uint16_t ui16Width,
+	const uint16_t ui16Height,
+	const VRAM_PLACEMENT ePlacement,
+	VRAM_RECT* psRect)
+{
+	uint32_t ui32X = psFree->ui16X;
+	uint32_t ui32Y = psFree->ui16Y;
+
+	if (ePlacement == VRAM_PLACEMENT_CLUT)
+	{
+		ui32X = ALIGN_UP(ui32X, PSX_CLUT_ALIGN_X);
+	}
+	else
+	{
+		if ((ui16Width > PSX_TPAGE_WIDTH) ||
+			(((ui32X % PSX_TPAGE_WIDTH) + ui16Width) > PSX_TPAGE_WIDTH))
+		{
+			ui32X = ALIGN_UP(ui32X, PSX_TPAGE_WIDTH);
+		}
+
+		if ((ui16Height > PSX_TPAGE_HEIGHT) ||
+			(((ui32Y % PSX_TPAGE_HEIGHT) + ui16Height) > PSX_TPAGE_HEIGHT))
+		{
+			ui32Y = ALIGN_UP(ui32Y, PSX_TPAGE_HEIGHT);
+		}
+	}
+
+	if (((ui32X + ui16Width) > (uint32_t)(psFree->ui16X + psFree->ui16Width)) ||
+		((ui32Y + ui16Height) > (uint32_t)(psFree->ui16Y + psFree->ui16Height)))
+	{
+		return false;
+	}
+
+	psRect->ui16X = ui32X;
+	psRect->ui16Y = ui32Y;
+	psRect->ui16Width = ui16Width;
+	psRect->ui16Height = ui16Height;
+
+	return true;
+}
+
+int PackVRAMRect(
+	VRAM_PACKER* psPacker,
+	const uint16_t ui16Width,
+	const uint16_t ui16Height,
+	const VRAM_PLACEMENT ePlacement,
+	VRAM_RECT* psRect)
+{
+	bool bFound = false;
+	uint32_t ui32BestShortSide = UINT32_MAX;
+	uint32_t ui32BestLongSide = UINT32_MAX;
+
+	if ((ui16Width == 0) || (ui16Height == 0))
+	{
+		return 1;
+	}
+
+	// Best short side fit: the free rect leaving the least space on its
+	// tightest side
+	for (uint32_t i = 0; i < psPacker->ui32NumFreeRects; ++i)
+	{
+		const VRAM_RECT* psFree = &psPacker->psFreeRects[i];
+		VRAM_RECT sCandidate;
+
+		if (FitVRAMRect(psFree, ui16Width, ui16Height, ePlacement, &sCandidate))
+		{
+			const uint32_t ui32LeftoverX = (psFree->ui16X + psFree->ui16Width) - (sCandidate.ui16X + ui16Width);
+			const uint32_t ui32LeftoverY = (psFree->ui16Y + psFree->ui16Height) - (sCandidate.ui16Y + ui16Height);
+			const uint32_t ui32ShortSide = (ui32LeftoverX < ui32LeftoverY) ? ui32LeftoverX : ui32LeftoverY;
+			const uint32_t ui32LongSide = (ui32LeftoverX < ui32LeftoverY) ? ui32LeftoverY : ui32LeftoverX;
+
+			if ((ui32ShortSide < ui32BestShortSide) ||
+				((ui32ShortSide == ui32BestShortSide) && (ui32LongSide < ui32BestLongSide)))
+			{
+				*psRect = sCandidate;
+				ui32BestShortSide = ui32ShortSide;
+				ui32BestLongSide = ui32LongSide;
+				bFound = true;
+			}
+		}
+	}
+
+	if (!bFound)
+	{
+		return 1;
+	}
+
+	return ReserveVRAMRect(psPacker, psRect);
+}
+
+uint32_t HashTIM(const TIM_FILE* psFile)
+{
+	uint32_t ui32Hash = TIM_HASH_SEED;
+
+	if (psFile->sFileHeader.sFlags.uClut)
+	{
+		ui32Hash = HashTIMData(
+			psFile->psCLUTData,
+			psFile->sCLUTHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER),
+			ui32Hash
+		);
+	}
+
+	return HashTIMData(
+		psFile->pui8PixelData,
+		psFile->sPixelHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER),
+		ui32Hash
+	);
+}
+
+static int PushVRAMLayoutEntry(VRAM_LAYOUT* psLayout, VRAM_LAYOUT_ENTRY** ppsEntry)
+{
+	// Grow in powers of two
+	if ((psLayout->ui32NumEntries & (psLayout->ui32NumEntries - 1)) == 0)
+	{
+		const uint32_t ui32Capacity = (psLayout->ui32NumEntries == 0) ? 1 : (psLayout->ui32NumEntries * 2);
+		VRAM_LAYOUT_ENTRY* psEntries = realloc(psLayout->psEntries, ui32Capacity * sizeof(VRAM_LAYOUT_ENTRY));
+		if (psEntries == NULL)
+		{
+			printf("failed to allocate layout entries\n");
+			return 1;
+		}
+
+		psLayout->psEntries = psEntries;
+	}
+
+	*ppsEntry = &psLayout->psEntries[psLayout->ui32NumEntries++];
+	memset(*ppsEntry, 0, sizeof(VRAM_LAYOUT_ENTRY));
+
+	return 0;
+}
+
+int AddVRAMLayoutEntry(
+	VRAM_LAYOUT* psLayout,
+	const char* pszFileName,
+	const TIM_FILE* psFile)
+{
+	VRAM_LAYOUT_ENTRY* psEntry;
+
+	if (PushVRAMLayoutEntry(psLayout, &psEntry) != 0)
+	{
+		return 1;
+	}
+
+	psEntry->pszFileName = strdup(pszFileName);
+	psEntry->sPixelRect = GetVRAMRect(&psFile->sPixelHeader);
+	if (psFile->sFileHeader.sFlags.uClut)
+	{
+		psEntry->sCLUTRect = GetVRAMRect(&psFile->sCLUTHeader);
+	}
+	psEntry->ui32Hash = HashTIM(psFile);
+
+	return 0;
+}
+
+int WriteVRAMLayout(const char* pszOutputFileName, const VRAM_LAYOUT* psLayout)
+{
+	FILE *fFilePtr = fopen(pszOutputFileName, "w");
+	if (fFilePtr == NULL)
+	{
+		printf("could not open %s for writing\n", pszOutputFileName);
+		return 1;
+	}
+
+	fprintf(
+		fFilePtr,
+		"# timpack layout\n"
+		"# reserve X Y W H\n"
+		"# tim FILE PIXEL_X PIXEL_Y PIXEL_W PIXEL_H CLUT_X CLUT_Y CLUT_W CLUT_H HASH\n"
+	);
+
+	for (uint32_t i = 0; i < psLayout->ui32NumReservedRects; ++i)
+	{
+		const VRAM_RECT* psRect = &psLayout->psReservedRects[i];
+
+		fprintf(
+			fFilePtr,
+			"reserve %hu %hu %hu %hu\n",
+			psRect->ui16X,
+			psRect->ui16Y,
+			psRect->ui16Width,
+			psRect->ui16Height
+		);
+	}
+
+	for (uint32_t i = 0; i < psLayout->ui32NumEntries; ++i)
+	{
+		const VRAM_LAYOUT_ENTRY* psEntry = &psLayout->psEntries[i];
+
+		fprintf(
+			fFilePtr,
+			"tim %s %hu %hu %hu %hu %hu %hu %hu %hu %08x\n",
+			psEntry->pszFileName,
+			psEntry->sPixelRect.ui16X,
+			psEntry->sPixelRect.ui16Y,
+			psEntry->sPixelRect.ui16Width,
+			psEntry->sPixelRect.ui16Height,
+			psEntry->sCLUTRect.ui16X,
+			psEntry->sCLUTRect.ui16Y,
+			psEntry->sCLUTRect.ui16Width,
+			psEntry->sCLUTRect.ui16Height,
+			psEntry->ui32Hash
+		);
+	}
+
+	if (fclose(fFilePtr) != 0)
+	{
+		printf("failed to write %s\n", pszOutputFileName);
+		return 1;
+	}
+
+	return 0;
+}
+
+int ReadVRAMLayout(const char* pszInputFileName, VRAM_LAYOUT* psLayout)
+{
+	char szLine[4096];
+	char szFileName[4096];
+	uint32_t ui32LineNumber = 0;
+
+	memset(psLayout, 0, sizeof(VRAM_LAYOUT));
+
+	FILE *fFilePtr = fopen(pszInputFileName, "r");
+	if (fFilePtr == NULL)
+	{
+		printf("could not open %s for reading\n", pszInputFileName);
+		return 1;
+	}
+
+	while (fgets(szLine, sizeof(szLine), fFilePtr) != NULL)
+	{
+		VRAM_RECT sRect;
+		VRAM_LAYOUT_ENTRY sEntry;
+
+		++ui32LineNumber;
+
+		if (sscanf(
+				szLine,
+				"reserve %hu %hu %hu %hu",
+				&sRect.ui16X,
+				&sRect.ui16Y,
+				&sRect.ui16Width,
+				&sRect.ui16Height
+			) == 4)
+		{
+			uint32_t ui32Capacity = psLayout->ui32NumReservedRects;
+
+			if (PushFreeRect(
+					&psLayout->psReservedRects,
+					&psLayout->ui32NumReservedRects,
+					&ui32Capacity,
+					&sRect
+				) != 0)
+			{
+				goto FAILED_ReadVRAMLayout;
+			}
+		}
+		else if (sscanf(
+				szLine,
+				"tim %4095s %hu %hu %hu %hu %hu %hu %hu %hu %x",
+				szFileName,
+				&sEntry.sPixelRect.ui16X,
+				&sEntry.sPixelRect.ui16Y,
+				&sEntry.sPixelRect.ui16Width,
+				&sEntry.sPixelRect.ui16Height,
+				&sEntry.sCLUTRect.ui16X,
+				&sEntry.sCLUTRect.ui16Y,
+				&sEntry.sCLUTRect.ui16Width,
+				&sEntry.sCLUTRect.ui16Height,
+				&sEntry.ui32Hash
+			) == 10)
+		{
+			VRAM_LAYOUT_ENTRY* psEntry;
+
+			if (PushVRAMLayoutEntry(psLayout, &psEntry) != 0)
+			{
+				goto FAILED_ReadVRAMLayout;
+			}
+
+			*psEntry = sEntry;
+			psEntry->pszFileName = strdup(szFileName);
+		}
+		else if ((szLine[0] != '#') && (szLine[0] != '\n'))
+		{
+			printf("%s:%u: unrecognised layout line\n", pszInputFileName, ui32LineNumber);
+			goto FAILED_ReadVRAMLayout;
+		}
+	}
+
+	fclose(fFilePtr);
+
+	return 0;
+
+FAILED_ReadVRAMLayout:
+	fclose(fFilePtr);
+	DestroyVRAMLayout(psLayout);
+
+	return 1;
+}
+
+void DestroyVRAMLayout(VRAM_LAYOUT* psLayout)
+{
+	for (uint32_t i = 0; i < psLayout->ui32NumEntries; ++i)
+	{
+		free(psLayout->psEntries[i].pszFileName);
+	}
+
+	free(psLayout->psEntries);
+	free(psLayout->psReservedRects);
+	memset(psLayout, 0, sizeof(VRAM_LAYOUT));
+}
+
+void ClearVRAMBitmap(VRAM_BITMAP* psBitmap)
+{
+	memset(psBitmap, 0, sizeof(VRAM_BITMAP));
+}
+
+// The bits of word ui32Word covered by [ui32X, ui32X + ui32Width)
+static uint64_t GetVRAMBitmapMask(const uint32_t ui32Word, const uint32_t ui32X, const uint32_t ui32Width)
+{
+	const uint32_t ui32WordStart = ui32Word * 64;
+	const uint32_t ui32Start = (ui32X > ui32WordStart) ? (ui32X - ui32WordStart) : 0;
+	const uint32_t ui32End = (
+		((ui32X + ui32Width) < (ui32WordStart + 64)) ?
+		(ui32X + ui32Width - ui32WordStart) :
+		64
+	);
+	const uint64_t ui64EndMask = (ui32End == 64) ? UINT64_MAX : ((1ULL << ui32End) - 1);
+
+	return ui64EndMask & ~((1ULL << ui32Start) - 1);
+}
+
+void SetVRAMBitmapRect(VRAM_BITMAP* psBitmap, const VRAM_RECT* psRect)
+{
+	const uint32_t ui32FirstWord = psRect->ui16X / 64;
+	const uint32_t ui32LastWord = (psRect->ui16X + psRect->ui16Width - 1) / 64;
+
+	assert(IsVRAMRectValid(psRect));
+
+	if ((psRect->ui16Width == 0) || (psRect->ui16Height == 0))
+	{
+		return;
+	}
+
+	for (uint32_t i = ui32FirstWord; i <= ui32LastWord; ++i)
+	{
+		const uint64_t ui64Mask = GetVRAMBitmapMask(i, psRect->ui16X, psRect->ui16Width);
+
+		for (uint32_t y = psRect->ui16Y; y < (uint32_t)(psRect->ui16Y + psRect->ui16Height); ++y)
+		{
+			psBitmap->aui64Rows[y][i] |= ui64Mask;
+		}
+	}
+}
+
+void SetVRAMBitmapRectOverlaps(
+	VRAM_BITMAP* psBitmap,
+	VRAM_BITMAP* psOverlapBitmap,
+	const VRAM_RECT* psRect)
+{
+	const uint32_t ui32FirstWord = psRect->ui16X / 64;
+	const uint32_t ui32LastWord = (psRect->ui16X + psRect->ui16Width - 1) / 64;
+
+	assert(IsVRAMRectValid(psRect));
+
+	if ((psRect->ui16Width == 0) || (psRect->ui16Height == 0))
+	{
+		return;
+	}
+
+	for (uint32_t i = ui32FirstWord; i <= ui32LastWord; ++i)
+	{
+		const uint64_t ui64Mask = GetVRAMBitmapMask(i, psRect->ui16X, psRect->ui16Width);
+
+		for (uint32_t y = psRect->ui16Y; y < (uint32_t)(psRect->ui16Y + psRect->ui16Height); ++y)
+		{
+			psOverlapBitmap->aui64Rows[y][i] |= psBitmap->aui64Rows[y][i] & ui64Mask;
+			psBitmap->aui64Rows[y][i] |= ui64Mask;
+		}
+	}
+}
+
+bool IsVRAMBitmapRectFree(const VRAM_BITMAP* psBitmap, const VRAM_RECT* psRect)
+{
+	const uint32_t ui32FirstWord = psRect->ui16X / 64;
+	const uint32_t ui32LastWord = (psRect->ui16X + psRect->ui16Width - 1) / 64;
+
+	if ((psRect->ui16Width == 0) || (psRect->ui16Height == 0))
+	{
+		return true;
+	}
+
+	for (uint32_t i = ui32FirstWord; i <= ui32LastWord; ++i)
+	{
+		const uint64_t ui64Mask = GetVRAMBitmapMask(i, psRect->ui16X, psRect->ui16Width);
+
+		for (uint32_t y = psRect->ui16Y; y < (uint32_t)(psRect->ui16Y + psRect->ui16Height); ++y)
+		{
+			if ((psBitmap->aui64Rows[y][i] & ui64Mask) != 0)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+uint32_t CountVRAMBitmapFree(const VRAM_BITMAP* psBitmap)
+{
+	uint32_t ui32NumUsed = 0;
+
+	for (uint32_t y = 0; y < PSX_VRAM_HEIGHT; ++y)
+	{
+		for (uint32_t i = 0; i < VRAM_BITMAP_WORDS_PER_ROW; ++i)
+		{
+			ui32NumUsed += __builtin_popcountll(psBitmap->aui64Rows[y][i]);
+		}
+	}
+
+	return (PSX_VRAM_WIDTH * PSX_VRAM_HEIGHT) - ui32NumUsed;
+}
+
+/*
+	Reduces a row to one bit per 16 halfword CLUT slot, set when the whole slot
+	is free. 1024 halfwords is exactly 64 slots, so a row fits in one word.
+*/
+static uint64_t GetVRAMBitmapFreeSlots(const uint64_t* pui64Row)
+{
+	uint64_t ui64Slots = 0;
+
+	for (uint32_t i = 0; i < VRAM_BITMAP_WORDS_PER_ROW; ++i)
+	{
+		// Fold each 16 bit lane onto its lowest bit, so bits 0, 16, 32 and 48
+		// are set if anything in their lane is occupied
+		uint64_t ui64Lanes = pui64Row[i];
+		ui64Lanes |= ui64Lanes >> 8;
+		ui64Lanes |= ui64Lanes >> 4;
+		ui64Lanes |= ui64Lanes >> 2;
+		ui64Lanes |= ui64Lanes >> 1;
+		ui64Lanes = ~ui64Lanes & 0x0001000100010001ULL;
+
+		// Gather the 4 lane bits together
+		ui64Lanes = (ui64Lanes | (ui64Lanes >> 15) | (ui64Lanes >> 30) | (ui64Lanes >> 45)) & 0xF;
+
+		ui64Slots |= ui64Lanes << (i * (64 / PSX_CLUT_ALIGN_X));
+	}
+
+	return ui64Slots;
+}
+
+// Keeps only the bits starting a run of at least ui32Length set bits
+static uint64_t FindBitRuns(uint64_t ui64Bits, const uint32_t ui32Length)
+{
+	uint32_t ui32Covered = 1;
+
+	while ((ui32Covered < ui32Length) && (ui64Bits != 0))
+	{
+		const uint32_t ui32Shift = (
+			(ui32Covered < (ui32Length - ui32Covered)) ?
+			ui32Covered :
+			(ui32Length - ui32Covered)
+		);
+
+		ui64Bits &= ui64Bits >> ui32Shift;
+		ui32Covered += ui32Shift;
+	}
+
+	return ui64Bits;
+}
+
+bool FindVRAMBitmapCLUTSpace(
+	const VRAM_BITMAP* psBitmap,
+	const uint16_t ui16Width,
+	const uint16_t ui16Height,
+	VRAM_RECT* psRect)
+{
+	const uint32_t ui32NumSlots = (ui16Width + PSX_CLUT_ALIGN_X - 1) / PSX_CLUT_ALIGN_X;
+	uint64_t aui64FreeSlots[PSX_VRAM_HEIGHT];
+
+	if ((ui16Width == 0) || (ui16Height == 0) ||
+		(ui16Width > PSX_VRAM_WIDTH) || (ui16Height > PSX_VRAM_HEIGHT))
+	{
+		return false;
+	}
+
+	for (uint32_t y = 0; y < PSX_VRAM_HEIGHT; ++y)
+	{
+		aui64FreeSlots[y] = GetVRAMBitmapFreeSlots(psBitmap->aui64Rows[y]);
+	}
+
+	for (uint32_t y = 0; y <= (uint32_t)(PSX_VRAM_HEIGHT - ui16Height); ++y)
+	{
+		uint64_t ui64Runs = ~0ULL;
+
+		// A slot can only start the CLUT if it's free on every row it covers
+		for (uint32_t i = 0; (i < ui16Height) && (ui64Runs != 0); ++i)
+		{
+			ui64Runs &= aui64FreeSlots[y + i];
+		}
+
+		ui64Runs = FindBitRuns(ui64Runs, ui32NumSlots);
+		if (ui64Runs != 0)
+		{
+			psRect->ui16X = __builtin_ctzll(ui64Runs) * PSX_CLUT_ALIGN_X;
+			psRect->ui16Y = y;
+			psRect->ui16Width = ui16Width;
+			psRect->ui16Height = ui16Height;
+
+			return true;
+		}
+	}
+
+	return false;
+}
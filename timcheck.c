@@ -0,0 +1,334 @@
+#include <stdio.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <argp.h>
+
+#include "tim_defs.h"
+#include "tim_vram_defs.h"
+
+typedef struct _TIM_CHECK_ARGS
+{
+	bool bCheckVRAM;
+
+	char** ppszFileNames;
+	uint32_t ui32NumFiles;
+} TIM_CHECK_ARGS;
+
+// A CLUT or pixel block's footprint in VRAM
+typedef struct _TIM_CHECK_RECT
+{
+	uint32_t ui32FileIndex;
+	bool bCLUT;
+	VRAM_RECT sRect;
+
+	// CLUT data hash, only for CLUTs which touch another block
+	bool bHashed;
+	uint32_t ui32Hash;
+} TIM_CHECK_RECT;
+
+// Hashes a candidate CLUT's data, so CLUTs shared by many files are only read
+// once each rather than once per pair
+static void HashCheckCLUT(const TIM_CHECK_ARGS* psArgs, TIM_CHECK_RECT* psRect)
+{
+	const uint32_t ui32SizeInBytes = psRect->sRect.ui16Width * psRect->sRect.ui16Height * sizeof(TIM_PIX);
+	TIM_MAPPING sMapping;
+	TIM_FILE sFile;
+
+	psRect->bHashed = false;
+
+	if (MapTIM(psArgs->ppszFileNames[psRect->ui32FileIndex], false, &sMapping, &sFile) != 0)
+	{
+		return;
+	}
+
+	if ((sFile.sCLUTHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER)) >= ui32SizeInBytes)
+	{
+		psRect->ui32Hash = HashTIMData(sFile.psCLUTData, ui32SizeInBytes, TIM_HASH_SEED);
+		psRect->bHashed = true;
+	}
+
+	UnmapTIM(&sMapping);
+}
+
+// Compares the data of two CLUTs whose hashes match, as a 32 bit hash alone
+// could hide a real overwrite
+static bool AreCheckCLUTsEqual(const TIM_CHECK_ARGS* psArgs, const TIM_CHECK_RECT* psA, const TIM_CHECK_RECT* psB)
+{
+	const uint32_t ui32SizeInBytes = psA->sRect.ui16Width * psA->sRect.ui16Height * sizeof(TIM_PIX);
+	TIM_MAPPING sMappingA;
+	TIM_MAPPING sMappingB;
+	TIM_FILE sFileA;
+	TIM_FILE sFileB;
+	bool bEqual = false;
+
+	if (MapTIM(psArgs->ppszFileNames[psA->ui32FileIndex], false, &sMappingA, &sFileA) != 0)
+	{
+		return false;
+	}
+
+	if (MapTIM(psArgs->ppszFileNames[psB->ui32FileIndex], false, &sMappingB, &sFileB) != 0)
+	{
+		UnmapTIM(&sMappingA);
+		return false;
+	}
+
+	if (((sFileA.sCLUTHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER)) >= ui32SizeInBytes) &&
+		((sFileB.sCLUTHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER)) >= ui32SizeInBytes))
+	{
+		bEqual = (memcmp(sFileA.psCLUTData, sFileB.psCLUTData, ui32SizeInBytes) == 0);
+	}
+
+	UnmapTIM(&sMappingB);
+	UnmapTIM(&sMappingA);
+
+	return bEqual;
+}
+
+// Batch mode deliberately points TIMs with identical palettes at the same CLUT,
+// which is only an overlap if the data differs
+static bool IsSharedCLUT(const TIM_CHECK_ARGS* psArgs, const TIM_CHECK_RECT* psA, const TIM_CHECK_RECT* psB)
+{
+	return (
+		psA->bCLUT && psB->bCLUT &&
+		psA->bHashed && psB->bHashed &&
+		(psA->ui32Hash == psB->ui32Hash) &&
+		(memcmp(&psA->sRect, &psB->sRect, sizeof(VRAM_RECT)) == 0) &&
+		AreCheckCLUTsEqual(psArgs, psA, psB)
+	);
+}
+
+static void PrintCheckRect(const TIM_CHECK_ARGS* psArgs, const TIM_CHECK_RECT* psRect)
+{
+	printf(
+		"%s %s (%hu, %hu, %hu, %hu)",
+		psArgs->ppszFileNames[psRect->ui32FileIndex],
+		psRect->bCLUT ? "CLUT" : "pixels",
+		psRect->sRect.ui16X,
+		psRect->sRect.ui16Y,
+		psRect->sRect.ui16Width,
+		psRect->sRect.ui16Height
+	);
+}
+
+static int CheckVRAM(const TIM_CHECK_ARGS* psArgs)
+{
+	TIM_CHECK_RECT* psRects = calloc(psArgs->ui32NumFiles * 2, sizeof(TIM_CHECK_RECT));
+	uint32_t* pui32Candidates = calloc(psArgs->ui32NumFiles * 2, sizeof(uint32_t));
+	VRAM_BITMAP* psBitmap = malloc(sizeof(VRAM_BITMAP));
+	VRAM_BITMAP* psOverlapBitmap = malloc(sizeof(VRAM_BITMAP));
+	uint32_t ui32NumRects = 0;
+	uint32_t ui32NumCandidates = 0;
+	uint32_t ui32NumInvalid = 0;
+	uint32_t ui32NumOverlaps = 0;
+	uint32_t ui32NumShared = 0;
+	struct timespec sStart;
+	int iResult = 1;
+
+	if ((psRects == NULL) || (pui32Candidates == NULL) || (psBitmap == NULL) || (psOverlapBitmap == NULL))
+	{
+		printf("failed to allocate VRAM check\n");
+		goto FAILED_CheckVRAM;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &sStart);
+
+	ClearVRAMBitmap(psBitmap);
+	ClearVRAMBitmap(psOverlapBitmap);
+
+	// Rasterise every block, collecting the bits covered more than once
+	for (uint32_t i = 0; i < psArgs->ui32NumFiles; ++i)
+	{
+		TIM_FILE sFile;
+
+		if (ReadTIMHeaders(psArgs->ppszFileNames[i], &sFile) != 0)
+		{
+			++ui32NumInvalid;
+			continue;
+		}
+
+		for (uint32_t j = 0; j < 2; ++j)
+		{
+			const bool bCLUT = (j == 0);
+			TIM_CHECK_RECT* psRect = &psRects[ui32NumRects];
+
+			if (bCLUT && !sFile.sFileHeader.sFlags.uClut)
+			{
+				continue;
+			}
+
+			psRect->ui32FileIndex = i;
+			psRect->bCLUT = bCLUT;
+			psRect->sRect = GetVRAMRect(bCLUT ? &sFile.sCLUTHeader : &sFile.sPixelHeader);
+
+			if (!IsVRAMRectValid(&psRect->sRect))
+			{
+				PrintCheckRect(psArgs, psRect);
+				printf(" does not fit within PSX VRAM\n");
+				++ui32NumInvalid;
+				continue;
+			}
+
+			SetVRAMBitmapRectOverlaps(psBitmap, psOverlapBitmap, &psRect->sRect);
+			++ui32NumRects;
+		}
+	}
+
+	// Only blocks touching a doubly covered bit can be part of an overlap, so
+	// the pairwise test is limited to those
+	for (uint32_t i = 0; i < ui32NumRects; ++i)
+	{
+		if (!IsVRAMBitmapRectFree(psOverlapBitmap, &psRects[i].sRect))
+		{
+			pui32Candidates[ui32NumCandidates++] = i;
+
+			if (psRects[i].bCLUT)
+			{
+				HashCheckCLUT(psArgs, &psRects[i]);
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < ui32NumCandidates; ++i)
+	{
+		const TIM_CHECK_RECT* psA = &psRects[pui32Candidates[i]];
+
+		for (uint32_t j = i + 1; j < ui32NumCandidates; ++j)
+		{
+			const TIM_CHECK_RECT* psB = &psRects[pui32Candidates[j]];
+
+			if (!DoVRAMRectsOverlap(&psA->sRect, &psB->sRect))
+			{
+				continue;
+			}
+
+			if (IsSharedCLUT(psArgs, psA, psB))
+			{
+				++ui32NumShared;
+				continue;
+			}
+
+			{
+				const uint16_t ui16Left = (psA->sRect.ui16X > psB->sRect.ui16X) ? psA->sRect.ui16X : psB->sRect.ui16X;
+				const uint16_t ui16Top = (psA->sRect.ui16Y > psB->sRect.ui16Y) ? psA->sRect.ui16Y : psB->sRect.ui16Y;
+				const uint16_t ui16RightA = psA->sRect.ui16X + psA->sRect.ui16Width;
+				const uint16_t ui16RightB = psB->sRect.ui16X + psB->sRect.ui16Width;
+				const uint16_t ui16BottomA = psA->sRect.ui16Y + psA->sRect.ui16Height;
+				const uint16_t ui16BottomB = psB->sRect.ui16Y + psB->sRect.ui16Height;
+				const uint16_t ui16Right = (ui16RightA < ui16RightB) ? ui16RightA : ui16RightB;
+				const uint16_t ui16Bottom = (ui16BottomA < ui16BottomB) ? ui16BottomA : ui16BottomB;
+
+				printf("overlap: ");
+				PrintCheckRect(psArgs, psA);
+				printf(" and ");
+				PrintCheckRect(psArgs, psB);
+				printf(
+					" at (%hu, %hu, %hu, %hu)\n",
+					ui16Left,
+					ui16Top,
+					ui16Right - ui16Left,
+					ui16Bottom - ui16Top
+				);
+			}
+
+			++ui32NumOverlaps;
+		}
+	}
+
+	printf(
+		"checked %u TIM file(s) in %.2f ms, %u overlap(s), %u shared CLUT pair(s), %u invalid\n",
+		psArgs->ui32NumFiles,
+		GetElapsedMS(&sStart),
+		ui32NumOverlaps,
+		ui32NumShared,
+		ui32NumInvalid
+	);
+
+	iResult = ((ui32NumOverlaps == 0) && (ui32NumInvalid == 0)) ? 0 : 1;
+
+FAILED_CheckVRAM:
+	free(psOverlapBitmap);
+	free(psBitmap);
+	free(pui32Candidates);
+	free(psRects);
+
+	return iResult;
+}
+
+const char *argp_program_version = "timcheck 1.0";
+const char *argp_program_bug_address = "<jw0z96@github>";
+static char szDoc[] = "timcheck - check sets of TIM files for problems before they reach hardware";
+static char szArgDoc[] = "--vram TIM_FILE...";
+
+static struct argp_option sOptions[] = {
+	{ "vram",	'v',	0,	0,	"Report every pair of CLUT or pixel blocks which overwrite each other in VRAM" },
+	{ 0 }
+};
+
+static error_t ParseOpts(int key, char *arg, struct argp_state *state)
+{
+	TIM_CHECK_ARGS *psArgs = state->input;
+
+	switch (key)
+	{
+		case 'v': psArgs->bCheckVRAM = true; break;
+
+		case ARGP_KEY_ARG:
+		{
+			psArgs->ppszFileNames[psArgs->ui32NumFiles++] = arg;
+			break;
+		}
+
+		case ARGP_KEY_END:
+		{
+			if (state->arg_num < 1) // Not enough args
+			{
+				argp_usage(state);
+			}
+			break;
+		}
+
+		default:
+			return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static struct argp sArgp = { sOptions, ParseOpts, szArgDoc, szDoc };
+
+int main (int argc, char * argv[])
+{
+	int iResult;
+
+	// Default args
+	TIM_CHECK_ARGS sArgs;
+	sArgs.bCheckVRAM = false;
+	sArgs.ppszFileNames = calloc(argc, sizeof(char*));
+	sArgs.ui32NumFiles = 0;
+
+	if (sArgs.ppszFileNames == NULL)
+	{
+		printf("failed to allocate file list\n");
+		return 1;
+	}
+
+	argp_parse(&sArgp, argc, argv, 0, 0, &sArgs);
+
+	if (!sArgs.bCheckVRAM)
+	{
+		printf("no check selected, pass --vram\n");
+		free(sArgs.ppszFileNames);
+		return 1;
+	}
+
+	iResult = CheckVRAM(&sArgs);
+
+	free(sArgs.ppszFileNames);
+
+	return iResult;
+}
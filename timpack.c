@@ -7,13 +7,12 @@
 #include <argp.h>
 
 #include "tim_defs.h"
+#include "timpack.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-#define ALIGN_UP(x, y) (((x % y) != 0) ? (x + y - (x % y)) : x)
-
-static const uint16_t aui16PixFmtNumColours[TIM_PIX_FMT_COUNT] =
+const uint16_t aui16PixFmtNumColours[TIM_PIX_FMT_COUNT] =
 {
 	16, // TIM_PIX_FMT_4BIT_CLUT
 	256, // TIM_PIX_FMT_8BIT_CLUT
@@ -34,7 +33,7 @@ static void RGB8ToTIMPix(
 	psPixel->stp = (bSTP ? 0x1 : 0x0);
 }
 
-static int LoadPalette(
+int LoadPalette(
 	const char* pszFileName,
 	const TIM_PIX_FMT ePixFmt,
 	const uint16_t ui16FBCoordX,
@@ -183,7 +182,29 @@ static bool CompareTIMPix(const TIM_PIX* psA, const TIM_PIX* psB)
 	);
 }
 
-static int LoadTexture(
+char* GetBaseFileName(const char* pszFileName)
+{
+	const char* pszSlash = strrchr(pszFileName, '/');
+	const char* pszDot = strrchr(pszFileName, '.');
+	size_t uLength = strlen(pszFileName);
+	char* pszBaseName;
+
+	if ((pszDot != NULL) && ((pszSlash == NULL) || (pszDot > pszSlash)))
+	{
+		uLength = pszDot - pszFileName;
+	}
+
+	pszBaseName = malloc(uLength + 1);
+	if (pszBaseName != NULL)
+	{
+		memcpy(pszBaseName, pszFileName, uLength);
+		pszBaseName[uLength] = '\0';
+	}
+
+	return pszBaseName;
+}
+
+int LoadTexture(
 	const char* pszFileName,
 	const TIM_PIX_FMT ePixFmt,
 	const uint16_t ui16FBCoordX,
@@ -367,21 +388,6 @@ FAILED_LoadTexture:
 	return 1;
 }
 
-typedef struct _TIM_ARGS
-{
-	TIM_PIX_FMT ePixFmt;
-
-	char* pszTextureFileName;
-	uint16_t ui16TextureCoordX;
-	uint16_t ui16TextureCoordY;
-
-	char* pszPaletteFileName;
-	uint16_t ui16PaletteCoordX;
-	uint16_t ui16PaletteCoordY;
-
-	char* pszOutputFileName;
-} TIM_ARGS;
-
 int PackTIM(const TIM_ARGS* psTIMArgs)
 {
 	TIM_FILE sFile = {
@@ -440,7 +446,7 @@ int PackTIM(const TIM_ARGS* psTIMArgs)
 const char *argp_program_version = "timpack 1.0";
 const char *argp_program_bug_address = "<jw0z96@github>";
 static char szDoc[] = "timpack - pack texture + palette data into the Sony Playstation's TIM file format";
-static char szArgDoc[] = "OUTPUT_FILE";
+static char szArgDoc[] = "OUTPUT_FILE\n--batch=LIST_FILE\n--from-tim=TIM_FILE [OUTPUT_FILE]\n--place-cluts TIM_FILE...\n--plan LIST_FILE...";
 
 static struct argp_option sOptions[] = {
 	{ "bpp",		'b',	"<bits>",			0,	"Bits per pixel (4 for 16 colour, 8 for 256 colour)" },
@@ -450,6 +456,19 @@ static struct argp_option sOptions[] = {
 	{ "palette",	'p',	"FILE",				0,	"Palette file" },
 	{ "palette-x",	'i',	"<X coordinate>",	0,	"Palette destination X coordinate in VRAM" },
 	{ "palette-y",	'j',	"<Y coordinate>",	0,	"Palette destination Y coordinate in VRAM" },
+	{ "batch",		'B',	"FILE",				0,	"Convert every texture listed in FILE, sharing identical palettes in a CLUT pool at the palette coordinates" },
+	{ "pack",		'P',	0,					0,	"With --batch, assign texture and CLUT coordinates by packing them into VRAM" },
+	{ "reserve",	'R',	"<x,y,w,h>",		0,	"With --pack, a rect of VRAM to leave free, such as the framebuffer (repeatable)" },
+	{ "layout",		'L',	"FILE",				0,	"With --batch, write a layout manifest of every TIM's VRAM coordinates. With --place-cluts, read one to find occupied VRAM" },
+	{ "incremental",	'I',	"FILE",				0,	"With --pack, keep unchanged textures where FILE's layout placed them, packing and writing only the ones which changed" },
+	{ "emit-blob",	'E',	"FILE",				0,	"With --batch, also write every CLUT and pixel payload back to back into FILE, with their offsets, coordinates and tpage/clut IDs in a generated C header alongside it" },
+	{ "emit-attrs",	'A',	"FILE",				0,	"With --batch, also write a table of every texture's tpage & clut attributes and UVs within its texture page to FILE, with a generated C header alongside it" },
+	{ "from-tim",	'T',	"FILE",				0,	"Transcode an existing TIM file, edited in place if no output file is given" },
+	{ "trim-clut",	'c',	0,					0,	"With --from-tim, remove CLUT entries which aren't referenced by the texture" },
+	{ "sequence",	'Q',	"FILE",				0,	"Pack the animation frames listed in FILE, writing the first to OUTPUT_FILE and the rects which change between frames to OUTPUT_FILE.delta" },
+	{ "split-tpage",	'S',	0,					0,	"Slice the texture at texture page boundaries into OUTPUT_FILE_N.tim files sharing one CLUT, with a table of slices in OUTPUT_FILE.slices" },
+	{ "plan",		'N',	0,					0,	"Plan VRAM for the scenes whose batch lists are given, packing textures used by every scene into a shared resident region and writing a LIST_FILE.layout per scene" },
+	{ "place-cluts",	'G',	0,					0,	"Move the CLUTs of the given TIM files into gaps left in VRAM, edited in place" },
 	{ 0 }
 };
 
@@ -481,9 +500,40 @@ static error_t ParseOpts(int key, char *arg, struct argp_state *state)
 		case 'p': psArgs->pszPaletteFileName = arg; break;
 		case 'i': psArgs->ui16PaletteCoordX = strtol(arg, NULL, 10); break;
 		case 'j': psArgs->ui16PaletteCoordY = strtol(arg, NULL, 10); break;
+		case 'B': psArgs->pszBatchFileName = arg; break;
+		case 'P': psArgs->bPackVRAM = true; break;
+		case 'R':
+		{
+			if (ParseVRAMRect(arg, &psArgs->psReservedRects[psArgs->ui32NumReservedRects]) != 0)
+			{
+				argp_usage(state);
+			}
+
+			++psArgs->ui32NumReservedRects;
+			break;
+		}
+		case 'L': psArgs->pszLayoutFileName = arg; break;
+		case 'I': psArgs->pszPreviousLayoutFileName = arg; break;
+		case 'E': psArgs->pszBlobFileName = arg; break;
+		case 'A': psArgs->pszAttributeFileName = arg; break;
+		case 'T': psArgs->pszFromTIMFileName = arg; break;
+		case 'c': psArgs->bTrimCLUT = true; break;
+		case 'G': psArgs->bPlaceCLUTs = true; break;
+		case 'N': psArgs->bPlanScenes = true; break;
+		case 'S': psArgs->bSplitTPage = true; break;
+		case 'Q': psArgs->pszSequenceFileName = arg; break;
 
 		case ARGP_KEY_ARG:
 		{
+			psArgs->ppszFileNames[psArgs->ui32NumFileNames++] = arg;
+
+			// CLUT placement takes any number of TIM files, and planning any
+			// number of scene lists
+			if (psArgs->bPlaceCLUTs || psArgs->bPlanScenes)
+			{
+				break;
+			}
+
 			if (state->arg_num >= 1) // Too many args
 			{
 				argp_usage(state);
@@ -495,7 +545,12 @@ static error_t ParseOpts(int key, char *arg, struct argp_state *state)
 
 		case ARGP_KEY_END:
 		{
-			if (state->arg_num < 1) // Not enough args
+			// Batch mode takes its output file names from the list, and
+			// transcoding defaults to editing the input file
+			if ((state->arg_num < 1) &&
+				(psArgs->bPlaceCLUTs || psArgs->bPlanScenes ||
+				((psArgs->pszBatchFileName == NULL) &&
+				(psArgs->pszFromTIMFileName == NULL))))
 			{
 				argp_usage(state);
 			}
@@ -513,19 +568,87 @@ static struct argp sArgp = { sOptions, ParseOpts, szArgDoc, szDoc };
 
 int main (int argc, char * argv[])
 {
-	// Default args
+	// Default args, the format and coordinates are left unset so that
+	// transcoding can tell which were passed
 	TIM_ARGS sArgs;
-	sArgs.ePixFmt = TIM_PIX_FMT_4BIT_CLUT;
+	sArgs.ePixFmt = TIM_PIX_FMT_COUNT;
 	sArgs.pszTextureFileName = NULL;
-	sArgs.ui16TextureCoordX = 0;
-	sArgs.ui16TextureCoordY = 0;
+	sArgs.ui16TextureCoordX = TIM_COORD_UNSET;
+	sArgs.ui16TextureCoordY = TIM_COORD_UNSET;
 	sArgs.pszPaletteFileName = NULL;
-	sArgs.ui16PaletteCoordX = 0;
-	sArgs.ui16PaletteCoordY = 0;
+	sArgs.ui16PaletteCoordX = TIM_COORD_UNSET;
+	sArgs.ui16PaletteCoordY = TIM_COORD_UNSET;
+	sArgs.pszBatchFileName = NULL;
+	sArgs.bPackVRAM = false;
+	sArgs.psReservedRects = calloc(argc, sizeof(VRAM_RECT));
+	sArgs.ui32NumReservedRects = 0;
+	sArgs.pszLayoutFileName = NULL;
+	sArgs.pszPreviousLayoutFileName = NULL;
+	sArgs.pszBlobFileName = NULL;
+	sArgs.pszAttributeFileName = NULL;
+	sArgs.pszFromTIMFileName = NULL;
+	sArgs.bTrimCLUT = false;
+	sArgs.pszSequenceFileName = NULL;
+	sArgs.bSplitTPage = false;
+	sArgs.bPlaceCLUTs = false;
+	sArgs.bPlanScenes = false;
+	sArgs.ppszFileNames = calloc(argc, sizeof(char*));
+	sArgs.ui32NumFileNames = 0;
 	sArgs.pszOutputFileName = NULL;
 
+	if ((sArgs.psReservedRects == NULL) || (sArgs.ppszFileNames == NULL))
+	{
+		printf("failed to allocate reserved rects\n");
+		return 1;
+	}
+
 	argp_parse(&sArgp, argc, argv, 0, 0, &sArgs);
 
+	if (sArgs.bPlaceCLUTs)
+	{
+		return PlaceTIMCLUTs(&sArgs);
+	}
+
+	if (sArgs.bPlanScenes)
+	{
+		return PlanTIMScenes(&sArgs);
+	}
+
+#define RETURN_IF_INVALID_COORD(coord, dim, fmt) do { if ((coord != TIM_COORD_UNSET) && (coord >= dim)) { \
+		printf("%s coordinate must be in the range [0, %u], (%hu provided)\n", fmt, (dim - 1), coord); \
+		return 1; \
+	} } while (0)
+
+	if (sArgs.pszFromTIMFileName != NULL)
+	{
+		RETURN_IF_INVALID_COORD(sArgs.ui16TextureCoordX, PSX_VRAM_WIDTH, "Texture X");
+		RETURN_IF_INVALID_COORD(sArgs.ui16TextureCoordY, PSX_VRAM_HEIGHT, "Texture Y");
+		RETURN_IF_INVALID_COORD(sArgs.ui16PaletteCoordX, PSX_VRAM_WIDTH, "Palette X");
+		RETURN_IF_INVALID_COORD(sArgs.ui16PaletteCoordY, PSX_VRAM_HEIGHT, "Palette Y");
+
+		return TranscodeTIM(&sArgs);
+	}
+
+	if (sArgs.ePixFmt == TIM_PIX_FMT_COUNT) { sArgs.ePixFmt = TIM_PIX_FMT_4BIT_CLUT; }
+	if (sArgs.ui16TextureCoordX == TIM_COORD_UNSET) { sArgs.ui16TextureCoordX = 0; }
+	if (sArgs.ui16TextureCoordY == TIM_COORD_UNSET) { sArgs.ui16TextureCoordY = 0; }
+	if (sArgs.ui16PaletteCoordX == TIM_COORD_UNSET) { sArgs.ui16PaletteCoordX = 0; }
+	if (sArgs.ui16PaletteCoordY == TIM_COORD_UNSET) { sArgs.ui16PaletteCoordY = 0; }
+
+	if (sArgs.pszBatchFileName != NULL)
+	{
+		RETURN_IF_INVALID_COORD(sArgs.ui16PaletteCoordX, PSX_VRAM_WIDTH, "Palette X");
+		RETURN_IF_INVALID_COORD(sArgs.ui16PaletteCoordY, PSX_VRAM_HEIGHT, "Palette Y");
+
+		if ((sArgs.pszPreviousLayoutFileName != NULL) && !sArgs.bPackVRAM)
+		{
+			printf("--incremental requires --pack\n");
+			return 1;
+		}
+
+		return PackTIMBatch(&sArgs);
+	}
+
 	// TODO: implement direct colour formats
 	if (sArgs.ePixFmt > TIM_PIX_FMT_8BIT_CLUT)
 	{
@@ -534,7 +657,7 @@ int main (int argc, char * argv[])
 	}
 
 	// Check if any files are null
-	if (sArgs.pszTextureFileName == NULL)
+	if ((sArgs.pszTextureFileName == NULL) && (sArgs.pszSequenceFileName == NULL))
 	{
 		printf("Texture File Name Invalid\n");
 		return 1;
@@ -546,11 +669,6 @@ int main (int argc, char * argv[])
 		return 1;
 	}
 
-#define RETURN_IF_INVALID_COORD(coord, dim, fmt) do { if (coord >= dim) { \
-		printf("%s coordinate must be in the range [0, %u], (%hu provided)\n", fmt, (dim - 1), coord); \
-		return 1; \
-	} } while (0)
-
 	RETURN_IF_INVALID_COORD(sArgs.ui16TextureCoordX, PSX_VRAM_WIDTH, "Texture X");
 	RETURN_IF_INVALID_COORD(sArgs.ui16TextureCoordY, PSX_VRAM_HEIGHT, "Texture Y");
 	RETURN_IF_INVALID_COORD(sArgs.ui16PaletteCoordX, PSX_VRAM_WIDTH, "Palette X");
@@ -564,5 +682,10 @@ int main (int argc, char * argv[])
 		return 1;
 	}
 
-	return PackTIM(&sArgs);
+	if (sArgs.pszSequenceFileName != NULL)
+	{
+		return PackTIMSequence(&sArgs);
+	}
+
+	return sArgs.bSplitTPage ? SplitTIMTexturePages(&sArgs) : PackTIM(&sArgs);
 }
@@ -0,0 +1,122 @@
+#ifndef TIMPACK_H
+#define TIMPACK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tim_defs.h"
+#include "tim_vram_defs.h"
+
+// Coordinates not passed on the command line, which --from-tim leaves as is
+#define TIM_COORD_UNSET (0xFFFF)
+
+extern const uint16_t aui16PixFmtNumColours[TIM_PIX_FMT_COUNT];
+
+typedef struct _TIM_ARGS
+{
+	TIM_PIX_FMT ePixFmt;
+
+	char* pszTextureFileName;
+	uint16_t ui16TextureCoordX;
+	uint16_t ui16TextureCoordY;
+
+	char* pszPaletteFileName;
+	uint16_t ui16PaletteCoordX;
+	uint16_t ui16PaletteCoordY;
+
+	// Batch mode, a list of textures to convert in a single run
+	char* pszBatchFileName;
+
+	// Batch mode VRAM packing, placing every texture and CLUT automatically
+	// around the reserved rects
+	bool bPackVRAM;
+	VRAM_RECT* psReservedRects;
+	uint32_t ui32NumReservedRects;
+	char* pszLayoutFileName;
+
+	// With --pack, the layout of the previous run, so that only changed
+	// textures are moved and written
+	char* pszPreviousLayoutFileName;
+
+	// Batch mode, a single file of every CLUT and pixel payload without
+	// headers, along with a C header of their offsets and coordinates
+	char* pszBlobFileName;
+
+	// Batch mode, a table of every texture's tpage & CLUT attributes and UVs,
+	// along with a C header of the same
+	char* pszAttributeFileName;
+
+	// Transcode mode, edits an existing TIM rather than loading images
+	char* pszFromTIMFileName;
+	bool bTrimCLUT;
+
+	// Sequence mode, a list of animation frames sharing the palette, written
+	// as the first frame's TIM plus the changes between frames
+	char* pszSequenceFileName;
+
+	// Split the texture at texture page boundaries, writing one TIM per slice
+	bool bSplitTPage;
+
+	// CLUT placement mode, moves the CLUTs of existing TIMs into free VRAM
+	bool bPlaceCLUTs;
+
+	// Planning mode, packs the batch lists of many scenes around the
+	// textures they all share
+	bool bPlanScenes;
+	char** ppszFileNames;
+	uint32_t ui32NumFileNames;
+
+	char* pszOutputFileName;
+} TIM_ARGS;
+
+// The file name without its extension, for naming files written alongside
+// it. The result must be freed
+char* GetBaseFileName(const char* pszFileName);
+
+int LoadPalette(
+	const char* pszFileName,
+	const TIM_PIX_FMT ePixFmt,
+	const uint16_t ui16FBCoordX,
+	const uint16_t ui16FBCoordY,
+	TIM_BLOCK_HEADER* psCLUTHeader,
+	TIM_PIX** ppsCLUTData);
+
+int LoadTexture(
+	const char* pszFileName,
+	const TIM_PIX_FMT ePixFmt,
+	const uint16_t ui16FBCoordX,
+	const uint16_t ui16FBCoordY,
+	const TIM_PIX* psPaletteColours,
+	TIM_BLOCK_HEADER* psPixelHeader,
+	uint8_t** ppui8PixelData);
+
+// timpack_batch.c
+int PackTIMBatch(const TIM_ARGS* psTIMArgs);
+int PlanTIMScenes(const TIM_ARGS* psTIMArgs);
+
+// timpack_transcode.c
+int TranscodeTIM(const TIM_ARGS* psTIMArgs);
+
+// timpack_place.c
+int PlaceTIMCLUTs(const TIM_ARGS* psTIMArgs);
+
+// timpack_split.c
+int SplitTIMTexturePages(const TIM_ARGS* psTIMArgs);
+
+// timpack_sequence.c
+int PackTIMSequence(const TIM_ARGS* psTIMArgs);
+
+// timpack_blob.c
+int WriteTIMBlob(
+	const char* pszBlobFileName,
+	const char* const* ppszNames,
+	const TIM_FILE* const* ppsFiles,
+	const uint32_t ui32NumFiles);
+
+int WriteTIMAttributeTable(
+	const char* pszTableFileName,
+	const char* const* ppszNames,
+	const TIM_FILE* const* ppsFiles,
+	const uint32_t ui32NumFiles);
+
+#endif // TIMPACK_H
@@ -0,0 +1,1403 @@
+#include <stdio.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <sys/stat.h>
+
+#include "tim_defs.h"
+#include "timpack.h"
+
+typedef struct _TIM_BATCH_ENTRY
+{
+	char* pszOutputFileName;
+	char* pszTextureFileName;
+	char* pszPaletteFileName;
+
+	TIM_PIX_FMT ePixFmt;
+	uint16_t ui16TextureCoordX;
+	uint16_t ui16TextureCoordY;
+
+	TIM_FILE sFile;
+
+	// Index of the CLUT pool entry this texture samples from
+	uint32_t ui32CLUTPoolIndex;
+
+	// When packing incrementally, this texture's entry in the previous
+	// layout, and whether it's unchanged and so kept where it was
+	const VRAM_LAYOUT_ENTRY* psPrevious;
+	bool bKept;
+} TIM_BATCH_ENTRY;
+
+typedef struct _TIM_CLUT_POOL_ENTRY
+{
+	uint32_t ui32Hash;
+
+	// The first batch entry using this palette, whose CLUT data is compared
+	// against when looking for duplicates
+	uint32_t ui32EntryIndex;
+	uint32_t ui32NumUsers;
+
+	uint16_t ui16Width;
+	uint16_t ui16Height;
+	uint16_t ui16FBCoordX;
+	uint16_t ui16FBCoordY;
+
+	// Left where a kept texture's CLUT was, rather than packed
+	bool bFixed;
+} TIM_CLUT_POOL_ENTRY;
+
+typedef struct _TIM_BATCH
+{
+	TIM_BATCH_ENTRY* psEntries;
+	uint32_t ui32NumEntries;
+
+	TIM_CLUT_POOL_ENTRY* psCLUTPool;
+	uint32_t ui32CLUTPoolSize;
+} TIM_BATCH;
+
+static void DestroyBatch(TIM_BATCH* psBatch)
+{
+	for (uint32_t i = 0; i < psBatch->ui32NumEntries; ++i)
+	{
+		TIM_BATCH_ENTRY* psEntry = &psBatch->psEntries[i];
+
+		free(psEntry->pszOutputFileName);
+		free(psEntry->pszTextureFileName);
+		free(psEntry->pszPaletteFileName);
+		DestroyTIM(&psEntry->sFile);
+	}
+
+	free(psBatch->psEntries);
+	free(psBatch->psCLUTPool);
+}
+
+/*
+	Each non-empty line of the list describes one texture:
+		OUTPUT_FILE BPP TEXTURE_FILE PALETTE_FILE TEXTURE_X TEXTURE_Y
+	The texture coordinates may be left out when packing VRAM. Lines starting
+	with '#' are ignored.
+*/
+static int LoadBatchList(
+	const char* pszFileName,
+	const bool bPackVRAM,
+	TIM_BATCH* psBatch)
+{
+	char szLine[4096];
+	uint32_t ui32LineNumber = 0;
+	uint32_t ui32Capacity = 0;
+
+	FILE *fFilePtr = fopen(pszFileName, "r");
+	if (fFilePtr == NULL)
+	{
+		printf("could not open %s for reading\n", pszFileName);
+		return 1;
+	}
+
+	while (fgets(szLine, sizeof(szLine), fFilePtr) != NULL)
+	{
+		char* apszTokens[6] = { NULL };
+		uint32_t ui32NumTokens = 0;
+		TIM_BATCH_ENTRY* psEntry;
+
+		++ui32LineNumber;
+
+		for (char* pszToken = strtok(szLine, " \t\r\n");
+			(pszToken != NULL) && (ui32NumTokens < 6);
+			pszToken = strtok(NULL, " \t\r\n"))
+		{
+			apszTokens[ui32NumTokens++] = pszToken;
+		}
+
+		if ((ui32NumTokens == 0) || (apszTokens[0][0] == '#'))
+		{
+			continue;
+		}
+
+		if ((ui32NumTokens < 6) && !(bPackVRAM && (ui32NumTokens == 4)))
+		{
+			printf(
+				"%s:%u: expected %s6 fields, found %u\n",
+				pszFileName,
+				ui32LineNumber,
+				bPackVRAM ? "4 or " : "",
+				ui32NumTokens
+			);
+			goto FAILED_LoadBatchList;
+		}
+
+		if ((strcmp(apszTokens[1], "4") != 0) && (strcmp(apszTokens[1], "8") != 0))
+		{
+			printf("%s:%u: expected bpp to be '4' or '8'\n", pszFileName, ui32LineNumber);
+			goto FAILED_LoadBatchList;
+		}
+
+		if (psBatch->ui32NumEntries == ui32Capacity)
+		{
+			TIM_BATCH_ENTRY* psEntries;
+
+			ui32Capacity = (ui32Capacity == 0) ? 64 : (ui32Capacity * 2);
+			psEntries = realloc(psBatch->psEntries, ui32Capacity * sizeof(TIM_BATCH_ENTRY));
+			if (psEntries == NULL)
+			{
+				printf("failed to allocate batch entries\n");
+				goto FAILED_LoadBatchList;
+			}
+
+			psBatch->psEntries = psEntries;
+		}
+
+		psEntry = &psBatch->psEntries[psBatch->ui32NumEntries++];
+		memset(psEntry, 0, sizeof(TIM_BATCH_ENTRY));
+
+		psEntry->pszOutputFileName = strdup(apszTokens[0]);
+		psEntry->ePixFmt = (
+			(apszTokens[1][0] == '4') ?
+			TIM_PIX_FMT_4BIT_CLUT :
+			TIM_PIX_FMT_8BIT_CLUT
+		);
+		psEntry->pszTextureFileName = strdup(apszTokens[2]);
+		psEntry->pszPaletteFileName = strdup(apszTokens[3]);
+
+		// Packed coordinates are assigned once every texture is loaded
+		if (!bPackVRAM)
+		{
+			psEntry->ui16TextureCoordX = strtol(apszTokens[4], NULL, 10);
+			psEntry->ui16TextureCoordY = strtol(apszTokens[5], NULL, 10);
+		}
+		else if (ui32NumTokens >= 6)
+		{
+			printf("%s:%u: coordinates are ignored when packing\n", pszFileName, ui32LineNumber);
+		}
+	}
+
+	fclose(fFilePtr);
+
+	if (psBatch->ui32NumEntries == 0)
+	{
+		printf("batch list %s contains no textures\n", pszFileName);
+		return 1;
+	}
+
+	return 0;
+
+FAILED_LoadBatchList:
+	fclose(fFilePtr);
+
+	return 1;
+}
+
+static int LoadBatchEntry(TIM_BATCH_ENTRY* psEntry)
+{
+	psEntry->sFile.sFileHeader.ui32ID = TIM_FILE_HEADER_ID;
+	psEntry->sFile.sFileHeader.sFlags.uMode = psEntry->ePixFmt;
+	psEntry->sFile.sFileHeader.sFlags.uClut = TIM_PIX_FMT_HAS_CLUT(psEntry->ePixFmt);
+
+	// The CLUT coordinates are assigned once the pool has been built
+	if (LoadPalette(
+			psEntry->pszPaletteFileName,
+			psEntry->ePixFmt,
+			0,
+			0,
+			&psEntry->sFile.sCLUTHeader,
+			&psEntry->sFile.psCLUTData
+		) != 0)
+	{
+		printf("failed to load palette %s\n", psEntry->pszPaletteFileName);
+		return 1;
+	}
+
+	if (LoadTexture(
+			psEntry->pszTextureFileName,
+			psEntry->ePixFmt,
+			psEntry->ui16TextureCoordX,
+			psEntry->ui16TextureCoordY,
+			psEntry->sFile.psCLUTData,
+			&psEntry->sFile.sPixelHeader,
+			&psEntry->sFile.pui8PixelData
+		) != 0)
+	{
+		printf("failed to load texture %s\n", psEntry->pszTextureFileName);
+		return 1;
+	}
+
+	return 0;
+}
+
+static bool CompareCLUTBlocks(const TIM_FILE* psA, const TIM_FILE* psB)
+{
+	return (
+		(psA->sCLUTHeader.ui16Width == psB->sCLUTHeader.ui16Width) &&
+		(psA->sCLUTHeader.ui16Height == psB->sCLUTHeader.ui16Height) &&
+		(memcmp(
+			psA->psCLUTData,
+			psB->psCLUTData,
+			psA->sCLUTHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER)
+		) == 0)
+	);
+}
+
+// Find the unique palettes within the batch
+static int BuildCLUTPool(TIM_BATCH* psBatch)
+{
+	psBatch->psCLUTPool = calloc(psBatch->ui32NumEntries, sizeof(TIM_CLUT_POOL_ENTRY));
+	if (psBatch->psCLUTPool == NULL)
+	{
+		printf("failed to allocate CLUT pool\n");
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < psBatch->ui32NumEntries; ++i)
+	{
+		TIM_BATCH_ENTRY* psEntry = &psBatch->psEntries[i];
+		const uint32_t ui32Hash = HashTIMData(
+			psEntry->sFile.psCLUTData,
+			psEntry->sFile.sCLUTHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER),
+			TIM_HASH_SEED
+		);
+
+		uint32_t j = 0;
+		for (; j < psBatch->ui32CLUTPoolSize; ++j)
+		{
+			const TIM_CLUT_POOL_ENTRY* psPoolEntry = &psBatch->psCLUTPool[j];
+
+			if ((psPoolEntry->ui32Hash == ui32Hash) &&
+				CompareCLUTBlocks(
+					&psBatch->psEntries[psPoolEntry->ui32EntryIndex].sFile,
+					&psEntry->sFile
+				))
+			{
+				break;
+			}
+		}
+
+		if (j == psBatch->ui32CLUTPoolSize)
+		{
+			psBatch->psCLUTPool[j].ui32Hash = ui32Hash;
+			psBatch->psCLUTPool[j].ui32EntryIndex = i;
+			psBatch->psCLUTPool[j].ui16Width = psEntry->sFile.sCLUTHeader.ui16Width;
+			psBatch->psCLUTPool[j].ui16Height = psEntry->sFile.sCLUTHeader.ui16Height;
+			++psBatch->ui32CLUTPoolSize;
+		}
+
+		++psBatch->psCLUTPool[j].ui32NumUsers;
+		psEntry->ui32CLUTPoolIndex = j;
+	}
+
+	return 0;
+}
+
+/*
+	Stack the pooled CLUTs downwards from the palette coordinates, moving to
+	a new column to the right once the bottom of VRAM is reached. The pool
+	must start on a CLUT ID boundary, and mustn't run into any texture
+*/
+static int PlaceCLUTPool(
+	TIM_BATCH* psBatch,
+	const uint16_t ui16FBCoordX,
+	const uint16_t ui16FBCoordY)
+{
+	uint32_t ui32CoordX = ui16FBCoordX;
+	uint32_t ui32CoordY = ui16FBCoordY;
+	uint32_t ui32ColumnWidth = 0;
+
+	if ((ui16FBCoordX % PSX_CLUT_ALIGN_X) != 0)
+	{
+		printf("palette X coordinate %hu is not a multiple of %u\n", ui16FBCoordX, PSX_CLUT_ALIGN_X);
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < psBatch->ui32CLUTPoolSize; ++i)
+	{
+		TIM_CLUT_POOL_ENTRY* psPoolEntry = &psBatch->psCLUTPool[i];
+		const TIM_BLOCK_HEADER* psCLUTHeader = (
+			&psBatch->psEntries[psPoolEntry->ui32EntryIndex].sFile.sCLUTHeader
+		);
+
+		if ((ui32CoordY + psCLUTHeader->ui16Height) > PSX_VRAM_HEIGHT)
+		{
+			ui32CoordX += ui32ColumnWidth;
+			ui32CoordY = ui16FBCoordY;
+			ui32ColumnWidth = 0;
+		}
+
+		if (((ui32CoordX + psCLUTHeader->ui16Width) > PSX_VRAM_WIDTH) ||
+			((ui32CoordY + psCLUTHeader->ui16Height) > PSX_VRAM_HEIGHT))
+		{
+			printf("CLUT pool overflows PSX VRAM after %u palettes\n", i);
+			return 1;
+		}
+
+		psPoolEntry->ui16FBCoordX = ui32CoordX;
+		psPoolEntry->ui16FBCoordY = ui32CoordY;
+
+		{
+			const VRAM_RECT sCLUTRect = {
+				.ui16X = ui32CoordX,
+				.ui16Y = ui32CoordY,
+				.ui16Width = psCLUTHeader->ui16Width,
+				.ui16Height = psCLUTHeader->ui16Height
+			};
+
+			for (uint32_t j = 0; j < psBatch->ui32NumEntries; ++j)
+			{
+				const TIM_BATCH_ENTRY* psEntry = &psBatch->psEntries[j];
+				const VRAM_RECT sPixelRect = GetVRAMRect(&psEntry->sFile.sPixelHeader);
+
+				if (DoVRAMRectsOverlap(&sCLUTRect, &sPixelRect))
+				{
+					printf(
+						"CLUT pool overlaps the pixels of %s at %hu, %hu after %u palettes\n",
+						psEntry->pszOutputFileName,
+						sCLUTRect.ui16X,
+						sCLUTRect.ui16Y,
+						i
+					);
+					return 1;
+				}
+			}
+		}
+
+		ui32CoordY += psCLUTHeader->ui16Height;
+		if (psCLUTHeader->ui16Width > ui32ColumnWidth)
+		{
+			ui32ColumnWidth = psCLUTHeader->ui16Width;
+		}
+	}
+
+	return 0;
+}
+
+// Point every texture at the pooled copy of its palette
+static void ApplyCLUTPool(TIM_BATCH* psBatch)
+{
+	for (uint32_t i = 0; i < psBatch->ui32NumEntries; ++i)
+	{
+		TIM_BATCH_ENTRY* psEntry = &psBatch->psEntries[i];
+		const TIM_CLUT_POOL_ENTRY* psPoolEntry = &psBatch->psCLUTPool[psEntry->ui32CLUTPoolIndex];
+
+		psEntry->sFile.sCLUTHeader.ui16FBCoordX = psPoolEntry->ui16FBCoordX;
+		psEntry->sFile.sCLUTHeader.ui16FBCoordY = psPoolEntry->ui16FBCoordY;
+	}
+}
+
+// Tallest first, then widest, which packs far tighter than list order
+static int CompareBatchEntrySize(const void* pvA, const void* pvB)
+{
+	const TIM_BLOCK_HEADER* psA = &(*(const TIM_BATCH_ENTRY* const*)pvA)->sFile.sPixelHeader;
+	const TIM_BLOCK_HEADER* psB = &(*(const TIM_BATCH_ENTRY* const*)pvB)->sFile.sPixelHeader;
+
+	if (psA->ui16Height != psB->ui16Height)
+	{
+		return (int)psB->ui16Height - (int)psA->ui16Height;
+	}
+
+	return (int)psB->ui16Width - (int)psA->ui16Width;
+}
+
+static int CompareCLUTPoolEntrySize(const void* pvA, const void* pvB)
+{
+	const TIM_CLUT_POOL_ENTRY* psA = *(const TIM_CLUT_POOL_ENTRY* const*)pvA;
+	const TIM_CLUT_POOL_ENTRY* psB = *(const TIM_CLUT_POOL_ENTRY* const*)pvB;
+
+	if (psA->ui16Height != psB->ui16Height)
+	{
+		return (int)psB->ui16Height - (int)psA->ui16Height;
+	}
+
+	return (int)psB->ui16Width - (int)psA->ui16Width;
+}
+
+/*
+	Assign coordinates to every texture and pooled CLUT by packing them into
+	the VRAM left free around the reserved rects. Kept textures and fixed CLUTs
+	already have their coordinates, and are packed around
+*/
+static int PackBatchVRAM(TIM_BATCH* psBatch, const TIM_ARGS* psTIMArgs)
+{
+	VRAM_PACKER sPacker;
+	TIM_BATCH_ENTRY** ppsEntries = NULL;
+	TIM_CLUT_POOL_ENTRY** ppsPoolEntries = NULL;
+	uint32_t ui32NumEntries = 0;
+	uint32_t ui32NumPoolEntries = 0;
+	uint32_t ui32UsedHalfwords = 0;
+
+	if (InitVRAMPacker(&sPacker) != 0)
+	{
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < psTIMArgs->ui32NumReservedRects; ++i)
+	{
+		if (ReserveVRAMRect(&sPacker, &psTIMArgs->psReservedRects[i]) != 0)
+		{
+			goto FAILED_PackBatchVRAM;
+		}
+	}
+
+	ppsEntries = malloc(psBatch->ui32NumEntries * sizeof(TIM_BATCH_ENTRY*));
+	ppsPoolEntries = malloc(psBatch->ui32CLUTPoolSize * sizeof(TIM_CLUT_POOL_ENTRY*));
+	if ((ppsEntries == NULL) || (ppsPoolEntries == NULL))
+	{
+		printf("failed to allocate packing order\n");
+		goto FAILED_PackBatchVRAM;
+	}
+
+	for (uint32_t i = 0; i < psBatch->ui32NumEntries; ++i)
+	{
+		TIM_BATCH_ENTRY* psEntry = &psBatch->psEntries[i];
+
+		if (psEntry->bKept)
+		{
+			const VRAM_RECT sRect = GetVRAMRect(&psEntry->sFile.sPixelHeader);
+
+			if (ReserveVRAMRect(&sPacker, &sRect) != 0)
+			{
+				goto FAILED_PackBatchVRAM;
+			}
+
+			ui32UsedHalfwords += sRect.ui16Width * sRect.ui16Height;
+			continue;
+		}
+
+		ppsEntries[ui32NumEntries++] = psEntry;
+	}
+
+	for (uint32_t i = 0; i < psBatch->ui32CLUTPoolSize; ++i)
+	{
+		TIM_CLUT_POOL_ENTRY* psPoolEntry = &psBatch->psCLUTPool[i];
+
+		if (psPoolEntry->bFixed)
+		{
+			const VRAM_RECT sRect = {
+				psPoolEntry->ui16FBCoordX,
+				psPoolEntry->ui16FBCoordY,
+				psPoolEntry->ui16Width,
+				psPoolEntry->ui16Height
+			};
+
+			if (ReserveVRAMRect(&sPacker, &sRect) != 0)
+			{
+				goto FAILED_PackBatchVRAM;
+			}
+
+			ui32UsedHalfwords += sRect.ui16Width * sRect.ui16Height;
+			continue;
+		}
+
+		ppsPoolEntries[ui32NumPoolEntries++] = psPoolEntry;
+	}
+
+	qsort(ppsEntries, ui32NumEntries, sizeof(TIM_BATCH_ENTRY*), CompareBatchEntrySize);
+	qsort(ppsPoolEntries, ui32NumPoolEntries, sizeof(TIM_CLUT_POOL_ENTRY*), CompareCLUTPoolEntrySize);
+
+	for (uint32_t i = 0; i < ui32NumEntries; ++i)
+	{
+		TIM_BLOCK_HEADER* psPixelHeader = &ppsEntries[i]->sFile.sPixelHeader;
+		VRAM_RECT sRect;
+
+		if (PackVRAMRect(
+				&sPacker,
+				psPixelHeader->ui16Width,
+				psPixelHeader->ui16Height,
+				VRAM_PLACEMENT_TEXTURE,
+				&sRect
+			) != 0)
+		{
+			printf(
+				"no space left in VRAM for %s (%hu * %hu halfwords)\n",
+				ppsEntries[i]->pszTextureFileName,
+				psPixelHeader->ui16Width,
+				psPixelHeader->ui16Height
+			);
+			goto FAILED_PackBatchVRAM;
+		}
+
+		psPixelHeader->ui16FBCoordX = sRect.ui16X;
+		psPixelHeader->ui16FBCoordY = sRect.ui16Y;
+		ui32UsedHalfwords += sRect.ui16Width * sRect.ui16Height;
+	}
+
+	for (uint32_t i = 0; i < ui32NumPoolEntries; ++i)
+	{
+		TIM_CLUT_POOL_ENTRY* psPoolEntry = ppsPoolEntries[i];
+		VRAM_RECT sRect;
+
+		if (PackVRAMRect(
+				&sPacker,
+				psPoolEntry->ui16Width,
+				psPoolEntry->ui16Height,
+				VRAM_PLACEMENT_CLUT,
+				&sRect
+			) != 0)
+		{
+			printf(
+				"no space left in VRAM for CLUT %s (%hu * %hu halfwords)\n",
+				psBatch->psEntries[psPoolEntry->ui32EntryIndex].pszPaletteFileName,
+				psPoolEntry->ui16Width,
+				psPoolEntry->ui16Height
+			);
+			goto FAILED_PackBatchVRAM;
+		}
+
+		psPoolEntry->ui16FBCoordX = sRect.ui16X;
+		psPoolEntry->ui16FBCoordY = sRect.ui16Y;
+		ui32UsedHalfwords += sRect.ui16Width * sRect.ui16Height;
+	}
+
+	printf(
+		"packed %u textures and %u CLUTs (%u and %u kept in place) into %u halfwords (%.1f%% of VRAM)\n",
+		psBatch->ui32NumEntries,
+		psBatch->ui32CLUTPoolSize,
+		psBatch->ui32NumEntries - ui32NumEntries,
+		psBatch->ui32CLUTPoolSize - ui32NumPoolEntries,
+		ui32UsedHalfwords,
+		(100.0 * ui32UsedHalfwords) / (PSX_VRAM_WIDTH * PSX_VRAM_HEIGHT)
+	);
+
+	free(ppsPoolEntries);
+	free(ppsEntries);
+	DestroyVRAMPacker(&sPacker);
+
+	return 0;
+
+FAILED_PackBatchVRAM:
+	free(ppsPoolEntries);
+	free(ppsEntries);
+	DestroyVRAMPacker(&sPacker);
+
+	return 1;
+}
+
+/*
+	Match every texture to its entry in the previous layout by output file
+	name. Those whose data and dimensions are unchanged keep their pixel
+	coordinates, and their pooled CLUT stays where the first of them had it
+*/
+static void KeepUnchangedBatchEntries(
+	TIM_BATCH* psBatch,
+	const VRAM_LAYOUT* psPrevious,
+	const TIM_ARGS* psTIMArgs)
+{
+	for (uint32_t i = 0; i < psBatch->ui32NumEntries; ++i)
+	{
+		TIM_BATCH_ENTRY* psEntry = &psBatch->psEntries[i];
+		TIM_BLOCK_HEADER* psPixelHeader = &psEntry->sFile.sPixelHeader;
+		TIM_CLUT_POOL_ENTRY* psPoolEntry = &psBatch->psCLUTPool[psEntry->ui32CLUTPoolIndex];
+		const VRAM_LAYOUT_ENTRY* psLayoutEntry = NULL;
+
+		for (uint32_t j = 0; j < psPrevious->ui32NumEntries; ++j)
+		{
+			if (strcmp(psPrevious->psEntries[j].pszFileName, psEntry->pszOutputFileName) == 0)
+			{
+				psLayoutEntry = &psPrevious->psEntries[j];
+				break;
+			}
+		}
+
+		psEntry->psPrevious = psLayoutEntry;
+
+		if ((psLayoutEntry == NULL) ||
+			(psLayoutEntry->ui32Hash != HashTIM(&psEntry->sFile)) ||
+			(psLayoutEntry->sPixelRect.ui16Width != psPixelHeader->ui16Width) ||
+			(psLayoutEntry->sPixelRect.ui16Height != psPixelHeader->ui16Height) ||
+			!IsVRAMRectValid(&psLayoutEntry->sPixelRect))
+		{
+			continue;
+		}
+
+		// The reserved rects may have changed since the previous layout
+		{
+			bool bReserved = false;
+
+			for (uint32_t j = 0; j < psTIMArgs->ui32NumReservedRects; ++j)
+			{
+				bReserved |= DoVRAMRectsOverlap(&psLayoutEntry->sPixelRect, &psTIMArgs->psReservedRects[j]);
+			}
+
+			if (bReserved)
+			{
+				continue;
+			}
+		}
+
+		psEntry->bKept = true;
+		psPixelHeader->ui16FBCoordX = psLayoutEntry->sPixelRect.ui16X;
+		psPixelHeader->ui16FBCoordY = psLayoutEntry->sPixelRect.ui16Y;
+
+		if (!psPoolEntry->bFixed &&
+			(psLayoutEntry->sCLUTRect.ui16Width == psPoolEntry->ui16Width) &&
+			(psLayoutEntry->sCLUTRect.ui16Height == psPoolEntry->ui16Height) &&
+			IsVRAMRectValid(&psLayoutEntry->sCLUTRect))
+		{
+			bool bReserved = false;
+
+			for (uint32_t j = 0; j < psTIMArgs->ui32NumReservedRects; ++j)
+			{
+				bReserved |= DoVRAMRectsOverlap(&psLayoutEntry->sCLUTRect, &psTIMArgs->psReservedRects[j]);
+			}
+
+			if (!bReserved)
+			{
+				psPoolEntry->bFixed = true;
+				psPoolEntry->ui16FBCoordX = psLayoutEntry->sCLUTRect.ui16X;
+				psPoolEntry->ui16FBCoordY = psLayoutEntry->sCLUTRect.ui16Y;
+			}
+		}
+	}
+}
+
+static void ClearKeptBatchEntries(TIM_BATCH* psBatch)
+{
+	for (uint32_t i = 0; i < psBatch->ui32NumEntries; ++i)
+	{
+		psBatch->psEntries[i].bKept = false;
+	}
+
+	for (uint32_t i = 0; i < psBatch->ui32CLUTPoolSize; ++i)
+	{
+		psBatch->psCLUTPool[i].bFixed = false;
+	}
+}
+
+// A kept texture only needs writing if its CLUT moved, or the file on disk
+// isn't the one the previous layout recorded. A --plan writes layouts without
+// TIMs, so the file there may still be from an older pack
+static bool IsBatchEntryUnchanged(const TIM_BATCH_ENTRY* psEntry)
+{
+	struct stat sStat;
+	TIM_FILE sHeaders;
+	TIM_MAPPING sMapping;
+	TIM_FILE sExisting;
+	bool bUnchanged;
+
+	if (!psEntry->bKept ||
+		(psEntry->sFile.sCLUTHeader.ui16FBCoordX != psEntry->psPrevious->sCLUTRect.ui16X) ||
+		(psEntry->sFile.sCLUTHeader.ui16FBCoordY != psEntry->psPrevious->sCLUTRect.ui16Y) ||
+		(stat(psEntry->pszOutputFileName, &sStat) != 0))
+	{
+		return false;
+	}
+
+	// The headers are enough to catch a file placed somewhere else, the data
+	// is only hashed once they match
+	if ((ReadTIMHeaders(psEntry->pszOutputFileName, &sHeaders) != 0) ||
+		(memcmp(&sHeaders.sFileHeader, &psEntry->sFile.sFileHeader, sizeof(TIM_FILE_HEADER)) != 0) ||
+		(memcmp(&sHeaders.sCLUTHeader, &psEntry->sFile.sCLUTHeader, sizeof(TIM_BLOCK_HEADER)) != 0) ||
+		(memcmp(&sHeaders.sPixelHeader, &psEntry->sFile.sPixelHeader, sizeof(TIM_BLOCK_HEADER)) != 0))
+	{
+		return false;
+	}
+
+	if (MapTIM(psEntry->pszOutputFileName, false, &sMapping, &sExisting) != 0)
+	{
+		return false;
+	}
+
+	bUnchanged = (HashTIM(&sExisting) == psEntry->psPrevious->ui32Hash);
+	UnmapTIM(&sMapping);
+
+	return bUnchanged;
+}
+
+static int WriteBatchLayout(const TIM_BATCH* psBatch, const TIM_ARGS* psTIMArgs, const char* pszFileName)
+{
+	VRAM_LAYOUT sLayout = {
+		.psReservedRects = psTIMArgs->psReservedRects,
+		.ui32NumReservedRects = psTIMArgs->ui32NumReservedRects
+	};
+	int iResult;
+
+	for (uint32_t i = 0; i < psBatch->ui32NumEntries; ++i)
+	{
+		if (AddVRAMLayoutEntry(
+				&sLayout,
+				psBatch->psEntries[i].pszOutputFileName,
+				&psBatch->psEntries[i].sFile
+			) != 0)
+		{
+			sLayout.psReservedRects = NULL;
+			DestroyVRAMLayout(&sLayout);
+			return 1;
+		}
+	}
+
+	iResult = WriteVRAMLayout(pszFileName, &sLayout);
+
+	// The reserved rects belong to the args
+	sLayout.psReservedRects = NULL;
+	DestroyVRAMLayout(&sLayout);
+
+	return iResult;
+}
+
+// Writes the runtime tables, which take every file in the batch
+static int WriteBatchTables(const TIM_BATCH* psBatch, const TIM_ARGS* psTIMArgs)
+{
+	const char** ppszNames = calloc(psBatch->ui32NumEntries, sizeof(char*));
+	const TIM_FILE** ppsFiles = calloc(psBatch->ui32NumEntries, sizeof(TIM_FILE*));
+	int iResult = 1;
+
+	if ((ppszNames == NULL) || (ppsFiles == NULL))
+	{
+		printf("failed to allocate table file list\n");
+		goto FAILED_WriteBatchTables;
+	}
+
+	for (uint32_t i = 0; i < psBatch->ui32NumEntries; ++i)
+	{
+		ppszNames[i] = psBatch->psEntries[i].pszOutputFileName;
+		ppsFiles[i] = &psBatch->psEntries[i].sFile;
+	}
+
+	if ((psTIMArgs->pszBlobFileName != NULL) &&
+		(WriteTIMBlob(psTIMArgs->pszBlobFileName, ppszNames, ppsFiles, psBatch->ui32NumEntries) != 0))
+	{
+		printf("failed to write blob\n");
+		goto FAILED_WriteBatchTables;
+	}
+
+	if ((psTIMArgs->pszAttributeFileName != NULL) &&
+		(WriteTIMAttributeTable(psTIMArgs->pszAttributeFileName, ppszNames, ppsFiles, psBatch->ui32NumEntries) != 0))
+	{
+		printf("failed to write attribute table\n");
+		goto FAILED_WriteBatchTables;
+	}
+
+	iResult = 0;
+
+FAILED_WriteBatchTables:
+	free(ppszNames);
+	free(ppsFiles);
+
+	return iResult;
+}
+
+static void PrintCLUTPoolReport(const TIM_BATCH* psBatch)
+{
+	uint32_t ui32TotalHalfwords = 0;
+	uint32_t ui32TotalRows = 0;
+	uint32_t ui32PooledHalfwords = 0;
+	uint32_t ui32PooledRows = 0;
+
+	for (uint32_t i = 0; i < psBatch->ui32NumEntries; ++i)
+	{
+		const TIM_BLOCK_HEADER* psCLUTHeader = &psBatch->psEntries[i].sFile.sCLUTHeader;
+
+		ui32TotalHalfwords += psCLUTHeader->ui16Width * psCLUTHeader->ui16Height;
+		ui32TotalRows += psCLUTHeader->ui16Height;
+	}
+
+	for (uint32_t i = 0; i < psBatch->ui32CLUTPoolSize; ++i)
+	{
+		const TIM_CLUT_POOL_ENTRY* psPoolEntry = &psBatch->psCLUTPool[i];
+		const TIM_BLOCK_HEADER* psCLUTHeader = (
+			&psBatch->psEntries[psPoolEntry->ui32EntryIndex].sFile.sCLUTHeader
+		);
+
+		ui32PooledHalfwords += psCLUTHeader->ui16Width * psCLUTHeader->ui16Height;
+		ui32PooledRows += psCLUTHeader->ui16Height;
+	}
+
+	printf(
+		"CLUT pool: %u textures, %u unique palettes\n"
+		"\tCLUT VRAM without pooling: %u rows, %u halfwords (%u bytes)\n"
+		"\tCLUT VRAM with pooling: %u rows, %u halfwords (%u bytes)\n"
+		"\tSaved: %u rows, %u halfwords (%u bytes)\n",
+		psBatch->ui32NumEntries,
+		psBatch->ui32CLUTPoolSize,
+		ui32TotalRows,
+		ui32TotalHalfwords,
+		ui32TotalHalfwords * (uint32_t)sizeof(TIM_PIX),
+		ui32PooledRows,
+		ui32PooledHalfwords,
+		ui32PooledHalfwords * (uint32_t)sizeof(TIM_PIX),
+		ui32TotalRows - ui32PooledRows,
+		ui32TotalHalfwords - ui32PooledHalfwords,
+		(ui32TotalHalfwords - ui32PooledHalfwords) * (uint32_t)sizeof(TIM_PIX)
+	);
+
+	for (uint32_t i = 0; i < psBatch->ui32CLUTPoolSize; ++i)
+	{
+		const TIM_CLUT_POOL_ENTRY* psPoolEntry = &psBatch->psCLUTPool[i];
+		const TIM_BLOCK_HEADER* psCLUTHeader = (
+			&psBatch->psEntries[psPoolEntry->ui32EntryIndex].sFile.sCLUTHeader
+		);
+
+		printf(
+			"\tCLUT %u: %hu * %hu at %hu, %hu, shared by %u texture(s)\n",
+			i,
+			psCLUTHeader->ui16Width,
+			psCLUTHeader->ui16Height,
+			psPoolEntry->ui16FBCoordX,
+			psPoolEntry->ui16FBCoordY,
+			psPoolEntry->ui32NumUsers
+		);
+	}
+}
+
+int PackTIMBatch(const TIM_ARGS* psTIMArgs)
+{
+	TIM_BATCH sBatch = { 0 };
+	VRAM_LAYOUT sPrevious = { 0 };
+	uint32_t ui32NumWritten = 0;
+
+	if (LoadBatchList(psTIMArgs->pszBatchFileName, psTIMArgs->bPackVRAM, &sBatch) != 0)
+	{
+		printf("failed to load batch list\n");
+		goto FAILED_PackTIMBatch;
+	}
+
+	for (uint32_t i = 0; i < sBatch.ui32NumEntries; ++i)
+	{
+		if (LoadBatchEntry(&sBatch.psEntries[i]) != 0)
+		{
+			goto FAILED_PackTIMBatch;
+		}
+	}
+
+	if (BuildCLUTPool(&sBatch) != 0)
+	{
+		goto FAILED_PackTIMBatch;
+	}
+
+	if (psTIMArgs->pszPreviousLayoutFileName != NULL)
+	{
+		if (ReadVRAMLayout(psTIMArgs->pszPreviousLayoutFileName, &sPrevious) != 0)
+		{
+			goto FAILED_PackTIMBatch;
+		}
+
+		KeepUnchangedBatchEntries(&sBatch, &sPrevious, psTIMArgs);
+	}
+
+	if (psTIMArgs->bPackVRAM)
+	{
+		if (PackBatchVRAM(&sBatch, psTIMArgs) != 0)
+		{
+			if (psTIMArgs->pszPreviousLayoutFileName == NULL)
+			{
+				goto FAILED_PackTIMBatch;
+			}
+
+			printf("changed textures don't fit around the previous layout, falling back to a full pack\n");
+			ClearKeptBatchEntries(&sBatch);
+
+			if (PackBatchVRAM(&sBatch, psTIMArgs) != 0)
+			{
+				goto FAILED_PackTIMBatch;
+			}
+		}
+	}
+	else if (PlaceCLUTPool(
+			&sBatch,
+			psTIMArgs->ui16PaletteCoordX,
+			psTIMArgs->ui16PaletteCoordY
+		) != 0)
+	{
+		goto FAILED_PackTIMBatch;
+	}
+
+	ApplyCLUTPool(&sBatch);
+
+	for (uint32_t i = 0; i < sBatch.ui32NumEntries; ++i)
+	{
+		TIM_BATCH_ENTRY* psEntry = &sBatch.psEntries[i];
+
+		if (IsBatchEntryUnchanged(psEntry))
+		{
+			continue;
+		}
+
+		PrintTIM(psEntry->pszOutputFileName, &psEntry->sFile);
+
+		if (WriteTIM(psEntry->pszOutputFileName, &psEntry->sFile) != 0)
+		{
+			printf("failed to write TIM\n");
+			goto FAILED_PackTIMBatch;
+		}
+
+		++ui32NumWritten;
+	}
+
+	if ((psTIMArgs->pszLayoutFileName != NULL) &&
+		(WriteBatchLayout(&sBatch, psTIMArgs, psTIMArgs->pszLayoutFileName) != 0))
+	{
+		printf("failed to write layout\n");
+		goto FAILED_PackTIMBatch;
+	}
+
+	// Written in full even when packing incrementally, as every offset after
+	// a changed texture moves
+	if (WriteBatchTables(&sBatch, psTIMArgs) != 0)
+	{
+		goto FAILED_PackTIMBatch;
+	}
+
+	PrintCLUTPoolReport(&sBatch);
+
+	printf(
+		"wrote %u of %u TIM file(s), %u unchanged\n",
+		ui32NumWritten,
+		sBatch.ui32NumEntries,
+		sBatch.ui32NumEntries - ui32NumWritten
+	);
+
+	DestroyBatch(&sBatch);
+	DestroyVRAMLayout(&sPrevious);
+
+	return 0;
+
+FAILED_PackTIMBatch:
+	DestroyBatch(&sBatch);
+	DestroyVRAMLayout(&sPrevious);
+
+	return 1;
+}
+
+typedef struct _TIM_PLAN_SCENE
+{
+	const char* pszListFileName;
+
+	// Indices into the plan's batch of every texture across all scenes
+	uint32_t* pui32Entries;
+	uint32_t ui32NumEntries;
+} TIM_PLAN_SCENE;
+
+typedef struct _TIM_PLAN
+{
+	// Every texture once, however many scenes list it
+	TIM_BATCH sBatch;
+	uint32_t* pui32NumScenesUsing;
+
+	TIM_PLAN_SCENE* psScenes;
+	uint32_t ui32NumScenes;
+} TIM_PLAN;
+
+static void DestroyPlan(TIM_PLAN* psPlan)
+{
+	for (uint32_t i = 0; i < psPlan->ui32NumScenes; ++i)
+	{
+		free(psPlan->psScenes[i].pui32Entries);
+	}
+
+	free(psPlan->psScenes);
+	free(psPlan->pui32NumScenesUsing);
+	DestroyBatch(&psPlan->sBatch);
+}
+
+/*
+	Loads a scene's list, merging its textures into the plan's batch by
+	output file name. A texture listed by several scenes must come from the
+	same files each time, as it's only converted once
+*/
+static int LoadPlanScene(TIM_PLAN* psPlan, uint32_t* pui32Capacity, TIM_PLAN_SCENE* psScene)
+{
+	TIM_BATCH sList = { 0 };
+	int iResult = 1;
+
+	if (LoadBatchList(psScene->pszListFileName, true, &sList) != 0)
+	{
+		printf("failed to load scene list\n");
+		goto FAILED_LoadPlanScene;
+	}
+
+	psScene->pui32Entries = malloc(sList.ui32NumEntries * sizeof(uint32_t));
+	if (psScene->pui32Entries == NULL)
+	{
+		printf("failed to allocate scene entries\n");
+		goto FAILED_LoadPlanScene;
+	}
+
+	for (uint32_t i = 0; i < sList.ui32NumEntries; ++i)
+	{
+		TIM_BATCH_ENTRY* psEntry = &sList.psEntries[i];
+		TIM_BATCH* psBatch = &psPlan->sBatch;
+		uint32_t j = 0;
+
+		for (; j < psBatch->ui32NumEntries; ++j)
+		{
+			if (strcmp(psBatch->psEntries[j].pszOutputFileName, psEntry->pszOutputFileName) == 0)
+			{
+				break;
+			}
+		}
+
+		if (j < psBatch->ui32NumEntries)
+		{
+			const TIM_BATCH_ENTRY* psExisting = &psBatch->psEntries[j];
+
+			if ((psExisting->ePixFmt != psEntry->ePixFmt) ||
+				(strcmp(psExisting->pszTextureFileName, psEntry->pszTextureFileName) != 0) ||
+				(strcmp(psExisting->pszPaletteFileName, psEntry->pszPaletteFileName) != 0))
+			{
+				printf(
+					"%s: %s is listed with different texture, palette or bpp to another scene\n",
+					psScene->pszListFileName,
+					psEntry->pszOutputFileName
+				);
+				goto FAILED_LoadPlanScene;
+			}
+		}
+		else
+		{
+			if (psBatch->ui32NumEntries == *pui32Capacity)
+			{
+				TIM_BATCH_ENTRY* psEntries;
+
+				*pui32Capacity = (*pui32Capacity == 0) ? 256 : (*pui32Capacity * 2);
+				psEntries = realloc(psBatch->psEntries, *pui32Capacity * sizeof(TIM_BATCH_ENTRY));
+				if (psEntries == NULL)
+				{
+					printf("failed to allocate plan entries\n");
+					goto FAILED_LoadPlanScene;
+				}
+
+				psBatch->psEntries = psEntries;
+			}
+
+			// The plan takes ownership of the entry's file names
+			psBatch->psEntries[psBatch->ui32NumEntries++] = *psEntry;
+			memset(psEntry, 0, sizeof(TIM_BATCH_ENTRY));
+		}
+
+		// Listing a texture twice in one scene doesn't make it resident
+		{
+			bool bListed = false;
+
+			for (uint32_t k = 0; (k < psScene->ui32NumEntries) && !bListed; ++k)
+			{
+				bListed = (psScene->pui32Entries[k] == j);
+			}
+
+			if (!bListed)
+			{
+				psScene->pui32Entries[psScene->ui32NumEntries++] = j;
+			}
+		}
+	}
+
+	iResult = 0;
+
+FAILED_LoadPlanScene:
+	DestroyBatch(&sList);
+
+	return iResult;
+}
+
+// A batch of the given plan entries, sharing the plan's files and data
+static int BuildPlanBatch(
+	const TIM_PLAN* psPlan,
+	const uint32_t* pui32Entries,
+	const uint32_t ui32NumEntries,
+	TIM_BATCH* psBatch)
+{
+	psBatch->psEntries = malloc(ui32NumEntries * sizeof(TIM_BATCH_ENTRY));
+	if (psBatch->psEntries == NULL)
+	{
+		printf("failed to allocate plan batch\n");
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < ui32NumEntries; ++i)
+	{
+		psBatch->psEntries[i] = psPlan->sBatch.psEntries[pui32Entries[i]];
+	}
+
+	psBatch->ui32NumEntries = ui32NumEntries;
+
+	return BuildCLUTPool(psBatch);
+}
+
+// Frees a batch from BuildPlanBatch, whose entries belong to the plan
+static void DestroyPlanBatch(TIM_BATCH* psBatch)
+{
+	free(psBatch->psEntries);
+	free(psBatch->psCLUTPool);
+	memset(psBatch, 0, sizeof(TIM_BATCH));
+}
+
+// Marks everything a packed batch occupies, along with the reserved rects
+static void SetPlanBatchBitmap(const TIM_BATCH* psBatch, const TIM_ARGS* psTIMArgs, VRAM_BITMAP* psBitmap)
+{
+	ClearVRAMBitmap(psBitmap);
+
+	for (uint32_t i = 0; i < psTIMArgs->ui32NumReservedRects; ++i)
+	{
+		SetVRAMBitmapRect(psBitmap, &psTIMArgs->psReservedRects[i]);
+	}
+
+	for (uint32_t i = 0; i < psBatch->ui32NumEntries; ++i)
+	{
+		const VRAM_RECT sRect = GetVRAMRect(&psBatch->psEntries[i].sFile.sPixelHeader);
+
+		SetVRAMBitmapRect(psBitmap, &sRect);
+	}
+
+	for (uint32_t i = 0; i < psBatch->ui32CLUTPoolSize; ++i)
+	{
+		const TIM_CLUT_POOL_ENTRY* psPoolEntry = &psBatch->psCLUTPool[i];
+		const VRAM_RECT sRect = {
+			psPoolEntry->ui16FBCoordX,
+			psPoolEntry->ui16FBCoordY,
+			psPoolEntry->ui16Width,
+			psPoolEntry->ui16Height
+		};
+
+		SetVRAMBitmapRect(psBitmap, &sRect);
+	}
+}
+
+// Whole texture pages left free, for textures added to the scene later
+static uint32_t CountFreeTexturePages(const VRAM_BITMAP* psBitmap)
+{
+	uint32_t ui32NumPages = 0;
+
+	for (uint32_t y = 0; y < PSX_VRAM_HEIGHT; y += PSX_TPAGE_HEIGHT)
+	{
+		for (uint32_t x = 0; x < PSX_VRAM_WIDTH; x += PSX_TPAGE_WIDTH)
+		{
+			const VRAM_RECT sRect = { x, y, PSX_TPAGE_WIDTH, PSX_TPAGE_HEIGHT };
+
+			ui32NumPages += IsVRAMBitmapRectFree(psBitmap, &sRect) ? 1 : 0;
+		}
+	}
+
+	return ui32NumPages;
+}
+
+/*
+	Packs the textures listed by every scene once, as a resident region which
+	stays where it is across all of them, then packs each scene's own
+	textures around it. A manifest of each scene's layout is written next to
+	its list, which --incremental can use to write its TIMs where planned
+*/
+int PlanTIMScenes(const TIM_ARGS* psTIMArgs)
+{
+	TIM_PLAN sPlan = { 0 };
+	TIM_BATCH sResident = { 0 };
+	VRAM_BITMAP* psBitmap = malloc(sizeof(VRAM_BITMAP));
+	uint32_t* pui32Resident = NULL;
+	uint32_t ui32NumResident = 0;
+	uint32_t ui32ResidentHalfwords = 0;
+	uint32_t ui32Capacity = 0;
+	uint32_t ui32NumFailed = 0;
+	uint32_t ui32TightestScene = 0;
+	uint32_t ui32TightestHeadroom = UINT32_MAX;
+	int iResult = 1;
+
+	sPlan.psScenes = calloc(psTIMArgs->ui32NumFileNames, sizeof(TIM_PLAN_SCENE));
+	if ((psBitmap == NULL) || (sPlan.psScenes == NULL))
+	{
+		printf("failed to allocate scenes\n");
+		goto FAILED_PlanTIMScenes;
+	}
+
+	for (uint32_t i = 0; i < psTIMArgs->ui32NumFileNames; ++i)
+	{
+		TIM_PLAN_SCENE* psScene = &sPlan.psScenes[sPlan.ui32NumScenes++];
+
+		psScene->pszListFileName = psTIMArgs->ppszFileNames[i];
+
+		if (LoadPlanScene(&sPlan, &ui32Capacity, psScene) != 0)
+		{
+			goto FAILED_PlanTIMScenes;
+		}
+	}
+
+	sPlan.pui32NumScenesUsing = calloc(sPlan.sBatch.ui32NumEntries, sizeof(uint32_t));
+	pui32Resident = malloc(sPlan.sBatch.ui32NumEntries * sizeof(uint32_t));
+	if ((sPlan.pui32NumScenesUsing == NULL) || (pui32Resident == NULL))
+	{
+		printf("failed to allocate plan entries\n");
+		goto FAILED_PlanTIMScenes;
+	}
+
+	// Each texture is converted once, however many scenes use it
+	for (uint32_t i = 0; i < sPlan.sBatch.ui32NumEntries; ++i)
+	{
+		if (LoadBatchEntry(&sPlan.sBatch.psEntries[i]) != 0)
+		{
+			goto FAILED_PlanTIMScenes;
+		}
+	}
+
+	for (uint32_t i = 0; i < sPlan.ui32NumScenes; ++i)
+	{
+		for (uint32_t j = 0; j < sPlan.psScenes[i].ui32NumEntries; ++j)
+		{
+			++sPlan.pui32NumScenesUsing[sPlan.psScenes[i].pui32Entries[j]];
+		}
+	}
+
+	for (uint32_t i = 0; i < sPlan.sBatch.ui32NumEntries; ++i)
+	{
+		if (sPlan.pui32NumScenesUsing[i] == sPlan.ui32NumScenes)
+		{
+			pui32Resident[ui32NumResident++] = i;
+		}
+	}
+
+	// Place the resident textures first, then copy their coordinates back so
+	// every scene sees them in the same place
+	if (BuildPlanBatch(&sPlan, pui32Resident, ui32NumResident, &sResident) != 0)
+	{
+		goto FAILED_PlanTIMScenes;
+	}
+
+	printf("resident: ");
+	if (PackBatchVRAM(&sResident, psTIMArgs) != 0)
+	{
+		printf("resident textures don't fit in VRAM\n");
+		goto FAILED_PlanTIMScenes;
+	}
+
+	ApplyCLUTPool(&sResident);
+
+	for (uint32_t i = 0; i < ui32NumResident; ++i)
+	{
+		TIM_BATCH_ENTRY* psEntry = &sPlan.sBatch.psEntries[pui32Resident[i]];
+
+		psEntry->sFile.sPixelHeader = sResident.psEntries[i].sFile.sPixelHeader;
+		psEntry->sFile.sCLUTHeader = sResident.psEntries[i].sFile.sCLUTHeader;
+		psEntry->bKept = true;
+		ui32ResidentHalfwords += psEntry->sFile.sPixelHeader.ui16Width * psEntry->sFile.sPixelHeader.ui16Height;
+	}
+
+	for (uint32_t i = 0; i < sResident.ui32CLUTPoolSize; ++i)
+	{
+		ui32ResidentHalfwords += sResident.psCLUTPool[i].ui16Width * sResident.psCLUTPool[i].ui16Height;
+	}
+
+	if ((psTIMArgs->pszLayoutFileName != NULL) &&
+		(WriteBatchLayout(&sResident, psTIMArgs, psTIMArgs->pszLayoutFileName) != 0))
+	{
+		printf("failed to write layout\n");
+		goto FAILED_PlanTIMScenes;
+	}
+
+	for (uint32_t i = 0; i < sPlan.ui32NumScenes; ++i)
+	{
+		const TIM_PLAN_SCENE* psScene = &sPlan.psScenes[i];
+		TIM_BATCH sScene = { 0 };
+		char* pszBaseName = NULL;
+		char* pszLayoutFileName = NULL;
+
+		if (BuildPlanBatch(&sPlan, psScene->pui32Entries, psScene->ui32NumEntries, &sScene) != 0)
+		{
+			DestroyPlanBatch(&sScene);
+			goto FAILED_PlanTIMScenes;
+		}
+
+		// Resident CLUTs stay put too, and scene textures with the same
+		// palette share them
+		for (uint32_t j = 0; j < sScene.ui32NumEntries; ++j)
+		{
+			const TIM_BATCH_ENTRY* psEntry = &sScene.psEntries[j];
+			TIM_CLUT_POOL_ENTRY* psPoolEntry = &sScene.psCLUTPool[psEntry->ui32CLUTPoolIndex];
+
+			if (psEntry->bKept && !psPoolEntry->bFixed)
+			{
+				psPoolEntry->bFixed = true;
+				psPoolEntry->ui16FBCoordX = psEntry->sFile.sCLUTHeader.ui16FBCoordX;
+				psPoolEntry->ui16FBCoordY = psEntry->sFile.sCLUTHeader.ui16FBCoordY;
+			}
+		}
+
+		printf("%s: ", psScene->pszListFileName);
+		if (PackBatchVRAM(&sScene, psTIMArgs) != 0)
+		{
+			printf("%s doesn't fit alongside the resident textures\n", psScene->pszListFileName);
+			DestroyPlanBatch(&sScene);
+			++ui32NumFailed;
+			continue;
+		}
+
+		ApplyCLUTPool(&sScene);
+
+		pszBaseName = GetBaseFileName(psScene->pszListFileName);
+		pszLayoutFileName = (pszBaseName != NULL) ? malloc(strlen(pszBaseName) + 8) : NULL;
+		if (pszLayoutFileName == NULL)
+		{
+			printf("failed to allocate layout file name\n");
+			free(pszBaseName);
+			DestroyPlanBatch(&sScene);
+			goto FAILED_PlanTIMScenes;
+		}
+
+		sprintf(pszLayoutFileName, "%s.layout", pszBaseName);
+		if (WriteBatchLayout(&sScene, psTIMArgs, pszLayoutFileName) != 0)
+		{
+			printf("failed to write layout\n");
+			free(pszLayoutFileName);
+			free(pszBaseName);
+			DestroyPlanBatch(&sScene);
+			goto FAILED_PlanTIMScenes;
+		}
+
+		SetPlanBatchBitmap(&sScene, psTIMArgs, psBitmap);
+
+		{
+			const uint32_t ui32Headroom = CountVRAMBitmapFree(psBitmap);
+
+			printf(
+				"%s: %u texture(s) (%u resident), %u CLUT(s), %u halfwords of headroom (%.1f%% of VRAM), %u free texture page(s), wrote %s\n",
+				psScene->pszListFileName,
+				sScene.ui32NumEntries,
+				ui32NumResident,
+				sScene.ui32CLUTPoolSize,
+				ui32Headroom,
+				(100.0 * ui32Headroom) / (PSX_VRAM_WIDTH * PSX_VRAM_HEIGHT),
+				CountFreeTexturePages(psBitmap),
+				pszLayoutFileName
+			);
+
+			if (ui32Headroom < ui32TightestHeadroom)
+			{
+				ui32TightestHeadroom = ui32Headroom;
+				ui32TightestScene = i;
+			}
+		}
+
+		free(pszLayoutFileName);
+		free(pszBaseName);
+		DestroyPlanBatch(&sScene);
+	}
+
+	printf(
+		"planned %u scene(s) using %u texture(s), %u resident in %u halfwords (%.1f%% of VRAM)\n",
+		sPlan.ui32NumScenes,
+		sPlan.sBatch.ui32NumEntries,
+		ui32NumResident,
+		ui32ResidentHalfwords,
+		(100.0 * ui32ResidentHalfwords) / (PSX_VRAM_WIDTH * PSX_VRAM_HEIGHT)
+	);
+
+	if (ui32TightestHeadroom != UINT32_MAX)
+	{
+		printf(
+			"least headroom: %s, %u halfwords\n",
+			sPlan.psScenes[ui32TightestScene].pszListFileName,
+			ui32TightestHeadroom
+		);
+	}
+
+	if (ui32NumFailed > 0)
+	{
+		printf("%u scene(s) don't fit in VRAM\n", ui32NumFailed);
+		goto FAILED_PlanTIMScenes;
+	}
+
+	iResult = 0;
+
+FAILED_PlanTIMScenes:
+	DestroyPlanBatch(&sResident);
+	DestroyPlan(&sPlan);
+	free(pui32Resident);
+	free(psBitmap);
+
+	return iResult;
+}
@@ -0,0 +1,571 @@
+#include <stdio.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "tim_defs.h"
+#include "tim_vram_defs.h"
+#include "timpack.h"
+
+// Every payload starts on a word boundary, so it can be DMA'd straight from
+// wherever the blob is loaded
+#define TIM_BLOB_ALIGN (4)
+
+typedef struct _TIM_BLOB_ENTRY
+{
+	// The C identifier the entry's constants are named with
+	char* pszIdentifier;
+
+	uint32_t ui32PixelOffset;
+	uint32_t ui32CLUTOffset;
+} TIM_BLOB_ENTRY;
+
+// Turns the file name, less its directory and extension, into an upper case
+// C identifier
+static char* GetBlobIdentifier(const char* pszFileName)
+{
+	char* pszBaseName = GetBaseFileName(pszFileName);
+	char* pszIdentifier;
+	const char* pszName;
+
+	if (pszBaseName == NULL)
+	{
+		return NULL;
+	}
+
+	pszName = strrchr(pszBaseName, '/');
+	pszName = (pszName != NULL) ? (pszName + 1) : pszBaseName;
+
+	// Room for a leading underscore and a suffix to tell duplicates apart
+	pszIdentifier = malloc(strlen(pszName) + 16);
+	if (pszIdentifier != NULL)
+	{
+		char* pszDst = pszIdentifier;
+
+		if (!isalpha((unsigned char)*pszName))
+		{
+			*pszDst++ = '_';
+		}
+
+		for (; *pszName != '\0'; ++pszName)
+		{
+			*pszDst++ = isalnum((unsigned char)*pszName) ? toupper((unsigned char)*pszName) : '_';
+		}
+
+		*pszDst = '\0';
+	}
+
+	free(pszBaseName);
+
+	return pszIdentifier;
+}
+
+// Names each file's constants, telling apart files whose names only differ
+// by directory or punctuation with their index
+static int NameBlobEntries(const char* const* ppszNames, TIM_BLOB_ENTRY* psEntries, const uint32_t ui32NumFiles)
+{
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		psEntries[i].pszIdentifier = GetBlobIdentifier(ppszNames[i]);
+		if (psEntries[i].pszIdentifier == NULL)
+		{
+			printf("failed to allocate identifier\n");
+			return 1;
+		}
+
+		for (uint32_t j = 0; j < i; ++j)
+		{
+			if (strcmp(psEntries[i].pszIdentifier, psEntries[j].pszIdentifier) == 0)
+			{
+				sprintf(psEntries[i].pszIdentifier + strlen(psEntries[i].pszIdentifier), "_%u", i);
+				break;
+			}
+		}
+	}
+
+	return 0;
+}
+
+// Writes a payload followed by the padding up to the next aligned offset
+static int WriteBlobPayload(FILE* fFilePtr, const void* pData, const uint32_t ui32SizeInBytes, uint32_t* pui32Offset)
+{
+	static const uint8_t aui8Padding[TIM_BLOB_ALIGN] = { 0 };
+	const uint32_t ui32PaddedSizeInBytes = ALIGN_UP(ui32SizeInBytes, TIM_BLOB_ALIGN);
+
+	if ((fwrite(pData, 1, ui32SizeInBytes, fFilePtr) != ui32SizeInBytes) ||
+		(fwrite(aui8Padding, 1, ui32PaddedSizeInBytes - ui32SizeInBytes, fFilePtr) != (ui32PaddedSizeInBytes - ui32SizeInBytes)))
+	{
+		return 1;
+	}
+
+	*pui32Offset += ui32PaddedSizeInBytes;
+
+	return 0;
+}
+
+// Finds an earlier file with the same CLUT at the same coordinates, which
+// batch mode gives every user of a pooled palette
+static bool FindBlobCLUT(const TIM_FILE* const* ppsFiles, const uint32_t ui32File, uint32_t* pui32Match)
+{
+	const TIM_BLOCK_HEADER* psHeader = &ppsFiles[ui32File]->sCLUTHeader;
+
+	for (uint32_t i = 0; i < ui32File; ++i)
+	{
+		const TIM_BLOCK_HEADER* psOther = &ppsFiles[i]->sCLUTHeader;
+
+		if ((psOther->ui16FBCoordX == psHeader->ui16FBCoordX) &&
+			(psOther->ui16FBCoordY == psHeader->ui16FBCoordY) &&
+			(psOther->ui16Width == psHeader->ui16Width) &&
+			(psOther->ui16Height == psHeader->ui16Height) &&
+			(memcmp(
+				ppsFiles[i]->psCLUTData,
+				ppsFiles[ui32File]->psCLUTData,
+				psHeader->ui16Width * psHeader->ui16Height * sizeof(TIM_PIX)
+			) == 0))
+		{
+			*pui32Match = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void WriteBlobUpload(FILE* fFilePtr, const uint32_t ui32Offset, const TIM_BLOCK_HEADER* psHeader)
+{
+	fprintf(
+		fFilePtr,
+		" \\\n\t{ %u, %hu, %hu, %hu, %hu },",
+		ui32Offset,
+		psHeader->ui16FBCoordX,
+		psHeader->ui16FBCoordY,
+		psHeader->ui16Width,
+		psHeader->ui16Height
+	);
+}
+
+typedef struct _TIM_BLOB_HEADER
+{
+	FILE* fFilePtr;
+	char* pszFileName;
+
+	// The identifier every constant in the header starts with
+	char* pszPrefix;
+} TIM_BLOB_HEADER;
+
+// Opens the C header for a table file, named after it with a suffix, and
+// starts its include guard. The suffix keeps headers for tables that share a
+// name, such as scene.bin and scene.attr, from overwriting each other, and is
+// added to the identifier prefix so their constants don't collide either
+static int OpenBlobHeader(const char* pszTableFileName, const char* pszSuffix, TIM_BLOB_HEADER* psHeader)
+{
+	char* pszBaseName = GetBaseFileName(pszTableFileName);
+	char* pszIdentifier = GetBlobIdentifier(pszTableFileName);
+
+	memset(psHeader, 0, sizeof(TIM_BLOB_HEADER));
+
+	psHeader->pszPrefix = (pszIdentifier != NULL) ? malloc(strlen(pszIdentifier) + strlen(pszSuffix) + 1) : NULL;
+	psHeader->pszFileName = (pszBaseName != NULL) ? malloc(strlen(pszBaseName) + strlen(pszSuffix) + 3) : NULL;
+	if ((psHeader->pszPrefix == NULL) || (psHeader->pszFileName == NULL))
+	{
+		printf("failed to allocate header name\n");
+		free(pszIdentifier);
+		free(pszBaseName);
+		return 1;
+	}
+
+	sprintf(psHeader->pszFileName, "%s%s.h", pszBaseName, pszSuffix);
+	free(pszBaseName);
+
+	sprintf(psHeader->pszPrefix, "%s", pszIdentifier);
+	for (char* pszDst = &psHeader->pszPrefix[strlen(pszIdentifier)]; *pszSuffix != '\0'; ++pszSuffix)
+	{
+		*pszDst++ = toupper((unsigned char)*pszSuffix);
+		*pszDst = '\0';
+	}
+	free(pszIdentifier);
+
+	psHeader->fFilePtr = fopen(psHeader->pszFileName, "w");
+	if (psHeader->fFilePtr == NULL)
+	{
+		printf("could not open %s for writing\n", psHeader->pszFileName);
+		return 1;
+	}
+
+	fprintf(psHeader->fFilePtr, "// Generated by timpack for %s, do not edit\n", pszTableFileName);
+	fprintf(psHeader->fFilePtr, "#ifndef %s_H\n#define %s_H\n\n", psHeader->pszPrefix, psHeader->pszPrefix);
+
+	return 0;
+}
+
+// Ends the include guard of a header which was opened, and frees it
+static int CloseBlobHeader(TIM_BLOB_HEADER* psHeader)
+{
+	int iResult = 0;
+
+	if (psHeader->fFilePtr != NULL)
+	{
+		fprintf(psHeader->fFilePtr, "\n#endif // %s_H\n", psHeader->pszPrefix);
+
+		if (fclose(psHeader->fFilePtr) != 0)
+		{
+			printf("failed to write %s\n", psHeader->pszFileName);
+			iResult = 1;
+		}
+		else
+		{
+			printf("wrote %s\n", psHeader->pszFileName);
+		}
+	}
+
+	free(psHeader->pszFileName);
+	free(psHeader->pszPrefix);
+	memset(psHeader, 0, sizeof(TIM_BLOB_HEADER));
+
+	return iResult;
+}
+
+static int WriteBlobHeader(
+	const char* pszBlobFileName,
+	const char* const* ppszNames,
+	const TIM_FILE* const* ppsFiles,
+	const TIM_BLOB_ENTRY* psEntries,
+	const uint32_t ui32NumFiles,
+	const uint32_t ui32SizeInBytes,
+	const uint32_t ui32NumUploads)
+{
+	TIM_BLOB_HEADER sHeader;
+	FILE* fFilePtr;
+	const char* pszPrefix;
+
+	if (OpenBlobHeader(pszBlobFileName, "", &sHeader) != 0)
+	{
+		CloseBlobHeader(&sHeader);
+		return 1;
+	}
+
+	fFilePtr = sHeader.fFilePtr;
+	pszPrefix = sHeader.pszPrefix;
+
+	fprintf(fFilePtr, "#define %s_BLOB_SIZE (%u)\n", pszPrefix, ui32SizeInBytes);
+	fprintf(fFilePtr, "#define %s_NUM_TEXTURES (%u)\n", pszPrefix, ui32NumFiles);
+	fprintf(fFilePtr, "#define %s_NUM_UPLOADS (%u)\n", pszPrefix, ui32NumUploads);
+
+	// Offsets are in bytes from the start of the blob, the rest in VRAM
+	// halfwords, with TPAGE & CLUT ready for the primitive's attributes
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		const TIM_FILE* psFile = ppsFiles[i];
+		const char* pszName = psEntries[i].pszIdentifier;
+
+		fprintf(fFilePtr, "\n// %s\n", ppszNames[i]);
+		fprintf(fFilePtr, "#define %s_%s_OFFSET (%u)\n", pszPrefix, pszName, psEntries[i].ui32PixelOffset);
+		fprintf(fFilePtr, "#define %s_%s_X (%hu)\n", pszPrefix, pszName, psFile->sPixelHeader.ui16FBCoordX);
+		fprintf(fFilePtr, "#define %s_%s_Y (%hu)\n", pszPrefix, pszName, psFile->sPixelHeader.ui16FBCoordY);
+		fprintf(fFilePtr, "#define %s_%s_W (%hu)\n", pszPrefix, pszName, psFile->sPixelHeader.ui16Width);
+		fprintf(fFilePtr, "#define %s_%s_H (%hu)\n", pszPrefix, pszName, psFile->sPixelHeader.ui16Height);
+		fprintf(
+			fFilePtr,
+			"#define %s_%s_TPAGE (0x%04hx)\n",
+			pszPrefix,
+			pszName,
+			GetVRAMTPageID(psFile->sFileHeader.sFlags.uMode, psFile->sPixelHeader.ui16FBCoordX, psFile->sPixelHeader.ui16FBCoordY)
+		);
+
+		if (psFile->sFileHeader.sFlags.uClut)
+		{
+			fprintf(
+				fFilePtr,
+				"#define %s_%s_CLUT (0x%04hx)\n",
+				pszPrefix,
+				pszName,
+				GetVRAMCLUTID(psFile->sCLUTHeader.ui16FBCoordX, psFile->sCLUTHeader.ui16FBCoordY)
+			);
+			fprintf(fFilePtr, "#define %s_%s_CLUT_OFFSET (%u)\n", pszPrefix, pszName, psEntries[i].ui32CLUTOffset);
+			fprintf(fFilePtr, "#define %s_%s_CLUT_X (%hu)\n", pszPrefix, pszName, psFile->sCLUTHeader.ui16FBCoordX);
+			fprintf(fFilePtr, "#define %s_%s_CLUT_Y (%hu)\n", pszPrefix, pszName, psFile->sCLUTHeader.ui16FBCoordY);
+			fprintf(fFilePtr, "#define %s_%s_CLUT_W (%hu)\n", pszPrefix, pszName, psFile->sCLUTHeader.ui16Width);
+			fprintf(fFilePtr, "#define %s_%s_CLUT_H (%hu)\n", pszPrefix, pszName, psFile->sCLUTHeader.ui16Height);
+		}
+	}
+
+	// Every transfer in blob order, as an initialiser of { offset, x, y, w, h }
+	fprintf(fFilePtr, "\n#define %s_UPLOADS", pszPrefix);
+
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		uint32_t ui32Match;
+
+		if (ppsFiles[i]->sFileHeader.sFlags.uClut && !FindBlobCLUT(ppsFiles, i, &ui32Match))
+		{
+			WriteBlobUpload(fFilePtr, psEntries[i].ui32CLUTOffset, &ppsFiles[i]->sCLUTHeader);
+		}
+
+		WriteBlobUpload(fFilePtr, psEntries[i].ui32PixelOffset, &ppsFiles[i]->sPixelHeader);
+	}
+
+	fprintf(fFilePtr, "\n");
+
+	return CloseBlobHeader(&sHeader);
+}
+
+/*
+	The blob is every file's CLUT, the first time it's seen, followed by its
+	pixel data, with no headers in between. The header written alongside it
+	gives the offset and VRAM rect of each payload.
+*/
+int WriteTIMBlob(
+	const char* pszBlobFileName,
+	const char* const* ppszNames,
+	const TIM_FILE* const* ppsFiles,
+	const uint32_t ui32NumFiles)
+{
+	TIM_BLOB_ENTRY* psEntries = calloc(ui32NumFiles, sizeof(TIM_BLOB_ENTRY));
+	FILE* fFilePtr = NULL;
+	uint32_t ui32Offset = 0;
+	uint32_t ui32NumUploads = 0;
+	int iResult = 1;
+
+	if (psEntries == NULL)
+	{
+		printf("failed to allocate blob entries\n");
+		return 1;
+	}
+
+	if (NameBlobEntries(ppszNames, psEntries, ui32NumFiles) != 0)
+	{
+		goto FAILED_WriteTIMBlob;
+	}
+
+	fFilePtr = fopen(pszBlobFileName, "wb");
+	if (fFilePtr == NULL)
+	{
+		printf("could not open %s for writing\n", pszBlobFileName);
+		goto FAILED_WriteTIMBlob;
+	}
+
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		const TIM_FILE* psFile = ppsFiles[i];
+		uint32_t ui32Match;
+
+		if (psFile->sFileHeader.sFlags.uClut)
+		{
+			if (FindBlobCLUT(ppsFiles, i, &ui32Match))
+			{
+				psEntries[i].ui32CLUTOffset = psEntries[ui32Match].ui32CLUTOffset;
+			}
+			else
+			{
+				psEntries[i].ui32CLUTOffset = ui32Offset;
+				++ui32NumUploads;
+
+				if (WriteBlobPayload(
+						fFilePtr,
+						psFile->psCLUTData,
+						psFile->sCLUTHeader.ui16Width * psFile->sCLUTHeader.ui16Height * sizeof(TIM_PIX),
+						&ui32Offset
+					) != 0)
+				{
+					printf("failed to write %s\n", pszBlobFileName);
+					goto FAILED_WriteTIMBlob;
+				}
+			}
+		}
+
+		psEntries[i].ui32PixelOffset = ui32Offset;
+		++ui32NumUploads;
+
+		if (WriteBlobPayload(
+				fFilePtr,
+				psFile->pui8PixelData,
+				psFile->sPixelHeader.ui16Width * psFile->sPixelHeader.ui16Height * sizeof(uint16_t),
+				&ui32Offset
+			) != 0)
+		{
+			printf("failed to write %s\n", pszBlobFileName);
+			goto FAILED_WriteTIMBlob;
+		}
+	}
+
+	if (fclose(fFilePtr) != 0)
+	{
+		fFilePtr = NULL;
+		printf("failed to write %s\n", pszBlobFileName);
+		goto FAILED_WriteTIMBlob;
+	}
+
+	fFilePtr = NULL;
+
+	printf("wrote %s: %u bytes, %u upload(s)\n", pszBlobFileName, ui32Offset, ui32NumUploads);
+
+	iResult = WriteBlobHeader(
+		pszBlobFileName,
+		ppszNames,
+		ppsFiles,
+		psEntries,
+		ui32NumFiles,
+		ui32Offset,
+		ui32NumUploads
+	);
+
+FAILED_WriteTIMBlob:
+	if (fFilePtr != NULL)
+	{
+		fclose(fFilePtr);
+	}
+
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		free(psEntries[i].pszIdentifier);
+	}
+
+	free(psEntries);
+
+	return iResult;
+}
+
+static int WriteAttributeHeader(
+	const char* pszTableFileName,
+	const char* const* ppszNames,
+	const VRAM_TEXTURE_ATTRS* psAttrs,
+	const TIM_BLOB_ENTRY* psEntries,
+	const uint32_t ui32NumFiles)
+{
+	TIM_BLOB_HEADER sHeader;
+	FILE* fFilePtr;
+	const char* pszPrefix;
+
+	if (OpenBlobHeader(pszTableFileName, "_attrs", &sHeader) != 0)
+	{
+		CloseBlobHeader(&sHeader);
+		return 1;
+	}
+
+	fFilePtr = sHeader.fFilePtr;
+	pszPrefix = sHeader.pszPrefix;
+
+	fprintf(fFilePtr, "#define %s_NUM_TEXTURES (%u)\n", pszPrefix, ui32NumFiles);
+
+	// INDEX is the texture's entry in the table, U, V, W & H are in pixels
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		const char* pszName = psEntries[i].pszIdentifier;
+
+		fprintf(fFilePtr, "\n// %s\n", ppszNames[i]);
+		fprintf(fFilePtr, "#define %s_%s_INDEX (%u)\n", pszPrefix, pszName, i);
+		fprintf(fFilePtr, "#define %s_%s_TPAGE (0x%04hx)\n", pszPrefix, pszName, psAttrs[i].ui16TPage);
+		fprintf(fFilePtr, "#define %s_%s_CLUT (0x%04hx)\n", pszPrefix, pszName, psAttrs[i].ui16CLUT);
+		fprintf(fFilePtr, "#define %s_%s_U (%u)\n", pszPrefix, pszName, psAttrs[i].ui8U);
+		fprintf(fFilePtr, "#define %s_%s_V (%u)\n", pszPrefix, pszName, psAttrs[i].ui8V);
+		fprintf(fFilePtr, "#define %s_%s_W (%hu)\n", pszPrefix, pszName, psAttrs[i].ui16Width);
+		fprintf(fFilePtr, "#define %s_%s_H (%hu)\n", pszPrefix, pszName, psAttrs[i].ui16Height);
+	}
+
+	// The table as an initialiser of { tpage, clut, u, v, w, h }
+	fprintf(fFilePtr, "\n#define %s_TABLE", pszPrefix);
+
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		fprintf(
+			fFilePtr,
+			" \\\n\t{ 0x%04hx, 0x%04hx, %u, %u, %hu, %hu },",
+			psAttrs[i].ui16TPage,
+			psAttrs[i].ui16CLUT,
+			psAttrs[i].ui8U,
+			psAttrs[i].ui8V,
+			psAttrs[i].ui16Width,
+			psAttrs[i].ui16Height
+		);
+	}
+
+	fprintf(fFilePtr, "\n");
+
+	return CloseBlobHeader(&sHeader);
+}
+
+/*
+	The table is a 32 bit count followed by a VRAM_TEXTURE_ATTRS per file, in
+	the order given, so that sprite setup is a lookup rather than working the
+	attributes out from each TIM's headers.
+*/
+int WriteTIMAttributeTable(
+	const char* pszTableFileName,
+	const char* const* ppszNames,
+	const TIM_FILE* const* ppsFiles,
+	const uint32_t ui32NumFiles)
+{
+	TIM_BLOB_ENTRY* psEntries = calloc(ui32NumFiles, sizeof(TIM_BLOB_ENTRY));
+	VRAM_TEXTURE_ATTRS* psAttrs = calloc(ui32NumFiles, sizeof(VRAM_TEXTURE_ATTRS));
+	FILE* fFilePtr = NULL;
+	int iResult = 1;
+
+	if ((psEntries == NULL) || (psAttrs == NULL))
+	{
+		printf("failed to allocate attribute table\n");
+		goto FAILED_WriteTIMAttributeTable;
+	}
+
+	if (NameBlobEntries(ppszNames, psEntries, ui32NumFiles) != 0)
+	{
+		goto FAILED_WriteTIMAttributeTable;
+	}
+
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		GetVRAMTextureAttrs(ppsFiles[i], &psAttrs[i]);
+
+		// A primitive can't sample across a page, so its UVs would wrap
+		if (((ppsFiles[i]->sPixelHeader.ui16FBCoordX % PSX_TPAGE_WIDTH) + ppsFiles[i]->sPixelHeader.ui16Width) > PSX_TPAGE_WIDTH)
+		{
+			printf("warning: %s crosses a texture page boundary horizontally\n", ppszNames[i]);
+		}
+
+		if ((psAttrs[i].ui8V + psAttrs[i].ui16Height) > PSX_TPAGE_HEIGHT)
+		{
+			printf("warning: %s crosses a texture page boundary vertically\n", ppszNames[i]);
+		}
+	}
+
+	fFilePtr = fopen(pszTableFileName, "wb");
+	if (fFilePtr == NULL)
+	{
+		printf("could not open %s for writing\n", pszTableFileName);
+		goto FAILED_WriteTIMAttributeTable;
+	}
+
+	if ((fwrite(&ui32NumFiles, sizeof(uint32_t), 1, fFilePtr) != 1) ||
+		(fwrite(psAttrs, sizeof(VRAM_TEXTURE_ATTRS), ui32NumFiles, fFilePtr) != ui32NumFiles))
+	{
+		printf("failed to write %s\n", pszTableFileName);
+		goto FAILED_WriteTIMAttributeTable;
+	}
+
+	printf("wrote %s: %u texture(s)\n", pszTableFileName, ui32NumFiles);
+
+	iResult = WriteAttributeHeader(pszTableFileName, ppszNames, psAttrs, psEntries, ui32NumFiles);
+
+FAILED_WriteTIMAttributeTable:
+	if ((fFilePtr != NULL) && (fclose(fFilePtr) != 0))
+	{
+		printf("failed to write %s\n", pszTableFileName);
+		iResult = 1;
+	}
+
+	if (psEntries != NULL)
+	{
+		for (uint32_t i = 0; i < ui32NumFiles; ++i)
+		{
+			free(psEntries[i].pszIdentifier);
+		}
+	}
+
+	free(psEntries);
+	free(psAttrs);
+
+	return iResult;
+}
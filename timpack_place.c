@@ -0,0 +1,251 @@
+#include <stdio.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tim_defs.h"
+#include "tim_vram_defs.h"
+#include "timpack.h"
+
+typedef struct _TIM_PLACE_FILE
+{
+	const char* pszFileName;
+	TIM_MAPPING sMapping;
+	TIM_FILE sFile;
+
+	// The file which owns the CLUT this one shares, or its own index
+	uint32_t ui32CLUTOwner;
+} TIM_PLACE_FILE;
+
+static TIM_PLACE_FILE* psSortFiles;
+
+// Tallest first, then widest
+static int CompareCLUTSize(const void* pvA, const void* pvB)
+{
+	const TIM_BLOCK_HEADER* psA = &psSortFiles[*(const uint32_t*)pvA].sFile.sCLUTHeader;
+	const TIM_BLOCK_HEADER* psB = &psSortFiles[*(const uint32_t*)pvB].sFile.sCLUTHeader;
+
+	if (psA->ui16Height != psB->ui16Height)
+	{
+		return (int)psB->ui16Height - (int)psA->ui16Height;
+	}
+
+	return (int)psB->ui16Width - (int)psA->ui16Width;
+}
+
+static bool IsPlaceFile(const TIM_ARGS* psTIMArgs, const char* pszFileName)
+{
+	for (uint32_t i = 0; i < psTIMArgs->ui32NumFileNames; ++i)
+	{
+		if (strcmp(psTIMArgs->ppszFileNames[i], pszFileName) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Mark everything in VRAM which the CLUTs being placed must avoid
+static int BuildPlaceBitmap(
+	const TIM_ARGS* psTIMArgs,
+	const TIM_PLACE_FILE* psFiles,
+	VRAM_BITMAP* psBitmap)
+{
+	ClearVRAMBitmap(psBitmap);
+
+	for (uint32_t i = 0; i < psTIMArgs->ui32NumReservedRects; ++i)
+	{
+		SetVRAMBitmapRect(psBitmap, &psTIMArgs->psReservedRects[i]);
+	}
+
+	if (psTIMArgs->pszLayoutFileName != NULL)
+	{
+		VRAM_LAYOUT sLayout;
+
+		if (ReadVRAMLayout(psTIMArgs->pszLayoutFileName, &sLayout) != 0)
+		{
+			return 1;
+		}
+
+		for (uint32_t i = 0; i < sLayout.ui32NumReservedRects; ++i)
+		{
+			if (IsVRAMRectValid(&sLayout.psReservedRects[i]))
+			{
+				SetVRAMBitmapRect(psBitmap, &sLayout.psReservedRects[i]);
+			}
+		}
+
+		// The CLUTs of the files being placed are free to move
+		for (uint32_t i = 0; i < sLayout.ui32NumEntries; ++i)
+		{
+			const VRAM_LAYOUT_ENTRY* psEntry = &sLayout.psEntries[i];
+
+			if (IsVRAMRectValid(&psEntry->sPixelRect))
+			{
+				SetVRAMBitmapRect(psBitmap, &psEntry->sPixelRect);
+			}
+
+			if (!IsPlaceFile(psTIMArgs, psEntry->pszFileName) &&
+				IsVRAMRectValid(&psEntry->sCLUTRect))
+			{
+				SetVRAMBitmapRect(psBitmap, &psEntry->sCLUTRect);
+			}
+		}
+
+		DestroyVRAMLayout(&sLayout);
+	}
+
+	for (uint32_t i = 0; i < psTIMArgs->ui32NumFileNames; ++i)
+	{
+		const VRAM_RECT sPixelRect = GetVRAMRect(&psFiles[i].sFile.sPixelHeader);
+
+		if (!IsVRAMRectValid(&sPixelRect))
+		{
+			printf("pixel block of %s does not fit within PSX VRAM\n", psFiles[i].pszFileName);
+			return 1;
+		}
+
+		SetVRAMBitmapRect(psBitmap, &sPixelRect);
+	}
+
+	return 0;
+}
+
+int PlaceTIMCLUTs(const TIM_ARGS* psTIMArgs)
+{
+	TIM_PLACE_FILE* psFiles = calloc(psTIMArgs->ui32NumFileNames, sizeof(TIM_PLACE_FILE));
+	uint32_t* pui32Order = calloc(psTIMArgs->ui32NumFileNames, sizeof(uint32_t));
+	VRAM_BITMAP* psBitmap = malloc(sizeof(VRAM_BITMAP));
+	uint32_t ui32NumUnique = 0;
+	uint32_t ui32NumShared = 0;
+	int iResult = 1;
+
+	if ((psFiles == NULL) || (pui32Order == NULL) || (psBitmap == NULL))
+	{
+		printf("failed to allocate CLUT placement\n");
+		goto FAILED_PlaceTIMCLUTs;
+	}
+
+	for (uint32_t i = 0; i < psTIMArgs->ui32NumFileNames; ++i)
+	{
+		TIM_PLACE_FILE* psFile = &psFiles[i];
+
+		psFile->pszFileName = psTIMArgs->ppszFileNames[i];
+
+		if (MapTIM(psFile->pszFileName, true, &psFile->sMapping, &psFile->sFile) != 0)
+		{
+			goto FAILED_PlaceTIMCLUTs;
+		}
+
+		if (!psFile->sFile.sFileHeader.sFlags.uClut)
+		{
+			printf("%s has no CLUT to place\n", psFile->pszFileName);
+			goto FAILED_PlaceTIMCLUTs;
+		}
+
+		// Files with identical CLUTs share a single placement
+		psFile->ui32CLUTOwner = i;
+		for (uint32_t j = 0; j < ui32NumUnique; ++j)
+		{
+			const TIM_FILE* psOwner = &psFiles[pui32Order[j]].sFile;
+
+			if ((psOwner->sCLUTHeader.ui16Width == psFile->sFile.sCLUTHeader.ui16Width) &&
+				(psOwner->sCLUTHeader.ui16Height == psFile->sFile.sCLUTHeader.ui16Height) &&
+				(psOwner->sCLUTHeader.ui32SizeInBytes == psFile->sFile.sCLUTHeader.ui32SizeInBytes) &&
+				(memcmp(
+					psOwner->psCLUTData,
+					psFile->sFile.psCLUTData,
+					psOwner->sCLUTHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER)
+				) == 0))
+			{
+				psFile->ui32CLUTOwner = pui32Order[j];
+				++ui32NumShared;
+				break;
+			}
+		}
+
+		if (psFile->ui32CLUTOwner == i)
+		{
+			pui32Order[ui32NumUnique++] = i;
+		}
+	}
+
+	if (BuildPlaceBitmap(psTIMArgs, psFiles, psBitmap) != 0)
+	{
+		goto FAILED_PlaceTIMCLUTs;
+	}
+
+	psSortFiles = psFiles;
+	qsort(pui32Order, ui32NumUnique, sizeof(uint32_t), CompareCLUTSize);
+
+	for (uint32_t i = 0; i < ui32NumUnique; ++i)
+	{
+		TIM_BLOCK_HEADER* psCLUTHeader = &psFiles[pui32Order[i]].sFile.sCLUTHeader;
+		VRAM_RECT sRect;
+
+		if (!FindVRAMBitmapCLUTSpace(psBitmap, psCLUTHeader->ui16Width, psCLUTHeader->ui16Height, &sRect))
+		{
+			printf(
+				"no space left in VRAM for the %hu * %hu CLUT of %s\n",
+				psCLUTHeader->ui16Width,
+				psCLUTHeader->ui16Height,
+				psFiles[pui32Order[i]].pszFileName
+			);
+			goto FAILED_PlaceTIMCLUTs;
+		}
+
+		SetVRAMBitmapRect(psBitmap, &sRect);
+		psCLUTHeader->ui16FBCoordX = sRect.ui16X;
+		psCLUTHeader->ui16FBCoordY = sRect.ui16Y;
+	}
+
+	// Only write once every CLUT has a home, so a failure leaves files as is
+	for (uint32_t i = 0; i < psTIMArgs->ui32NumFileNames; ++i)
+	{
+		TIM_PLACE_FILE* psFile = &psFiles[i];
+		const TIM_BLOCK_HEADER* psOwnerHeader = &psFiles[psFile->ui32CLUTOwner].sFile.sCLUTHeader;
+
+		psFile->sMapping.psCLUTHeader->ui16FBCoordX = psOwnerHeader->ui16FBCoordX;
+		psFile->sMapping.psCLUTHeader->ui16FBCoordY = psOwnerHeader->ui16FBCoordY;
+
+		printf(
+			"%s: CLUT %hu * %hu at %hu, %hu\n",
+			psFile->pszFileName,
+			psOwnerHeader->ui16Width,
+			psOwnerHeader->ui16Height,
+			psOwnerHeader->ui16FBCoordX,
+			psOwnerHeader->ui16FBCoordY
+		);
+	}
+
+	printf(
+		"placed %u unique CLUT(s) for %u TIM file(s), %u shared\n",
+		ui32NumUnique,
+		psTIMArgs->ui32NumFileNames,
+		ui32NumShared
+	);
+
+	iResult = 0;
+
+FAILED_PlaceTIMCLUTs:
+	if (psFiles != NULL)
+	{
+		for (uint32_t i = 0; i < psTIMArgs->ui32NumFileNames; ++i)
+		{
+			if (UnmapTIM(&psFiles[i].sMapping) != 0)
+			{
+				iResult = 1;
+			}
+		}
+	}
+
+	free(psBitmap);
+	free(pui32Order);
+	free(psFiles);
+
+	return iResult;
+}
@@ -0,0 +1,487 @@
+#include <stdio.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SEQUENCE_SIMD_WIDTH (8)
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SEQUENCE_SIMD_WIDTH (8)
+#endif
+
+#include "tim_defs.h"
+#include "tim_vram_defs.h"
+#include "timpack.h"
+
+typedef struct _TIM_SEQUENCE
+{
+	char** ppszFrameFileNames;
+	uint32_t ui32NumFrames;
+
+	// The scratch list of changed rects, at most one per row
+	VRAM_RECT* psRects;
+
+	uint32_t ui32NumChangedHalfwords;
+	uint32_t ui32NumRects;
+} TIM_SEQUENCE;
+
+static void DestroySequence(TIM_SEQUENCE* psSequence)
+{
+	for (uint32_t i = 0; i < psSequence->ui32NumFrames; ++i)
+	{
+		free(psSequence->ppszFrameFileNames[i]);
+	}
+
+	free(psSequence->ppszFrameFileNames);
+	free(psSequence->psRects);
+}
+
+/*
+	Each non-empty line of the list is one frame's texture file, in playback
+	order. Lines starting with '#' are ignored.
+*/
+static int LoadSequenceList(const char* pszFileName, TIM_SEQUENCE* psSequence)
+{
+	char szLine[4096];
+	uint32_t ui32Capacity = 0;
+
+	FILE *fFilePtr = fopen(pszFileName, "r");
+	if (fFilePtr == NULL)
+	{
+		printf("could not open %s for reading\n", pszFileName);
+		return 1;
+	}
+
+	while (fgets(szLine, sizeof(szLine), fFilePtr) != NULL)
+	{
+		const char* pszToken = strtok(szLine, " \t\r\n");
+
+		if ((pszToken == NULL) || (pszToken[0] == '#'))
+		{
+			continue;
+		}
+
+		if (psSequence->ui32NumFrames == ui32Capacity)
+		{
+			char** ppszFrameFileNames;
+
+			ui32Capacity = (ui32Capacity == 0) ? 64 : (ui32Capacity * 2);
+			ppszFrameFileNames = realloc(psSequence->ppszFrameFileNames, ui32Capacity * sizeof(char*));
+			if (ppszFrameFileNames == NULL)
+			{
+				printf("failed to allocate frame list\n");
+				fclose(fFilePtr);
+				return 1;
+			}
+
+			psSequence->ppszFrameFileNames = ppszFrameFileNames;
+		}
+
+		psSequence->ppszFrameFileNames[psSequence->ui32NumFrames++] = strdup(pszToken);
+	}
+
+	fclose(fFilePtr);
+
+	if (psSequence->ui32NumFrames == 0)
+	{
+		printf("sequence list %s contains no frames\n", pszFileName);
+		return 1;
+	}
+
+	if (psSequence->ui32NumFrames > UINT16_MAX)
+	{
+		printf("sequence list %s contains more than %u frames\n", pszFileName, UINT16_MAX);
+		return 1;
+	}
+
+	return 0;
+}
+
+#ifdef SEQUENCE_SIMD_WIDTH
+static inline bool AreHalfwordsEqual(const uint16_t* pui16A, const uint16_t* pui16B)
+{
+#if defined(__SSE2__)
+	const __m128i sEqual = _mm_cmpeq_epi16(
+		_mm_loadu_si128((const __m128i*)pui16A),
+		_mm_loadu_si128((const __m128i*)pui16B)
+	);
+
+	return _mm_movemask_epi8(sEqual) == 0xFFFF;
+#else
+	return vminvq_u16(vceqq_u16(vld1q_u16(pui16A), vld1q_u16(pui16B))) == 0xFFFF;
+#endif
+}
+#endif
+
+// Finds the first and last halfwords which differ between two rows. Whole
+// vectors are compared from each end, then the mismatching one is searched
+static bool FindRowChanges(
+	const uint16_t* pui16Previous,
+	const uint16_t* pui16Current,
+	const uint32_t ui32Width,
+	uint32_t* pui32First,
+	uint32_t* pui32Last)
+{
+	uint32_t ui32First = 0;
+	uint32_t ui32End = ui32Width;
+
+#ifdef SEQUENCE_SIMD_WIDTH
+	while (((ui32First + SEQUENCE_SIMD_WIDTH) <= ui32Width) &&
+		AreHalfwordsEqual(&pui16Previous[ui32First], &pui16Current[ui32First]))
+	{
+		ui32First += SEQUENCE_SIMD_WIDTH;
+	}
+#endif
+
+	while ((ui32First < ui32Width) && (pui16Previous[ui32First] == pui16Current[ui32First]))
+	{
+		++ui32First;
+	}
+
+	if (ui32First == ui32Width)
+	{
+		return false;
+	}
+
+#ifdef SEQUENCE_SIMD_WIDTH
+	while ((ui32End >= (ui32First + SEQUENCE_SIMD_WIDTH)) &&
+		AreHalfwordsEqual(&pui16Previous[ui32End - SEQUENCE_SIMD_WIDTH], &pui16Current[ui32End - SEQUENCE_SIMD_WIDTH]))
+	{
+		ui32End -= SEQUENCE_SIMD_WIDTH;
+	}
+#endif
+
+	// Stops at ui32First at the latest, which is known to differ
+	while (pui16Previous[ui32End - 1] == pui16Current[ui32End - 1])
+	{
+		--ui32End;
+	}
+
+	*pui32First = ui32First;
+	*pui32Last = ui32End - 1;
+
+	return true;
+}
+
+// Collects runs of changed rows into rects, each as wide as the widest change
+// in the run. Returns the number of rects, relative to the pixel block
+static uint32_t FindChangedRects(
+	const TIM_BLOCK_HEADER* psPixelHeader,
+	const uint16_t* pui16Previous,
+	const uint16_t* pui16Current,
+	VRAM_RECT* psRects)
+{
+	const uint32_t ui32Width = psPixelHeader->ui16Width;
+	uint32_t ui32NumRects = 0;
+	VRAM_RECT* psRect = NULL;
+
+	for (uint32_t y = 0; y < psPixelHeader->ui16Height; ++y)
+	{
+		uint32_t ui32First;
+		uint32_t ui32Last;
+
+		if (!FindRowChanges(&pui16Previous[y * ui32Width], &pui16Current[y * ui32Width], ui32Width, &ui32First, &ui32Last))
+		{
+			psRect = NULL;
+			continue;
+		}
+
+		if (psRect == NULL)
+		{
+			psRect = &psRects[ui32NumRects++];
+			psRect->ui16X = ui32First;
+			psRect->ui16Y = y;
+			psRect->ui16Width = ui32Last + 1 - ui32First;
+			psRect->ui16Height = 1;
+			continue;
+		}
+
+		if (ui32First < psRect->ui16X)
+		{
+			psRect->ui16Width += psRect->ui16X - ui32First;
+			psRect->ui16X = ui32First;
+		}
+
+		if ((ui32Last + 1) > (uint32_t)(psRect->ui16X + psRect->ui16Width))
+		{
+			psRect->ui16Width = ui32Last + 1 - psRect->ui16X;
+		}
+
+		++psRect->ui16Height;
+	}
+
+	return ui32NumRects;
+}
+
+// Writes the blocks which turn the previous frame into the current one
+static int WriteSequenceDelta(
+	FILE* fFilePtr,
+	TIM_SEQUENCE* psSequence,
+	const uint16_t ui16Frame,
+	const TIM_BLOCK_HEADER* psPixelHeader,
+	const uint8_t* pui8Previous,
+	const uint8_t* pui8Current)
+{
+	static const uint8_t aui8Padding[4] = { 0 };
+	const uint16_t* pui16Current = (const uint16_t*)pui8Current;
+	const uint32_t ui32NumRects = FindChangedRects(
+		psPixelHeader,
+		(const uint16_t*)pui8Previous,
+		pui16Current,
+		psSequence->psRects
+	);
+	uint32_t ui32NumChangedHalfwords = 0;
+
+	TIM_DELTA_FRAME_HEADER sFrameHeader = {
+		.ui32SizeInBytes = sizeof(TIM_DELTA_FRAME_HEADER),
+		.ui16Frame = ui16Frame,
+		.ui16NumBlocks = ui32NumRects
+	};
+
+	for (uint32_t i = 0; i < ui32NumRects; ++i)
+	{
+		const VRAM_RECT* psRect = &psSequence->psRects[i];
+
+		ui32NumChangedHalfwords += psRect->ui16Width * psRect->ui16Height;
+		sFrameHeader.ui32SizeInBytes += sizeof(TIM_BLOCK_HEADER) + ALIGN_UP(psRect->ui16Width * psRect->ui16Height * sizeof(uint16_t), 4);
+	}
+
+	fwrite(&sFrameHeader, sizeof(TIM_DELTA_FRAME_HEADER), 1, fFilePtr);
+
+	// Each rect is a pixel block in VRAM coordinates, like those in a TIM
+	for (uint32_t i = 0; i < ui32NumRects; ++i)
+	{
+		const VRAM_RECT* psRect = &psSequence->psRects[i];
+		const uint32_t ui32RowInBytes = psRect->ui16Width * sizeof(uint16_t);
+		const uint32_t ui32DataInBytes = ui32RowInBytes * psRect->ui16Height;
+
+		const TIM_BLOCK_HEADER sBlockHeader = {
+			.ui32SizeInBytes = sizeof(TIM_BLOCK_HEADER) + ALIGN_UP(ui32DataInBytes, 4),
+			.ui16FBCoordX = psPixelHeader->ui16FBCoordX + psRect->ui16X,
+			.ui16FBCoordY = psPixelHeader->ui16FBCoordY + psRect->ui16Y,
+			.ui16Width = psRect->ui16Width,
+			.ui16Height = psRect->ui16Height
+		};
+
+		fwrite(&sBlockHeader, sizeof(TIM_BLOCK_HEADER), 1, fFilePtr);
+
+		for (uint32_t y = psRect->ui16Y; y < (uint32_t)(psRect->ui16Y + psRect->ui16Height); ++y)
+		{
+			fwrite(&pui16Current[(y * psPixelHeader->ui16Width) + psRect->ui16X], ui32RowInBytes, 1, fFilePtr);
+		}
+
+		fwrite(aui8Padding, ALIGN_UP(ui32DataInBytes, 4) - ui32DataInBytes, 1, fFilePtr);
+	}
+
+	printf(
+		"frame %hu: %u rect(s), %u of %u halfwords changed\n",
+		ui16Frame,
+		ui32NumRects,
+		ui32NumChangedHalfwords,
+		psPixelHeader->ui16Width * psPixelHeader->ui16Height
+	);
+
+	psSequence->ui32NumChangedHalfwords += ui32NumChangedHalfwords;
+	psSequence->ui32NumRects += ui32NumRects;
+
+	return ferror(fFilePtr) ? 1 : 0;
+}
+
+/*
+	The first frame is written as an ordinary TIM, then each frame after it as
+	a delta against the one before, ending with a delta from the last frame
+	back to the first so that looping never uploads the whole rect again.
+*/
+int PackTIMSequence(const TIM_ARGS* psTIMArgs)
+{
+	TIM_FILE sFile = {
+		.sFileHeader = {
+			.ui32ID = TIM_FILE_HEADER_ID,
+			.sFlags =
+			{
+				.uMode = psTIMArgs->ePixFmt,
+				.uClut = TIM_PIX_FMT_HAS_CLUT(psTIMArgs->ePixFmt)
+			}
+		}
+	};
+	TIM_SEQUENCE sSequence = { 0 };
+	uint8_t* pui8Previous = NULL;
+	char* pszBaseName = NULL;
+	char* pszDeltaFileName = NULL;
+	FILE* fDeltaFilePtr = NULL;
+	long lDeltaSizeInBytes = 0;
+	int iResult = 1;
+
+	if (LoadSequenceList(psTIMArgs->pszSequenceFileName, &sSequence) != 0)
+	{
+		printf("failed to load sequence list\n");
+		goto FAILED_PackTIMSequence;
+	}
+
+	if (LoadPalette(
+			psTIMArgs->pszPaletteFileName,
+			psTIMArgs->ePixFmt,
+			psTIMArgs->ui16PaletteCoordX,
+			psTIMArgs->ui16PaletteCoordY,
+			&sFile.sCLUTHeader,
+			&sFile.psCLUTData
+		) != 0)
+	{
+		printf("failed to load palette\n");
+		goto FAILED_PackTIMSequence;
+	}
+
+	if (LoadTexture(
+			sSequence.ppszFrameFileNames[0],
+			psTIMArgs->ePixFmt,
+			psTIMArgs->ui16TextureCoordX,
+			psTIMArgs->ui16TextureCoordY,
+			sFile.psCLUTData,
+			&sFile.sPixelHeader,
+			&sFile.pui8PixelData
+		) != 0)
+	{
+		printf("failed to load Texture\n");
+		goto FAILED_PackTIMSequence;
+	}
+
+	PrintTIM(psTIMArgs->pszOutputFileName, &sFile);
+
+	if (WriteTIM(psTIMArgs->pszOutputFileName, &sFile) != 0)
+	{
+		printf("failed to write TIM\n");
+		goto FAILED_PackTIMSequence;
+	}
+
+	sSequence.psRects = calloc(sFile.sPixelHeader.ui16Height, sizeof(VRAM_RECT));
+	pszBaseName = GetBaseFileName(psTIMArgs->pszOutputFileName);
+	pszDeltaFileName = (pszBaseName != NULL) ? malloc(strlen(pszBaseName) + 7) : NULL;
+	if ((sSequence.psRects == NULL) || (pszDeltaFileName == NULL))
+	{
+		printf("failed to allocate sequence deltas\n");
+		goto FAILED_PackTIMSequence;
+	}
+
+	sprintf(pszDeltaFileName, "%s.delta", pszBaseName);
+	fDeltaFilePtr = fopen(pszDeltaFileName, "wb");
+	if (fDeltaFilePtr == NULL)
+	{
+		printf("could not open %s for writing\n", pszDeltaFileName);
+		goto FAILED_PackTIMSequence;
+	}
+
+	{
+		const TIM_DELTA_HEADER sHeader = {
+			.ui32ID = TIM_DELTA_FILE_ID,
+			.ui16NumFrames = sSequence.ui32NumFrames,
+			.ui16NumDeltas = (sSequence.ui32NumFrames > 1) ? sSequence.ui32NumFrames : 0
+		};
+
+		fwrite(&sHeader, sizeof(TIM_DELTA_HEADER), 1, fDeltaFilePtr);
+	}
+
+	pui8Previous = sFile.pui8PixelData;
+
+	for (uint32_t i = 1; i < sSequence.ui32NumFrames; ++i)
+	{
+		TIM_BLOCK_HEADER sPixelHeader;
+		uint8_t* pui8Current = NULL;
+		int iDeltaResult;
+
+		if (LoadTexture(
+				sSequence.ppszFrameFileNames[i],
+				psTIMArgs->ePixFmt,
+				psTIMArgs->ui16TextureCoordX,
+				psTIMArgs->ui16TextureCoordY,
+				sFile.psCLUTData,
+				&sPixelHeader,
+				&pui8Current
+			) != 0)
+		{
+			printf("failed to load Texture\n");
+			goto FAILED_PackTIMSequence;
+		}
+
+		if ((sPixelHeader.ui16Width != sFile.sPixelHeader.ui16Width) ||
+			(sPixelHeader.ui16Height != sFile.sPixelHeader.ui16Height))
+		{
+			printf(
+				"%s is %hu * %hu halfwords, but the first frame is %hu * %hu\n",
+				sSequence.ppszFrameFileNames[i],
+				sPixelHeader.ui16Width,
+				sPixelHeader.ui16Height,
+				sFile.sPixelHeader.ui16Width,
+				sFile.sPixelHeader.ui16Height
+			);
+			free(pui8Current);
+			goto FAILED_PackTIMSequence;
+		}
+
+		iDeltaResult = WriteSequenceDelta(fDeltaFilePtr, &sSequence, i, &sFile.sPixelHeader, pui8Previous, pui8Current);
+
+		// The first frame is kept for the delta which loops back to it
+		if (pui8Previous != sFile.pui8PixelData)
+		{
+			free(pui8Previous);
+		}
+
+		pui8Previous = pui8Current;
+
+		if (iDeltaResult != 0)
+		{
+			printf("failed to write %s\n", pszDeltaFileName);
+			goto FAILED_PackTIMSequence;
+		}
+	}
+
+	if ((sSequence.ui32NumFrames > 1) &&
+		(WriteSequenceDelta(fDeltaFilePtr, &sSequence, 0, &sFile.sPixelHeader, pui8Previous, sFile.pui8PixelData) != 0))
+	{
+		printf("failed to write %s\n", pszDeltaFileName);
+		goto FAILED_PackTIMSequence;
+	}
+
+	lDeltaSizeInBytes = ftell(fDeltaFilePtr);
+
+	printf(
+		"wrote %s: %u frame(s), %u rect(s) of %u halfwords, %ld bytes, against %u bytes as whole frames\n",
+		pszDeltaFileName,
+		sSequence.ui32NumFrames,
+		sSequence.ui32NumRects,
+		sSequence.ui32NumChangedHalfwords,
+		lDeltaSizeInBytes,
+		((sSequence.ui32NumFrames > 1) ? sSequence.ui32NumFrames : 0) * (sFile.sPixelHeader.ui32SizeInBytes - (uint32_t)sizeof(TIM_BLOCK_HEADER))
+	);
+
+	iResult = 0;
+
+FAILED_PackTIMSequence:
+	if ((fDeltaFilePtr != NULL) && (fclose(fDeltaFilePtr) != 0))
+	{
+		printf("failed to write %s\n", pszDeltaFileName);
+		iResult = 1;
+	}
+
+	// A partial delta file would promise frames it doesn't hold
+	if ((iResult != 0) && (fDeltaFilePtr != NULL))
+	{
+		remove(pszDeltaFileName);
+	}
+
+	if (pui8Previous != sFile.pui8PixelData)
+	{
+		free(pui8Previous);
+	}
+
+	free(pszDeltaFileName);
+	free(pszBaseName);
+	DestroyTIM(&sFile);
+	DestroySequence(&sSequence);
+
+	return iResult;
+}
@@ -0,0 +1,211 @@
+#include <stdio.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tim_defs.h"
+#include "tim_vram_defs.h"
+#include "timpack.h"
+
+// The end of the texture page span starting at ui32Start, clamped to ui32End
+static uint32_t GetSliceEnd(const uint32_t ui32Start, const uint32_t ui32End, const uint32_t ui32PageSize)
+{
+	const uint32_t ui32PageEnd = ((ui32Start / ui32PageSize) + 1) * ui32PageSize;
+
+	return (ui32PageEnd < ui32End) ? ui32PageEnd : ui32End;
+}
+
+// Copies a rect of the source's pixel block into a new TIM sharing its CLUT,
+// the indices are already packed so rows are copied without decoding
+static int WriteSliceTIM(
+	const char* pszFileName,
+	const TIM_FILE* psSource,
+	const VRAM_RECT* psRect)
+{
+	const uint32_t ui32SourceRowInBytes = psSource->sPixelHeader.ui16Width * sizeof(uint16_t);
+	const uint32_t ui32RowInBytes = psRect->ui16Width * sizeof(uint16_t);
+	const uint32_t ui32DataInBytes = ALIGN_UP(ui32RowInBytes * psRect->ui16Height, 4);
+	const uint8_t* pui8Src = (
+		psSource->pui8PixelData +
+		((psRect->ui16Y - psSource->sPixelHeader.ui16FBCoordY) * ui32SourceRowInBytes) +
+		((psRect->ui16X - psSource->sPixelHeader.ui16FBCoordX) * sizeof(uint16_t))
+	);
+
+	TIM_FILE sSlice = {
+		.sFileHeader = psSource->sFileHeader,
+		.sCLUTHeader = psSource->sCLUTHeader,
+		.psCLUTData = psSource->psCLUTData,
+		.sPixelHeader = {
+			.ui32SizeInBytes = ui32DataInBytes + sizeof(TIM_BLOCK_HEADER),
+			.ui16FBCoordX = psRect->ui16X,
+			.ui16FBCoordY = psRect->ui16Y,
+			.ui16Width = psRect->ui16Width,
+			.ui16Height = psRect->ui16Height
+		}
+	};
+	int iResult;
+
+	sSlice.pui8PixelData = calloc(ui32DataInBytes, sizeof(uint8_t));
+	if (sSlice.pui8PixelData == NULL)
+	{
+		printf("failed to allocate slice data\n");
+		return 1;
+	}
+
+	for (uint32_t y = 0; y < psRect->ui16Height; ++y)
+	{
+		memcpy(&sSlice.pui8PixelData[y * ui32RowInBytes], pui8Src, ui32RowInBytes);
+		pui8Src += ui32SourceRowInBytes;
+	}
+
+	iResult = WriteTIM(pszFileName, &sSlice);
+	if (iResult != 0)
+	{
+		printf("failed to write %s\n", pszFileName);
+	}
+
+	// The CLUT belongs to the source
+	free(sSlice.pui8PixelData);
+
+	return iResult;
+}
+
+int SplitTIMTexturePages(const TIM_ARGS* psTIMArgs)
+{
+	const uint32_t ui32PixelsPerHalfword = (psTIMArgs->ePixFmt == TIM_PIX_FMT_4BIT_CLUT) ? 4 : 2;
+
+	TIM_FILE sFile = {
+		.sFileHeader = {
+			.ui32ID = TIM_FILE_HEADER_ID,
+			.sFlags =
+			{
+				.uMode = psTIMArgs->ePixFmt,
+				.uClut = TIM_PIX_FMT_HAS_CLUT(psTIMArgs->ePixFmt)
+			}
+		}
+	};
+	char* pszBaseName = NULL;
+	char* pszFileName = NULL;
+	FILE* fTableFilePtr = NULL;
+	uint32_t ui32NumSlices = 0;
+	int iResult = 1;
+
+	if (LoadPalette(
+			psTIMArgs->pszPaletteFileName,
+			psTIMArgs->ePixFmt,
+			psTIMArgs->ui16PaletteCoordX,
+			psTIMArgs->ui16PaletteCoordY,
+			&sFile.sCLUTHeader,
+			&sFile.psCLUTData
+		) != 0)
+	{
+		printf("failed to load palette\n");
+		return 1;
+	}
+
+	if (LoadTexture(
+			psTIMArgs->pszTextureFileName,
+			psTIMArgs->ePixFmt,
+			psTIMArgs->ui16TextureCoordX,
+			psTIMArgs->ui16TextureCoordY,
+			sFile.psCLUTData,
+			&sFile.sPixelHeader,
+			&sFile.pui8PixelData
+		) != 0)
+	{
+		printf("failed to load Texture\n");
+		goto FAILED_SplitTIMTexturePages;
+	}
+
+	pszBaseName = GetBaseFileName(psTIMArgs->pszOutputFileName);
+	pszFileName = (pszBaseName != NULL) ? malloc(strlen(pszBaseName) + 32) : NULL;
+	if (pszFileName == NULL)
+	{
+		printf("failed to allocate slice file names\n");
+		goto FAILED_SplitTIMTexturePages;
+	}
+
+	sprintf(pszFileName, "%s.slices", pszBaseName);
+	fTableFilePtr = fopen(pszFileName, "w");
+	if (fTableFilePtr == NULL)
+	{
+		printf("could not open %s for writing\n", pszFileName);
+		goto FAILED_SplitTIMTexturePages;
+	}
+
+	fprintf(fTableFilePtr, "# timpack slice table for %s\n", psTIMArgs->pszTextureFileName);
+	fprintf(fTableFilePtr, "# slice FILE SOURCE_X SOURCE_Y WIDTH HEIGHT PIXEL_X PIXEL_Y PIXEL_W PIXEL_H\n");
+
+	// Cut at every texture page boundary the pixel block crosses, the source
+	// coordinates are in image pixels and the rest in VRAM halfwords
+	{
+		const TIM_BLOCK_HEADER* psHeader = &sFile.sPixelHeader;
+		const uint32_t ui32Right = psHeader->ui16FBCoordX + psHeader->ui16Width;
+		const uint32_t ui32Bottom = psHeader->ui16FBCoordY + psHeader->ui16Height;
+
+		for (uint32_t y = psHeader->ui16FBCoordY; y < ui32Bottom; y = GetSliceEnd(y, ui32Bottom, PSX_TPAGE_HEIGHT))
+		{
+			for (uint32_t x = psHeader->ui16FBCoordX; x < ui32Right; x = GetSliceEnd(x, ui32Right, PSX_TPAGE_WIDTH))
+			{
+				const VRAM_RECT sRect = {
+					.ui16X = x,
+					.ui16Y = y,
+					.ui16Width = GetSliceEnd(x, ui32Right, PSX_TPAGE_WIDTH) - x,
+					.ui16Height = GetSliceEnd(y, ui32Bottom, PSX_TPAGE_HEIGHT) - y
+				};
+
+				sprintf(pszFileName, "%s_%u.tim", pszBaseName, ui32NumSlices);
+
+				if (WriteSliceTIM(pszFileName, &sFile, &sRect) != 0)
+				{
+					goto FAILED_SplitTIMTexturePages;
+				}
+
+				fprintf(
+					fTableFilePtr,
+					"slice %s %u %u %u %hu %hu %hu %hu %hu\n",
+					pszFileName,
+					(x - psHeader->ui16FBCoordX) * ui32PixelsPerHalfword,
+					y - psHeader->ui16FBCoordY,
+					sRect.ui16Width * ui32PixelsPerHalfword,
+					sRect.ui16Height,
+					sRect.ui16X,
+					sRect.ui16Y,
+					sRect.ui16Width,
+					sRect.ui16Height
+				);
+
+				printf(
+					"%s: %u * %hu pixels at %hu, %hu\n",
+					pszFileName,
+					sRect.ui16Width * ui32PixelsPerHalfword,
+					sRect.ui16Height,
+					sRect.ui16X,
+					sRect.ui16Y
+				);
+
+				++ui32NumSlices;
+			}
+		}
+	}
+
+	printf("split %s into %u texture page slice(s)\n", psTIMArgs->pszTextureFileName, ui32NumSlices);
+
+	iResult = 0;
+
+FAILED_SplitTIMTexturePages:
+	if ((fTableFilePtr != NULL) && (fclose(fTableFilePtr) != 0))
+	{
+		printf("failed to write slice table\n");
+		iResult = 1;
+	}
+
+	free(pszFileName);
+	free(pszBaseName);
+	DestroyTIM(&sFile);
+
+	return iResult;
+}
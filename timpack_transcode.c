@@ -0,0 +1,346 @@
+#include <stdio.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <sys/stat.h>
+
+#include "tim_defs.h"
+#include "timpack.h"
+
+static bool IsSameFile(const char* pszFileNameA, const char* pszFileNameB)
+{
+	struct stat sStatA;
+	struct stat sStatB;
+
+	if ((stat(pszFileNameA, &sStatA) != 0) || (stat(pszFileNameB, &sStatB) != 0))
+	{
+		return false;
+	}
+
+	return (sStatA.st_dev == sStatB.st_dev) && (sStatA.st_ino == sStatB.st_ino);
+}
+
+// Apply any coordinates passed on the command line, and check the result fits
+static int RelocateTIM(const TIM_ARGS* psTIMArgs, TIM_FILE* psFile)
+{
+	TIM_BLOCK_HEADER* psCLUTHeader = &psFile->sCLUTHeader;
+	TIM_BLOCK_HEADER* psPixelHeader = &psFile->sPixelHeader;
+
+	if (psTIMArgs->ui16TextureCoordX != TIM_COORD_UNSET) { psPixelHeader->ui16FBCoordX = psTIMArgs->ui16TextureCoordX; }
+	if (psTIMArgs->ui16TextureCoordY != TIM_COORD_UNSET) { psPixelHeader->ui16FBCoordY = psTIMArgs->ui16TextureCoordY; }
+	if (psTIMArgs->ui16PaletteCoordX != TIM_COORD_UNSET) { psCLUTHeader->ui16FBCoordX = psTIMArgs->ui16PaletteCoordX; }
+	if (psTIMArgs->ui16PaletteCoordY != TIM_COORD_UNSET) { psCLUTHeader->ui16FBCoordY = psTIMArgs->ui16PaletteCoordY; }
+
+	if (((psCLUTHeader->ui16FBCoordX + psCLUTHeader->ui16Width) > PSX_VRAM_WIDTH) ||
+		((psCLUTHeader->ui16FBCoordY + psCLUTHeader->ui16Height) > PSX_VRAM_HEIGHT))
+	{
+		printf("Palette dimensions + destination FB coordinates overflow PSX VRAM\n");
+		return 1;
+	}
+
+	if (((psPixelHeader->ui16FBCoordX + psPixelHeader->ui16Width) > PSX_VRAM_WIDTH) ||
+		((psPixelHeader->ui16FBCoordY + psPixelHeader->ui16Height) > PSX_VRAM_HEIGHT))
+	{
+		printf("Texture dimensions + destination FB coordinates overflow PSX VRAM\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+static inline uint8_t GetTIMIndex(
+	const uint8_t* pui8PixelData,
+	const TIM_PIX_FMT ePixFmt,
+	const uint32_t ui32Index)
+{
+	if (ePixFmt == TIM_PIX_FMT_4BIT_CLUT)
+	{
+		return (pui8PixelData[ui32Index / 2] >> ((ui32Index % 2) * 4)) & 0x0F;
+	}
+
+	return pui8PixelData[ui32Index];
+}
+
+/*
+	Rebuild the CLUT and pixel blocks of psFile into psOutFile, keeping only
+	the CLUT entries which are referenced, optionally repacking 8 bit indices
+	into nibbles
+*/
+static int RepackTIM(
+	const TIM_FILE* psFile,
+	const TIM_PIX_FMT eOutPixFmt,
+	TIM_FILE* psOutFile)
+{
+	const TIM_PIX_FMT ePixFmt = psFile->sFileHeader.sFlags.uMode;
+	const uint32_t ui32PixelsPerHalfword = (ePixFmt == TIM_PIX_FMT_4BIT_CLUT) ? 4 : 2;
+	const uint32_t ui32OutPixelsPerHalfword = (eOutPixFmt == TIM_PIX_FMT_4BIT_CLUT) ? 4 : 2;
+
+	const uint32_t ui32Width = psFile->sPixelHeader.ui16Width * ui32PixelsPerHalfword;
+	const uint32_t ui32Height = psFile->sPixelHeader.ui16Height;
+
+	bool abUsed[256] = { false };
+	uint8_t aui8Remap[256] = { 0 };
+	uint32_t ui32NumUsed = 0;
+
+	uint32_t ui32OutWidth;
+	uint32_t ui32OutRowInBytes;
+	uint32_t ui32OutSizeInBytes;
+
+	if ((psFile->sPixelHeader.ui32SizeInBytes - sizeof(TIM_BLOCK_HEADER)) <
+		((ui32Width * ui32Height) / (ui32PixelsPerHalfword / 2)))
+	{
+		printf("pixel block is smaller than its dimensions\n");
+		return 1;
+	}
+
+	// Find which CLUT entries are referenced by the pixel data
+	for (uint32_t i = 0; i < (ui32Width * ui32Height); ++i)
+	{
+		abUsed[GetTIMIndex(psFile->pui8PixelData, ePixFmt, i)] = true;
+	}
+
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		if (abUsed[i])
+		{
+			if (i >= psFile->sCLUTHeader.ui16Width)
+			{
+				printf("pixel data references CLUT entry %u, outside of the palette\n", i);
+				return 1;
+			}
+
+			aui8Remap[i] = ui32NumUsed++;
+		}
+	}
+
+	printf(
+		"%u of %hu CLUT entries are referenced by the pixel data\n",
+		ui32NumUsed,
+		psFile->sCLUTHeader.ui16Width
+	);
+
+	if (ui32NumUsed > aui16PixFmtNumColours[eOutPixFmt])
+	{
+		printf(
+			"cannot repack to %u colours, %u CLUT entries are in use\n",
+			aui16PixFmtNumColours[eOutPixFmt],
+			ui32NumUsed
+		);
+		return 1;
+	}
+
+	psOutFile->sFileHeader = psFile->sFileHeader;
+	psOutFile->sFileHeader.sFlags.uMode = eOutPixFmt;
+
+	// Trimmed CLUTs stay aligned to 16 entries, as the hardware requires for
+	// the CLUT X coordinate of anything placed after them
+	{
+		const uint32_t ui32NumColours = (ui32NumUsed > 0) ? ui32NumUsed : 1;
+		const uint32_t ui32CLUTWidth = (
+			(eOutPixFmt == TIM_PIX_FMT_4BIT_CLUT) ?
+			16 :
+			ALIGN_UP(ui32NumColours, 16)
+		);
+		const uint32_t ui32CLUTHeight = psFile->sCLUTHeader.ui16Height;
+
+		TIM_PIX* psCLUTData = calloc(ui32CLUTWidth * ui32CLUTHeight, sizeof(TIM_PIX));
+		if (psCLUTData == NULL)
+		{
+			printf("failed to allocate palette data\n");
+			return 1;
+		}
+
+		for (uint32_t y = 0; y < ui32CLUTHeight; ++y)
+		{
+			for (uint32_t i = 0; i < psFile->sCLUTHeader.ui16Width; ++i)
+			{
+				if ((i < 256) && abUsed[i])
+				{
+					psCLUTData[(y * ui32CLUTWidth) + aui8Remap[i]] = (
+						psFile->psCLUTData[(y * psFile->sCLUTHeader.ui16Width) + i]
+					);
+				}
+			}
+		}
+
+		psOutFile->sCLUTHeader = psFile->sCLUTHeader;
+		psOutFile->sCLUTHeader.ui16Width = ui32CLUTWidth;
+		psOutFile->sCLUTHeader.ui32SizeInBytes = (
+			sizeof(TIM_BLOCK_HEADER) +
+			(ui32CLUTWidth * ui32CLUTHeight * sizeof(TIM_PIX))
+		);
+		psOutFile->psCLUTData = psCLUTData;
+
+		printf(
+			"CLUT width %hu -> %u\n",
+			psFile->sCLUTHeader.ui16Width,
+			ui32CLUTWidth
+		);
+	}
+
+	// Rows are padded with index 0 if the width doesn't fill the last halfword
+	ui32OutWidth = ALIGN_UP(ui32Width, ui32OutPixelsPerHalfword);
+	ui32OutRowInBytes = (ui32OutWidth / ui32OutPixelsPerHalfword) * 2;
+	ui32OutSizeInBytes = ui32OutRowInBytes * ui32Height;
+	ui32OutSizeInBytes = ALIGN_UP(ui32OutSizeInBytes, 4);
+
+	psOutFile->pui8PixelData = calloc(ui32OutSizeInBytes, sizeof(uint8_t));
+	if (psOutFile->pui8PixelData == NULL)
+	{
+		printf("failed to allocate indices data\n");
+		return 1;
+	}
+
+	for (uint32_t y = 0; y < ui32Height; ++y)
+	{
+		uint8_t* pui8OutRow = &psOutFile->pui8PixelData[y * ui32OutRowInBytes];
+
+		for (uint32_t x = 0; x < ui32Width; ++x)
+		{
+			const uint8_t ui8Index = aui8Remap[
+				GetTIMIndex(psFile->pui8PixelData, ePixFmt, (y * ui32Width) + x)
+			];
+
+			if (eOutPixFmt == TIM_PIX_FMT_4BIT_CLUT)
+			{
+				pui8OutRow[x / 2] |= (x % 2) ? (ui8Index << 4) : ui8Index;
+			}
+			else
+			{
+				pui8OutRow[x] = ui8Index;
+			}
+		}
+	}
+
+	psOutFile->sPixelHeader = psFile->sPixelHeader;
+	psOutFile->sPixelHeader.ui16Width = ui32OutWidth / ui32OutPixelsPerHalfword;
+	psOutFile->sPixelHeader.ui32SizeInBytes = sizeof(TIM_BLOCK_HEADER) + ui32OutSizeInBytes;
+
+	return 0;
+}
+
+int TranscodeTIM(const TIM_ARGS* psTIMArgs)
+{
+	const char* pszOutputFileName = (
+		(psTIMArgs->pszOutputFileName != NULL) ?
+		psTIMArgs->pszOutputFileName :
+		psTIMArgs->pszFromTIMFileName
+	);
+	const bool bInPlace = (
+		(psTIMArgs->pszOutputFileName == NULL) ||
+		IsSameFile(psTIMArgs->pszFromTIMFileName, psTIMArgs->pszOutputFileName)
+	);
+
+	TIM_MAPPING sMapping;
+	TIM_FILE sFile;
+	TIM_PIX_FMT ePixFmt;
+	bool bHeaderOnly;
+
+	// Only coordinate changes can be made in place, so find out what we need
+	// before deciding how to map the file
+	{
+		TIM_MAPPING sProbeMapping;
+
+		if (MapTIM(psTIMArgs->pszFromTIMFileName, false, &sProbeMapping, &sFile) != 0)
+		{
+			return 1;
+		}
+
+		ePixFmt = sFile.sFileHeader.sFlags.uMode;
+		UnmapTIM(&sProbeMapping);
+	}
+
+	if (!TIM_PIX_FMT_HAS_CLUT(ePixFmt))
+	{
+		printf("15/24 bit direct colour formats unsupported\n");
+		return 1;
+	}
+
+	if ((psTIMArgs->ePixFmt != TIM_PIX_FMT_COUNT) &&
+		(psTIMArgs->ePixFmt != ePixFmt) &&
+		(psTIMArgs->ePixFmt != TIM_PIX_FMT_4BIT_CLUT))
+	{
+		printf("only 8 bit to 4 bit repacking is supported\n");
+		return 1;
+	}
+
+	bHeaderOnly = (
+		!psTIMArgs->bTrimCLUT &&
+		((psTIMArgs->ePixFmt == TIM_PIX_FMT_COUNT) || (psTIMArgs->ePixFmt == ePixFmt))
+	);
+
+	if (MapTIM(psTIMArgs->pszFromTIMFileName, (bHeaderOnly && bInPlace), &sMapping, &sFile) != 0)
+	{
+		return 1;
+	}
+
+	PrintTIM(psTIMArgs->pszFromTIMFileName, &sFile);
+
+	if (bHeaderOnly)
+	{
+		if (RelocateTIM(psTIMArgs, &sFile) != 0)
+		{
+			goto FAILED_TranscodeTIM;
+		}
+
+		PrintTIM(pszOutputFileName, &sFile);
+
+		if (bInPlace)
+		{
+			*sMapping.psCLUTHeader = sFile.sCLUTHeader;
+			*sMapping.psPixelHeader = sFile.sPixelHeader;
+		}
+		else if (WriteTIM(pszOutputFileName, &sFile) != 0)
+		{
+			printf("failed to write TIM\n");
+			goto FAILED_TranscodeTIM;
+		}
+
+		return UnmapTIM(&sMapping);
+	}
+
+	{
+		TIM_FILE sOutFile = { 0 };
+
+		if (RepackTIM(
+				&sFile,
+				(psTIMArgs->ePixFmt != TIM_PIX_FMT_COUNT) ? psTIMArgs->ePixFmt : ePixFmt,
+				&sOutFile
+			) != 0)
+		{
+			DestroyTIM(&sOutFile);
+			goto FAILED_TranscodeTIM;
+		}
+
+		// The output may be the input file, so release it before writing
+		UnmapTIM(&sMapping);
+
+		if (RelocateTIM(psTIMArgs, &sOutFile) != 0)
+		{
+			DestroyTIM(&sOutFile);
+			return 1;
+		}
+
+		PrintTIM(pszOutputFileName, &sOutFile);
+
+		if (WriteTIM(pszOutputFileName, &sOutFile) != 0)
+		{
+			printf("failed to write TIM\n");
+			DestroyTIM(&sOutFile);
+			return 1;
+		}
+
+		DestroyTIM(&sOutFile);
+	}
+
+	return 0;
+
+FAILED_TranscodeTIM:
+	UnmapTIM(&sMapping);
+
+	return 1;
+}
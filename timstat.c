@@ -0,0 +1,598 @@
+// nftw is an XSI extension
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <argp.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+#include "tim_defs.h"
+#include "tim_vram_defs.h"
+
+// The R3000A's clock, to turn cycle estimates into time
+#define PSX_CPU_CLOCK_HZ (33868800)
+
+typedef struct _TIM_STAT_ARGS
+{
+	bool bUploadCost;
+	bool bVerbose;
+
+	// The transfer cost model, every LoadImage pays the setup cost, then
+	// moves its data in whole DMA blocks
+	uint32_t ui32SetupCycles;
+	uint32_t ui32CyclesPerWord;
+	uint32_t ui32WordsPerBlock;
+
+	// Each input is a scene, either a directory of TIMs or a single file
+	char** ppszInputs;
+	uint32_t ui32NumInputs;
+} TIM_STAT_ARGS;
+
+// A CLUT or pixel block, each of which is uploaded with one LoadImage
+typedef struct _TIM_STAT_BLOCK
+{
+	uint32_t ui32FileIndex;
+	bool bCLUT;
+	VRAM_RECT sRect;
+
+	// Already part of a suggested merge, or a repeat of another block's rect
+	bool bMerged;
+} TIM_STAT_BLOCK;
+
+typedef struct _TIM_STAT_SCENE
+{
+	char** ppszFileNames;
+	uint32_t ui32NumFiles;
+	uint32_t ui32FileCapacity;
+
+	TIM_STAT_BLOCK* psBlocks;
+	uint32_t ui32NumBlocks;
+	uint32_t ui32BlockCapacity;
+
+	uint32_t ui32NumInvalid;
+} TIM_STAT_SCENE;
+
+typedef struct _TIM_STAT_TOTALS
+{
+	uint32_t ui32NumFiles;
+	uint32_t ui32NumTransfers;
+	uint64_t ui64NumWords;
+	uint64_t ui64Cycles;
+	uint64_t ui64SavedCycles;
+} TIM_STAT_TOTALS;
+
+// nftw has no user pointer, so the walk appends to this scene
+static TIM_STAT_SCENE* psWalkScene;
+
+static double GetCyclesMS(const uint64_t ui64Cycles)
+{
+	return (ui64Cycles * 1000.0) / PSX_CPU_CLOCK_HZ;
+}
+
+// A rect's halfwords are sent packed two to a word, in whole DMA blocks
+static uint32_t GetUploadWords(const TIM_STAT_ARGS* psArgs, const VRAM_RECT* psRect)
+{
+	const uint32_t ui32Words = ((psRect->ui16Width * psRect->ui16Height) + 1) / 2;
+
+	return ALIGN_UP(ui32Words, psArgs->ui32WordsPerBlock);
+}
+
+static uint64_t GetUploadCycles(const TIM_STAT_ARGS* psArgs, const VRAM_RECT* psRect)
+{
+	return psArgs->ui32SetupCycles + ((uint64_t)GetUploadWords(psArgs, psRect) * psArgs->ui32CyclesPerWord);
+}
+
+static int AddStatBlock(TIM_STAT_SCENE* psScene, const uint32_t ui32FileIndex, const bool bCLUT, const TIM_BLOCK_HEADER* psHeader)
+{
+	TIM_STAT_BLOCK* psBlock;
+
+	if (psScene->ui32NumBlocks == psScene->ui32BlockCapacity)
+	{
+		TIM_STAT_BLOCK* psBlocks;
+
+		psScene->ui32BlockCapacity = (psScene->ui32BlockCapacity == 0) ? 1024 : (psScene->ui32BlockCapacity * 2);
+		psBlocks = realloc(psScene->psBlocks, psScene->ui32BlockCapacity * sizeof(TIM_STAT_BLOCK));
+		if (psBlocks == NULL)
+		{
+			printf("failed to allocate block list\n");
+			return 1;
+		}
+
+		psScene->psBlocks = psBlocks;
+	}
+
+	psBlock = &psScene->psBlocks[psScene->ui32NumBlocks++];
+	psBlock->ui32FileIndex = ui32FileIndex;
+	psBlock->bCLUT = bCLUT;
+	psBlock->sRect = GetVRAMRect(psHeader);
+	psBlock->bMerged = false;
+
+	return 0;
+}
+
+// Reads only the headers of a TIM, adding a block for each upload it implies
+static int AddStatFile(TIM_STAT_SCENE* psScene, const char* pszFileName)
+{
+	TIM_FILE sFile;
+
+	if (ReadTIMHeaders(pszFileName, &sFile) != 0)
+	{
+		++psScene->ui32NumInvalid;
+		return 0;
+	}
+
+	if (psScene->ui32NumFiles == psScene->ui32FileCapacity)
+	{
+		char** ppszFileNames;
+
+		psScene->ui32FileCapacity = (psScene->ui32FileCapacity == 0) ? 512 : (psScene->ui32FileCapacity * 2);
+		ppszFileNames = realloc(psScene->ppszFileNames, psScene->ui32FileCapacity * sizeof(char*));
+		if (ppszFileNames == NULL)
+		{
+			printf("failed to allocate file list\n");
+			return 1;
+		}
+
+		psScene->ppszFileNames = ppszFileNames;
+	}
+
+	psScene->ppszFileNames[psScene->ui32NumFiles] = strdup(pszFileName);
+
+	if ((sFile.sFileHeader.sFlags.uClut &&
+			(AddStatBlock(psScene, psScene->ui32NumFiles, true, &sFile.sCLUTHeader) != 0)) ||
+		(AddStatBlock(psScene, psScene->ui32NumFiles, false, &sFile.sPixelHeader) != 0))
+	{
+		return 1;
+	}
+
+	++psScene->ui32NumFiles;
+
+	return 0;
+}
+
+static int WalkCallback(
+	const char* pszFileName,
+	const struct stat* psStat,
+	int iTypeFlag,
+	struct FTW* psFTW)
+{
+	(void)psStat;
+	(void)psFTW;
+
+	if ((iTypeFlag == FTW_F) && HasTIMExtension(pszFileName))
+	{
+		return AddStatFile(psWalkScene, pszFileName);
+	}
+
+	return 0;
+}
+
+static void DestroyStatScene(TIM_STAT_SCENE* psScene)
+{
+	for (uint32_t i = 0; i < psScene->ui32NumFiles; ++i)
+	{
+		free(psScene->ppszFileNames[i]);
+	}
+
+	free(psScene->ppszFileNames);
+	free(psScene->psBlocks);
+	memset(psScene, 0, sizeof(TIM_STAT_SCENE));
+}
+
+static void PrintStatBlock(const TIM_STAT_SCENE* psScene, const TIM_STAT_BLOCK* psBlock)
+{
+	printf(
+		"%s %s (%hu, %hu, %hu, %hu)",
+		psScene->ppszFileNames[psBlock->ui32FileIndex],
+		psBlock->bCLUT ? "CLUT" : "pixels",
+		psBlock->sRect.ui16X,
+		psBlock->sRect.ui16Y,
+		psBlock->sRect.ui16Width,
+		psBlock->sRect.ui16Height
+	);
+}
+
+static TIM_STAT_BLOCK* psSortBlocks;
+
+// Orders blocks into rows, so blocks that could share a transfer horizontally
+// end up next to each other
+static int CompareStatBlockRows(const void* pvA, const void* pvB)
+{
+	const VRAM_RECT* psA = &psSortBlocks[*(const uint32_t*)pvA].sRect;
+	const VRAM_RECT* psB = &psSortBlocks[*(const uint32_t*)pvB].sRect;
+
+	if (psA->ui16Y != psB->ui16Y) { return (int)psA->ui16Y - (int)psB->ui16Y; }
+	if (psA->ui16Height != psB->ui16Height) { return (int)psA->ui16Height - (int)psB->ui16Height; }
+	if (psA->ui16X != psB->ui16X) { return (int)psA->ui16X - (int)psB->ui16X; }
+
+	return (int)psA->ui16Width - (int)psB->ui16Width;
+}
+
+// As above for columns, such as a stack of pooled CLUTs
+static int CompareStatBlockColumns(const void* pvA, const void* pvB)
+{
+	const VRAM_RECT* psA = &psSortBlocks[*(const uint32_t*)pvA].sRect;
+	const VRAM_RECT* psB = &psSortBlocks[*(const uint32_t*)pvB].sRect;
+
+	if (psA->ui16X != psB->ui16X) { return (int)psA->ui16X - (int)psB->ui16X; }
+	if (psA->ui16Width != psB->ui16Width) { return (int)psA->ui16Width - (int)psB->ui16Width; }
+	if (psA->ui16Y != psB->ui16Y) { return (int)psA->ui16Y - (int)psB->ui16Y; }
+
+	return (int)psA->ui16Height - (int)psB->ui16Height;
+}
+
+/*
+	Walks the sorted blocks for runs which tile a single rect, either side by
+	side on the same rows or stacked in the same columns. Each run could be one
+	LoadImage rather than several, saving the setup cost of all but one and
+	the DMA block padding of each.
+*/
+static uint64_t SuggestStatMerges(
+	const TIM_STAT_ARGS* psArgs,
+	const TIM_STAT_SCENE* psScene,
+	uint32_t* pui32Order,
+	const bool bRows)
+{
+	uint64_t ui64SavedCycles = 0;
+
+	for (uint32_t i = 0; i < psScene->ui32NumBlocks; ++i)
+	{
+		pui32Order[i] = i;
+	}
+
+	psSortBlocks = psScene->psBlocks;
+	qsort(pui32Order, psScene->ui32NumBlocks, sizeof(uint32_t), bRows ? CompareStatBlockRows : CompareStatBlockColumns);
+
+	for (uint32_t i = 0; i < psScene->ui32NumBlocks; )
+	{
+		TIM_STAT_BLOCK* psFirst = &psScene->psBlocks[pui32Order[i]];
+		VRAM_RECT sMerged = psFirst->sRect;
+		uint64_t ui64SeparateCycles = GetUploadCycles(psArgs, &psFirst->sRect);
+		uint32_t ui32RunLength = 1;
+
+		if (psFirst->bMerged)
+		{
+			++i;
+			continue;
+		}
+
+		while ((i + ui32RunLength) < psScene->ui32NumBlocks)
+		{
+			const TIM_STAT_BLOCK* psNext = &psScene->psBlocks[pui32Order[i + ui32RunLength]];
+			const bool bAdjacent = (
+				bRows ?
+				((psNext->sRect.ui16Y == sMerged.ui16Y) &&
+					(psNext->sRect.ui16Height == sMerged.ui16Height) &&
+					(psNext->sRect.ui16X == (sMerged.ui16X + sMerged.ui16Width))) :
+				((psNext->sRect.ui16X == sMerged.ui16X) &&
+					(psNext->sRect.ui16Width == sMerged.ui16Width) &&
+					(psNext->sRect.ui16Y == (sMerged.ui16Y + sMerged.ui16Height)))
+			);
+
+			if (!bAdjacent || psNext->bMerged)
+			{
+				break;
+			}
+
+			if (bRows)
+			{
+				sMerged.ui16Width += psNext->sRect.ui16Width;
+			}
+			else
+			{
+				sMerged.ui16Height += psNext->sRect.ui16Height;
+			}
+
+			ui64SeparateCycles += GetUploadCycles(psArgs, &psNext->sRect);
+			++ui32RunLength;
+		}
+
+		if (ui32RunLength > 1)
+		{
+			const uint64_t ui64Saved = ui64SeparateCycles - GetUploadCycles(psArgs, &sMerged);
+
+			printf(
+				"\tmerge %u %s blocks into one transfer at (%hu, %hu, %hu, %hu), saving %llu cycles:\n",
+				ui32RunLength,
+				bRows ? "side by side" : "stacked",
+				sMerged.ui16X,
+				sMerged.ui16Y,
+				sMerged.ui16Width,
+				sMerged.ui16Height,
+				(unsigned long long)ui64Saved
+			);
+
+			for (uint32_t j = 0; j < ui32RunLength; ++j)
+			{
+				TIM_STAT_BLOCK* psBlock = &psScene->psBlocks[pui32Order[i + j]];
+
+				printf("\t\t");
+				PrintStatBlock(psScene, psBlock);
+				printf("\n");
+
+				psBlock->bMerged = true;
+			}
+
+			ui64SavedCycles += ui64Saved;
+		}
+
+		i += ui32RunLength;
+	}
+
+	return ui64SavedCycles;
+}
+
+// Blocks uploaded to the same rect more than once, such as a pooled CLUT
+// shared by several TIMs, only need uploading once
+static uint64_t FindStatRepeats(
+	const TIM_STAT_ARGS* psArgs,
+	const TIM_STAT_SCENE* psScene,
+	uint32_t* pui32Order)
+{
+	uint64_t ui64SavedCycles = 0;
+
+	for (uint32_t i = 0; i < psScene->ui32NumBlocks; ++i)
+	{
+		pui32Order[i] = i;
+	}
+
+	psSortBlocks = psScene->psBlocks;
+	qsort(pui32Order, psScene->ui32NumBlocks, sizeof(uint32_t), CompareStatBlockRows);
+
+	for (uint32_t i = 0; i < psScene->ui32NumBlocks; )
+	{
+		const TIM_STAT_BLOCK* psFirst = &psScene->psBlocks[pui32Order[i]];
+		uint32_t ui32NumRepeats = 0;
+
+		while (((i + 1 + ui32NumRepeats) < psScene->ui32NumBlocks) &&
+			(memcmp(
+				&psScene->psBlocks[pui32Order[i + 1 + ui32NumRepeats]].sRect,
+				&psFirst->sRect,
+				sizeof(VRAM_RECT)
+			) == 0))
+		{
+			psScene->psBlocks[pui32Order[i + 1 + ui32NumRepeats]].bMerged = true;
+			++ui32NumRepeats;
+		}
+
+		if (ui32NumRepeats > 0)
+		{
+			const uint64_t ui64Saved = ui32NumRepeats * GetUploadCycles(psArgs, &psFirst->sRect);
+
+			printf("\tskip %u repeated upload(s) of ", ui32NumRepeats);
+			PrintStatBlock(psScene, psFirst);
+			printf(", saving %llu cycles\n", (unsigned long long)ui64Saved);
+
+			ui64SavedCycles += ui64Saved;
+		}
+
+		i += 1 + ui32NumRepeats;
+	}
+
+	return ui64SavedCycles;
+}
+
+static int ReportUploadCost(const TIM_STAT_ARGS* psArgs, const char* pszSceneName, TIM_STAT_TOTALS* psTotals)
+{
+	TIM_STAT_SCENE sScene = { 0 };
+	struct stat sStat;
+	uint32_t* pui32Order = NULL;
+	uint64_t ui64NumWords = 0;
+	uint64_t ui64Cycles = 0;
+	uint64_t ui64SavedCycles = 0;
+	int iResult;
+
+	if (stat(pszSceneName, &sStat) != 0)
+	{
+		printf("could not find %s\n", pszSceneName);
+		return 1;
+	}
+
+	psWalkScene = &sScene;
+	if (S_ISDIR(sStat.st_mode))
+	{
+		if (nftw(pszSceneName, WalkCallback, 64, FTW_PHYS) != 0)
+		{
+			printf("failed to walk %s\n", pszSceneName);
+			goto FAILED_ReportUploadCost;
+		}
+	}
+	else if (AddStatFile(&sScene, pszSceneName) != 0)
+	{
+		goto FAILED_ReportUploadCost;
+	}
+
+	for (uint32_t i = 0; i < sScene.ui32NumBlocks; ++i)
+	{
+		const TIM_STAT_BLOCK* psBlock = &sScene.psBlocks[i];
+		const uint32_t ui32Words = GetUploadWords(psArgs, &psBlock->sRect);
+		const uint64_t ui64BlockCycles = GetUploadCycles(psArgs, &psBlock->sRect);
+
+		if (psArgs->bVerbose)
+		{
+			printf("\t");
+			PrintStatBlock(&sScene, psBlock);
+			printf(": %u words, %llu cycles\n", ui32Words, (unsigned long long)ui64BlockCycles);
+		}
+
+		ui64NumWords += ui32Words;
+		ui64Cycles += ui64BlockCycles;
+	}
+
+	printf(
+		"%s: %u TIM file(s), %u transfer(s), %llu words, %llu cycles (%.2f ms)%s\n",
+		pszSceneName,
+		sScene.ui32NumFiles,
+		sScene.ui32NumBlocks,
+		(unsigned long long)ui64NumWords,
+		(unsigned long long)ui64Cycles,
+		GetCyclesMS(ui64Cycles),
+		(sScene.ui32NumInvalid > 0) ? ", some files could not be read" : ""
+	);
+
+	if (sScene.ui32NumBlocks > 0)
+	{
+		pui32Order = malloc(sScene.ui32NumBlocks * sizeof(uint32_t));
+		if (pui32Order == NULL)
+		{
+			printf("failed to allocate block order\n");
+			goto FAILED_ReportUploadCost;
+		}
+
+		ui64SavedCycles += FindStatRepeats(psArgs, &sScene, pui32Order);
+		ui64SavedCycles += SuggestStatMerges(psArgs, &sScene, pui32Order, true);
+		ui64SavedCycles += SuggestStatMerges(psArgs, &sScene, pui32Order, false);
+	}
+
+	if (ui64SavedCycles > 0)
+	{
+		printf(
+			"\twith the above: %llu cycles (%.2f ms), saving %.1f%%\n",
+			(unsigned long long)(ui64Cycles - ui64SavedCycles),
+			GetCyclesMS(ui64Cycles - ui64SavedCycles),
+			(100.0 * ui64SavedCycles) / ui64Cycles
+		);
+	}
+
+	psTotals->ui32NumFiles += sScene.ui32NumFiles;
+	psTotals->ui32NumTransfers += sScene.ui32NumBlocks;
+	psTotals->ui64NumWords += ui64NumWords;
+	psTotals->ui64Cycles += ui64Cycles;
+	psTotals->ui64SavedCycles += ui64SavedCycles;
+
+	iResult = (sScene.ui32NumInvalid > 0) ? 1 : 0;
+
+	free(pui32Order);
+	DestroyStatScene(&sScene);
+
+	return iResult;
+
+FAILED_ReportUploadCost:
+	free(pui32Order);
+	DestroyStatScene(&sScene);
+
+	return 1;
+}
+
+const char *argp_program_version = "timstat 1.0";
+const char *argp_program_bug_address = "<jw0z96@github>";
+static char szDoc[] = "timstat - report statistics about scenes of TIM files, read from their headers alone";
+static char szArgDoc[] = "--upload-cost SCENE_DIRECTORY_OR_TIM_FILE...";
+
+static struct argp_option sOptions[] = {
+	{ "upload-cost",	'u',	0,				0,	"Estimate the GPU DMA time to upload each scene, suggesting transfers which could be merged" },
+	{ "setup-cycles",	's',	"<cycles>",		0,	"CPU cycles spent setting up each LoadImage transfer (default 300)" },
+	{ "word-cycles",	'w',	"<cycles>",		0,	"CPU cycles per 32 bit word transferred (default 2)" },
+	{ "block-words",	'b',	"<words>",		0,	"Words per DMA block, transfers are padded to whole blocks (default 16)" },
+	{ "verbose",		'v',	0,				0,	"List the cost of every transfer" },
+	{ 0 }
+};
+
+static error_t ParseOpts(int key, char *arg, struct argp_state *state)
+{
+	TIM_STAT_ARGS *psArgs = state->input;
+
+	switch (key)
+	{
+		case 'u': psArgs->bUploadCost = true; break;
+		case 's': psArgs->ui32SetupCycles = strtoul(arg, NULL, 10); break;
+		case 'w': psArgs->ui32CyclesPerWord = strtoul(arg, NULL, 10); break;
+		case 'b':
+		{
+			psArgs->ui32WordsPerBlock = strtoul(arg, NULL, 10);
+			if (psArgs->ui32WordsPerBlock == 0)
+			{
+				printf("expected -b/--block-words arg to be at least 1\n");
+				argp_usage(state);
+			}
+			break;
+		}
+		case 'v': psArgs->bVerbose = true; break;
+
+		case ARGP_KEY_ARG:
+		{
+			psArgs->ppszInputs[psArgs->ui32NumInputs++] = arg;
+			break;
+		}
+
+		case ARGP_KEY_END:
+		{
+			if (state->arg_num < 1) // Not enough args
+			{
+				argp_usage(state);
+			}
+			break;
+		}
+
+		default:
+			return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static struct argp sArgp = { sOptions, ParseOpts, szArgDoc, szDoc };
+
+int main (int argc, char * argv[])
+{
+	TIM_STAT_TOTALS sTotals = { 0 };
+	struct timespec sStart;
+	int iResult = 0;
+
+	// Default args
+	TIM_STAT_ARGS sArgs;
+	sArgs.bUploadCost = false;
+	sArgs.bVerbose = false;
+	sArgs.ui32SetupCycles = 300;
+	sArgs.ui32CyclesPerWord = 2;
+	sArgs.ui32WordsPerBlock = 16;
+	sArgs.ppszInputs = calloc(argc, sizeof(char*));
+	sArgs.ui32NumInputs = 0;
+
+	if (sArgs.ppszInputs == NULL)
+	{
+		printf("failed to allocate input list\n");
+		return 1;
+	}
+
+	argp_parse(&sArgp, argc, argv, 0, 0, &sArgs);
+
+	if (!sArgs.bUploadCost)
+	{
+		printf("no report selected, pass --upload-cost\n");
+		free(sArgs.ppszInputs);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &sStart);
+
+	for (uint32_t i = 0; i < sArgs.ui32NumInputs; ++i)
+	{
+		iResult |= ReportUploadCost(&sArgs, sArgs.ppszInputs[i], &sTotals);
+	}
+
+	printf(
+		"total: %u scene(s), %u TIM file(s), %u transfer(s), %llu words, %llu cycles (%.2f ms), "
+		"%llu cycles (%.2f ms) with suggestions, read in %.2f ms\n",
+		sArgs.ui32NumInputs,
+		sTotals.ui32NumFiles,
+		sTotals.ui32NumTransfers,
+		(unsigned long long)sTotals.ui64NumWords,
+		(unsigned long long)sTotals.ui64Cycles,
+		GetCyclesMS(sTotals.ui64Cycles),
+		(unsigned long long)(sTotals.ui64Cycles - sTotals.ui64SavedCycles),
+		GetCyclesMS(sTotals.ui64Cycles - sTotals.ui64SavedCycles),
+		GetElapsedMS(&sStart)
+	);
+
+	free(sArgs.ppszInputs);
+
+	return iResult;
+}
@@ -0,0 +1,400 @@
+// nftw is an XSI extension
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+
+#include <argp.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+#include "tim_defs.h"
+#include "tim_thread_defs.h"
+
+typedef struct _TIM_UNPACK_ARGS
+{
+	char* pszOutputDirectory;
+	uint32_t ui32PaletteIndex;
+	bool bAllCLUTs;
+	uint32_t ui32NumThreads;
+
+	char** ppszInputs;
+	uint32_t ui32NumInputs;
+} TIM_UNPACK_ARGS;
+
+typedef struct _TIM_UNPACK_FILE
+{
+	char* pszInputFileName;
+
+	// The path relative to the input argument it was found under, used to
+	// mirror the directory tree into the output directory
+	const char* pszRelativeFileName;
+} TIM_UNPACK_FILE;
+
+typedef struct _TIM_UNPACK_LIST
+{
+	TIM_UNPACK_FILE* psFiles;
+	uint32_t ui32NumFiles;
+	uint32_t ui32Capacity;
+} TIM_UNPACK_LIST;
+
+typedef struct _TIM_UNPACK_JOBS
+{
+	const TIM_UNPACK_ARGS* psArgs;
+	const TIM_UNPACK_LIST* psList;
+
+	atomic_uint ui32NumPNGs;
+	atomic_uint ui32NumFailed;
+} TIM_UNPACK_JOBS;
+
+// nftw has no user pointer, so the walk appends to this list
+static TIM_UNPACK_LIST sFileList;
+static size_t uWalkRootLength;
+
+static int AddUnpackFile(const char* pszFileName, const size_t uRootLength)
+{
+	TIM_UNPACK_FILE* psFile;
+
+	if (sFileList.ui32NumFiles == sFileList.ui32Capacity)
+	{
+		TIM_UNPACK_FILE* psFiles;
+
+		sFileList.ui32Capacity = (sFileList.ui32Capacity == 0) ? 1024 : (sFileList.ui32Capacity * 2);
+		psFiles = realloc(sFileList.psFiles, sFileList.ui32Capacity * sizeof(TIM_UNPACK_FILE));
+		if (psFiles == NULL)
+		{
+			printf("failed to allocate file list\n");
+			return 1;
+		}
+
+		sFileList.psFiles = psFiles;
+	}
+
+	psFile = &sFileList.psFiles[sFileList.ui32NumFiles++];
+	psFile->pszInputFileName = strdup(pszFileName);
+	psFile->pszRelativeFileName = psFile->pszInputFileName + uRootLength;
+
+	while (*psFile->pszRelativeFileName == '/')
+	{
+		++psFile->pszRelativeFileName;
+	}
+
+	return 0;
+}
+
+static int WalkCallback(
+	const char* pszFileName,
+	const struct stat* psStat,
+	int iTypeFlag,
+	struct FTW* psFTW)
+{
+	(void)psStat;
+	(void)psFTW;
+
+	if ((iTypeFlag == FTW_F) && HasTIMExtension(pszFileName))
+	{
+		return AddUnpackFile(pszFileName, uWalkRootLength);
+	}
+
+	return 0;
+}
+
+static int CollectUnpackFiles(const TIM_UNPACK_ARGS* psArgs)
+{
+	for (uint32_t i = 0; i < psArgs->ui32NumInputs; ++i)
+	{
+		const char* pszInput = psArgs->ppszInputs[i];
+		struct stat sStat;
+
+		if (stat(pszInput, &sStat) != 0)
+		{
+			printf("could not find %s\n", pszInput);
+			return 1;
+		}
+
+		if (S_ISDIR(sStat.st_mode))
+		{
+			uWalkRootLength = strlen(pszInput);
+			if (nftw(pszInput, WalkCallback, 64, FTW_PHYS) != 0)
+			{
+				printf("failed to walk %s\n", pszInput);
+				return 1;
+			}
+		}
+		else
+		{
+			// Loose files are written to the top of the output directory
+			const char* pszBaseName = strrchr(pszInput, '/');
+			const size_t uRootLength = (pszBaseName != NULL) ? (size_t)(pszBaseName - pszInput) : 0;
+
+			if (AddUnpackFile(pszInput, uRootLength) != 0)
+			{
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void DestroyUnpackFiles(void)
+{
+	for (uint32_t i = 0; i < sFileList.ui32NumFiles; ++i)
+	{
+		free(sFileList.psFiles[i].pszInputFileName);
+	}
+
+	free(sFileList.psFiles);
+	memset(&sFileList, 0, sizeof(sFileList));
+}
+
+static void MakeParentDirectories(char* pszFileName)
+{
+	for (char* pszSlash = strchr(pszFileName + 1, '/'); pszSlash != NULL; pszSlash = strchr(pszSlash + 1, '/'))
+	{
+		*pszSlash = '\0';
+		if ((mkdir(pszFileName, 0777) != 0) && (errno != EEXIST))
+		{
+			printf("could not create directory %s\n", pszFileName);
+		}
+		*pszSlash = '/';
+	}
+}
+
+/*
+	Builds the output file name for one CLUT row, dropping the .tim extension.
+	A CLUT index of -1 omits the suffix used when unpacking every CLUT row.
+*/
+static void GetUnpackFileName(
+	const TIM_UNPACK_ARGS* psArgs,
+	const TIM_UNPACK_FILE* psFile,
+	const int32_t i32PaletteIndex,
+	char* pszOutputFileName,
+	const size_t uSize)
+{
+	const char* pszName = (
+		(psArgs->pszOutputDirectory != NULL) ?
+		psFile->pszRelativeFileName :
+		psFile->pszInputFileName
+	);
+	const int iNameLength = (int)(strlen(pszName) - 4);
+
+	if (psArgs->pszOutputDirectory != NULL)
+	{
+		snprintf(pszOutputFileName, uSize, "%s/%.*s", psArgs->pszOutputDirectory, iNameLength, pszName);
+	}
+	else
+	{
+		snprintf(pszOutputFileName, uSize, "%.*s", iNameLength, pszName);
+	}
+
+	if (i32PaletteIndex >= 0)
+	{
+		const size_t uLength = strlen(pszOutputFileName);
+		snprintf(&pszOutputFileName[uLength], uSize - uLength, "_clut%d", i32PaletteIndex);
+	}
+
+	strncat(pszOutputFileName, ".png", uSize - strlen(pszOutputFileName) - 1);
+}
+
+static void UnpackTIMJob(void* pvUserData, const uint32_t ui32JobIndex)
+{
+	TIM_UNPACK_JOBS* psJobs = pvUserData;
+	const TIM_UNPACK_ARGS* psArgs = psJobs->psArgs;
+	const TIM_UNPACK_FILE* psUnpackFile = &psJobs->psList->psFiles[ui32JobIndex];
+
+	TIM_MAPPING sMapping;
+	TIM_FILE sFile;
+	R8G8B8A8* psPixels = NULL;
+	uint32_t ui32Width;
+	uint32_t ui32FirstPalette;
+	uint32_t ui32LastPalette;
+	char szOutputFileName[4096];
+
+	if (MapTIM(psUnpackFile->pszInputFileName, false, &sMapping, &sFile) != 0)
+	{
+		goto FAILED_UnpackTIMJob;
+	}
+
+	if (ValidateTIM(&sFile) != 0)
+	{
+		printf("skipping %s\n", psUnpackFile->pszInputFileName);
+		goto FAILED_UnpackTIMJob;
+	}
+
+	ui32FirstPalette = psArgs->bAllCLUTs ? 0 : psArgs->ui32PaletteIndex;
+	ui32LastPalette = psArgs->bAllCLUTs ? (sFile.sCLUTHeader.ui16Height - 1) : psArgs->ui32PaletteIndex;
+
+	if (ui32LastPalette >= sFile.sCLUTHeader.ui16Height)
+	{
+		printf(
+			"%s only has %hu CLUT(s), cannot unpack CLUT %u\n",
+			psUnpackFile->pszInputFileName,
+			sFile.sCLUTHeader.ui16Height,
+			ui32LastPalette
+		);
+		goto FAILED_UnpackTIMJob;
+	}
+
+	ui32Width = GetTIMPixelWidth(&sFile);
+	psPixels = malloc(ui32Width * sFile.sPixelHeader.ui16Height * sizeof(R8G8B8A8));
+	if (psPixels == NULL)
+	{
+		printf("failed to allocate pixels for %s\n", psUnpackFile->pszInputFileName);
+		goto FAILED_UnpackTIMJob;
+	}
+
+	for (uint32_t i = ui32FirstPalette; i <= ui32LastPalette; ++i)
+	{
+		GetUnpackFileName(
+			psArgs,
+			psUnpackFile,
+			psArgs->bAllCLUTs ? (int32_t)i : -1,
+			szOutputFileName,
+			sizeof(szOutputFileName)
+		);
+
+		MakeParentDirectories(szOutputFileName);
+
+		if ((DecodeTIMPixelDataWithPalette(&sFile, i, psPixels) != 0) ||
+			(WritePNG(szOutputFileName, psPixels, ui32Width, sFile.sPixelHeader.ui16Height) != 0))
+		{
+			goto FAILED_UnpackTIMJob;
+		}
+
+		atomic_fetch_add(&psJobs->ui32NumPNGs, 1);
+	}
+
+	free(psPixels);
+	UnmapTIM(&sMapping);
+
+	return;
+
+FAILED_UnpackTIMJob:
+	free(psPixels);
+	UnmapTIM(&sMapping);
+	atomic_fetch_add(&psJobs->ui32NumFailed, 1);
+}
+
+static int UnpackTIMs(const TIM_UNPACK_ARGS* psArgs)
+{
+	TIM_THREAD_POOL* psPool;
+	TIM_UNPACK_JOBS sJobs = { .psArgs = psArgs, .psList = &sFileList };
+	struct timespec sStart;
+
+	if (CollectUnpackFiles(psArgs) != 0)
+	{
+		DestroyUnpackFiles();
+		return 1;
+	}
+
+	psPool = CreateThreadPool(psArgs->ui32NumThreads);
+	if (psPool == NULL)
+	{
+		DestroyUnpackFiles();
+		return 1;
+	}
+
+	atomic_init(&sJobs.ui32NumPNGs, 0);
+	atomic_init(&sJobs.ui32NumFailed, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &sStart);
+	RunThreadPoolJobs(psPool, UnpackTIMJob, &sJobs, sFileList.ui32NumFiles);
+
+	printf(
+		"unpacked %u TIM file(s) to %u PNG(s) in %.1f ms on %u thread(s), %u failed\n",
+		sFileList.ui32NumFiles - atomic_load(&sJobs.ui32NumFailed),
+		atomic_load(&sJobs.ui32NumPNGs),
+		GetElapsedMS(&sStart),
+		GetThreadPoolSize(psPool) + 1,
+		atomic_load(&sJobs.ui32NumFailed)
+	);
+
+	DestroyThreadPool(psPool);
+	DestroyUnpackFiles();
+
+	return (atomic_load(&sJobs.ui32NumFailed) == 0) ? 0 : 1;
+}
+
+const char *argp_program_version = "timunpack 1.0";
+const char *argp_program_bug_address = "<jw0z96@github>";
+static char szDoc[] = "timunpack - decode TIM files, or directory trees of them, to PNG";
+static char szArgDoc[] = "TIM_FILE_OR_DIRECTORY...";
+
+static struct argp_option sOptions[] = {
+	{ "output",		'o',	"DIRECTORY",	0,	"Write PNGs into DIRECTORY, mirroring the input tree, rather than next to each TIM" },
+	{ "clut",		'c',	"<index>",		0,	"CLUT row to decode with (default 0)" },
+	{ "all-cluts",	'a',	0,				0,	"Write one PNG per CLUT row" },
+	{ "jobs",		'j',	"<threads>",	0,	"Number of worker threads (default one per CPU)" },
+	{ 0 }
+};
+
+static error_t ParseOpts(int key, char *arg, struct argp_state *state)
+{
+	TIM_UNPACK_ARGS *psArgs = state->input;
+
+	switch (key)
+	{
+		case 'o': psArgs->pszOutputDirectory = arg; break;
+		case 'c': psArgs->ui32PaletteIndex = strtoul(arg, NULL, 10); break;
+		case 'a': psArgs->bAllCLUTs = true; break;
+		case 'j': psArgs->ui32NumThreads = strtoul(arg, NULL, 10); break;
+
+		case ARGP_KEY_ARG:
+		{
+			psArgs->ppszInputs[psArgs->ui32NumInputs++] = arg;
+			break;
+		}
+
+		case ARGP_KEY_END:
+		{
+			if (state->arg_num < 1) // Not enough args
+			{
+				argp_usage(state);
+			}
+			break;
+		}
+
+		default:
+			return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static struct argp sArgp = { sOptions, ParseOpts, szArgDoc, szDoc };
+
+int main (int argc, char * argv[])
+{
+	int iResult;
+
+	// Default args
+	TIM_UNPACK_ARGS sArgs;
+	sArgs.pszOutputDirectory = NULL;
+	sArgs.ui32PaletteIndex = 0;
+	sArgs.bAllCLUTs = false;
+	sArgs.ui32NumThreads = 0;
+	sArgs.ppszInputs = calloc(argc, sizeof(char*));
+	sArgs.ui32NumInputs = 0;
+
+	if (sArgs.ppszInputs == NULL)
+	{
+		printf("failed to allocate input list\n");
+		return 1;
+	}
+
+	argp_parse(&sArgp, argc, argv, 0, 0, &sArgs);
+
+	iResult = UnpackTIMs(&sArgs);
+
+	free(sArgs.ppszInputs);
+
+	return iResult;
+}
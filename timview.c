@@ -1,249 +1,1023 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
+#include <argp.h>
+
 #include "tim_defs.h"
+#include "tim_vram_defs.h"
+#include "timview.h"
 
 #include <SDL.h>
 
-typedef struct _R8G8B8A8
+// Automatic zoom picks the largest integer scale that fits a window this big
+#define TIM_VIEW_AUTO_WIDTH (1024)
+#define TIM_VIEW_AUTO_HEIGHT (768)
+#define TIM_VIEW_MAX_ZOOM (16)
+
+typedef struct _TIM_VIEW
 {
-	uint32_t uRed: 8, uGreen: 8, uBlue: 8, uAlpha: 8;
-} R8G8B8A8;
+	// A private copy of the file, swapped for a fresh one when it's rewritten
+	// on disk. Keeping it mapped would let the rewrite change or truncate it
+	// under the view
+	const char* pszFileName;
+	TIM_FILE sFile;
+
+	// Hash of the CLUT and pixel data, so a rewrite that leaves the file the
+	// same doesn't decode anything
+	uint32_t ui32Hash;
+
+	uint32_t ui32Width;
+	uint32_t ui32Height;
+
+	SDL_Window* pWindow;
+	SDL_Renderer* pRenderer;
+
+	// Created once with the view, large rects are decoded across it in bands
+	TIM_THREAD_POOL* psPool;
+
+	// The texture only holds the part of the image in the window, and wraps
+	// around at its edges, image pixel (x, y) living at texel (x % width,
+	// y % height). Panning only decodes the strips that come into view, and
+	// drawing unwraps it with up to four copies
+	SDL_Texture* pTexture;
+	uint32_t ui32TextureWidth;
+	uint32_t ui32TextureHeight;
+
+	// The CLUT index of every texel, laid out and wrapped like the texture.
+	// Switching CLUT sets this surface's palette and converts from it, so
+	// the TIM isn't decoded again
+	SDL_Surface* pIndexSurface;
+
+	// The image pixel at the top left of the window
+	uint32_t ui32ViewX;
+	uint32_t ui32ViewY;
 
+	// Which of the 256 indices each row uses, so a CLUT change only decodes
+	// the visible rows whose colours actually changed
+	uint32_t* pui32RowIndexMasks;
 
-static R8G8B8A8 TIMPixToRGBA8(const TIM_PIX* psPix)
+	// The CLUT row currently in the texture
+	R8G8B8A8 asPalette[256];
+	uint32_t ui32PaletteIndex;
+	uint32_t ui32NumDecodedPixels;
+
+	uint32_t ui32Zoom;
+	bool bWhiteBackground;
+
+	// Mouse drags move less than a texel per event when zoomed in
+	int32_t i32DragX;
+	int32_t i32DragY;
+} TIM_VIEW;
+
+#define TIM_VIEW_MASK_WORDS (256 / 32)
+
+static uint32_t GetTIMViewAutoZoom(const uint32_t ui32Width, const uint32_t ui32Height)
 {
-	R8G8B8A8 sPix = {
-		.uRed = CONV_U5_TO_U8(psPix->r),
-		.uGreen = CONV_U5_TO_U8(psPix->g),
-		.uBlue = CONV_U5_TO_U8(psPix->b),
-		.uAlpha = ((psPix->stp == 0x1) ? 0xff : 0x00)
-	};
+	uint32_t ui32Zoom = TIM_VIEW_AUTO_WIDTH / ui32Width;
 
-	return sPix;
+	if ((TIM_VIEW_AUTO_HEIGHT / ui32Height) < ui32Zoom)
+	{
+		ui32Zoom = TIM_VIEW_AUTO_HEIGHT / ui32Height;
+	}
+
+	return (ui32Zoom < 1) ? 1 : ((ui32Zoom > TIM_VIEW_MAX_ZOOM) ? TIM_VIEW_MAX_ZOOM : ui32Zoom);
 }
 
-static int DecodeTIMPixelDataWithPalette(
-	const TIM_FILE* psFile,
-	const uint32_t ui32PaletteIndex,
-	R8G8B8A8* pui32PixelData)
+// Decodes a rect of the image, which must be in view, into the texels it
+// wraps to, keeping its indices in the index surface. With bFromIndices the
+// texels are instead converted from the index surface through its palette.
+// A locked streaming texture is write only, so each piece is locked and
+// written whole
+static int DecodeTIMViewRect(
+	TIM_VIEW* psView,
+	const uint32_t ui32X,
+	const uint32_t ui32Y,
+	const uint32_t ui32Width,
+	const uint32_t ui32Height,
+	const bool bFromIndices)
 {
-	assert(psFile != NULL);
-	assert(ui32PaletteIndex < psFile->sCLUTHeader.ui16Height);
-	assert(pui32PixelData != NULL);
+	for (uint32_t y = ui32Y; y < (ui32Y + ui32Height);)
+	{
+		const uint32_t ui32TexelY = y % psView->ui32TextureHeight;
+		uint32_t ui32Rows = psView->ui32TextureHeight - ui32TexelY;
 
-	uint32_t ui32NumPixels = (
-		psFile->sPixelHeader.ui16Width * psFile->sPixelHeader.ui16Height
-	);
+		ui32Rows = (ui32Rows < ((ui32Y + ui32Height) - y)) ? ui32Rows : ((ui32Y + ui32Height) - y);
 
-	switch (psFile->sFileHeader.sFlags.uMode)
-	{
-		case TIM_PIX_FMT_4BIT_CLUT:
+		for (uint32_t x = ui32X; x < (ui32X + ui32Width);)
 		{
-			ui32NumPixels *= 4;
-			break;
+			const uint32_t ui32TexelX = x % psView->ui32TextureWidth;
+			uint32_t ui32Columns = psView->ui32TextureWidth - ui32TexelX;
+			SDL_Rect sLockRect;
+			SDL_Surface* pLockSurface;
+
+			ui32Columns = (ui32Columns < ((ui32X + ui32Width) - x)) ? ui32Columns : ((ui32X + ui32Width) - x);
+
+			sLockRect.x = ui32TexelX;
+			sLockRect.y = ui32TexelY;
+			sLockRect.w = ui32Columns;
+			sLockRect.h = ui32Rows;
+
+			if (SDL_LockTextureToSurface(psView->pTexture, &sLockRect, &pLockSurface) != 0)
+			{
+				printf("texture could not be locked! SDL_Error: %s\n", SDL_GetError());
+				return 1;
+			}
 
+			if (bFromIndices)
+			{
+				SDL_BlitSurface(psView->pIndexSurface, &sLockRect, pLockSurface, NULL);
+			}
+			else
+			{
+				uint8_t* pui8Indices = (uint8_t*)psView->pIndexSurface->pixels;
+
+				ExpandTIMPixelRectIndices(
+					&psView->sFile,
+					x,
+					y,
+					ui32Columns,
+					ui32Rows,
+					&pui8Indices[(ui32TexelY * psView->pIndexSurface->pitch) + ui32TexelX],
+					psView->pIndexSurface->pitch
+				);
+
+				DecodeTIMPixelRectInBands(
+					psView->psPool,
+					&psView->sFile,
+					psView->ui32PaletteIndex,
+					x,
+					y,
+					ui32Columns,
+					ui32Rows,
+					(R8G8B8A8*)pLockSurface->pixels,
+					pLockSurface->pitch / sizeof(R8G8B8A8)
+				);
+
+				psView->ui32NumDecodedPixels += ui32Columns * ui32Rows;
+			}
+
+			SDL_UnlockTexture(psView->pTexture);
+
+			x += ui32Columns;
 		}
-		case TIM_PIX_FMT_8BIT_CLUT:
+
+		y += ui32Rows;
+	}
+
+	return 0;
+}
+
+// Gives the index surface the view's current CLUT row, in 256 entries
+static void SetTIMViewSurfacePalette(TIM_VIEW* psView)
+{
+	SDL_Color asColours[256];
+
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		asColours[i].r = psView->asPalette[i].uRed;
+		asColours[i].g = psView->asPalette[i].uGreen;
+		asColours[i].b = psView->asPalette[i].uBlue;
+		asColours[i].a = psView->asPalette[i].uAlpha;
+	}
+
+	SDL_SetPaletteColors(psView->pIndexSurface->format->palette, asColours, 0, 256);
+}
+
+// Converts a CLUT row into the index surface's palette, and converts the
+// visible rows using any colour that differs from the current palette from
+// their indices. Nothing is decoded from the TIM
+static int SetTIMViewPalette(TIM_VIEW* psView, const uint32_t ui32PaletteIndex)
+{
+	R8G8B8A8 asColours[256] = { 0 };
+	uint32_t aui32Changed[TIM_VIEW_MASK_WORDS] = { 0 };
+	const uint32_t ui32EndY = psView->ui32ViewY + psView->ui32TextureHeight;
+
+	DecodeTIMPalette(&psView->sFile, ui32PaletteIndex, asColours);
+
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		if (memcmp(&asColours[i], &psView->asPalette[i], sizeof(R8G8B8A8)) != 0)
 		{
-			ui32NumPixels *= 2;
-			break;
+			aui32Changed[i / 32] |= 1u << (i % 32);
 		}
-		default: break;
 	}
 
-	uint8_t ui8ColourIndex;
-	const uint32_t ui32PaletteOffset = ui32PaletteIndex * psFile->sCLUTHeader.ui16Width;
-	for (uint32_t i = 0; i < ui32NumPixels; ++i)
+	memcpy(psView->asPalette, asColours, sizeof(asColours));
+	psView->ui32PaletteIndex = ui32PaletteIndex;
+	SetTIMViewSurfacePalette(psView);
+
+	for (uint32_t y = psView->ui32ViewY; y < ui32EndY;)
 	{
-		if (psFile->sFileHeader.sFlags.uMode == TIM_PIX_FMT_4BIT_CLUT)
+		uint32_t ui32NumRows = 0;
+
+		// Find the next run of rows that use a changed colour
+		for (; (y + ui32NumRows) < ui32EndY; ++ui32NumRows)
 		{
-			ui8ColourIndex = psFile->pui8PixelData[i / 2];
-			if (i % 2)
-			{
-				ui8ColourIndex = ((ui8ColourIndex & 0xF0) >> 4);
+			const uint32_t* pui32Mask = &psView->pui32RowIndexMasks[(y + ui32NumRows) * TIM_VIEW_MASK_WORDS];
+			bool bDirty = false;
 
+			for (uint32_t i = 0; i < TIM_VIEW_MASK_WORDS; ++i)
+			{
+				bDirty |= (pui32Mask[i] & aui32Changed[i]) != 0;
 			}
-			else
+
+			if (!bDirty)
 			{
-				ui8ColourIndex = ui8ColourIndex & 0x0F;
+				break;
 			}
 		}
-		else
+
+		if ((ui32NumRows > 0) &&
+			(DecodeTIMViewRect(psView, psView->ui32ViewX, y, psView->ui32TextureWidth, ui32NumRows, true) != 0))
 		{
-			ui8ColourIndex = psFile->pui8PixelData[i];
+			return 1;
 		}
 
-		pui32PixelData[i] = TIMPixToRGBA8(
-			&psFile->psCLUTData[ui32PaletteOffset + ui8ColourIndex]
-		);
+		y += ui32NumRows + 1;
 	}
 
 	return 0;
 }
 
-static int RenderTIM(const TIM_FILE* psFile)
+// Sizes the texture to the part of the image the window shows at the current
+// zoom, and decodes all of it
+static int ResizeTIMView(TIM_VIEW* psView)
+{
+	int iOutputWidth;
+	int iOutputHeight;
+	uint32_t ui32TextureWidth;
+	uint32_t ui32TextureHeight;
+
+	SDL_GetRendererOutputSize(psView->pRenderer, &iOutputWidth, &iOutputHeight);
+
+	// Partly visible texels at the edges count
+	ui32TextureWidth = (iOutputWidth + psView->ui32Zoom - 1) / psView->ui32Zoom;
+	ui32TextureWidth = (ui32TextureWidth < psView->ui32Width) ? ui32TextureWidth : psView->ui32Width;
+	ui32TextureWidth = (ui32TextureWidth > 0) ? ui32TextureWidth : 1;
+	ui32TextureHeight = (iOutputHeight + psView->ui32Zoom - 1) / psView->ui32Zoom;
+	ui32TextureHeight = (ui32TextureHeight < psView->ui32Height) ? ui32TextureHeight : psView->ui32Height;
+	ui32TextureHeight = (ui32TextureHeight > 0) ? ui32TextureHeight : 1;
+
+	if ((psView->pTexture == NULL) ||
+		(ui32TextureWidth != psView->ui32TextureWidth) ||
+		(ui32TextureHeight != psView->ui32TextureHeight))
+	{
+		if (psView->pTexture != NULL)
+		{
+			SDL_DestroyTexture(psView->pTexture);
+		}
+
+		psView->pTexture = SDL_CreateTexture(
+			psView->pRenderer,
+			SDL_PIXELFORMAT_RGBA32,
+			SDL_TEXTUREACCESS_STREAMING,
+			ui32TextureWidth,
+			ui32TextureHeight
+		);
+
+		if (psView->pTexture == NULL)
+		{
+			printf("texture could not be created! SDL_Error: %s\n", SDL_GetError());
+			return 1;
+		}
+
+		// Blend with the palette's alpha over the background
+		SDL_SetTextureBlendMode(psView->pTexture, SDL_BLENDMODE_BLEND);
+
+		if (psView->pIndexSurface != NULL)
+		{
+			SDL_FreeSurface(psView->pIndexSurface);
+		}
+
+		psView->pIndexSurface = SDL_CreateRGBSurfaceWithFormat(0, ui32TextureWidth, ui32TextureHeight, 8, SDL_PIXELFORMAT_INDEX8);
+		if (psView->pIndexSurface == NULL)
+		{
+			printf("surface could not be created! SDL_Error: %s\n", SDL_GetError());
+			return 1;
+		}
+
+		// Copied with the palette's alpha, the texture does the blending
+		SDL_SetSurfaceBlendMode(psView->pIndexSurface, SDL_BLENDMODE_NONE);
+
+		psView->ui32TextureWidth = ui32TextureWidth;
+		psView->ui32TextureHeight = ui32TextureHeight;
+	}
+
+	if ((psView->ui32ViewX + psView->ui32TextureWidth) > psView->ui32Width)
+	{
+		psView->ui32ViewX = psView->ui32Width - psView->ui32TextureWidth;
+	}
+
+	if ((psView->ui32ViewY + psView->ui32TextureHeight) > psView->ui32Height)
+	{
+		psView->ui32ViewY = psView->ui32Height - psView->ui32TextureHeight;
+	}
+
+	SetTIMViewSurfacePalette(psView);
+
+	return DecodeTIMViewRect(
+		psView,
+		psView->ui32ViewX,
+		psView->ui32ViewY,
+		psView->ui32TextureWidth,
+		psView->ui32TextureHeight,
+		false
+	);
+}
+
+// Moves the view by some number of image pixels, decoding only the columns
+// and rows that come into view
+static int PanTIMView(TIM_VIEW* psView, const int32_t i32DeltaX, const int32_t i32DeltaY)
 {
-	uint16_t ui16ActualWidth = psFile->sPixelHeader.ui16Width;
+	const int32_t i32MaxX = psView->ui32Width - psView->ui32TextureWidth;
+	const int32_t i32MaxY = psView->ui32Height - psView->ui32TextureHeight;
+	const uint32_t ui32OldX = psView->ui32ViewX;
+	const uint32_t ui32OldY = psView->ui32ViewY;
+	int32_t i32NewX = (int32_t)ui32OldX + i32DeltaX;
+	int32_t i32NewY = (int32_t)ui32OldY + i32DeltaY;
+	uint32_t ui32OverlapX;
+	uint32_t ui32OverlapWidth;
+
+	i32NewX = (i32NewX < 0) ? 0 : ((i32NewX > i32MaxX) ? i32MaxX : i32NewX);
+	i32NewY = (i32NewY < 0) ? 0 : ((i32NewY > i32MaxY) ? i32MaxY : i32NewY);
+
+	psView->ui32ViewX = i32NewX;
+	psView->ui32ViewY = i32NewY;
+
+	if ((psView->ui32ViewX == ui32OldX) && (psView->ui32ViewY == ui32OldY))
+	{
+		return 0;
+	}
+
+	// Nothing in view before is still in view
+	if ((abs(i32NewX - (int32_t)ui32OldX) >= (int32_t)psView->ui32TextureWidth) ||
+		(abs(i32NewY - (int32_t)ui32OldY) >= (int32_t)psView->ui32TextureHeight))
+	{
+		return DecodeTIMViewRect(
+			psView,
+			psView->ui32ViewX,
+			psView->ui32ViewY,
+			psView->ui32TextureWidth,
+			psView->ui32TextureHeight,
+			false
+		);
+	}
 
-	switch (psFile->sFileHeader.sFlags.uMode)
+	// The columns that came into view, at every visible row
+	if (psView->ui32ViewX != ui32OldX)
 	{
-		case TIM_PIX_FMT_4BIT_CLUT:
+		const uint32_t ui32StripX = (psView->ui32ViewX > ui32OldX) ? (ui32OldX + psView->ui32TextureWidth) : psView->ui32ViewX;
+		const uint32_t ui32StripWidth = (psView->ui32ViewX > ui32OldX) ? (psView->ui32ViewX - ui32OldX) : (ui32OldX - psView->ui32ViewX);
+
+		if (DecodeTIMViewRect(psView, ui32StripX, psView->ui32ViewY, ui32StripWidth, psView->ui32TextureHeight, false) != 0)
 		{
-			ui16ActualWidth *= 4;
-			break;
+			return 1;
+		}
+	}
 
+	// Then the rows that came into view, across the columns that were
+	// already in view
+	if (psView->ui32ViewY != ui32OldY)
+	{
+		const uint32_t ui32StripY = (psView->ui32ViewY > ui32OldY) ? (ui32OldY + psView->ui32TextureHeight) : psView->ui32ViewY;
+		const uint32_t ui32StripHeight = (psView->ui32ViewY > ui32OldY) ? (psView->ui32ViewY - ui32OldY) : (ui32OldY - psView->ui32ViewY);
+
+		ui32OverlapX = (psView->ui32ViewX > ui32OldX) ? psView->ui32ViewX : ui32OldX;
+		ui32OverlapWidth = psView->ui32TextureWidth - ((psView->ui32ViewX > ui32OldX) ? (psView->ui32ViewX - ui32OldX) : (ui32OldX - psView->ui32ViewX));
+
+		if (DecodeTIMViewRect(psView, ui32OverlapX, ui32StripY, ui32OverlapWidth, ui32StripHeight, false) != 0)
+		{
+			return 1;
 		}
-		case TIM_PIX_FMT_8BIT_CLUT:
+	}
+
+	return 0;
+}
+
+// Changes the zoom keeping the image pixel at the centre of the window there
+static int SetTIMViewZoom(TIM_VIEW* psView, const int32_t i32Zoom)
+{
+	const uint32_t ui32NewZoom = (i32Zoom < 1) ? 1 : ((i32Zoom > TIM_VIEW_MAX_ZOOM) ? TIM_VIEW_MAX_ZOOM : (uint32_t)i32Zoom);
+	int iOutputWidth;
+	int iOutputHeight;
+	int32_t i32CentreX;
+	int32_t i32CentreY;
+
+	if (ui32NewZoom == psView->ui32Zoom)
+	{
+		return 0;
+	}
+
+	SDL_GetRendererOutputSize(psView->pRenderer, &iOutputWidth, &iOutputHeight);
+	i32CentreX = psView->ui32ViewX + ((iOutputWidth / 2) / psView->ui32Zoom);
+	i32CentreY = psView->ui32ViewY + ((iOutputHeight / 2) / psView->ui32Zoom);
+
+	psView->ui32Zoom = ui32NewZoom;
+	i32CentreX -= (iOutputWidth / 2) / psView->ui32Zoom;
+	i32CentreY -= (iOutputHeight / 2) / psView->ui32Zoom;
+	psView->ui32ViewX = (i32CentreX > 0) ? i32CentreX : 0;
+	psView->ui32ViewY = (i32CentreY > 0) ? i32CentreY : 0;
+
+	return ResizeTIMView(psView);
+}
+
+// Draws the visible part of the image at its integer zoom, centred when it's
+// smaller than the window
+static void DrawTIMView(const TIM_VIEW* psView)
+{
+	const uint8_t ui8Background = psView->bWhiteBackground ? 0xff : 0x00;
+	const uint32_t ui32TexelX = psView->ui32ViewX % psView->ui32TextureWidth;
+	const uint32_t ui32TexelY = psView->ui32ViewY % psView->ui32TextureHeight;
+	const int32_t i32Zoom = psView->ui32Zoom;
+	int iOutputWidth;
+	int iOutputHeight;
+	int iOriginX;
+	int iOriginY;
+
+	SDL_GetRendererOutputSize(psView->pRenderer, &iOutputWidth, &iOutputHeight);
+	iOriginX = ((psView->ui32Width * i32Zoom) < (uint32_t)iOutputWidth) ? ((iOutputWidth - (psView->ui32Width * i32Zoom)) / 2) : 0;
+	iOriginY = ((psView->ui32Height * i32Zoom) < (uint32_t)iOutputHeight) ? ((iOutputHeight - (psView->ui32Height * i32Zoom)) / 2) : 0;
+
+	SDL_SetRenderDrawColor(psView->pRenderer, ui8Background, ui8Background, ui8Background, 0xff);
+	SDL_RenderClear(psView->pRenderer);
+
+	// Unwrap the texture, the texels from the wrap point onwards are the
+	// left (or top) of the view
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		const bool bRight = (i & 1) != 0;
+		const bool bBottom = (i & 2) != 0;
+		const SDL_Rect sSrcRect = {
+			bRight ? 0 : ui32TexelX,
+			bBottom ? 0 : ui32TexelY,
+			bRight ? ui32TexelX : (psView->ui32TextureWidth - ui32TexelX),
+			bBottom ? ui32TexelY : (psView->ui32TextureHeight - ui32TexelY)
+		};
+		const SDL_Rect sDstRect = {
+			iOriginX + ((bRight ? (psView->ui32TextureWidth - ui32TexelX) : 0) * i32Zoom),
+			iOriginY + ((bBottom ? (psView->ui32TextureHeight - ui32TexelY) : 0) * i32Zoom),
+			sSrcRect.w * i32Zoom,
+			sSrcRect.h * i32Zoom
+		};
+
+		if ((sSrcRect.w > 0) && (sSrcRect.h > 0))
 		{
-			ui16ActualWidth *= 2;
-			break;
+			SDL_RenderCopy(psView->pRenderer, psView->pTexture, &sSrcRect, &sDstRect);
 		}
-		default: break;
 	}
 
-	SDL_Window* pWindow = SDL_CreateWindow(
+	SDL_RenderPresent(psView->pRenderer);
+}
+
+static void DestroyTIMView(TIM_VIEW* psView)
+{
+	if (psView->pTexture != NULL)
+	{
+		SDL_DestroyTexture(psView->pTexture);
+	}
+
+	if (psView->pIndexSurface != NULL)
+	{
+		SDL_FreeSurface(psView->pIndexSurface);
+	}
+
+	if (psView->pRenderer != NULL)
+	{
+		SDL_DestroyRenderer(psView->pRenderer);
+	}
+
+	if (psView->pWindow != NULL)
+	{
+		SDL_DestroyWindow(psView->pWindow);
+	}
+
+	DestroyThreadPool(psView->psPool);
+	free(psView->pui32RowIndexMasks);
+	DestroyTIM(&psView->sFile);
+}
+
+// Takes over a copied file once it's known to be viewable, destroying the one
+// it replaces. The caller still has to decode it into the texture, and
+// destroy it if this fails
+static int SetTIMViewFile(TIM_VIEW* psView, const TIM_FILE* psFile)
+{
+	const uint32_t ui32Height = psFile->sPixelHeader.ui16Height;
+	const uint32_t ui32RowInBytes = psFile->sPixelHeader.ui16Width * sizeof(uint16_t);
+	uint32_t* pui32RowIndexMasks;
+
+	if (ValidateTIM(psFile) != 0)
+	{
+		return 1;
+	}
+
+	if (psFile->sCLUTHeader.ui16Width > 256)
+	{
+		printf("CLUT is wider than 256 colours\n");
+		return 1;
+	}
+
+	pui32RowIndexMasks = calloc(ui32Height * TIM_VIEW_MASK_WORDS, sizeof(uint32_t));
+	if (pui32RowIndexMasks == NULL)
+	{
+		printf("failed to allocate row masks\n");
+		return 1;
+	}
+
+	for (uint32_t y = 0; y < ui32Height; ++y)
+	{
+		const uint8_t* pui8Row = &psFile->pui8PixelData[y * ui32RowInBytes];
+		uint32_t* pui32Mask = &pui32RowIndexMasks[y * TIM_VIEW_MASK_WORDS];
+
+		for (uint32_t x = 0; x < ui32RowInBytes; ++x)
+		{
+			if (psFile->sFileHeader.sFlags.uMode == TIM_PIX_FMT_4BIT_CLUT)
+			{
+				pui32Mask[0] |= (1u << (pui8Row[x] & 0x0F)) | (1u << (pui8Row[x] >> 4));
+			}
+			else
+			{
+				pui32Mask[pui8Row[x] / 32] |= 1u << (pui8Row[x] % 32);
+			}
+		}
+	}
+
+	free(psView->pui32RowIndexMasks);
+	DestroyTIM(&psView->sFile);
+
+	psView->pui32RowIndexMasks = pui32RowIndexMasks;
+	psView->sFile = *psFile;
+	psView->ui32Hash = HashTIM(psFile);
+	psView->ui32Width = GetTIMPixelWidth(psFile);
+	psView->ui32Height = ui32Height;
+
+	return 0;
+}
+
+// Copies the file again after it's been rewritten, and decodes what's in view
+// if its headers or data changed. The CLUT row and zoom are kept, and a file
+// that can't be viewed leaves the last good one on screen
+static int ReloadTIMView(TIM_VIEW* psView, bool* pbChanged)
+{
+	const uint64_t ui64Start = SDL_GetPerformanceCounter();
+	TIM_FILE sFile;
+
+	*pbChanged = false;
+
+	if (CopyTIM(psView->pszFileName, &sFile) != 0)
+	{
+		printf("keeping the last good copy of %s\n", psView->pszFileName);
+		return 0;
+	}
+
+	if ((memcmp(&sFile.sFileHeader, &psView->sFile.sFileHeader, sizeof(TIM_FILE_HEADER)) == 0) &&
+		(memcmp(&sFile.sCLUTHeader, &psView->sFile.sCLUTHeader, sizeof(TIM_BLOCK_HEADER)) == 0) &&
+		(memcmp(&sFile.sPixelHeader, &psView->sFile.sPixelHeader, sizeof(TIM_BLOCK_HEADER)) == 0) &&
+		(HashTIM(&sFile) == psView->ui32Hash))
+	{
+		DestroyTIM(&sFile);
+		return 0;
+	}
+
+	if (SetTIMViewFile(psView, &sFile) != 0)
+	{
+		printf("keeping the last good copy of %s\n", psView->pszFileName);
+		DestroyTIM(&sFile);
+		return 0;
+	}
+
+	if (psView->ui32PaletteIndex >= psView->sFile.sCLUTHeader.ui16Height)
+	{
+		psView->ui32PaletteIndex = 0;
+	}
+
+	DecodeTIMPalette(&psView->sFile, psView->ui32PaletteIndex, psView->asPalette);
+
+	if (ResizeTIMView(psView) != 0)
+	{
+		return 1;
+	}
+
+	*pbChanged = true;
+	printf(
+		"reloaded %s in %.2fms\n",
+		psView->pszFileName,
+		(double)(SDL_GetPerformanceCounter() - ui64Start) * 1000.0 / (double)SDL_GetPerformanceFrequency()
+	);
+
+	return 0;
+}
+
+static int CreateTIMView(
+	const char* pszFileName,
+	const uint32_t ui32Zoom,
+	const uint32_t ui32NumThreads,
+	TIM_VIEW* psView)
+{
+	SDL_RendererInfo sRendererInfo;
+	TIM_FILE sFile;
+	uint32_t ui32WindowWidth;
+	uint32_t ui32WindowHeight;
+
+	memset(psView, 0, sizeof(TIM_VIEW));
+	psView->pszFileName = pszFileName;
+
+	if (CopyTIM(pszFileName, &sFile) != 0)
+	{
+		return 1;
+	}
+
+	PrintTIM(pszFileName, &sFile);
+
+	if (SetTIMViewFile(psView, &sFile) != 0)
+	{
+		DestroyTIM(&sFile);
+		return 1;
+	}
+
+	psView->ui32Zoom = (ui32Zoom != 0) ? ui32Zoom : GetTIMViewAutoZoom(psView->ui32Width, psView->ui32Height);
+	psView->ui32Zoom = (psView->ui32Zoom > TIM_VIEW_MAX_ZOOM) ? TIM_VIEW_MAX_ZOOM : psView->ui32Zoom;
+
+	psView->psPool = CreateThreadPool(ui32NumThreads);
+	if (psView->psPool == NULL)
+	{
+		goto FAILED_CreateTIMView;
+	}
+
+	// The window starts showing as much of the image as fits on screen, the
+	// rest is reached by panning
+	ui32WindowWidth = psView->ui32Width * psView->ui32Zoom;
+	ui32WindowWidth = (ui32WindowWidth < TIM_VIEW_AUTO_WIDTH) ? ui32WindowWidth : TIM_VIEW_AUTO_WIDTH;
+	ui32WindowHeight = psView->ui32Height * psView->ui32Zoom;
+	ui32WindowHeight = (ui32WindowHeight < TIM_VIEW_AUTO_HEIGHT) ? ui32WindowHeight : TIM_VIEW_AUTO_HEIGHT;
+
+	psView->pWindow = SDL_CreateWindow(
 		"timview",
 		SDL_WINDOWPOS_UNDEFINED,
 		SDL_WINDOWPOS_UNDEFINED,
-		ui16ActualWidth,
-		psFile->sPixelHeader.ui16Height,
-		SDL_WINDOW_SHOWN
+		ui32WindowWidth,
+		ui32WindowHeight,
+		SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
 	);
 
-	if (pWindow == NULL)
+	if (psView->pWindow == NULL)
 	{
 		printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
-		return 1;
+		goto FAILED_CreateTIMView;
 	}
 
-	SDL_Surface* pScreenSurface = SDL_GetWindowSurface(pWindow);
-	if (pScreenSurface == NULL)
+	// Scale with nearest filtering, so zoomed texels stay square
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+
+	// Boxes without a GPU (or with SDL_VIDEODRIVER=dummy) get the software
+	// renderer, which supports everything used here
+	psView->pRenderer = SDL_CreateRenderer(psView->pWindow, -1, SDL_RENDERER_ACCELERATED);
+	if (psView->pRenderer == NULL)
 	{
-		printf("screen surface could not be created! SDL_Error: %s\n", SDL_GetError());
-		goto FAILED_GetWindowSurface;
+		psView->pRenderer = SDL_CreateRenderer(psView->pWindow, -1, SDL_RENDERER_SOFTWARE);
 	}
 
-	SDL_Surface* pTIMSurface = SDL_CreateRGBSurface(
-		0,
-		ui16ActualWidth,
-		psFile->sPixelHeader.ui16Height,
-		32,
-		// component masks
-		0x000000ff,
-		0x0000ff00,
-		0x00ff0000,
-		0xff000000
-	);
+	if (psView->pRenderer == NULL)
+	{
+		printf("renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+		goto FAILED_CreateTIMView;
+	}
 
-	if (pTIMSurface == NULL)
+	if (SDL_GetRendererInfo(psView->pRenderer, &sRendererInfo) == 0)
 	{
-		printf("surface could not be created! SDL_Error: %s\n", SDL_GetError());
-		goto FAILED_CreateTIMSurface;
+		printf("using the %s renderer\n", sRendererInfo.name);
 	}
 
-	R8G8B8A8* psPixels = (R8G8B8A8*)pTIMSurface->pixels;
-	uint32_t ui32PaletteIndex = 0;
-	if (DecodeTIMPixelDataWithPalette(psFile, ui32PaletteIndex, psPixels) != 0)
+	DecodeTIMPalette(&psView->sFile, 0, psView->asPalette);
+
+	if (ResizeTIMView(psView) != 0)
 	{
 		printf("Failed to get pixel data from TIM\n");
-		goto FAILED_DecodePalette;
+		goto FAILED_CreateTIMView;
 	}
 
-	SDL_BlitSurface(pTIMSurface, NULL, pScreenSurface, NULL);
-	SDL_UpdateWindowSurface(pWindow);
+	return 0;
+
+FAILED_CreateTIMView:
+	DestroyTIMView(psView);
+
+	return 1;
+}
+
+static int RenderTIM(const char* pszFileName, const uint32_t ui32Zoom, const uint32_t ui32NumThreads)
+{
+	TIM_VIEW sView;
+	TIM_WATCH* psWatch;
+	uint32_t ui32ReloadEventType;
+	int iResult = 1;
+
+	if (CreateTIMView(pszFileName, ui32Zoom, ui32NumThreads, &sView) != 0)
+	{
+		return 1;
+	}
+
+	// The watch wakes the loop when the file is written, so a reload is on
+	// screen by the next frame
+	ui32ReloadEventType = SDL_RegisterEvents(1);
+	psWatch = (ui32ReloadEventType != (uint32_t)-1) ? CreateTIMWatch(&pszFileName, 1, ui32ReloadEventType) : NULL;
 
 	{
 		SDL_Event sEvent;
 		bool bQuit = false;
-		// Too help view textures with alpha, we can toggle a surface clear
-		// TODO: actually set this on a key
-		bool bClear = false;
+		// Frames are only drawn when the palette, background, view or window
+		// contents have changed, otherwise the loop sleeps in SDL_WaitEvent
+		bool bDirty = true;
+		uint32_t ui32NumRedraws = 0;
+
 		while (!bQuit)
 		{
-			while (SDL_PollEvent(&sEvent))
+			if (bDirty)
 			{
+				const uint64_t ui64Start = SDL_GetPerformanceCounter();
+				char szTitle[192];
+
+				DrawTIMView(&sView);
+				++ui32NumRedraws;
+
+				// The frame time, redraw count and pixels decoded since the
+				// last frame are shown, so it's easy to check nothing is
+				// drawn while idle and panning only decodes what it exposes
+				snprintf(
+					szTitle,
+					sizeof(szTitle),
+					"timview - CLUT %u/%hu - %ux at %u, %u - %.2fms - %u redraws, %u pixels decoded",
+					sView.ui32PaletteIndex,
+					sView.sFile.sCLUTHeader.ui16Height,
+					sView.ui32Zoom,
+					sView.ui32ViewX,
+					sView.ui32ViewY,
+					(double)(SDL_GetPerformanceCounter() - ui64Start) * 1000.0 / (double)SDL_GetPerformanceFrequency(),
+					ui32NumRedraws,
+					sView.ui32NumDecodedPixels
+				);
+				SDL_SetWindowTitle(sView.pWindow, szTitle);
+
+				sView.ui32NumDecodedPixels = 0;
+				bDirty = false;
+			}
+
+			if (SDL_WaitEvent(&sEvent) == 0)
+			{
+				printf("failed waiting for events! SDL_Error: %s\n", SDL_GetError());
+				goto FAILED_RenderTIM;
+			}
+
+			// Take everything that's queued before drawing, so a burst of
+			// events costs one redraw
+			do
+			{
+				// Events that leave the view where it was don't redraw
+				const uint32_t ui32OldViewX = sView.ui32ViewX;
+				const uint32_t ui32OldViewY = sView.ui32ViewY;
+				const uint32_t ui32OldZoom = sView.ui32Zoom;
+				const uint32_t ui32OldPaletteIndex = sView.ui32PaletteIndex;
+				const bool bOldWhiteBackground = sView.bWhiteBackground;
+				int iEventResult = 0;
+
 				if (sEvent.type == SDL_QUIT)
 				{
 					bQuit = true;
 				}
 
-				if (sEvent.type == SDL_KEYDOWN)
+				if (sEvent.type == SDL_WINDOWEVENT)
 				{
-					ui32PaletteIndex = (
-						(ui32PaletteIndex + 1) % psFile->sCLUTHeader.ui16Height
-					);
+					if (sEvent.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+					{
+						iEventResult = ResizeTIMView(&sView);
+						bDirty = true;
+					}
 
-					if (DecodeTIMPixelDataWithPalette(psFile, ui32PaletteIndex, psPixels) != 0)
+					if (sEvent.window.event == SDL_WINDOWEVENT_EXPOSED)
 					{
-						printf("Failed to get pixel data from TIM\n");
-						goto FAILED_DecodePalette;
+						bDirty = true;
 					}
+				}
 
-					SDL_FillRect(pScreenSurface, NULL, (bClear ? 0xffffffff : 0xff000000));
-					bClear = !bClear;
+				if (sEvent.type == ui32ReloadEventType)
+				{
+					bool bChanged;
 
-					SDL_BlitSurface(pTIMSurface, NULL, pScreenSurface, NULL);
-					SDL_UpdateWindowSurface(pWindow);
+					iEventResult = ReloadTIMView(&sView, &bChanged);
+					bDirty |= bChanged;
 				}
-			}
+
+				if (sEvent.type == SDL_MOUSEWHEEL)
+				{
+					iEventResult = SetTIMViewZoom(&sView, (int32_t)sView.ui32Zoom + sEvent.wheel.y);
+				}
+
+				// Dragging with the left button pans, a texel at a time
+				if ((sEvent.type == SDL_MOUSEMOTION) && (sEvent.motion.state & SDL_BUTTON_LMASK))
+				{
+					const int32_t i32Zoom = sView.ui32Zoom;
+					int32_t i32DeltaX;
+					int32_t i32DeltaY;
+
+					sView.i32DragX -= sEvent.motion.xrel;
+					sView.i32DragY -= sEvent.motion.yrel;
+					i32DeltaX = sView.i32DragX / i32Zoom;
+					i32DeltaY = sView.i32DragY / i32Zoom;
+					sView.i32DragX -= i32DeltaX * i32Zoom;
+					sView.i32DragY -= i32DeltaY * i32Zoom;
+
+					iEventResult = PanTIMView(&sView, i32DeltaX, i32DeltaY);
+				}
+
+				if (sEvent.type == SDL_KEYDOWN)
+				{
+					const int32_t i32PanStep = ((sView.ui32TextureWidth / 8) > 0) ? (sView.ui32TextureWidth / 8) : 1;
+
+					switch (sEvent.key.keysym.sym)
+					{
+						case SDLK_ESCAPE: bQuit = true; break;
+						case SDLK_b: sView.bWhiteBackground = !sView.bWhiteBackground; break;
+						case SDLK_PLUS:
+						case SDLK_EQUALS: iEventResult = SetTIMViewZoom(&sView, (int32_t)sView.ui32Zoom + 1); break;
+						case SDLK_MINUS: iEventResult = SetTIMViewZoom(&sView, (int32_t)sView.ui32Zoom - 1); break;
+						case SDLK_LEFT: iEventResult = PanTIMView(&sView, -i32PanStep, 0); break;
+						case SDLK_RIGHT: iEventResult = PanTIMView(&sView, i32PanStep, 0); break;
+						case SDLK_UP: iEventResult = PanTIMView(&sView, 0, -i32PanStep); break;
+						case SDLK_DOWN: iEventResult = PanTIMView(&sView, 0, i32PanStep); break;
+
+						// Modifiers are held for other keys, such as shift for
+						// '+', so they don't count as a key of their own
+						case SDLK_LSHIFT:
+						case SDLK_RSHIFT:
+						case SDLK_LCTRL:
+						case SDLK_RCTRL:
+						case SDLK_LALT:
+						case SDLK_RALT:
+						case SDLK_LGUI:
+						case SDLK_RGUI:
+						case SDLK_CAPSLOCK:
+						case SDLK_NUMLOCKCLEAR:
+						case SDLK_MODE:
+							break;
+
+						// Any other key moves to the next CLUT row
+						default:
+						{
+							iEventResult = SetTIMViewPalette(
+								&sView,
+								(sView.ui32PaletteIndex + 1) % sView.sFile.sCLUTHeader.ui16Height
+							);
+							break;
+						}
+					}
+				}
+
+				if (iEventResult != 0)
+				{
+					goto FAILED_RenderTIM;
+				}
+
+				bDirty |= (
+					(sView.ui32ViewX != ui32OldViewX) ||
+					(sView.ui32ViewY != ui32OldViewY) ||
+					(sView.ui32Zoom != ui32OldZoom) ||
+					(sView.ui32PaletteIndex != ui32OldPaletteIndex) ||
+					(sView.bWhiteBackground != bOldWhiteBackground)
+				);
+			} while (SDL_PollEvent(&sEvent));
 		}
 	}
 
-	SDL_FreeSurface(pTIMSurface);
-	SDL_FreeSurface(pScreenSurface);
-	SDL_DestroyWindow(pWindow);
-
-	return 0;
+	iResult = 0;
 
-FAILED_DecodePalette:
-	SDL_FreeSurface(pTIMSurface);
-FAILED_CreateTIMSurface:
-	SDL_FreeSurface(pScreenSurface);
-FAILED_GetWindowSurface:
-	SDL_DestroyWindow(pWindow);
+FAILED_RenderTIM:
+	DestroyTIMWatch(psWatch);
+	DestroyTIMView(&sView);
 
-	return 1;
+	return iResult;
 }
 
-int main (int argc, char * argv[])
+const char *argp_program_version = "timview 1.0";
+const char *argp_program_bug_address = "<jw0z96@github>";
+static char szDoc[] = "timview - SDL-based viewer for TIM files";
+static char szArgDoc[] = "TIM_FILE\n--vram TIM_FILE...\n--export=OUTPUT TIM_FILE...\n--grid TIM_FILE_OR_DIRECTORY...\n--anim TIM_FILE...";
+
+static struct argp_option sOptions[] = {
+	{ "vram",	'v',	0,	0,	"Composite every TIM file into a full 1024x512 VRAM view" },
+	{ "zoom",	'z',	"SCALE",	0,	"Integer scale to view the texture at (default fits it to 1024x768)" },
+	{ "export",	'e',	"OUTPUT",	0,	"Decode to a PNG without a display, a directory of them for several files, or - for raw RGBA on stdout" },
+	{ "clut",	'c',	"INDEX",	0,	"CLUT row to export with (default 0)" },
+	{ "all-cluts",	'a',	0,	0,	"Export every CLUT row, as <name>_clut<N>.png" },
+	{ "jobs",	'j',	"THREADS",	0,	"Number of threads to decode with (default one per CPU)" },
+	{ "grid",	'g',	0,	0,	"Browse TIM files, and directories of them, as a grid of thumbnails" },
+	{ "cache-mb",	'm',	"MB",	0,	"Memory to keep decoded thumbnails in (default 64)" },
+	{ "anim",	'n',	0,	0,	"Play the TIM files in order as a looping animation" },
+	{ "fps",	'f',	"FPS",	0,	"Frame rate to play animations at (default 30)" },
+	{ 0 }
+};
+
+static error_t ParseOpts(int key, char *arg, struct argp_state *state)
 {
-	TIM_FILE sFile;
+	TIM_VIEW_ARGS *psArgs = state->input;
 
-	if (argc != 2)
+	switch (key)
 	{
-		printf("just one arg pls!\n");
-		return 1;
+		case 'v': psArgs->bVRAM = true; break;
+		case 'z': psArgs->ui32Zoom = strtol(arg, NULL, 10); break;
+		case 'e': psArgs->pszExportFileName = arg; break;
+		case 'c': psArgs->ui32PaletteIndex = strtoul(arg, NULL, 10); break;
+		case 'a': psArgs->bAllCLUTs = true; break;
+		case 'j': psArgs->ui32NumThreads = strtoul(arg, NULL, 10); break;
+		case 'g': psArgs->bGrid = true; break;
+		case 'm': psArgs->ui32CacheSizeInMB = strtoul(arg, NULL, 10); break;
+		case 'n': psArgs->bAnim = true; break;
+		case 'f': psArgs->ui32FPS = strtoul(arg, NULL, 10); break;
+
+		case ARGP_KEY_ARG:
+		{
+			// Only the VRAM view, grid, animations and exports take more than
+			// one file
+			if (!psArgs->bVRAM && !psArgs->bGrid && !psArgs->bAnim &&
+				(psArgs->pszExportFileName == NULL) && (state->arg_num >= 1))
+			{
+				printf("just one arg pls!\n");
+				argp_usage(state);
+			}
+
+			psArgs->ppszFileNames[psArgs->ui32NumFiles++] = arg;
+			break;
+		}
+
+		case ARGP_KEY_END:
+		{
+			if (state->arg_num < 1) // Not enough args
+			{
+				argp_usage(state);
+			}
+			break;
+		}
+
+		default:
+			return ARGP_ERR_UNKNOWN;
 	}
 
-	if (ReadTIM(argv[1], &sFile) != 0)
+	return 0;
+}
+
+static struct argp sArgp = { sOptions, ParseOpts, szArgDoc, szDoc };
+
+int main (int argc, char * argv[])
+{
+	int iResult;
+
+	// Default args
+	TIM_VIEW_ARGS sArgs;
+	sArgs.bVRAM = false;
+	sArgs.ui32Zoom = 0;
+	sArgs.pszExportFileName = NULL;
+	sArgs.ui32PaletteIndex = 0;
+	sArgs.bAllCLUTs = false;
+	sArgs.ui32NumThreads = 0;
+	sArgs.bGrid = false;
+	sArgs.ui32CacheSizeInMB = 64;
+	sArgs.bAnim = false;
+	sArgs.ui32FPS = 30;
+	sArgs.ppszFileNames = calloc(argc, sizeof(char*));
+	sArgs.ui32NumFiles = 0;
+
+	if (sArgs.ppszFileNames == NULL)
 	{
+		printf("failed to allocate file list\n");
 		return 1;
 	}
 
-	if (SDL_Init(SDL_INIT_VIDEO) < 0)
+	argp_parse(&sArgp, argc, argv, 0, 0, &sArgs);
+
+	// Exports never touch SDL, so they run without a display
+	if (sArgs.pszExportFileName != NULL)
 	{
-		printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
-		goto FAILED_SDL_Init;
+		iResult = ExportTIMs(&sArgs);
+		free(sArgs.ppszFileNames);
+		return iResult;
 	}
 
-	PrintTIM(argv[1], &sFile);
-
-	if (RenderTIM(&sFile) != 0)
+	if (SDL_Init(SDL_INIT_VIDEO) < 0)
 	{
-		goto FAILED_RenderTIM;
+		printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+		free(sArgs.ppszFileNames);
+		return 1;
 	}
 
-	SDL_Quit();
-	DestroyTIM(&sFile);
-
-	return 0;
+	iResult = (
+		sArgs.bVRAM ? RenderVRAM(&sArgs) :
+		sArgs.bGrid ? RenderGrid(&sArgs) :
+		sArgs.bAnim ? RenderAnimation(&sArgs) :
+		RenderTIM(sArgs.ppszFileNames[0], sArgs.ui32Zoom, sArgs.ui32NumThreads)
+	);
 
-FAILED_RenderTIM:
 	SDL_Quit();
-FAILED_SDL_Init:
-	DestroyTIM(&sFile);
+	free(sArgs.ppszFileNames);
 
-	return 1;
+	return iResult;
 }
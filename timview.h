@@ -0,0 +1,58 @@
+#ifndef TIMVIEW_H
+#define TIMVIEW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "tim_defs.h"
+
+typedef struct _TIM_VIEW_ARGS
+{
+	// Composite every file into a full VRAM view, rather than viewing one
+	bool bVRAM;
+
+	// Integer scale for the single texture view, 0 picks one to fit
+	uint32_t ui32Zoom;
+
+	// Decode to a PNG (or a directory of them) without opening a window, "-"
+	// writes raw RGBA to stdout instead
+	char* pszExportFileName;
+	uint32_t ui32PaletteIndex;
+	bool bAllCLUTs;
+	uint32_t ui32NumThreads;
+
+	// Browse files and directories of them as a grid of thumbnails, keeping
+	// at most this much of them cached
+	bool bGrid;
+	uint32_t ui32CacheSizeInMB;
+
+	// Play the files in order as an animation at this frame rate
+	bool bAnim;
+	uint32_t ui32FPS;
+
+	char** ppszFileNames;
+	uint32_t ui32NumFiles;
+} TIM_VIEW_ARGS;
+
+// timview_vram.c
+int RenderVRAM(const TIM_VIEW_ARGS* psArgs);
+
+// timview_grid.c
+int RenderGrid(const TIM_VIEW_ARGS* psArgs);
+
+// timview_anim.c
+int RenderAnimation(const TIM_VIEW_ARGS* psArgs);
+
+// timview_export.c
+int ExportTIMs(const TIM_VIEW_ARGS* psArgs);
+
+// timview_watch.c
+typedef struct _TIM_WATCH TIM_WATCH;
+
+// Watches the files for being rewritten or replaced, pushing an SDL event of
+// the given type with user.code set to the file's index. Returns NULL where
+// files can't be watched, which DestroyTIMWatch accepts
+TIM_WATCH* CreateTIMWatch(const char* const* ppszFileNames, const uint32_t ui32NumFiles, const uint32_t ui32EventType);
+void DestroyTIMWatch(TIM_WATCH* psWatch);
+
+#endif // TIMVIEW_H
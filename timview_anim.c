@@ -0,0 +1,550 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "tim_defs.h"
+#include "timview.h"
+
+#include <SDL.h>
+
+// Frames decoded ahead of the one on screen. Enough to ride out a slow disk
+// read or two without holding a whole sequence in memory
+#define TIM_ANIM_RING_SIZE (8)
+#define TIM_ANIM_MAX_ZOOM (16)
+
+typedef struct _TIM_ANIM_FRAME
+{
+	R8G8B8A8* psPixels;
+	uint32_t ui32Width;
+	uint32_t ui32Height;
+	uint32_t ui32FileIndex;
+	// The file couldn't be read, the previous frame stays on screen
+	bool bFailed;
+} TIM_ANIM_FRAME;
+
+typedef struct _TIM_ANIM
+{
+	const TIM_VIEW_ARGS* psArgs;
+
+	// The files whose headers could be read, and the largest of them, which
+	// every ring slot and the texture are sized for
+	const char** ppszFileNames;
+	uint32_t ui32NumFiles;
+	uint32_t ui32MaxWidth;
+	uint32_t ui32MaxHeight;
+
+	SDL_Window* pWindow;
+	SDL_Renderer* pRenderer;
+	SDL_Texture* pTexture;
+	uint32_t ui32Zoom;
+	bool bWhiteBackground;
+
+	// The decoder thread fills slot ui32NumDecoded % TIM_ANIM_RING_SIZE, and
+	// the UI thread presents from slot ui32NumTaken % TIM_ANIM_RING_SIZE. A
+	// slot belongs to the decoder until it's been decoded, then to the UI
+	// until it's been taken, so the pixels themselves are never locked
+	TIM_ANIM_FRAME asRing[TIM_ANIM_RING_SIZE];
+	pthread_t sDecoderThread;
+	bool bDecoderStarted;
+	pthread_mutex_t sMutex;
+	pthread_cond_t sSpaceCond;
+	pthread_cond_t sDecodedCond;
+	uint32_t ui32NumDecoded;
+	uint32_t ui32NumTaken;
+	bool bQuit;
+
+	// Ticks that found the ring empty. Each is paid off by the decoder
+	// skipping a frame, so a slow decode costs frames rather than pushing
+	// the rest of the sequence back
+	uint32_t ui32NumOwed;
+
+	// The frame on screen, and how many were shown or missed their tick
+	TIM_ANIM_FRAME sShown;
+	uint32_t ui32NumShown;
+	uint32_t ui32NumDropped;
+} TIM_ANIM;
+
+// Maps a frame and decodes it into a ring slot, with the CLUT row asked for
+// on the command line if the file has it
+static void DecodeAnimFrame(TIM_ANIM* psAnim, const uint32_t ui32FileIndex, TIM_ANIM_FRAME* psFrame)
+{
+	const char* pszFileName = psAnim->ppszFileNames[ui32FileIndex];
+	TIM_MAPPING sMapping;
+	TIM_FILE sFile;
+
+	psFrame->ui32FileIndex = ui32FileIndex;
+	psFrame->bFailed = true;
+
+	if (MapTIM(pszFileName, false, &sMapping, &sFile) != 0)
+	{
+		return;
+	}
+
+	// The file may have grown since its header was probed
+	if ((ValidateTIM(&sFile) != 0) ||
+		(GetTIMPixelWidth(&sFile) > psAnim->ui32MaxWidth) ||
+		(sFile.sPixelHeader.ui16Height > psAnim->ui32MaxHeight))
+	{
+		printf("skipping frame %s\n", pszFileName);
+		UnmapTIM(&sMapping);
+		return;
+	}
+
+	psFrame->ui32Width = GetTIMPixelWidth(&sFile);
+	psFrame->ui32Height = sFile.sPixelHeader.ui16Height;
+	psFrame->bFailed = DecodeTIMPixelDataWithPalette(
+		&sFile,
+		(psAnim->psArgs->ui32PaletteIndex < sFile.sCLUTHeader.ui16Height) ? psAnim->psArgs->ui32PaletteIndex : 0,
+		psFrame->psPixels
+	) != 0;
+
+	UnmapTIM(&sMapping);
+}
+
+// Decodes the sequence in order, looping, as far ahead as the ring allows.
+// Frames owed to the UI are skipped without being decoded. The frame that
+// was being decoded when they fell due is still kept, as throwing it away
+// could leave a decoder slower than the frame rate nothing to show at all
+static void* AnimDecoderThread(void* pvAnim)
+{
+	TIM_ANIM* psAnim = pvAnim;
+	uint32_t ui32FileIndex = 0;
+
+	pthread_mutex_lock(&psAnim->sMutex);
+
+	for (;;)
+	{
+		TIM_ANIM_FRAME* psFrame;
+
+		while (!psAnim->bQuit && ((psAnim->ui32NumDecoded - psAnim->ui32NumTaken) == TIM_ANIM_RING_SIZE))
+		{
+			pthread_cond_wait(&psAnim->sSpaceCond, &psAnim->sMutex);
+		}
+
+		if (psAnim->bQuit)
+		{
+			break;
+		}
+
+		if (psAnim->ui32NumOwed > 0)
+		{
+			--psAnim->ui32NumOwed;
+			ui32FileIndex = (ui32FileIndex + 1) % psAnim->ui32NumFiles;
+			continue;
+		}
+
+		psFrame = &psAnim->asRing[psAnim->ui32NumDecoded % TIM_ANIM_RING_SIZE];
+		pthread_mutex_unlock(&psAnim->sMutex);
+
+		DecodeAnimFrame(psAnim, ui32FileIndex, psFrame);
+		ui32FileIndex = (ui32FileIndex + 1) % psAnim->ui32NumFiles;
+
+		pthread_mutex_lock(&psAnim->sMutex);
+		++psAnim->ui32NumDecoded;
+		pthread_cond_signal(&psAnim->sDecodedCond);
+	}
+
+	pthread_mutex_unlock(&psAnim->sMutex);
+
+	return NULL;
+}
+
+// Takes the next decoded frame off the ring, uploading it when it's to be
+// shown rather than skipped. Returns false if the decoder hasn't got to it,
+// in which case the frame is owed and the decoder will skip it
+static bool TakeAnimFrame(TIM_ANIM* psAnim, const bool bShow)
+{
+	TIM_ANIM_FRAME* psFrame;
+	uint32_t ui32NumReady;
+
+	pthread_mutex_lock(&psAnim->sMutex);
+	ui32NumReady = psAnim->ui32NumDecoded - psAnim->ui32NumTaken;
+	if (ui32NumReady == 0)
+	{
+		++psAnim->ui32NumOwed;
+	}
+	pthread_mutex_unlock(&psAnim->sMutex);
+
+	if (ui32NumReady == 0)
+	{
+		return false;
+	}
+
+	psFrame = &psAnim->asRing[psAnim->ui32NumTaken % TIM_ANIM_RING_SIZE];
+
+	if (bShow && !psFrame->bFailed)
+	{
+		const SDL_Rect sRect = { 0, 0, psFrame->ui32Width, psFrame->ui32Height };
+
+		SDL_UpdateTexture(psAnim->pTexture, &sRect, psFrame->psPixels, psFrame->ui32Width * sizeof(R8G8B8A8));
+
+		psAnim->sShown.ui32Width = psFrame->ui32Width;
+		psAnim->sShown.ui32Height = psFrame->ui32Height;
+		psAnim->sShown.ui32FileIndex = psFrame->ui32FileIndex;
+		psAnim->sShown.bFailed = false;
+	}
+
+	pthread_mutex_lock(&psAnim->sMutex);
+	++psAnim->ui32NumTaken;
+	pthread_cond_signal(&psAnim->sSpaceCond);
+	pthread_mutex_unlock(&psAnim->sMutex);
+
+	return bShow && !psFrame->bFailed;
+}
+
+// Draws the frame on screen centred in the window, sprites that are smaller
+// than the largest frame keeping their centre
+static void DrawAnim(const TIM_ANIM* psAnim)
+{
+	const uint8_t ui8Background = psAnim->bWhiteBackground ? 0xff : 0x00;
+	const int32_t i32Zoom = psAnim->ui32Zoom;
+	int iOutputWidth;
+	int iOutputHeight;
+	char szTitle[192];
+
+	SDL_GetRendererOutputSize(psAnim->pRenderer, &iOutputWidth, &iOutputHeight);
+
+	SDL_SetRenderDrawColor(psAnim->pRenderer, ui8Background, ui8Background, ui8Background, 0xff);
+	SDL_RenderClear(psAnim->pRenderer);
+
+	if (!psAnim->sShown.bFailed)
+	{
+		const SDL_Rect sSrcRect = { 0, 0, psAnim->sShown.ui32Width, psAnim->sShown.ui32Height };
+		const SDL_Rect sDstRect = {
+			(iOutputWidth - (sSrcRect.w * i32Zoom)) / 2,
+			(iOutputHeight - (sSrcRect.h * i32Zoom)) / 2,
+			sSrcRect.w * i32Zoom,
+			sSrcRect.h * i32Zoom
+		};
+
+		SDL_RenderCopy(psAnim->pRenderer, psAnim->pTexture, &sSrcRect, &sDstRect);
+	}
+
+	SDL_RenderPresent(psAnim->pRenderer);
+
+	snprintf(
+		szTitle,
+		sizeof(szTitle),
+		"timview - frame %u/%u - %u fps - %u shown, %u dropped",
+		psAnim->sShown.ui32FileIndex + 1,
+		psAnim->ui32NumFiles,
+		psAnim->psArgs->ui32FPS,
+		psAnim->ui32NumShown,
+		psAnim->ui32NumDropped
+	);
+	SDL_SetWindowTitle(psAnim->pWindow, szTitle);
+}
+
+// Only the headers are read up front, to size the ring and window for the
+// largest frame
+static int ProbeAnim(TIM_ANIM* psAnim)
+{
+	const TIM_VIEW_ARGS* psArgs = psAnim->psArgs;
+
+	psAnim->ppszFileNames = calloc(psArgs->ui32NumFiles, sizeof(char*));
+	if (psAnim->ppszFileNames == NULL)
+	{
+		printf("failed to allocate frame list\n");
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < psArgs->ui32NumFiles; ++i)
+	{
+		TIM_FILE sHeaders;
+		uint32_t ui32Width;
+
+		if ((ReadTIMHeaders(psArgs->ppszFileNames[i], &sHeaders) != 0) ||
+			!sHeaders.sFileHeader.sFlags.uClut)
+		{
+			printf("skipping frame %s\n", psArgs->ppszFileNames[i]);
+			continue;
+		}
+
+		ui32Width = GetTIMPixelWidth(&sHeaders);
+		psAnim->ui32MaxWidth = (ui32Width > psAnim->ui32MaxWidth) ? ui32Width : psAnim->ui32MaxWidth;
+		psAnim->ui32MaxHeight = (sHeaders.sPixelHeader.ui16Height > psAnim->ui32MaxHeight) ?
+			sHeaders.sPixelHeader.ui16Height : psAnim->ui32MaxHeight;
+
+		psAnim->ppszFileNames[psAnim->ui32NumFiles++] = psArgs->ppszFileNames[i];
+	}
+
+	if ((psAnim->ui32NumFiles == 0) || (psAnim->ui32MaxWidth == 0) || (psAnim->ui32MaxHeight == 0))
+	{
+		printf("no frames to play\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+static void DestroyAnim(TIM_ANIM* psAnim)
+{
+	if (psAnim->bDecoderStarted)
+	{
+		pthread_mutex_lock(&psAnim->sMutex);
+		psAnim->bQuit = true;
+		pthread_cond_signal(&psAnim->sSpaceCond);
+		pthread_mutex_unlock(&psAnim->sMutex);
+
+		pthread_join(psAnim->sDecoderThread, NULL);
+	}
+
+	for (uint32_t i = 0; i < TIM_ANIM_RING_SIZE; ++i)
+	{
+		free(psAnim->asRing[i].psPixels);
+	}
+
+	if (psAnim->pTexture != NULL)
+	{
+		SDL_DestroyTexture(psAnim->pTexture);
+	}
+
+	if (psAnim->pRenderer != NULL)
+	{
+		SDL_DestroyRenderer(psAnim->pRenderer);
+	}
+
+	if (psAnim->pWindow != NULL)
+	{
+		SDL_DestroyWindow(psAnim->pWindow);
+	}
+
+	pthread_cond_destroy(&psAnim->sSpaceCond);
+	pthread_cond_destroy(&psAnim->sDecodedCond);
+	pthread_mutex_destroy(&psAnim->sMutex);
+
+	free(psAnim->ppszFileNames);
+}
+
+int RenderAnimation(const TIM_VIEW_ARGS* psArgs)
+{
+	TIM_ANIM sAnim = {
+		.psArgs = psArgs,
+		.sShown.bFailed = true
+	};
+	uint64_t ui64Period;
+	uint64_t ui64NextTick;
+	int iResult = 1;
+
+	pthread_mutex_init(&sAnim.sMutex, NULL);
+	pthread_cond_init(&sAnim.sSpaceCond, NULL);
+	pthread_cond_init(&sAnim.sDecodedCond, NULL);
+
+	if (psArgs->ui32FPS == 0)
+	{
+		printf("the frame rate must be at least 1\n");
+		goto FAILED_RenderAnimation;
+	}
+
+	if (ProbeAnim(&sAnim) != 0)
+	{
+		goto FAILED_RenderAnimation;
+	}
+
+	for (uint32_t i = 0; i < TIM_ANIM_RING_SIZE; ++i)
+	{
+		sAnim.asRing[i].psPixels = malloc(sAnim.ui32MaxWidth * sAnim.ui32MaxHeight * sizeof(R8G8B8A8));
+		if (sAnim.asRing[i].psPixels == NULL)
+		{
+			printf("failed to allocate frame ring\n");
+			goto FAILED_RenderAnimation;
+		}
+	}
+
+	// The largest integer scale that fits the largest frame in 1024x768
+	sAnim.ui32Zoom = psArgs->ui32Zoom;
+	if (sAnim.ui32Zoom == 0)
+	{
+		const uint32_t ui32ZoomX = 1024 / sAnim.ui32MaxWidth;
+		const uint32_t ui32ZoomY = 768 / sAnim.ui32MaxHeight;
+
+		sAnim.ui32Zoom = (ui32ZoomX < ui32ZoomY) ? ui32ZoomX : ui32ZoomY;
+		sAnim.ui32Zoom = (sAnim.ui32Zoom > 0) ? sAnim.ui32Zoom : 1;
+	}
+	sAnim.ui32Zoom = (sAnim.ui32Zoom > TIM_ANIM_MAX_ZOOM) ? TIM_ANIM_MAX_ZOOM : sAnim.ui32Zoom;
+
+	sAnim.pWindow = SDL_CreateWindow(
+		"timview",
+		SDL_WINDOWPOS_UNDEFINED,
+		SDL_WINDOWPOS_UNDEFINED,
+		sAnim.ui32MaxWidth * sAnim.ui32Zoom,
+		sAnim.ui32MaxHeight * sAnim.ui32Zoom,
+		SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
+	);
+
+	if (sAnim.pWindow == NULL)
+	{
+		printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+		goto FAILED_RenderAnimation;
+	}
+
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+
+	sAnim.pRenderer = SDL_CreateRenderer(sAnim.pWindow, -1, SDL_RENDERER_ACCELERATED);
+	if (sAnim.pRenderer == NULL)
+	{
+		sAnim.pRenderer = SDL_CreateRenderer(sAnim.pWindow, -1, SDL_RENDERER_SOFTWARE);
+	}
+
+	if (sAnim.pRenderer == NULL)
+	{
+		printf("renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+		goto FAILED_RenderAnimation;
+	}
+
+	sAnim.pTexture = SDL_CreateTexture(
+		sAnim.pRenderer,
+		SDL_PIXELFORMAT_RGBA32,
+		SDL_TEXTUREACCESS_STREAMING,
+		sAnim.ui32MaxWidth,
+		sAnim.ui32MaxHeight
+	);
+
+	if (sAnim.pTexture == NULL)
+	{
+		printf("texture could not be created! SDL_Error: %s\n", SDL_GetError());
+		goto FAILED_RenderAnimation;
+	}
+
+	SDL_SetTextureBlendMode(sAnim.pTexture, SDL_BLENDMODE_BLEND);
+
+	if (pthread_create(&sAnim.sDecoderThread, NULL, AnimDecoderThread, &sAnim) != 0)
+	{
+		printf("failed to create frame decoder thread\n");
+		goto FAILED_RenderAnimation;
+	}
+	sAnim.bDecoderStarted = true;
+
+	// Let the decoder fill the ring before the clock starts, so playback
+	// begins with a full frame of slack
+	pthread_mutex_lock(&sAnim.sMutex);
+	while (sAnim.ui32NumDecoded < TIM_ANIM_RING_SIZE)
+	{
+		pthread_cond_wait(&sAnim.sDecodedCond, &sAnim.sMutex);
+	}
+	pthread_mutex_unlock(&sAnim.sMutex);
+
+	printf("playing %u frame(s) at %u fps\n", sAnim.ui32NumFiles, psArgs->ui32FPS);
+
+	ui64Period = SDL_GetPerformanceFrequency() / psArgs->ui32FPS;
+	ui64NextTick = SDL_GetPerformanceCounter();
+
+	{
+		SDL_Event sEvent;
+		bool bQuit = false;
+		bool bPaused = false;
+		bool bDirty = true;
+
+		while (!bQuit)
+		{
+			uint64_t ui64Now = SDL_GetPerformanceCounter();
+			bool bEvent;
+
+			// Frames are due on a fixed cadence. A tick whose frame isn't
+			// decoded yet is owed to the decoder, which skips that frame, and
+			// a tick missed because this thread was held up skips one off the
+			// ring. Either way the frame is dropped rather than shown late
+			if (!bPaused && (ui64Now >= ui64NextTick))
+			{
+				const uint64_t ui64NumTicks = 1 + ((ui64Now - ui64NextTick) / ui64Period);
+
+				ui64NextTick += ui64NumTicks * ui64Period;
+
+				for (uint64_t i = 1; i < ui64NumTicks; ++i)
+				{
+					TakeAnimFrame(&sAnim, false);
+					++sAnim.ui32NumDropped;
+				}
+
+				if (TakeAnimFrame(&sAnim, true))
+				{
+					++sAnim.ui32NumShown;
+				}
+				else
+				{
+					++sAnim.ui32NumDropped;
+				}
+
+				bDirty = true;
+			}
+
+			if (bDirty)
+			{
+				DrawAnim(&sAnim);
+				bDirty = false;
+			}
+
+			// Sleep until the next tick, or an event, whichever comes first
+			if (bPaused)
+			{
+				if (SDL_WaitEvent(&sEvent) == 0)
+				{
+					printf("failed waiting for events! SDL_Error: %s\n", SDL_GetError());
+					goto FAILED_RenderAnimation;
+				}
+
+				bEvent = true;
+			}
+			else
+			{
+				ui64Now = SDL_GetPerformanceCounter();
+				bEvent = SDL_WaitEventTimeout(
+					&sEvent,
+					(ui64Now < ui64NextTick) ? (int)(((ui64NextTick - ui64Now) * 1000) / SDL_GetPerformanceFrequency()) : 0
+				) != 0;
+			}
+
+			if (!bEvent)
+			{
+				continue;
+			}
+
+			do
+			{
+				if (sEvent.type == SDL_QUIT)
+				{
+					bQuit = true;
+				}
+
+				if (sEvent.type == SDL_WINDOWEVENT)
+				{
+					bDirty = true;
+				}
+
+				if (sEvent.type == SDL_KEYDOWN)
+				{
+					switch (sEvent.key.keysym.sym)
+					{
+						case SDLK_ESCAPE: bQuit = true; break;
+						case SDLK_b: sAnim.bWhiteBackground = !sAnim.bWhiteBackground; break;
+
+						// Resuming starts the cadence again from now, so the
+						// pause isn't counted as dropped frames
+						case SDLK_SPACE:
+						{
+							bPaused = !bPaused;
+							ui64NextTick = SDL_GetPerformanceCounter();
+							break;
+						}
+
+						default: break;
+					}
+
+					bDirty = true;
+				}
+			} while (SDL_PollEvent(&sEvent));
+		}
+	}
+
+	printf("showed %u frame(s), dropped %u\n", sAnim.ui32NumShown, sAnim.ui32NumDropped);
+
+	iResult = 0;
+
+FAILED_RenderAnimation:
+	DestroyAnim(&sAnim);
+
+	return iResult;
+}
@@ -0,0 +1,369 @@
+#include <stdio.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "tim_defs.h"
+#include "tim_thread_defs.h"
+#include "timview.h"
+
+typedef struct _TIM_EXPORT_JOBS
+{
+	const TIM_VIEW_ARGS* psArgs;
+
+	// Raw RGBA is written to stdout in argument order, rather than to PNGs,
+	// and messages go to stderr to keep it clean
+	bool bToStdout;
+	FILE* fLogFilePtr;
+	FILE* fPixelFilePtr;
+
+	atomic_uint ui32NumImages;
+	atomic_uint ui32NumFailed;
+
+	// Summed across every thread, so decode speed can be measured apart from
+	// the cost of writing PNGs
+	atomic_ullong ui64DecodeNanoseconds;
+
+	// The name of each file in the export directory, when there are several
+	char** ppszFileNames;
+} TIM_EXPORT_JOBS;
+
+// Several files are written into the export directory, named after their
+// inputs without the extension. Inputs whose names clash, such as a/x.tim and
+// b/x.tim, each get the first free _<N> suffix instead, so none of them is
+// overwritten by another
+static int CreateExportFileNames(TIM_EXPORT_JOBS* psJobs)
+{
+	const TIM_VIEW_ARGS* psArgs = psJobs->psArgs;
+	const uint32_t ui32NumFiles = psArgs->ui32NumFiles;
+	bool* pbClashes = calloc(ui32NumFiles, sizeof(bool));
+
+	psJobs->ppszFileNames = calloc(ui32NumFiles, sizeof(char*));
+	if ((pbClashes == NULL) || (psJobs->ppszFileNames == NULL))
+	{
+		printf("failed to allocate export file names\n");
+		goto FAILED_CreateExportFileNames;
+	}
+
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		const char* pszInputName = strrchr(psArgs->ppszFileNames[i], '/');
+		const char* pszExtension;
+		int iNameLength;
+
+		pszInputName = (pszInputName != NULL) ? (pszInputName + 1) : psArgs->ppszFileNames[i];
+		pszExtension = strrchr(pszInputName, '.');
+		iNameLength = (pszExtension != NULL) ? (int)(pszExtension - pszInputName) : (int)strlen(pszInputName);
+
+		// Room for a _<N> suffix, should the name clash
+		psJobs->ppszFileNames[i] = malloc(iNameLength + 12);
+		if (psJobs->ppszFileNames[i] == NULL)
+		{
+			printf("failed to allocate export file names\n");
+			goto FAILED_CreateExportFileNames;
+		}
+
+		snprintf(psJobs->ppszFileNames[i], iNameLength + 12, "%.*s", iNameLength, pszInputName);
+	}
+
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		for (uint32_t j = i + 1; j < ui32NumFiles; ++j)
+		{
+			if (strcmp(psJobs->ppszFileNames[i], psJobs->ppszFileNames[j]) == 0)
+			{
+				pbClashes[i] = true;
+				pbClashes[j] = true;
+			}
+		}
+	}
+
+	// A suffixed name is checked against every other name as it stands, so
+	// it can't land on a later input's own name, or on an earlier suffix
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		const size_t uNameLength = strlen(psJobs->ppszFileNames[i]);
+		bool bTaken = pbClashes[i];
+
+		for (uint32_t ui32Suffix = 1; bTaken; ++ui32Suffix)
+		{
+			snprintf(&psJobs->ppszFileNames[i][uNameLength], 12, "_%u", ui32Suffix);
+
+			bTaken = false;
+			for (uint32_t j = 0; (j < ui32NumFiles) && !bTaken; ++j)
+			{
+				bTaken = (j != i) && (strcmp(psJobs->ppszFileNames[i], psJobs->ppszFileNames[j]) == 0);
+			}
+		}
+	}
+
+	free(pbClashes);
+
+	return 0;
+
+FAILED_CreateExportFileNames:
+	free(pbClashes);
+	return 1;
+}
+
+static void DestroyExportFileNames(TIM_EXPORT_JOBS* psJobs)
+{
+	if (psJobs->ppszFileNames == NULL)
+	{
+		return;
+	}
+
+	for (uint32_t i = 0; i < psJobs->psArgs->ui32NumFiles; ++i)
+	{
+		free(psJobs->ppszFileNames[i]);
+	}
+
+	free(psJobs->ppszFileNames);
+	psJobs->ppszFileNames = NULL;
+}
+
+// A single file is written to the export name, and several are written into
+// it as a directory, under the names CreateExportFileNames picked. Each CLUT
+// row gets a _clut<N> suffix when exporting all of them
+static void GetExportFileName(
+	const TIM_EXPORT_JOBS* psJobs,
+	const uint32_t ui32File,
+	const int32_t i32PaletteIndex,
+	char* pszOutputFileName,
+	const size_t uSize)
+{
+	const TIM_VIEW_ARGS* psArgs = psJobs->psArgs;
+	const char* pszName = psArgs->pszExportFileName;
+
+	if (psArgs->ui32NumFiles == 1)
+	{
+		const char* pszExtension = strrchr(pszName, '.');
+		const int iNameLength = (
+			((pszExtension != NULL) && (strchr(pszExtension, '/') == NULL)) ?
+			(int)(pszExtension - pszName) :
+			(int)strlen(pszName)
+		);
+
+		snprintf(pszOutputFileName, uSize, "%.*s", iNameLength, pszName);
+	}
+	else
+	{
+		snprintf(pszOutputFileName, uSize, "%s/%s", pszName, psJobs->ppszFileNames[ui32File]);
+	}
+
+	if (i32PaletteIndex >= 0)
+	{
+		const size_t uLength = strlen(pszOutputFileName);
+		snprintf(&pszOutputFileName[uLength], uSize - uLength, "_clut%d", i32PaletteIndex);
+	}
+
+	strncat(pszOutputFileName, ".png", uSize - strlen(pszOutputFileName) - 1);
+}
+
+static void ExportTIMJob(void* pvUserData, const uint32_t ui32JobIndex)
+{
+	TIM_EXPORT_JOBS* psJobs = pvUserData;
+	const TIM_VIEW_ARGS* psArgs = psJobs->psArgs;
+	const char* pszInputFileName = psArgs->ppszFileNames[ui32JobIndex];
+
+	TIM_MAPPING sMapping;
+	TIM_FILE sFile;
+	R8G8B8A8* psPixels = NULL;
+	uint32_t ui32Width;
+	uint32_t ui32FirstPalette;
+	uint32_t ui32LastPalette;
+	char szOutputFileName[4096];
+
+	if (MapTIM(pszInputFileName, false, &sMapping, &sFile) != 0)
+	{
+		goto FAILED_ExportTIMJob;
+	}
+
+	if (ValidateTIM(&sFile) != 0)
+	{
+		fprintf(psJobs->fLogFilePtr, "skipping %s\n", pszInputFileName);
+		goto FAILED_ExportTIMJob;
+	}
+
+	ui32FirstPalette = psArgs->bAllCLUTs ? 0 : psArgs->ui32PaletteIndex;
+	ui32LastPalette = psArgs->bAllCLUTs ? (sFile.sCLUTHeader.ui16Height - 1) : psArgs->ui32PaletteIndex;
+
+	if (ui32LastPalette >= sFile.sCLUTHeader.ui16Height)
+	{
+		fprintf(
+			psJobs->fLogFilePtr,
+			"%s only has %hu CLUT(s), cannot export CLUT %u\n",
+			pszInputFileName,
+			sFile.sCLUTHeader.ui16Height,
+			ui32LastPalette
+		);
+		goto FAILED_ExportTIMJob;
+	}
+
+	ui32Width = GetTIMPixelWidth(&sFile);
+	psPixels = malloc(ui32Width * sFile.sPixelHeader.ui16Height * sizeof(R8G8B8A8));
+	if (psPixels == NULL)
+	{
+		fprintf(psJobs->fLogFilePtr, "failed to allocate pixels for %s\n", pszInputFileName);
+		goto FAILED_ExportTIMJob;
+	}
+
+	for (uint32_t i = ui32FirstPalette; i <= ui32LastPalette; ++i)
+	{
+		const uint32_t ui32NumPixels = ui32Width * sFile.sPixelHeader.ui16Height;
+		struct timespec sStart;
+
+		clock_gettime(CLOCK_MONOTONIC, &sStart);
+		if (DecodeTIMPixelDataWithPalette(&sFile, i, psPixels) != 0)
+		{
+			goto FAILED_ExportTIMJob;
+		}
+
+		atomic_fetch_add(&psJobs->ui64DecodeNanoseconds, GetElapsedNS(&sStart));
+
+		if (psJobs->bToStdout)
+		{
+			if (fwrite(psPixels, sizeof(R8G8B8A8), ui32NumPixels, psJobs->fPixelFilePtr) != ui32NumPixels)
+			{
+				fprintf(psJobs->fLogFilePtr, "failed to write %s to stdout\n", pszInputFileName);
+				goto FAILED_ExportTIMJob;
+			}
+		}
+		else
+		{
+			GetExportFileName(
+				psJobs,
+				ui32JobIndex,
+				psArgs->bAllCLUTs ? (int32_t)i : -1,
+				szOutputFileName,
+				sizeof(szOutputFileName)
+			);
+
+			if (WritePNG(szOutputFileName, psPixels, ui32Width, sFile.sPixelHeader.ui16Height) != 0)
+			{
+				goto FAILED_ExportTIMJob;
+			}
+		}
+
+		atomic_fetch_add(&psJobs->ui32NumImages, 1);
+	}
+
+	free(psPixels);
+	UnmapTIM(&sMapping);
+
+	return;
+
+FAILED_ExportTIMJob:
+	free(psPixels);
+	UnmapTIM(&sMapping);
+	atomic_fetch_add(&psJobs->ui32NumFailed, 1);
+}
+
+int ExportTIMs(const TIM_VIEW_ARGS* psArgs)
+{
+	TIM_EXPORT_JOBS sJobs = {
+		.psArgs = psArgs,
+		.bToStdout = (strcmp(psArgs->pszExportFileName, "-") == 0)
+	};
+	uint32_t ui32NumThreads = 1;
+	struct timespec sStart;
+
+	sJobs.fLogFilePtr = sJobs.bToStdout ? stderr : stdout;
+
+	atomic_init(&sJobs.ui32NumImages, 0);
+	atomic_init(&sJobs.ui32NumFailed, 0);
+	atomic_init(&sJobs.ui64DecodeNanoseconds, 0);
+
+	if (!sJobs.bToStdout && (psArgs->ui32NumFiles > 1) &&
+		(mkdir(psArgs->pszExportFileName, 0777) != 0) && (errno != EEXIST))
+	{
+		printf("could not create %s\n", psArgs->pszExportFileName);
+		return 1;
+	}
+
+	if (!sJobs.bToStdout && (psArgs->ui32NumFiles > 1) && (CreateExportFileNames(&sJobs) != 0))
+	{
+		DestroyExportFileNames(&sJobs);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &sStart);
+
+	if (sJobs.bToStdout)
+	{
+		// The library reports errors with printf, so the pixels are written
+		// to a copy of stdout, and stdout itself is pointed at stderr. Then
+		// nothing but pixels reaches the stream, whichever function fails
+		int iPixelFD;
+
+		fflush(stdout);
+		iPixelFD = dup(STDOUT_FILENO);
+		sJobs.fPixelFilePtr = (iPixelFD >= 0) ? fdopen(iPixelFD, "wb") : NULL;
+
+		if ((sJobs.fPixelFilePtr == NULL) || (dup2(STDERR_FILENO, STDOUT_FILENO) < 0))
+		{
+			fprintf(stderr, "could not redirect stdout\n");
+
+			if (sJobs.fPixelFilePtr != NULL)
+			{
+				fclose(sJobs.fPixelFilePtr);
+			}
+			else if (iPixelFD >= 0)
+			{
+				close(iPixelFD);
+			}
+
+			return 1;
+		}
+
+		// The images are concatenated in argument order, so they're exported
+		// one after another on this thread
+		for (uint32_t i = 0; i < psArgs->ui32NumFiles; ++i)
+		{
+			ExportTIMJob(&sJobs, i);
+			fflush(stdout);
+		}
+
+		if (fclose(sJobs.fPixelFilePtr) != 0)
+		{
+			fprintf(stderr, "failed to write to stdout\n");
+			atomic_fetch_add(&sJobs.ui32NumFailed, 1);
+		}
+	}
+	else
+	{
+		TIM_THREAD_POOL* psPool = CreateThreadPool(psArgs->ui32NumThreads);
+		if (psPool == NULL)
+		{
+			DestroyExportFileNames(&sJobs);
+			return 1;
+		}
+
+		RunThreadPoolJobs(psPool, ExportTIMJob, &sJobs, psArgs->ui32NumFiles);
+
+		ui32NumThreads = GetThreadPoolSize(psPool) + 1;
+		DestroyThreadPool(psPool);
+		DestroyExportFileNames(&sJobs);
+	}
+
+	fprintf(
+		sJobs.fLogFilePtr,
+		"exported %u TIM file(s) to %u image(s) in %.1f ms (%.1f ms decoding) on %u thread(s), %u failed\n",
+		psArgs->ui32NumFiles - atomic_load(&sJobs.ui32NumFailed),
+		atomic_load(&sJobs.ui32NumImages),
+		GetElapsedMS(&sStart),
+		atomic_load(&sJobs.ui64DecodeNanoseconds) / 1000000.0,
+		ui32NumThreads,
+		atomic_load(&sJobs.ui32NumFailed)
+	);
+
+	return (atomic_load(&sJobs.ui32NumFailed) == 0) ? 0 : 1;
+}
@@ -0,0 +1,915 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "tim_defs.h"
+#include "tim_thread_defs.h"
+#include "timview.h"
+
+#include <SDL.h>
+
+// Thumbnails are downsampled to fit a square this big, and drawn in cells
+// with a border around them
+#define TIM_GRID_THUMB_SIZE (128)
+#define TIM_GRID_CELL_SIZE (TIM_GRID_THUMB_SIZE + 8)
+#define TIM_GRID_SCROLL_STEP (TIM_GRID_CELL_SIZE / 2)
+
+typedef enum _TIM_GRID_CELL_STATE
+{
+	// No thumbnail, a loader can claim it
+	TIM_GRID_CELL_EMPTY,
+	// Claimed by the loader, which owns psThumbPixels
+	TIM_GRID_CELL_LOADING,
+	// Decoded, waiting for the UI thread to upload psThumbPixels
+	TIM_GRID_CELL_DECODED,
+	// Held as a texture in the cache
+	TIM_GRID_CELL_CACHED,
+	// The header or pixels couldn't be read
+	TIM_GRID_CELL_FAILED
+} TIM_GRID_CELL_STATE;
+
+typedef struct _TIM_GRID_CELL
+{
+	const char* pszFileName;
+	char* pszAllocatedFileName;
+
+	// Probed from the headers before anything is decoded, so the grid can be
+	// laid out up front
+	TIM_FILE sHeaders;
+	uint32_t ui32ThumbWidth;
+	uint32_t ui32ThumbHeight;
+
+	atomic_int eState;
+	R8G8B8A8* psThumbPixels;
+	SDL_Texture* pTexture;
+
+	// Links in the cache's LRU list, most recently drawn first
+	int32_t i32Newer;
+	int32_t i32Older;
+} TIM_GRID_CELL;
+
+typedef struct _TIM_GRID
+{
+	TIM_GRID_CELL* psCells;
+	uint32_t ui32NumCells;
+	uint32_t ui32Capacity;
+
+	SDL_Window* pWindow;
+	SDL_Renderer* pRenderer;
+	uint32_t ui32DecodedEventType;
+
+	TIM_THREAD_POOL* psPool;
+	pthread_t sLoaderThread;
+	bool bLoaderStarted;
+
+	// The cells the loader should fill, published by the UI thread. Cells
+	// that scroll out before a worker reaches them are skipped
+	pthread_mutex_t sMutex;
+	pthread_cond_t sRequestCond;
+	uint32_t ui32RequestGeneration;
+	bool bQuit;
+	atomic_uint ui32FirstWanted;
+	atomic_uint ui32EndWanted;
+
+	// The loader's current batch
+	uint32_t* pui32Batch;
+
+	// Byte-bounded LRU of the uploaded thumbnails
+	int32_t i32Newest;
+	int32_t i32Oldest;
+	size_t uCacheSizeInBytes;
+	size_t uCacheBudgetInBytes;
+
+	int32_t i32ScrollY;
+	int32_t i32Hovered;
+} TIM_GRID;
+
+typedef struct _TIM_GRID_BATCH
+{
+	TIM_GRID* psGrid;
+	uint32_t ui32NumCells;
+} TIM_GRID_BATCH;
+
+static int CompareGridCells(const void* pvA, const void* pvB)
+{
+	return strcmp(((const TIM_GRID_CELL*)pvA)->pszFileName, ((const TIM_GRID_CELL*)pvB)->pszFileName);
+}
+
+static int AddGridCell(TIM_GRID* psGrid, const char* pszFileName, char* pszAllocatedFileName)
+{
+	if (psGrid->ui32NumCells == psGrid->ui32Capacity)
+	{
+		const uint32_t ui32Capacity = (psGrid->ui32Capacity != 0) ? (psGrid->ui32Capacity * 2) : 256;
+		TIM_GRID_CELL* psCells = realloc(psGrid->psCells, ui32Capacity * sizeof(TIM_GRID_CELL));
+
+		if (psCells == NULL)
+		{
+			printf("failed to allocate grid cells\n");
+			free(pszAllocatedFileName);
+			return 1;
+		}
+
+		psGrid->psCells = psCells;
+		psGrid->ui32Capacity = ui32Capacity;
+	}
+
+	memset(&psGrid->psCells[psGrid->ui32NumCells], 0, sizeof(TIM_GRID_CELL));
+	psGrid->psCells[psGrid->ui32NumCells].pszFileName = pszFileName;
+	psGrid->psCells[psGrid->ui32NumCells].pszAllocatedFileName = pszAllocatedFileName;
+	++psGrid->ui32NumCells;
+
+	return 0;
+}
+
+// Files are taken as given, and directories contribute their .tim files in
+// name order
+static int CollectGridCells(const TIM_VIEW_ARGS* psArgs, TIM_GRID* psGrid)
+{
+	for (uint32_t i = 0; i < psArgs->ui32NumFiles; ++i)
+	{
+		const char* pszInput = psArgs->ppszFileNames[i];
+		const uint32_t ui32FirstCell = psGrid->ui32NumCells;
+		struct stat sStat;
+		struct dirent* psEntry;
+		DIR* psDir;
+
+		if (stat(pszInput, &sStat) != 0)
+		{
+			printf("could not find %s\n", pszInput);
+			return 1;
+		}
+
+		if (!S_ISDIR(sStat.st_mode))
+		{
+			if (AddGridCell(psGrid, pszInput, NULL) != 0)
+			{
+				return 1;
+			}
+			continue;
+		}
+
+		psDir = opendir(pszInput);
+		if (psDir == NULL)
+		{
+			printf("could not open %s\n", pszInput);
+			return 1;
+		}
+
+		while ((psEntry = readdir(psDir)) != NULL)
+		{
+			const size_t uSize = strlen(pszInput) + strlen(psEntry->d_name) + 2;
+			char* pszFileName;
+
+			if (!HasTIMExtension(psEntry->d_name))
+			{
+				continue;
+			}
+
+			pszFileName = malloc(uSize);
+			if (pszFileName == NULL)
+			{
+				printf("failed to allocate file name\n");
+				closedir(psDir);
+				return 1;
+			}
+
+			snprintf(pszFileName, uSize, "%s/%s", pszInput, psEntry->d_name);
+
+			if (AddGridCell(psGrid, pszFileName, pszFileName) != 0)
+			{
+				closedir(psDir);
+				return 1;
+			}
+		}
+
+		closedir(psDir);
+
+		qsort(
+			&psGrid->psCells[ui32FirstCell],
+			psGrid->ui32NumCells - ui32FirstCell,
+			sizeof(TIM_GRID_CELL),
+			CompareGridCells
+		);
+	}
+
+	return 0;
+}
+
+static void ProbeGridCellJob(void* pvUserData, const uint32_t ui32JobIndex)
+{
+	TIM_GRID* psGrid = pvUserData;
+	TIM_GRID_CELL* psCell = &psGrid->psCells[ui32JobIndex];
+	uint32_t ui32Width;
+	uint32_t ui32Height;
+
+	if ((ReadTIMHeaders(psCell->pszFileName, &psCell->sHeaders) != 0) ||
+		!TIM_PIX_FMT_HAS_CLUT(psCell->sHeaders.sFileHeader.sFlags.uMode) ||
+		!psCell->sHeaders.sFileHeader.sFlags.uClut ||
+		(psCell->sHeaders.sCLUTHeader.ui16Height == 0) ||
+		(psCell->sHeaders.sPixelHeader.ui16Width == 0) ||
+		(psCell->sHeaders.sPixelHeader.ui16Height == 0))
+	{
+		atomic_init(&psCell->eState, TIM_GRID_CELL_FAILED);
+		psCell->ui32ThumbWidth = TIM_GRID_THUMB_SIZE;
+		psCell->ui32ThumbHeight = TIM_GRID_THUMB_SIZE;
+		return;
+	}
+
+	atomic_init(&psCell->eState, TIM_GRID_CELL_EMPTY);
+
+	// Fit within the thumbnail keeping the aspect ratio, without upscaling
+	ui32Width = GetTIMPixelWidth(&psCell->sHeaders);
+	ui32Height = psCell->sHeaders.sPixelHeader.ui16Height;
+
+	if ((ui32Width <= TIM_GRID_THUMB_SIZE) && (ui32Height <= TIM_GRID_THUMB_SIZE))
+	{
+		psCell->ui32ThumbWidth = ui32Width;
+		psCell->ui32ThumbHeight = ui32Height;
+	}
+	else if (ui32Width >= ui32Height)
+	{
+		psCell->ui32ThumbWidth = TIM_GRID_THUMB_SIZE;
+		psCell->ui32ThumbHeight = (ui32Height * TIM_GRID_THUMB_SIZE) / ui32Width;
+	}
+	else
+	{
+		psCell->ui32ThumbWidth = (ui32Width * TIM_GRID_THUMB_SIZE) / ui32Height;
+		psCell->ui32ThumbHeight = TIM_GRID_THUMB_SIZE;
+	}
+
+	psCell->ui32ThumbWidth = (psCell->ui32ThumbWidth != 0) ? psCell->ui32ThumbWidth : 1;
+	psCell->ui32ThumbHeight = (psCell->ui32ThumbHeight != 0) ? psCell->ui32ThumbHeight : 1;
+}
+
+// Box filters the decoded texture down to the thumbnail, averaging every
+// source pixel that each thumbnail pixel covers
+static void DownsampleThumbnail(
+	const R8G8B8A8* psSrc,
+	const uint32_t ui32SrcWidth,
+	const uint32_t ui32SrcHeight,
+	R8G8B8A8* psDst,
+	const uint32_t ui32DstWidth,
+	const uint32_t ui32DstHeight)
+{
+	for (uint32_t y = 0; y < ui32DstHeight; ++y)
+	{
+		const uint32_t ui32Top = (y * ui32SrcHeight) / ui32DstHeight;
+		const uint32_t ui32Bottom = (((y + 1) * ui32SrcHeight) / ui32DstHeight);
+
+		for (uint32_t x = 0; x < ui32DstWidth; ++x)
+		{
+			const uint32_t ui32Left = (x * ui32SrcWidth) / ui32DstWidth;
+			const uint32_t ui32Right = (((x + 1) * ui32SrcWidth) / ui32DstWidth);
+			uint32_t aui32Sums[4] = { 0 };
+			uint32_t ui32NumPixels = 0;
+
+			for (uint32_t sy = ui32Top; sy < ui32Bottom; ++sy)
+			{
+				for (uint32_t sx = ui32Left; sx < ui32Right; ++sx)
+				{
+					const R8G8B8A8* psPixel = &psSrc[(sy * ui32SrcWidth) + sx];
+
+					aui32Sums[0] += psPixel->uRed;
+					aui32Sums[1] += psPixel->uGreen;
+					aui32Sums[2] += psPixel->uBlue;
+					aui32Sums[3] += psPixel->uAlpha;
+					++ui32NumPixels;
+				}
+			}
+
+			psDst[(y * ui32DstWidth) + x].uRed = aui32Sums[0] / ui32NumPixels;
+			psDst[(y * ui32DstWidth) + x].uGreen = aui32Sums[1] / ui32NumPixels;
+			psDst[(y * ui32DstWidth) + x].uBlue = aui32Sums[2] / ui32NumPixels;
+			psDst[(y * ui32DstWidth) + x].uAlpha = aui32Sums[3] / ui32NumPixels;
+		}
+	}
+}
+
+static void DecodeGridCellJob(void* pvUserData, const uint32_t ui32JobIndex)
+{
+	TIM_GRID_BATCH* psBatch = pvUserData;
+	TIM_GRID* psGrid = psBatch->psGrid;
+	const uint32_t ui32Cell = psGrid->pui32Batch[ui32JobIndex];
+	TIM_GRID_CELL* psCell = &psGrid->psCells[ui32Cell];
+	TIM_MAPPING sMapping;
+	TIM_FILE sFile;
+	R8G8B8A8* psPixels = NULL;
+	R8G8B8A8* psThumbPixels = NULL;
+	uint32_t ui32Width;
+
+	// Scrolled away since the batch was made, leave it for another time
+	if ((ui32Cell < atomic_load(&psGrid->ui32FirstWanted)) ||
+		(ui32Cell >= atomic_load(&psGrid->ui32EndWanted)))
+	{
+		atomic_store(&psCell->eState, TIM_GRID_CELL_EMPTY);
+		return;
+	}
+
+	if (MapTIM(psCell->pszFileName, false, &sMapping, &sFile) != 0)
+	{
+		atomic_store(&psCell->eState, TIM_GRID_CELL_FAILED);
+		return;
+	}
+
+	if (ValidateTIM(&sFile) != 0)
+	{
+		goto FAILED_DecodeGridCellJob;
+	}
+
+	ui32Width = GetTIMPixelWidth(&sFile);
+	psPixels = malloc(ui32Width * sFile.sPixelHeader.ui16Height * sizeof(R8G8B8A8));
+	psThumbPixels = malloc(psCell->ui32ThumbWidth * psCell->ui32ThumbHeight * sizeof(R8G8B8A8));
+	if ((psPixels == NULL) || (psThumbPixels == NULL))
+	{
+		printf("failed to allocate thumbnail for %s\n", psCell->pszFileName);
+		goto FAILED_DecodeGridCellJob;
+	}
+
+	if (DecodeTIMPixelDataWithPalette(&sFile, 0, psPixels) != 0)
+	{
+		goto FAILED_DecodeGridCellJob;
+	}
+
+	DownsampleThumbnail(
+		psPixels,
+		ui32Width,
+		sFile.sPixelHeader.ui16Height,
+		psThumbPixels,
+		psCell->ui32ThumbWidth,
+		psCell->ui32ThumbHeight
+	);
+
+	free(psPixels);
+	UnmapTIM(&sMapping);
+
+	psCell->psThumbPixels = psThumbPixels;
+	atomic_store(&psCell->eState, TIM_GRID_CELL_DECODED);
+
+	return;
+
+FAILED_DecodeGridCellJob:
+	free(psThumbPixels);
+	free(psPixels);
+	UnmapTIM(&sMapping);
+	atomic_store(&psCell->eState, TIM_GRID_CELL_FAILED);
+}
+
+// Waits for the UI to publish a new set of wanted cells, claims the empty
+// ones and decodes them on the pool, then wakes the UI to upload them. The
+// UI thread never waits on this, so scrolling never blocks on file I/O
+static void* GridLoaderThread(void* pvGrid)
+{
+	TIM_GRID* psGrid = pvGrid;
+	uint32_t ui32Generation = 0;
+
+	pthread_mutex_lock(&psGrid->sMutex);
+
+	for (;;)
+	{
+		TIM_GRID_BATCH sBatch = { .psGrid = psGrid };
+		uint32_t ui32First;
+		uint32_t ui32End;
+
+		while (!psGrid->bQuit && (psGrid->ui32RequestGeneration == ui32Generation))
+		{
+			pthread_cond_wait(&psGrid->sRequestCond, &psGrid->sMutex);
+		}
+
+		if (psGrid->bQuit)
+		{
+			break;
+		}
+
+		ui32Generation = psGrid->ui32RequestGeneration;
+		ui32First = atomic_load(&psGrid->ui32FirstWanted);
+		ui32End = atomic_load(&psGrid->ui32EndWanted);
+		pthread_mutex_unlock(&psGrid->sMutex);
+
+		for (uint32_t i = ui32First; i < ui32End; ++i)
+		{
+			int eExpected = TIM_GRID_CELL_EMPTY;
+
+			if (atomic_compare_exchange_strong(&psGrid->psCells[i].eState, &eExpected, TIM_GRID_CELL_LOADING))
+			{
+				psGrid->pui32Batch[sBatch.ui32NumCells++] = i;
+			}
+		}
+
+		if (sBatch.ui32NumCells > 0)
+		{
+			SDL_Event sEvent = { 0 };
+
+			RunThreadPoolJobs(psGrid->psPool, DecodeGridCellJob, &sBatch, sBatch.ui32NumCells);
+
+			sEvent.type = psGrid->ui32DecodedEventType;
+			SDL_PushEvent(&sEvent);
+		}
+
+		pthread_mutex_lock(&psGrid->sMutex);
+	}
+
+	pthread_mutex_unlock(&psGrid->sMutex);
+
+	return NULL;
+}
+
+static void UnlinkGridCell(TIM_GRID* psGrid, const int32_t i32Cell)
+{
+	TIM_GRID_CELL* psCell = &psGrid->psCells[i32Cell];
+
+	if (psCell->i32Newer >= 0) { psGrid->psCells[psCell->i32Newer].i32Older = psCell->i32Older; }
+	else { psGrid->i32Newest = psCell->i32Older; }
+
+	if (psCell->i32Older >= 0) { psGrid->psCells[psCell->i32Older].i32Newer = psCell->i32Newer; }
+	else { psGrid->i32Oldest = psCell->i32Newer; }
+
+	psCell->i32Newer = -1;
+	psCell->i32Older = -1;
+}
+
+static void LinkGridCell(TIM_GRID* psGrid, const int32_t i32Cell)
+{
+	TIM_GRID_CELL* psCell = &psGrid->psCells[i32Cell];
+
+	psCell->i32Newer = -1;
+	psCell->i32Older = psGrid->i32Newest;
+
+	if (psGrid->i32Newest >= 0) { psGrid->psCells[psGrid->i32Newest].i32Newer = i32Cell; }
+	else { psGrid->i32Oldest = i32Cell; }
+
+	psGrid->i32Newest = i32Cell;
+}
+
+// Moves a cached cell to the front of the LRU
+static void TouchGridCell(TIM_GRID* psGrid, const int32_t i32Cell)
+{
+	if (psGrid->i32Newest != i32Cell)
+	{
+		UnlinkGridCell(psGrid, i32Cell);
+		LinkGridCell(psGrid, i32Cell);
+	}
+}
+
+// Drops the least recently drawn thumbnails until the cache fits its budget,
+// skipping over any that are currently wanted rather than stopping at them
+static void TrimGridCache(TIM_GRID* psGrid)
+{
+	const uint32_t ui32First = atomic_load(&psGrid->ui32FirstWanted);
+	const uint32_t ui32End = atomic_load(&psGrid->ui32EndWanted);
+	int32_t i32Cell = psGrid->i32Oldest;
+
+	while ((psGrid->uCacheSizeInBytes > psGrid->uCacheBudgetInBytes) && (i32Cell >= 0))
+	{
+		TIM_GRID_CELL* psCell = &psGrid->psCells[i32Cell];
+		const int32_t i32Newer = psCell->i32Newer;
+
+		if (((uint32_t)i32Cell < ui32First) || ((uint32_t)i32Cell >= ui32End))
+		{
+			UnlinkGridCell(psGrid, i32Cell);
+			SDL_DestroyTexture(psCell->pTexture);
+			psCell->pTexture = NULL;
+			psGrid->uCacheSizeInBytes -= psCell->ui32ThumbWidth * psCell->ui32ThumbHeight * sizeof(R8G8B8A8);
+			atomic_store(&psCell->eState, TIM_GRID_CELL_EMPTY);
+		}
+
+		i32Cell = i32Newer;
+	}
+}
+
+// Uploads any thumbnails the loader has finished into the cache
+static void UploadGridCells(TIM_GRID* psGrid)
+{
+	for (uint32_t i = 0; i < psGrid->ui32NumCells; ++i)
+	{
+		TIM_GRID_CELL* psCell = &psGrid->psCells[i];
+
+		if (atomic_load(&psCell->eState) != TIM_GRID_CELL_DECODED)
+		{
+			continue;
+		}
+
+		psCell->pTexture = SDL_CreateTexture(
+			psGrid->pRenderer,
+			SDL_PIXELFORMAT_RGBA32,
+			SDL_TEXTUREACCESS_STATIC,
+			psCell->ui32ThumbWidth,
+			psCell->ui32ThumbHeight
+		);
+
+		if (psCell->pTexture == NULL)
+		{
+			printf("texture could not be created! SDL_Error: %s\n", SDL_GetError());
+			atomic_store(&psCell->eState, TIM_GRID_CELL_FAILED);
+		}
+		else
+		{
+			SDL_UpdateTexture(psCell->pTexture, NULL, psCell->psThumbPixels, psCell->ui32ThumbWidth * sizeof(R8G8B8A8));
+			SDL_SetTextureBlendMode(psCell->pTexture, SDL_BLENDMODE_BLEND);
+
+			psGrid->uCacheSizeInBytes += psCell->ui32ThumbWidth * psCell->ui32ThumbHeight * sizeof(R8G8B8A8);
+			LinkGridCell(psGrid, i);
+			atomic_store(&psCell->eState, TIM_GRID_CELL_CACHED);
+		}
+
+		free(psCell->psThumbPixels);
+		psCell->psThumbPixels = NULL;
+	}
+
+	TrimGridCache(psGrid);
+}
+
+static uint32_t GetGridColumns(const int iWidth)
+{
+	return (iWidth >= TIM_GRID_CELL_SIZE) ? (uint32_t)(iWidth / TIM_GRID_CELL_SIZE) : 1;
+}
+
+// Clamps the scroll and asks the loader for the visible rows, plus a row
+// either side so short scrolls find their thumbnails ready
+static void UpdateGridWanted(TIM_GRID* psGrid)
+{
+	int iWidth;
+	int iHeight;
+	uint32_t ui32Columns;
+	uint32_t ui32NumRows;
+	int32_t i32MaxScroll;
+	uint32_t ui32FirstRow;
+	uint32_t ui32EndRow;
+
+	SDL_GetRendererOutputSize(psGrid->pRenderer, &iWidth, &iHeight);
+	ui32Columns = GetGridColumns(iWidth);
+	ui32NumRows = (psGrid->ui32NumCells + ui32Columns - 1) / ui32Columns;
+
+	i32MaxScroll = (int32_t)(ui32NumRows * TIM_GRID_CELL_SIZE) - iHeight;
+	psGrid->i32ScrollY = (psGrid->i32ScrollY > i32MaxScroll) ? i32MaxScroll : psGrid->i32ScrollY;
+	psGrid->i32ScrollY = (psGrid->i32ScrollY < 0) ? 0 : psGrid->i32ScrollY;
+
+	ui32FirstRow = psGrid->i32ScrollY / TIM_GRID_CELL_SIZE;
+	ui32FirstRow = (ui32FirstRow > 0) ? (ui32FirstRow - 1) : 0;
+	ui32EndRow = ((psGrid->i32ScrollY + iHeight + TIM_GRID_CELL_SIZE - 1) / TIM_GRID_CELL_SIZE) + 1;
+
+	pthread_mutex_lock(&psGrid->sMutex);
+	atomic_store(&psGrid->ui32FirstWanted, ui32FirstRow * ui32Columns);
+	atomic_store(
+		&psGrid->ui32EndWanted,
+		((ui32EndRow * ui32Columns) < psGrid->ui32NumCells) ? (ui32EndRow * ui32Columns) : psGrid->ui32NumCells
+	);
+	++psGrid->ui32RequestGeneration;
+	pthread_cond_signal(&psGrid->sRequestCond);
+	pthread_mutex_unlock(&psGrid->sMutex);
+}
+
+// Finds the cell under a window coordinate, or -1
+static int32_t FindGridCell(const TIM_GRID* psGrid, const int32_t i32X, const int32_t i32Y)
+{
+	int iWidth;
+	int iHeight;
+	uint32_t ui32Columns;
+	uint32_t ui32Cell;
+
+	SDL_GetRendererOutputSize(psGrid->pRenderer, &iWidth, &iHeight);
+	ui32Columns = GetGridColumns(iWidth);
+
+	if ((i32X < 0) || (i32Y < 0) || ((uint32_t)(i32X / TIM_GRID_CELL_SIZE) >= ui32Columns))
+	{
+		return -1;
+	}
+
+	ui32Cell = (((i32Y + psGrid->i32ScrollY) / TIM_GRID_CELL_SIZE) * ui32Columns) + (i32X / TIM_GRID_CELL_SIZE);
+
+	return (ui32Cell < psGrid->ui32NumCells) ? (int32_t)ui32Cell : -1;
+}
+
+static void DrawGrid(TIM_GRID* psGrid)
+{
+	const uint32_t ui32First = atomic_load(&psGrid->ui32FirstWanted);
+	const uint32_t ui32End = atomic_load(&psGrid->ui32EndWanted);
+	int iWidth;
+	int iHeight;
+	uint32_t ui32Columns;
+
+	SDL_GetRendererOutputSize(psGrid->pRenderer, &iWidth, &iHeight);
+	ui32Columns = GetGridColumns(iWidth);
+
+	SDL_SetRenderDrawColor(psGrid->pRenderer, 0x20, 0x20, 0x20, 0xff);
+	SDL_RenderClear(psGrid->pRenderer);
+
+	for (uint32_t i = ui32First; i < ui32End; ++i)
+	{
+		TIM_GRID_CELL* psCell = &psGrid->psCells[i];
+		const int iCellX = (i % ui32Columns) * TIM_GRID_CELL_SIZE;
+		const int iCellY = ((i / ui32Columns) * TIM_GRID_CELL_SIZE) - psGrid->i32ScrollY;
+		const SDL_Rect sThumbRect = {
+			iCellX + ((TIM_GRID_CELL_SIZE - (int)psCell->ui32ThumbWidth) / 2),
+			iCellY + ((TIM_GRID_CELL_SIZE - (int)psCell->ui32ThumbHeight) / 2),
+			(int)psCell->ui32ThumbWidth,
+			(int)psCell->ui32ThumbHeight
+		};
+
+		if (((iCellY + TIM_GRID_CELL_SIZE) <= 0) || (iCellY >= iHeight))
+		{
+			continue;
+		}
+
+		if ((int32_t)i == psGrid->i32Hovered)
+		{
+			const SDL_Rect sCellRect = { iCellX, iCellY, TIM_GRID_CELL_SIZE, TIM_GRID_CELL_SIZE };
+
+			SDL_SetRenderDrawColor(psGrid->pRenderer, 0x50, 0x50, 0x50, 0xff);
+			SDL_RenderFillRect(psGrid->pRenderer, &sCellRect);
+		}
+
+		// Cells still loading show their probed size as a placeholder
+		switch (atomic_load(&psCell->eState))
+		{
+			case TIM_GRID_CELL_CACHED:
+			{
+				SDL_RenderCopy(psGrid->pRenderer, psCell->pTexture, NULL, &sThumbRect);
+				TouchGridCell(psGrid, i);
+				break;
+			}
+
+			case TIM_GRID_CELL_FAILED:
+			{
+				SDL_SetRenderDrawColor(psGrid->pRenderer, 0xc0, 0x30, 0x30, 0xff);
+				SDL_RenderDrawRect(psGrid->pRenderer, &sThumbRect);
+				break;
+			}
+
+			default:
+			{
+				SDL_SetRenderDrawColor(psGrid->pRenderer, 0x38, 0x38, 0x38, 0xff);
+				SDL_RenderFillRect(psGrid->pRenderer, &sThumbRect);
+				break;
+			}
+		}
+	}
+
+	SDL_RenderPresent(psGrid->pRenderer);
+}
+
+static void SetGridTitle(const TIM_GRID* psGrid)
+{
+	char szTitle[512];
+
+	if (psGrid->i32Hovered >= 0)
+	{
+		const TIM_GRID_CELL* psCell = &psGrid->psCells[psGrid->i32Hovered];
+
+		if (atomic_load(&psCell->eState) == TIM_GRID_CELL_FAILED)
+		{
+			snprintf(szTitle, sizeof(szTitle), "timview - %s (unreadable)", psCell->pszFileName);
+		}
+		else
+		{
+			snprintf(
+				szTitle,
+				sizeof(szTitle),
+				"timview - %s (%u * %hu, %s, %hu CLUT(s))",
+				psCell->pszFileName,
+				GetTIMPixelWidth(&psCell->sHeaders),
+				psCell->sHeaders.sPixelHeader.ui16Height,
+				(psCell->sHeaders.sFileHeader.sFlags.uMode == TIM_PIX_FMT_4BIT_CLUT) ? "4bpp" : "8bpp",
+				psCell->sHeaders.sCLUTHeader.ui16Height
+			);
+		}
+	}
+	else
+	{
+		snprintf(
+			szTitle,
+			sizeof(szTitle),
+			"timview - %u file(s), %zu/%zu KB of thumbnails cached",
+			psGrid->ui32NumCells,
+			psGrid->uCacheSizeInBytes / 1024,
+			psGrid->uCacheBudgetInBytes / 1024
+		);
+	}
+
+	SDL_SetWindowTitle(psGrid->pWindow, szTitle);
+}
+
+static void DestroyGrid(TIM_GRID* psGrid)
+{
+	if (psGrid->bLoaderStarted)
+	{
+		pthread_mutex_lock(&psGrid->sMutex);
+		psGrid->bQuit = true;
+		pthread_cond_signal(&psGrid->sRequestCond);
+		pthread_mutex_unlock(&psGrid->sMutex);
+
+		pthread_join(psGrid->sLoaderThread, NULL);
+	}
+
+	DestroyThreadPool(psGrid->psPool);
+
+	for (uint32_t i = 0; i < psGrid->ui32NumCells; ++i)
+	{
+		if (psGrid->psCells[i].pTexture != NULL)
+		{
+			SDL_DestroyTexture(psGrid->psCells[i].pTexture);
+		}
+
+		free(psGrid->psCells[i].psThumbPixels);
+		free(psGrid->psCells[i].pszAllocatedFileName);
+	}
+
+	if (psGrid->pRenderer != NULL)
+	{
+		SDL_DestroyRenderer(psGrid->pRenderer);
+	}
+
+	if (psGrid->pWindow != NULL)
+	{
+		SDL_DestroyWindow(psGrid->pWindow);
+	}
+
+	pthread_cond_destroy(&psGrid->sRequestCond);
+	pthread_mutex_destroy(&psGrid->sMutex);
+
+	free(psGrid->pui32Batch);
+	free(psGrid->psCells);
+}
+
+int RenderGrid(const TIM_VIEW_ARGS* psArgs)
+{
+	TIM_GRID sGrid = {
+		.i32Newest = -1,
+		.i32Oldest = -1,
+		.uCacheBudgetInBytes = (size_t)psArgs->ui32CacheSizeInMB * 1024 * 1024,
+		.i32Hovered = -1
+	};
+	int iResult = 1;
+
+	pthread_mutex_init(&sGrid.sMutex, NULL);
+	pthread_cond_init(&sGrid.sRequestCond, NULL);
+	atomic_init(&sGrid.ui32FirstWanted, 0);
+	atomic_init(&sGrid.ui32EndWanted, 0);
+
+	if (CollectGridCells(psArgs, &sGrid) != 0)
+	{
+		goto FAILED_RenderGrid;
+	}
+
+	if (sGrid.ui32NumCells == 0)
+	{
+		printf("no TIM files to show\n");
+		goto FAILED_RenderGrid;
+	}
+
+	for (uint32_t i = 0; i < sGrid.ui32NumCells; ++i)
+	{
+		sGrid.psCells[i].i32Newer = -1;
+		sGrid.psCells[i].i32Older = -1;
+	}
+
+	sGrid.pui32Batch = malloc(sGrid.ui32NumCells * sizeof(uint32_t));
+	sGrid.psPool = CreateThreadPool(psArgs->ui32NumThreads);
+	if ((sGrid.pui32Batch == NULL) || (sGrid.psPool == NULL))
+	{
+		printf("failed to create grid loader\n");
+		goto FAILED_RenderGrid;
+	}
+
+	// Only the headers are read up front, so the layout is known before any
+	// pixels are
+	RunThreadPoolJobs(sGrid.psPool, ProbeGridCellJob, &sGrid, sGrid.ui32NumCells);
+	printf("probed %u TIM file(s)\n", sGrid.ui32NumCells);
+
+	sGrid.ui32DecodedEventType = SDL_RegisterEvents(1);
+	if (sGrid.ui32DecodedEventType == (uint32_t)-1)
+	{
+		printf("could not register grid events! SDL_Error: %s\n", SDL_GetError());
+		goto FAILED_RenderGrid;
+	}
+
+	sGrid.pWindow = SDL_CreateWindow(
+		"timview",
+		SDL_WINDOWPOS_UNDEFINED,
+		SDL_WINDOWPOS_UNDEFINED,
+		TIM_GRID_CELL_SIZE * 7,
+		TIM_GRID_CELL_SIZE * 5,
+		SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
+	);
+
+	if (sGrid.pWindow == NULL)
+	{
+		printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+		goto FAILED_RenderGrid;
+	}
+
+	sGrid.pRenderer = SDL_CreateRenderer(sGrid.pWindow, -1, SDL_RENDERER_ACCELERATED);
+	if (sGrid.pRenderer == NULL)
+	{
+		sGrid.pRenderer = SDL_CreateRenderer(sGrid.pWindow, -1, SDL_RENDERER_SOFTWARE);
+	}
+
+	if (sGrid.pRenderer == NULL)
+	{
+		printf("renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+		goto FAILED_RenderGrid;
+	}
+
+	if (pthread_create(&sGrid.sLoaderThread, NULL, GridLoaderThread, &sGrid) != 0)
+	{
+		printf("failed to create grid loader thread\n");
+		goto FAILED_RenderGrid;
+	}
+	sGrid.bLoaderStarted = true;
+
+	UpdateGridWanted(&sGrid);
+
+	{
+		SDL_Event sEvent;
+		bool bQuit = false;
+		bool bDirty = true;
+
+		while (!bQuit)
+		{
+			if (bDirty)
+			{
+				DrawGrid(&sGrid);
+				SetGridTitle(&sGrid);
+				bDirty = false;
+			}
+
+			if (SDL_WaitEvent(&sEvent) == 0)
+			{
+				printf("failed waiting for events! SDL_Error: %s\n", SDL_GetError());
+				goto FAILED_RenderGrid;
+			}
+
+			do
+			{
+				const int32_t i32ScrollY = sGrid.i32ScrollY;
+
+				if (sEvent.type == SDL_QUIT)
+				{
+					bQuit = true;
+				}
+				else if (sEvent.type == sGrid.ui32DecodedEventType)
+				{
+					UploadGridCells(&sGrid);
+					bDirty = true;
+				}
+				else if (sEvent.type == SDL_WINDOWEVENT)
+				{
+					if (sEvent.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+					{
+						UpdateGridWanted(&sGrid);
+					}
+					bDirty = true;
+				}
+				else if (sEvent.type == SDL_MOUSEWHEEL)
+				{
+					sGrid.i32ScrollY -= sEvent.wheel.y * TIM_GRID_SCROLL_STEP;
+				}
+				else if (sEvent.type == SDL_MOUSEMOTION)
+				{
+					const int32_t i32Hovered = FindGridCell(&sGrid, sEvent.motion.x, sEvent.motion.y);
+
+					bDirty |= (i32Hovered != sGrid.i32Hovered);
+					sGrid.i32Hovered = i32Hovered;
+				}
+				else if (sEvent.type == SDL_KEYDOWN)
+				{
+					int iWidth;
+					int iHeight;
+
+					SDL_GetRendererOutputSize(sGrid.pRenderer, &iWidth, &iHeight);
+
+					switch (sEvent.key.keysym.sym)
+					{
+						case SDLK_ESCAPE: bQuit = true; break;
+						case SDLK_UP: sGrid.i32ScrollY -= TIM_GRID_SCROLL_STEP; break;
+						case SDLK_DOWN: sGrid.i32ScrollY += TIM_GRID_SCROLL_STEP; break;
+						case SDLK_PAGEUP: sGrid.i32ScrollY -= iHeight; break;
+						case SDLK_PAGEDOWN: sGrid.i32ScrollY += iHeight; break;
+						case SDLK_HOME: sGrid.i32ScrollY = 0; break;
+						case SDLK_END: sGrid.i32ScrollY = INT32_MAX / 2; break;
+						default: break;
+					}
+				}
+
+				if (sGrid.i32ScrollY != i32ScrollY)
+				{
+					UpdateGridWanted(&sGrid);
+					bDirty = true;
+				}
+			} while (SDL_PollEvent(&sEvent));
+		}
+	}
+
+	iResult = 0;
+
+FAILED_RenderGrid:
+	DestroyGrid(&sGrid);
+
+	return iResult;
+}
@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tim_defs.h"
+#include "tim_vram_defs.h"
+#include "timview.h"
+
+#include <SDL.h>
+
+typedef struct _TIM_VRAM_VIEW_FILE
+{
+	// A private copy of the file, so rewriting one file can't change or
+	// truncate the data the composite is rebuilt from
+	const char* pszFileName;
+	TIM_FILE sFile;
+	VRAM_RECT sPixelRect;
+
+	// Hash of the CLUT and pixel data, so a rewrite that leaves the file the
+	// same doesn't touch the composite
+	uint32_t ui32Hash;
+} TIM_VRAM_VIEW_FILE;
+
+typedef struct _TIM_VRAM_VIEW
+{
+	SDL_Window* pWindow;
+	SDL_Surface* pScreenSurface;
+
+	// The composite converted to RGBA once, so restoring a region is a blit
+	SDL_Surface* pVRAMSurface;
+
+	TIM_VRAM_VIEW_FILE* psFiles;
+	uint32_t ui32NumFiles;
+
+	// Large selections are decoded across it in bands
+	TIM_THREAD_POOL* psPool;
+
+	// The texture drawn decoded over its pixel rect, if any
+	bool bSelected;
+	uint32_t ui32SelectedFile;
+	uint32_t ui32PaletteIndex;
+	SDL_Rect sSelectedRect;
+} TIM_VRAM_VIEW;
+
+// Copies every file and blits its blocks into the composite, later files
+// overwriting earlier ones as they would on hardware
+static int LoadVRAMView(const TIM_VIEW_ARGS* psArgs, uint16_t* pui16VRAM, TIM_VRAM_VIEW* psView)
+{
+	psView->psFiles = calloc(psArgs->ui32NumFiles, sizeof(TIM_VRAM_VIEW_FILE));
+	if (psView->psFiles == NULL)
+	{
+		printf("failed to allocate file list\n");
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < psArgs->ui32NumFiles; ++i)
+	{
+		TIM_VRAM_VIEW_FILE* psFile = &psView->psFiles[psView->ui32NumFiles];
+
+		psFile->pszFileName = psArgs->ppszFileNames[i];
+
+		if (CopyTIM(psFile->pszFileName, &psFile->sFile) != 0)
+		{
+			continue;
+		}
+
+		if (BlitTIMToVRAM(pui16VRAM, &psFile->sFile) != 0)
+		{
+			printf("failed to composite %s\n", psFile->pszFileName);
+			DestroyTIM(&psFile->sFile);
+			continue;
+		}
+
+		psFile->sPixelRect = GetVRAMRect(&psFile->sFile.sPixelHeader);
+		psFile->ui32Hash = HashTIM(&psFile->sFile);
+		++psView->ui32NumFiles;
+	}
+
+	printf("composited %u of %u TIM file(s)\n", psView->ui32NumFiles, psArgs->ui32NumFiles);
+
+	return 0;
+}
+
+// Finds the topmost file whose pixel block covers a VRAM coordinate
+static bool FindVRAMViewFile(const TIM_VRAM_VIEW* psView, const int32_t i32X, const int32_t i32Y, uint32_t* pui32File)
+{
+	for (uint32_t i = psView->ui32NumFiles; i-- > 0; )
+	{
+		const VRAM_RECT* psRect = &psView->psFiles[i].sPixelRect;
+
+		if ((i32X >= psRect->ui16X) && (i32X < (psRect->ui16X + psRect->ui16Width)) &&
+			(i32Y >= psRect->ui16Y) && (i32Y < (psRect->ui16Y + psRect->ui16Height)))
+		{
+			*pui32File = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Draws the selected texture decoded over its pixel rect. The decoded texture
+// is 2 or 4 times wider than the rect, so this covers its neighbours. It's
+// decoded straight into the window surface, then converted in place to the
+// surface's format with transparent pixels drawn black
+static int DrawVRAMViewSelection(TIM_VRAM_VIEW* psView)
+{
+	const TIM_VRAM_VIEW_FILE* psFile = &psView->psFiles[psView->ui32SelectedFile];
+	SDL_Surface* pScreenSurface = psView->pScreenSurface;
+	const SDL_PixelFormat* psFormat = pScreenSurface->format;
+	const uint32_t ui32Pitch = pScreenSurface->pitch / sizeof(R8G8B8A8);
+	R8G8B8A8* psPixels;
+	char szTitle[256];
+
+	if (ValidateTIM(&psFile->sFile) != 0)
+	{
+		return 1;
+	}
+
+	if (psFormat->BytesPerPixel != sizeof(R8G8B8A8))
+	{
+		printf("can't draw a selection on a %u bit window surface\n", psFormat->BitsPerPixel);
+		return 1;
+	}
+
+	psView->sSelectedRect.x = psFile->sPixelRect.ui16X;
+	psView->sSelectedRect.y = psFile->sPixelRect.ui16Y;
+	psView->sSelectedRect.w = GetTIMPixelWidth(&psFile->sFile);
+	psView->sSelectedRect.h = psFile->sPixelRect.ui16Height;
+
+	// Clip to the window, so only the pixels that change are decoded
+	if ((psView->sSelectedRect.x + psView->sSelectedRect.w) > PSX_VRAM_WIDTH)
+	{
+		psView->sSelectedRect.w = PSX_VRAM_WIDTH - psView->sSelectedRect.x;
+	}
+
+	if (SDL_LockSurface(pScreenSurface) != 0)
+	{
+		printf("surface could not be locked! SDL_Error: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	psPixels = &((R8G8B8A8*)pScreenSurface->pixels)[(psView->sSelectedRect.y * ui32Pitch) + psView->sSelectedRect.x];
+
+	DecodeTIMPixelRectInBands(
+		psView->psPool,
+		&psFile->sFile,
+		psView->ui32PaletteIndex,
+		0,
+		0,
+		psView->sSelectedRect.w,
+		psView->sSelectedRect.h,
+		psPixels,
+		ui32Pitch
+	);
+
+	for (int y = 0; y < psView->sSelectedRect.h; ++y)
+	{
+		R8G8B8A8* psRow = &psPixels[y * ui32Pitch];
+
+		for (int x = 0; x < psView->sSelectedRect.w; ++x)
+		{
+			const R8G8B8A8 sPix = psRow[x];
+			uint32_t ui32Pix = psFormat->Amask;
+
+			if (sPix.uAlpha != 0)
+			{
+				ui32Pix |= ((uint32_t)(sPix.uRed >> psFormat->Rloss) << psFormat->Rshift) |
+					((uint32_t)(sPix.uGreen >> psFormat->Gloss) << psFormat->Gshift) |
+					((uint32_t)(sPix.uBlue >> psFormat->Bloss) << psFormat->Bshift);
+			}
+
+			memcpy(&psRow[x], &ui32Pix, sizeof(uint32_t));
+		}
+	}
+
+	SDL_UnlockSurface(pScreenSurface);
+
+	snprintf(
+		szTitle,
+		sizeof(szTitle),
+		"timview - %s (CLUT %u/%hu)",
+		psFile->pszFileName,
+		psView->ui32PaletteIndex,
+		psFile->sFile.sCLUTHeader.ui16Height
+	);
+	SDL_SetWindowTitle(psView->pWindow, szTitle);
+
+	return 0;
+}
+
+// Changes the selection, redrawing only the rects it covered and now covers
+static void SelectVRAMViewFile(TIM_VRAM_VIEW* psView, const bool bSelected, const uint32_t ui32File, const uint32_t ui32PaletteIndex)
+{
+	SDL_Rect asDirtyRects[2];
+	int iNumDirtyRects = 0;
+
+	if (psView->bSelected)
+	{
+		SDL_Rect sDstRect = psView->sSelectedRect;
+
+		SDL_BlitSurface(psView->pVRAMSurface, &psView->sSelectedRect, psView->pScreenSurface, &sDstRect);
+		asDirtyRects[iNumDirtyRects++] = psView->sSelectedRect;
+	}
+
+	psView->bSelected = bSelected;
+	psView->ui32SelectedFile = ui32File;
+	psView->ui32PaletteIndex = ui32PaletteIndex;
+
+	if (psView->bSelected)
+	{
+		if (DrawVRAMViewSelection(psView) == 0)
+		{
+			asDirtyRects[iNumDirtyRects++] = psView->sSelectedRect;
+		}
+		else
+		{
+			psView->bSelected = false;
+		}
+	}
+
+	if (!psView->bSelected)
+	{
+		SDL_SetWindowTitle(psView->pWindow, "timview - VRAM");
+	}
+
+	SDL_UpdateWindowSurfaceRects(psView->pWindow, asDirtyRects, iNumDirtyRects);
+}
+
+// Converts a rect of the composite again and copies it to the screen
+static void UpdateVRAMViewRect(TIM_VRAM_VIEW* psView, const uint16_t* pui16VRAM, const VRAM_RECT* psRect, SDL_Rect* psDirtyRect)
+{
+	const uint32_t ui32Pitch = psView->pVRAMSurface->pitch / sizeof(R8G8B8A8);
+	R8G8B8A8* psPixels = (R8G8B8A8*)psView->pVRAMSurface->pixels;
+	SDL_Rect sDstRect;
+
+	DecodeVRAMRect(pui16VRAM, psRect, &psPixels[(psRect->ui16Y * ui32Pitch) + psRect->ui16X], ui32Pitch);
+
+	psDirtyRect->x = psRect->ui16X;
+	psDirtyRect->y = psRect->ui16Y;
+	psDirtyRect->w = psRect->ui16Width;
+	psDirtyRect->h = psRect->ui16Height;
+
+	sDstRect = *psDirtyRect;
+	SDL_BlitSurface(psView->pVRAMSurface, psDirtyRect, psView->pScreenSurface, &sDstRect);
+}
+
+// Copies a file again after it's been rewritten. If its headers or data
+// changed the composite is rebuilt from the copies, as its blocks may overlap
+// other files', but only the rects it used to cover and now covers are
+// converted and redrawn. A file that no longer fits leaves the last good copy
+// in place
+static int ReloadVRAMViewFile(TIM_VRAM_VIEW* psView, uint16_t* pui16VRAM, const uint32_t ui32File)
+{
+	TIM_VRAM_VIEW_FILE* psFile = &psView->psFiles[ui32File];
+	const uint64_t ui64Start = SDL_GetPerformanceCounter();
+	TIM_FILE sFile;
+	VRAM_RECT asChangedRects[4];
+	SDL_Rect asDirtyRects[4];
+	uint32_t ui32NumChangedRects = 0;
+	uint16_t* pui16NewVRAM;
+
+	if (CopyTIM(psFile->pszFileName, &sFile) != 0)
+	{
+		printf("keeping the last good copy of %s\n", psFile->pszFileName);
+		return 0;
+	}
+
+	if ((memcmp(&sFile.sFileHeader, &psFile->sFile.sFileHeader, sizeof(TIM_FILE_HEADER)) == 0) &&
+		(memcmp(&sFile.sCLUTHeader, &psFile->sFile.sCLUTHeader, sizeof(TIM_BLOCK_HEADER)) == 0) &&
+		(memcmp(&sFile.sPixelHeader, &psFile->sFile.sPixelHeader, sizeof(TIM_BLOCK_HEADER)) == 0) &&
+		(HashTIM(&sFile) == psFile->ui32Hash))
+	{
+		DestroyTIM(&sFile);
+		return 0;
+	}
+
+	pui16NewVRAM = calloc(PSX_VRAM_WIDTH * PSX_VRAM_HEIGHT, sizeof(uint16_t));
+	if (pui16NewVRAM == NULL)
+	{
+		printf("failed to allocate VRAM\n");
+		DestroyTIM(&sFile);
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < psView->ui32NumFiles; ++i)
+	{
+		if (BlitTIMToVRAM(pui16NewVRAM, (i == ui32File) ? &sFile : &psView->psFiles[i].sFile) != 0)
+		{
+			printf("keeping the last good copy of %s\n", psFile->pszFileName);
+			free(pui16NewVRAM);
+			DestroyTIM(&sFile);
+			return 0;
+		}
+	}
+
+	memcpy(pui16VRAM, pui16NewVRAM, PSX_VRAM_WIDTH * PSX_VRAM_HEIGHT * sizeof(uint16_t));
+	free(pui16NewVRAM);
+
+	asChangedRects[ui32NumChangedRects++] = psFile->sPixelRect;
+	if (psFile->sFile.sFileHeader.sFlags.uClut)
+	{
+		asChangedRects[ui32NumChangedRects++] = GetVRAMRect(&psFile->sFile.sCLUTHeader);
+	}
+
+	DestroyTIM(&psFile->sFile);
+	psFile->sFile = sFile;
+	psFile->sPixelRect = GetVRAMRect(&sFile.sPixelHeader);
+	psFile->ui32Hash = HashTIM(&sFile);
+
+	asChangedRects[ui32NumChangedRects++] = psFile->sPixelRect;
+	if (sFile.sFileHeader.sFlags.uClut)
+	{
+		asChangedRects[ui32NumChangedRects++] = GetVRAMRect(&sFile.sCLUTHeader);
+	}
+
+	for (uint32_t i = 0; i < ui32NumChangedRects; ++i)
+	{
+		UpdateVRAMViewRect(psView, pui16VRAM, &asChangedRects[i], &asDirtyRects[i]);
+	}
+
+	SDL_UpdateWindowSurfaceRects(psView->pWindow, asDirtyRects, ui32NumChangedRects);
+
+	// Draw the selection back over the composite, it may have moved or lost
+	// CLUT rows
+	if (psView->bSelected)
+	{
+		const uint32_t ui32NumPalettes = psView->psFiles[psView->ui32SelectedFile].sFile.sCLUTHeader.ui16Height;
+
+		SelectVRAMViewFile(
+			psView,
+			true,
+			psView->ui32SelectedFile,
+			(psView->ui32PaletteIndex < ui32NumPalettes) ? psView->ui32PaletteIndex : 0
+		);
+	}
+
+	printf(
+		"reloaded %s in %.2fms\n",
+		psFile->pszFileName,
+		(double)(SDL_GetPerformanceCounter() - ui64Start) * 1000.0 / (double)SDL_GetPerformanceFrequency()
+	);
+
+	return 0;
+}
+
+int RenderVRAM(const TIM_VIEW_ARGS* psArgs)
+{
+	static const VRAM_RECT sVRAMRect = { 0, 0, PSX_VRAM_WIDTH, PSX_VRAM_HEIGHT };
+
+	TIM_VRAM_VIEW sView = { 0 };
+	uint16_t* pui16VRAM = calloc(PSX_VRAM_WIDTH * PSX_VRAM_HEIGHT, sizeof(uint16_t));
+	const char** ppszWatchedFileNames = NULL;
+	TIM_WATCH* psWatch = NULL;
+	uint32_t ui32ReloadEventType;
+	int iResult = 1;
+
+	if (pui16VRAM == NULL)
+	{
+		printf("failed to allocate VRAM\n");
+		return 1;
+	}
+
+	if (LoadVRAMView(psArgs, pui16VRAM, &sView) != 0)
+	{
+		goto FAILED_LoadVRAMView;
+	}
+
+	sView.psPool = CreateThreadPool(psArgs->ui32NumThreads);
+	if (sView.psPool == NULL)
+	{
+		goto FAILED_LoadVRAMView;
+	}
+
+	sView.pWindow = SDL_CreateWindow(
+		"timview - VRAM",
+		SDL_WINDOWPOS_UNDEFINED,
+		SDL_WINDOWPOS_UNDEFINED,
+		PSX_VRAM_WIDTH,
+		PSX_VRAM_HEIGHT,
+		SDL_WINDOW_SHOWN
+	);
+
+	if (sView.pWindow == NULL)
+	{
+		printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+		goto FAILED_LoadVRAMView;
+	}
+
+	sView.pScreenSurface = SDL_GetWindowSurface(sView.pWindow);
+	if (sView.pScreenSurface == NULL)
+	{
+		printf("screen surface could not be created! SDL_Error: %s\n", SDL_GetError());
+		goto FAILED_GetWindowSurface;
+	}
+
+	sView.pVRAMSurface = SDL_CreateRGBSurface(
+		0,
+		PSX_VRAM_WIDTH,
+		PSX_VRAM_HEIGHT,
+		32,
+		// component masks
+		0x000000ff,
+		0x0000ff00,
+		0x00ff0000,
+		0xff000000
+	);
+
+	if (sView.pVRAMSurface == NULL)
+	{
+		printf("surface could not be created! SDL_Error: %s\n", SDL_GetError());
+		goto FAILED_GetWindowSurface;
+	}
+
+	DecodeVRAMRect(pui16VRAM, &sVRAMRect, (R8G8B8A8*)sView.pVRAMSurface->pixels, sView.pVRAMSurface->pitch / sizeof(R8G8B8A8));
+	SDL_SetSurfaceBlendMode(sView.pVRAMSurface, SDL_BLENDMODE_NONE);
+
+	SDL_BlitSurface(sView.pVRAMSurface, NULL, sView.pScreenSurface, NULL);
+	SDL_UpdateWindowSurface(sView.pWindow);
+
+	// Only the files that made it into the composite are watched, by their
+	// index in it
+	ui32ReloadEventType = SDL_RegisterEvents(1);
+	ppszWatchedFileNames = calloc(sView.ui32NumFiles, sizeof(char*));
+	if ((ui32ReloadEventType != (uint32_t)-1) && (ppszWatchedFileNames != NULL))
+	{
+		for (uint32_t i = 0; i < sView.ui32NumFiles; ++i)
+		{
+			ppszWatchedFileNames[i] = sView.psFiles[i].pszFileName;
+		}
+
+		psWatch = CreateTIMWatch(ppszWatchedFileNames, sView.ui32NumFiles, ui32ReloadEventType);
+	}
+
+	{
+		SDL_Event sEvent;
+		bool bQuit = false;
+		// Everything is drawn in response to an event, so sleep until one
+		// arrives rather than polling
+		while (!bQuit)
+		{
+			if (SDL_WaitEvent(&sEvent) == 0)
+			{
+				printf("failed waiting for events! SDL_Error: %s\n", SDL_GetError());
+				goto FAILED_WaitEvent;
+			}
+
+			do
+			{
+				if (sEvent.type == SDL_QUIT)
+				{
+					bQuit = true;
+				}
+
+				if ((sEvent.type == ui32ReloadEventType) &&
+					(ReloadVRAMViewFile(&sView, pui16VRAM, sEvent.user.code) != 0))
+				{
+					goto FAILED_WaitEvent;
+				}
+
+				if ((sEvent.type == SDL_WINDOWEVENT) && (sEvent.window.event == SDL_WINDOWEVENT_EXPOSED))
+				{
+					SDL_UpdateWindowSurface(sView.pWindow);
+				}
+
+				// Clicking a texture shows it decoded, clicking it again moves
+				// to its next CLUT row, and clicking anywhere else deselects it
+				if ((sEvent.type == SDL_MOUSEBUTTONDOWN) && (sEvent.button.button == SDL_BUTTON_LEFT))
+				{
+					uint32_t ui32File;
+
+					if (sView.bSelected &&
+						(sEvent.button.x >= sView.sSelectedRect.x) &&
+						(sEvent.button.x < (sView.sSelectedRect.x + sView.sSelectedRect.w)) &&
+						(sEvent.button.y >= sView.sSelectedRect.y) &&
+						(sEvent.button.y < (sView.sSelectedRect.y + sView.sSelectedRect.h)))
+					{
+						SelectVRAMViewFile(
+							&sView,
+							true,
+							sView.ui32SelectedFile,
+							(sView.ui32PaletteIndex + 1) % sView.psFiles[sView.ui32SelectedFile].sFile.sCLUTHeader.ui16Height
+						);
+					}
+					else if (FindVRAMViewFile(&sView, sEvent.button.x, sEvent.button.y, &ui32File))
+					{
+						SelectVRAMViewFile(&sView, true, ui32File, 0);
+					}
+					else
+					{
+						SelectVRAMViewFile(&sView, false, 0, 0);
+					}
+				}
+
+				if ((sEvent.type == SDL_MOUSEBUTTONDOWN) && (sEvent.button.button == SDL_BUTTON_RIGHT))
+				{
+					SelectVRAMViewFile(&sView, false, 0, 0);
+				}
+			} while (SDL_PollEvent(&sEvent));
+		}
+	}
+
+	iResult = 0;
+
+FAILED_WaitEvent:
+	DestroyTIMWatch(psWatch);
+	free(ppszWatchedFileNames);
+	SDL_FreeSurface(sView.pVRAMSurface);
+FAILED_GetWindowSurface:
+	SDL_DestroyWindow(sView.pWindow);
+FAILED_LoadVRAMView:
+	DestroyThreadPool(sView.psPool);
+	for (uint32_t i = 0; i < sView.ui32NumFiles; ++i)
+	{
+		DestroyTIM(&sView.psFiles[i].sFile);
+	}
+	free(sView.psFiles);
+	free(pui16VRAM);
+
+	return iResult;
+}
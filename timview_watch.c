@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timview.h"
+
+#include <SDL.h>
+
+#if defined(__linux__)
+
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+struct _TIM_WATCH
+{
+	int iFD;
+	// Written to wake the watcher thread when it should exit
+	int aiQuitPipe[2];
+	pthread_t sThread;
+	uint32_t ui32EventType;
+
+	// The directory watch and name within it of each file. Directories are
+	// watched rather than the files, so files replaced by a rename are seen
+	uint32_t ui32NumFiles;
+	int* piWatches;
+	const char** ppszNames;
+};
+
+static void* WatchThread(void* pvWatch)
+{
+	TIM_WATCH* psWatch = pvWatch;
+	char acBuffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	for (;;)
+	{
+		struct pollfd asPollFDs[2] = {
+			{ .fd = psWatch->iFD, .events = POLLIN },
+			{ .fd = psWatch->aiQuitPipe[0], .events = POLLIN }
+		};
+		ssize_t iLength;
+
+		if ((poll(asPollFDs, 2, -1) < 0) || (asPollFDs[1].revents != 0))
+		{
+			break;
+		}
+
+		iLength = read(psWatch->iFD, acBuffer, sizeof(acBuffer));
+		if (iLength <= 0)
+		{
+			continue;
+		}
+
+		for (char* pcEvent = acBuffer; pcEvent < (acBuffer + iLength);)
+		{
+			const struct inotify_event* psEvent = (const struct inotify_event*)pcEvent;
+
+			pcEvent += sizeof(struct inotify_event) + psEvent->len;
+
+			if (psEvent->len == 0)
+			{
+				continue;
+			}
+
+			for (uint32_t i = 0; i < psWatch->ui32NumFiles; ++i)
+			{
+				if ((psWatch->piWatches[i] == psEvent->wd) && (strcmp(psWatch->ppszNames[i], psEvent->name) == 0))
+				{
+					SDL_Event sEvent = { 0 };
+
+					sEvent.type = psWatch->ui32EventType;
+					sEvent.user.code = i;
+					SDL_PushEvent(&sEvent);
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+TIM_WATCH* CreateTIMWatch(const char* const* ppszFileNames, const uint32_t ui32NumFiles, const uint32_t ui32EventType)
+{
+	TIM_WATCH* psWatch = calloc(1, sizeof(TIM_WATCH));
+	if (psWatch == NULL)
+	{
+		printf("failed to allocate file watch\n");
+		return NULL;
+	}
+
+	psWatch->ui32EventType = ui32EventType;
+	psWatch->ui32NumFiles = ui32NumFiles;
+	psWatch->aiQuitPipe[0] = -1;
+	psWatch->aiQuitPipe[1] = -1;
+	psWatch->piWatches = calloc(ui32NumFiles, sizeof(int));
+	psWatch->ppszNames = calloc(ui32NumFiles, sizeof(char*));
+	psWatch->iFD = inotify_init1(IN_CLOEXEC);
+
+	if ((psWatch->piWatches == NULL) || (psWatch->ppszNames == NULL) || (psWatch->iFD < 0) ||
+		(pipe(psWatch->aiQuitPipe) != 0))
+	{
+		printf("failed to create file watch\n");
+		goto FAILED_CreateTIMWatch;
+	}
+
+	for (uint32_t i = 0; i < ui32NumFiles; ++i)
+	{
+		const char* pszSlash = strrchr(ppszFileNames[i], '/');
+		char szDirectory[4096];
+
+		if (pszSlash != NULL)
+		{
+			snprintf(szDirectory, sizeof(szDirectory), "%.*s", (int)(pszSlash - ppszFileNames[i]) + 1, ppszFileNames[i]);
+			psWatch->ppszNames[i] = pszSlash + 1;
+		}
+		else
+		{
+			snprintf(szDirectory, sizeof(szDirectory), ".");
+			psWatch->ppszNames[i] = ppszFileNames[i];
+		}
+
+		// Watching a directory twice returns its existing watch
+		psWatch->piWatches[i] = inotify_add_watch(psWatch->iFD, szDirectory, IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (psWatch->piWatches[i] < 0)
+		{
+			printf("could not watch %s for changes\n", szDirectory);
+		}
+	}
+
+	if (pthread_create(&psWatch->sThread, NULL, WatchThread, psWatch) != 0)
+	{
+		printf("failed to create file watch thread\n");
+		goto FAILED_CreateTIMWatch;
+	}
+
+	return psWatch;
+
+FAILED_CreateTIMWatch:
+	if (psWatch->aiQuitPipe[0] >= 0) { close(psWatch->aiQuitPipe[0]); }
+	if (psWatch->aiQuitPipe[1] >= 0) { close(psWatch->aiQuitPipe[1]); }
+	if (psWatch->iFD >= 0) { close(psWatch->iFD); }
+	free(psWatch->ppszNames);
+	free(psWatch->piWatches);
+	free(psWatch);
+
+	return NULL;
+}
+
+void DestroyTIMWatch(TIM_WATCH* psWatch)
+{
+	if (psWatch == NULL)
+	{
+		return;
+	}
+
+	if (write(psWatch->aiQuitPipe[1], "q", 1) == 1)
+	{
+		pthread_join(psWatch->sThread, NULL);
+	}
+
+	close(psWatch->aiQuitPipe[0]);
+	close(psWatch->aiQuitPipe[1]);
+	close(psWatch->iFD);
+	free(psWatch->ppszNames);
+	free(psWatch->piWatches);
+	free(psWatch);
+}
+
+#else
+
+// Hot reload needs inotify, everything else works without it
+TIM_WATCH* CreateTIMWatch(const char* const* ppszFileNames, const uint32_t ui32NumFiles, const uint32_t ui32EventType)
+{
+	(void)ppszFileNames;
+	(void)ui32NumFiles;
+	(void)ui32EventType;
+
+	printf("files are not watched for changes on this platform\n");
+
+	return NULL;
+}
+
+void DestroyTIMWatch(TIM_WATCH* psWatch)
+{
+	(void)psWatch;
+}
+
+#endif
@@ -0,0 +1,308 @@
+#include <stdio.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <argp.h>
+
+#include "tim_defs.h"
+#include "tim_vram_defs.h"
+
+typedef enum _TIM_VRAM_COMMAND
+{
+	TIM_VRAM_COMMAND_NONE,
+	TIM_VRAM_COMMAND_EXTRACT,
+	TIM_VRAM_COMMAND_COMPOSITE,
+} TIM_VRAM_COMMAND;
+
+typedef struct _TIM_VRAM_ARGS
+{
+	TIM_VRAM_COMMAND eCommand;
+	char* pszDumpFileName;
+	bool bClear;
+
+	// Extract
+	TIM_PIX_FMT ePixFmt;
+	uint16_t ui16TextureCoordX;
+	uint16_t ui16TextureCoordY;
+	uint16_t ui16TextureWidth;
+	uint16_t ui16TextureHeight;
+	uint16_t ui16PaletteCoordX;
+	uint16_t ui16PaletteCoordY;
+	uint16_t ui16PaletteRows;
+
+	// The output TIM when extracting, or the TIMs to composite
+	char** ppszFileNames;
+	uint32_t ui32NumFiles;
+} TIM_VRAM_ARGS;
+
+static int ExtractTIM(const TIM_VRAM_ARGS* psArgs)
+{
+	const uint16_t ui16PixelsPerHalfword = (psArgs->ePixFmt == TIM_PIX_FMT_4BIT_CLUT) ? 4 : 2;
+	const VRAM_RECT sPixelRect = {
+		.ui16X = psArgs->ui16TextureCoordX,
+		.ui16Y = psArgs->ui16TextureCoordY,
+		.ui16Width = psArgs->ui16TextureWidth / ui16PixelsPerHalfword,
+		.ui16Height = psArgs->ui16TextureHeight
+	};
+	const VRAM_RECT sCLUTRect = {
+		.ui16X = psArgs->ui16PaletteCoordX,
+		.ui16Y = psArgs->ui16PaletteCoordY,
+		.ui16Width = (psArgs->ePixFmt == TIM_PIX_FMT_4BIT_CLUT) ? 16 : 256,
+		.ui16Height = psArgs->ui16PaletteRows
+	};
+
+	VRAM_MAPPING sMapping;
+	TIM_FILE sFile;
+	struct timespec sStart;
+
+	if ((psArgs->ui16TextureWidth % ui16PixelsPerHalfword) != 0)
+	{
+		printf(
+			"Invalid texture width, must be a multiple of %u (%u provided)\n",
+			ui16PixelsPerHalfword,
+			psArgs->ui16TextureWidth
+		);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &sStart);
+
+	if (MapVRAMDump(psArgs->pszDumpFileName, false, &sMapping) != 0)
+	{
+		return 1;
+	}
+
+	if (ExtractTIMFromVRAM(
+			sMapping.pui16Data,
+			psArgs->ePixFmt,
+			&sPixelRect,
+			&sCLUTRect,
+			&sFile
+		) != 0)
+	{
+		printf("failed to extract TIM\n");
+		UnmapVRAMDump(&sMapping);
+		return 1;
+	}
+
+	UnmapVRAMDump(&sMapping);
+
+	PrintTIM(psArgs->ppszFileNames[0], &sFile);
+
+	if (WriteTIM(psArgs->ppszFileNames[0], &sFile) != 0)
+	{
+		printf("failed to write TIM\n");
+		DestroyTIM(&sFile);
+		return 1;
+	}
+
+	DestroyTIM(&sFile);
+
+	printf("extracted %s in %.2f ms\n", psArgs->ppszFileNames[0], GetElapsedMS(&sStart));
+
+	return 0;
+}
+
+static int CompositeTIMs(const TIM_VRAM_ARGS* psArgs)
+{
+	VRAM_MAPPING sMapping;
+	uint32_t ui32NumFailed = 0;
+	struct timespec sStart;
+
+	clock_gettime(CLOCK_MONOTONIC, &sStart);
+
+	if (MapVRAMDump(psArgs->pszDumpFileName, true, &sMapping) != 0)
+	{
+		return 1;
+	}
+
+	if (psArgs->bClear)
+	{
+		memset(sMapping.pui16Data, 0, PSX_VRAM_SIZE_IN_BYTES);
+	}
+
+	// Later files overwrite earlier ones, as if uploaded in order
+	for (uint32_t i = 0; i < psArgs->ui32NumFiles; ++i)
+	{
+		TIM_MAPPING sTIMMapping;
+		TIM_FILE sFile;
+
+		if (MapTIM(psArgs->ppszFileNames[i], false, &sTIMMapping, &sFile) != 0)
+		{
+			++ui32NumFailed;
+			continue;
+		}
+
+		if (BlitTIMToVRAM(sMapping.pui16Data, &sFile) != 0)
+		{
+			printf("failed to composite %s\n", psArgs->ppszFileNames[i]);
+			++ui32NumFailed;
+		}
+
+		UnmapTIM(&sTIMMapping);
+	}
+
+	if (UnmapVRAMDump(&sMapping) != 0)
+	{
+		return 1;
+	}
+
+	printf(
+		"composited %u TIM file(s) into %s in %.2f ms, %u failed\n",
+		psArgs->ui32NumFiles - ui32NumFailed,
+		psArgs->pszDumpFileName,
+		GetElapsedMS(&sStart),
+		ui32NumFailed
+	);
+
+	return (ui32NumFailed == 0) ? 0 : 1;
+}
+
+const char *argp_program_version = "timvram 1.0";
+const char *argp_program_bug_address = "<jw0z96@github>";
+static char szDoc[] = "timvram - extract TIM files from, or composite them into, raw 1024x512 16 bit VRAM dumps";
+static char szArgDoc[] = "extract OUTPUT_FILE\ncomposite TIM_FILE...";
+
+static struct argp_option sOptions[] = {
+	{ "dump",			'd',	"FILE",				0,	"Raw VRAM dump, created when compositing if it doesn't exist" },
+	{ "clear",			'C',	0,					0,	"Clear the dump to zero before compositing" },
+	{ "bpp",			'b',	"<bits>",			0,	"Bits per pixel of the extracted texture (4 or 8)" },
+	{ "texture-x",		'x',	"<X coordinate>",	0,	"Texture X coordinate in VRAM" },
+	{ "texture-y",		'y',	"<Y coordinate>",	0,	"Texture Y coordinate in VRAM" },
+	{ "width",			'w',	"<pixels>",			0,	"Texture width in pixels" },
+	{ "height",			'h',	"<pixels>",			0,	"Texture height in pixels" },
+	{ "palette-x",		'i',	"<X coordinate>",	0,	"Palette X coordinate in VRAM" },
+	{ "palette-y",		'j',	"<Y coordinate>",	0,	"Palette Y coordinate in VRAM" },
+	{ "palette-rows",	'r',	"<rows>",			0,	"Number of CLUT rows to extract (default 1)" },
+	{ 0 }
+};
+
+static error_t ParseOpts(int key, char *arg, struct argp_state *state)
+{
+	TIM_VRAM_ARGS *psArgs = state->input;
+
+	switch (key)
+	{
+		case 'd': psArgs->pszDumpFileName = arg; break;
+		case 'C': psArgs->bClear = true; break;
+		case 'b':
+		{
+			if ((*arg != '4') && (*arg != '8'))
+			{
+				printf("expected -b/--bpp arg to be '4' or '8'\n");
+				argp_usage(state);
+			}
+
+			psArgs->ePixFmt = (
+				*arg == '4' ?
+				TIM_PIX_FMT_4BIT_CLUT :
+				TIM_PIX_FMT_8BIT_CLUT
+			);
+			break;
+		}
+
+		case 'x': psArgs->ui16TextureCoordX = strtol(arg, NULL, 10); break;
+		case 'y': psArgs->ui16TextureCoordY = strtol(arg, NULL, 10); break;
+		case 'w': psArgs->ui16TextureWidth = strtol(arg, NULL, 10); break;
+		case 'h': psArgs->ui16TextureHeight = strtol(arg, NULL, 10); break;
+		case 'i': psArgs->ui16PaletteCoordX = strtol(arg, NULL, 10); break;
+		case 'j': psArgs->ui16PaletteCoordY = strtol(arg, NULL, 10); break;
+		case 'r': psArgs->ui16PaletteRows = strtol(arg, NULL, 10); break;
+
+		case ARGP_KEY_ARG:
+		{
+			if (state->arg_num == 0)
+			{
+				if (strcmp(arg, "extract") == 0)
+				{
+					psArgs->eCommand = TIM_VRAM_COMMAND_EXTRACT;
+				}
+				else if (strcmp(arg, "composite") == 0)
+				{
+					psArgs->eCommand = TIM_VRAM_COMMAND_COMPOSITE;
+				}
+				else
+				{
+					printf("unknown command %s\n", arg);
+					argp_usage(state);
+				}
+				break;
+			}
+
+			// Extract writes a single file
+			if ((psArgs->eCommand == TIM_VRAM_COMMAND_EXTRACT) && (psArgs->ui32NumFiles >= 1))
+			{
+				argp_usage(state);
+			}
+
+			psArgs->ppszFileNames[psArgs->ui32NumFiles++] = arg;
+			break;
+		}
+
+		case ARGP_KEY_END:
+		{
+			if (state->arg_num < 2) // Not enough args
+			{
+				argp_usage(state);
+			}
+			break;
+		}
+
+		default:
+			return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static struct argp sArgp = { sOptions, ParseOpts, szArgDoc, szDoc };
+
+int main (int argc, char * argv[])
+{
+	int iResult;
+
+	// Default args
+	TIM_VRAM_ARGS sArgs;
+	sArgs.eCommand = TIM_VRAM_COMMAND_NONE;
+	sArgs.pszDumpFileName = NULL;
+	sArgs.bClear = false;
+	sArgs.ePixFmt = TIM_PIX_FMT_4BIT_CLUT;
+	sArgs.ui16TextureCoordX = 0;
+	sArgs.ui16TextureCoordY = 0;
+	sArgs.ui16TextureWidth = 0;
+	sArgs.ui16TextureHeight = 0;
+	sArgs.ui16PaletteCoordX = 0;
+	sArgs.ui16PaletteCoordY = 0;
+	sArgs.ui16PaletteRows = 1;
+	sArgs.ppszFileNames = calloc(argc, sizeof(char*));
+	sArgs.ui32NumFiles = 0;
+
+	if (sArgs.ppszFileNames == NULL)
+	{
+		printf("failed to allocate file list\n");
+		return 1;
+	}
+
+	argp_parse(&sArgp, argc, argv, 0, 0, &sArgs);
+
+	if (sArgs.pszDumpFileName == NULL)
+	{
+		printf("VRAM Dump File Name Invalid\n");
+		free(sArgs.ppszFileNames);
+		return 1;
+	}
+
+	iResult = (
+		(sArgs.eCommand == TIM_VRAM_COMMAND_EXTRACT) ?
+		ExtractTIM(&sArgs) :
+		CompositeTIMs(&sArgs)
+	);
+
+	free(sArgs.ppszFileNames);
+
+	return iResult;
+}